@@ -0,0 +1,45 @@
+#include "aot.h"
+
+static AotPackage* packages = NULL;
+
+void registerAotPackage(AotPackage* package) {
+    package->next = packages;
+    packages = package;
+}
+
+// FNV-1a, which is enough to tell one package from another.
+uint32_t aotPackageHash(const uint8_t* buffer, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= buffer[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+void attachAotCode(const uint8_t* buffer, size_t size, ObjFunction** functions, int count) {
+    if (packages == NULL) return;
+
+    uint32_t hash = aotPackageHash(buffer, size);
+    for (AotPackage* package = packages; package != NULL; package = package->next) {
+        if (package->hash == hash && package->size == size && package->functionCount == count) {
+            for (int i = 0; i < count; i++) {
+                functions[i]->aot = package->functions[i];
+            }
+            return;
+        }
+    }
+}
+
+bool aotLoop(ObjRoutine* routine, CallFrame* frame) {
+    if (routine->traceExecution) return false;
+
+    Chunk* chunk = &frame->closure->function->chunk;
+    uint8_t* code = chunk->code;
+    uint32_t exit = frame->closure->function->aot(routine, frame, (uint32_t)chunkCodeOffset(chunk, frame->ip));
+    if (exit == AOT_NOT_ENTERED) return false;
+
+    frame->ip = code + AOT_EXIT_OFFSET(exit);
+    routine->stackTopIndex = frame->stackEntryIndex + AOT_EXIT_DEPTH(exit);
+    return true;
+}
@@ -0,0 +1,177 @@
+#ifndef cyarg_aot_h
+#define cyarg_aot_h
+
+#include "vm.h"
+
+// Native code for the chunk of one function in a package, as written by cyarg --aot.
+// It runs the frame from the loop head at the bytecode offset it is given, keeping the
+// value stack in the frame's slots at the depth the bytecode has it, and returns where
+// the interpreter is to carry on. Anything it has no code for is left to the interpreter
+// by returning at that instruction, so errors are raised, and lines reported, by it.
+typedef uint32_t (*AotFn)(ObjRoutine* routine, CallFrame* frame, uint32_t entry);
+
+// an exit packs the offset and stack depth into 16 bits each; chunks beyond that are left
+// to the interpreter
+#define AOT_EXIT_MAX 0xffff
+#define AOT_EXIT(offset, depth) ((uint32_t)(offset) | ((uint32_t)(depth) << 16))
+#define AOT_EXIT_OFFSET(exit) ((exit) & 0xffff)
+#define AOT_EXIT_DEPTH(exit) ((exit) >> 16)
+#define AOT_NOT_ENTERED UINT32_MAX
+
+typedef struct AotPackage {
+    uint32_t hash;              // of the package, as aotPackageHash()
+    uint32_t size;
+    int functionCount;
+    const AotFn* functions;     // by chunk; NULL for a chunk without loops
+    struct AotPackage* next;
+} AotPackage;
+
+// Generated files register their package before main() runs.
+#define AOT_REGISTER(package) \
+    __attribute__((constructor)) static void register_##package(void) { registerAotPackage(&package); }
+
+void registerAotPackage(AotPackage* package);
+uint32_t aotPackageHash(const uint8_t* buffer, size_t size);
+void attachAotCode(const uint8_t* buffer, size_t size, ObjFunction** functions, int count);
+bool aotLoop(ObjRoutine* routine, CallFrame* frame);
+int translatePackage(const char* path, const char* outputPath);
+
+// Helpers the generated code is made of. Each does what the interpreter does for the
+// instruction when the operands suit it, returning false otherwise.
+
+typedef enum { AOT_ADD, AOT_SUBTRACT, AOT_MULTIPLY, AOT_LESS, AOT_GREATER } AotArith;
+typedef enum { AOT_SMALL_INT, AOT_I32, AOT_UI32, AOT_DOUBLE, AOT_ANY } AotKind;
+typedef enum { AOT_LEFT_SHIFT, AOT_RIGHT_SHIFT, AOT_BITOR, AOT_BITAND, AOT_BITXOR } AotBitwise;
+
+#define AOT_CONSTANT(index) (frame->closure->function->chunk.constants.values[(index)])
+#define AOT_ERROR() (*(volatile ExecState*)&routine->state == EXEC_ERROR)
+
+// The collector marks the stack up to its top, so that is brought up to date before
+// anything that may allocate.
+static inline void aotSync(ObjRoutine* routine, CallFrame* frame, int depth) {
+    routine->stackTopIndex = frame->stackEntryIndex + depth;
+}
+
+static inline bool aotFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static inline bool aotArithmetic(ObjRoutine* routine, CallFrame* frame, int depth, AotArith op, AotKind kind) {
+    Value* a = &frame->slots[depth - 2];
+    Value* b = &frame->slots[depth - 1];
+
+    if ((kind == AOT_SMALL_INT || kind == AOT_ANY) && IS_SMALL_INT(*a) && IS_SMALL_INT(*b)) {
+        int64_t x = AS_SMALL_INT(*a);
+        int64_t y = AS_SMALL_INT(*b);
+        if (op == AOT_LESS || op == AOT_GREATER) {
+            *a = BOOL_VAL(op == AOT_LESS ? x < y : x > y);
+            return true;
+        }
+        int64_t result = op == AOT_ADD ? x + y : op == AOT_SUBTRACT ? x - y : x * y;
+        if (result < INT32_MIN || result > INT32_MAX) {
+            aotSync(routine, frame, depth);
+        }
+        *a = intValue(result);
+        return true;
+    }
+    if ((kind == AOT_DOUBLE || kind == AOT_ANY) && IS_DOUBLE(*a) && IS_DOUBLE(*b)) {
+        double x = AS_DOUBLE(*a);
+        double y = AS_DOUBLE(*b);
+        switch (op) {
+            case AOT_ADD: *a = DOUBLE_VAL(x + y); break;
+            case AOT_SUBTRACT: *a = DOUBLE_VAL(x - y); break;
+            case AOT_MULTIPLY: *a = DOUBLE_VAL(x * y); break;
+            case AOT_LESS: *a = BOOL_VAL(x < y); break;
+            case AOT_GREATER: *a = BOOL_VAL(x > y); break;
+        }
+        return true;
+    }
+    if (kind == AOT_SMALL_INT || kind == AOT_DOUBLE) return false;
+
+    if (VALUE_TYPE(*a) != VALUE_TYPE(*b)) {
+        promote(a, b);
+    }
+    if (kind != AOT_UI32 && IS_I32(*a) && IS_I32(*b)) {
+        int32_t x = AS_I32(*a);
+        int32_t y = AS_I32(*b);
+        switch (op) {
+            case AOT_ADD: *a = I32_VAL((int32_t)((uint32_t)x + (uint32_t)y)); break;
+            case AOT_SUBTRACT: *a = I32_VAL((int32_t)((uint32_t)x - (uint32_t)y)); break;
+            case AOT_MULTIPLY: *a = I32_VAL((int32_t)((uint32_t)x * (uint32_t)y)); break;
+            case AOT_LESS: *a = BOOL_VAL(x < y); break;
+            case AOT_GREATER: *a = BOOL_VAL(x > y); break;
+        }
+        return true;
+    }
+    if (kind != AOT_I32 && IS_UI32(*a) && IS_UI32(*b)) {
+        uint32_t x = AS_UI32(*a);
+        uint32_t y = AS_UI32(*b);
+        switch (op) {
+            case AOT_ADD: *a = UI32_VAL(x + y); break;
+            case AOT_SUBTRACT: *a = UI32_VAL(x - y); break;
+            case AOT_MULTIPLY: *a = UI32_VAL(x * y); break;
+            case AOT_LESS: *a = BOOL_VAL(x < y); break;
+            case AOT_GREATER: *a = BOOL_VAL(x > y); break;
+        }
+        return true;
+    }
+    return false;
+}
+
+static inline bool aotBitwise(CallFrame* frame, int depth, AotBitwise op) {
+    Value* a = &frame->slots[depth - 2];
+    Value* b = &frame->slots[depth - 1];
+    promote(a, b);
+    if (!IS_UI32(*a) || !IS_UI32(*b)) return false;
+
+    uint32_t x = AS_UI32(*a);
+    uint32_t y = AS_UI32(*b);
+    switch (op) {
+        case AOT_LEFT_SHIFT: *a = UI32_VAL(x << y); break;
+        case AOT_RIGHT_SHIFT: *a = UI32_VAL(x >> y); break;
+        case AOT_BITOR: *a = UI32_VAL(x | y); break;
+        case AOT_BITAND: *a = UI32_VAL(x & y); break;
+        case AOT_BITXOR: *a = UI32_VAL(x ^ y); break;
+    }
+    return true;
+}
+
+static inline bool aotEqual(CallFrame* frame, int depth) {
+    Value* a = &frame->slots[depth - 2];
+    Value b = frame->slots[depth - 1];
+    if (VALUE_TYPE(*a) != VALUE_TYPE(b)) return false;
+
+    if (IS_SMALL_INT(b)) {
+        *a = BOOL_VAL(AS_SMALL_INT(*a) == AS_SMALL_INT(b));
+    } else if (IS_I32(b)) {
+        *a = BOOL_VAL(AS_I32(*a) == AS_I32(b));
+    } else if (IS_UI32(b)) {
+        *a = BOOL_VAL(AS_UI32(*a) == AS_UI32(b));
+    } else if (IS_BOOL(b)) {
+        *a = BOOL_VAL(AS_BOOL(*a) == AS_BOOL(b));
+    } else if (IS_NIL(b)) {
+        *a = BOOL_VAL(true);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A global the chunk has already bound; binding is left to the interpreter.
+static inline ValueCell* aotGlobal(CallFrame* frame, uint8_t constant) {
+    Chunk* chunk = &frame->closure->function->chunk;
+    if (chunk->globalCells == NULL || constant >= chunk->globalCellCount) return NULL;
+    return chunk->globalCells[constant];
+}
+
+static inline bool aotSetGlobal(ObjRoutine* routine, CallFrame* frame, int depth, uint8_t constant) {
+    ValueCell* cell = aotGlobal(frame, constant);
+    if (cell == NULL) return false;
+    if (cell->cellType != NULL) {
+        aotSync(routine, frame, depth);
+    }
+    ValueCellTarget target = { .cellType = cell->cellType, .value = &cell->value };
+    return assignToValueCellTarget(target, frame->slots[depth - 1]);
+}
+
+#endif
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sysexits.h>
+
+#include "aot.h"
+#include "chunk.h"
+#include "pack.h"
+
+// Translates each chunk of a package to a C function of straight-line code, one or two
+// statements per instruction, with the jumps as gotos between them. The code refers to
+// slots by the stack depth before each instruction, which is known from the bytecode.
+
+typedef struct {
+    FILE* out;
+    Chunk* chunk;
+    int offset;
+    int depth;
+    bool usesSlots;
+} Translation;
+
+static const char* arithName(int group) {
+    static const char* names[] = { "AOT_ADD", "AOT_SUBTRACT", "AOT_MULTIPLY", "AOT_LESS", "AOT_GREATER" };
+    return names[group];
+}
+
+static void exitHere(Translation* t, const char* condition) {
+    if (condition == NULL) {
+        fprintf(t->out, "    return AOT_EXIT(%d, %d);\n", t->offset, t->depth);
+    } else {
+        fprintf(t->out, "    if (%s) return AOT_EXIT(%d, %d);\n", condition, t->offset, t->depth);
+    }
+}
+
+static bool translateImmediate(Translation* t, uint8_t* code) {
+    int top = t->depth;
+    if (code[0] == OP_IMMEDIATE_TYPED) {
+        uint32_t bits = 0;
+        int length = typedImmediateLength(code[1]);
+        if (length > 4) return false;
+        for (int i = 0; i < length; i++) {
+            bits |= (uint32_t)code[2 + i] << (8 * i);
+        }
+        switch (code[1]) {
+            case TYPE_LITERAL_INT8: fprintf(t->out, "    slots[%d] = I8_VAL(%d);\n", top, (int8_t)bits); break;
+            case TYPE_LITERAL_UINT8: fprintf(t->out, "    slots[%d] = UI8_VAL(%u);\n", top, (uint8_t)bits); break;
+            case TYPE_LITERAL_INT16: fprintf(t->out, "    slots[%d] = I16_VAL(%d);\n", top, (int16_t)bits); break;
+            case TYPE_LITERAL_UINT16: fprintf(t->out, "    slots[%d] = UI16_VAL(%u);\n", top, (uint16_t)bits); break;
+            case TYPE_LITERAL_INT32: fprintf(t->out, "    slots[%d] = I32_VAL(%d);\n", top, (int32_t)bits); break;
+            case TYPE_LITERAL_UINT32: fprintf(t->out, "    slots[%d] = UI32_VAL(%uu);\n", top, bits); break;
+            default: return false;
+        }
+        t->usesSlots = true;
+        return true;
+    }
+
+    int32_t num = code[1];
+    if (code[0] == OP_IMMEDIATE_N16 || code[0] == OP_IMMEDIATE_P16 || code[0] == OP_IMMEDIATE_N24 || code[0] == OP_IMMEDIATE_P24) {
+        num += 256 * code[2];
+    }
+    if (code[0] == OP_IMMEDIATE_N24 || code[0] == OP_IMMEDIATE_P24) {
+        num += 65536 * code[3];
+    }
+    if (code[0] == OP_IMMEDIATE_N8 || code[0] == OP_IMMEDIATE_N16 || code[0] == OP_IMMEDIATE_N24) {
+        num = -num;
+    }
+    fprintf(t->out, "    slots[%d] = SMALL_INT_LITERAL_VAL(%d);\n", top, num);
+    t->usesSlots = true;
+    return true;
+}
+
+// Writes the code for one instruction, returning false if it has none.
+static bool translateInstruction(Translation* t) {
+    uint8_t* code = &t->chunk->code[t->offset];
+    int top = t->depth - 1;
+    char condition[96];
+
+    switch (code[0]) {
+        case OP_CONSTANT:
+            fprintf(t->out, "    slots[%d] = AOT_CONSTANT(%d);\n", t->depth, code[1]);
+            break;
+        case OP_NIL: fprintf(t->out, "    slots[%d] = NIL_VAL;\n", t->depth); break;
+        case OP_TRUE: fprintf(t->out, "    slots[%d] = BOOL_VAL(true);\n", t->depth); break;
+        case OP_FALSE: fprintf(t->out, "    slots[%d] = BOOL_VAL(false);\n", t->depth); break;
+        case OP_IMMEDIATE_N8: case OP_IMMEDIATE_P8: case OP_IMMEDIATE_N16: case OP_IMMEDIATE_P16:
+        case OP_IMMEDIATE_N24: case OP_IMMEDIATE_P24: case OP_IMMEDIATE_TYPED:
+            return translateImmediate(t, code);
+        case OP_POP:
+            return true;
+        // superinstructions are followed by the instructions they fuse, so run as the first
+        case OP_GET_LOCAL:
+        case OP_ADD_LOCALS:
+        case OP_LOCAL_ARITH_CONST:
+        case OP_LOCAL_COMPARE_CONST_JUMP:
+            fprintf(t->out, "    slots[%d] = slots[%d];\n", t->depth, code[1]);
+            break;
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+            fprintf(t->out, "    slots[%d] = slots[%d];\n", code[1], top);
+            fprintf(t->out, "    noLongerLiteralInt(&slots[%d]);\n", code[1]);
+            break;
+        case OP_INITIALISE:
+            fprintf(t->out, "    noLongerLiteralInt(&slots[%d]);\n", top);
+            break;
+        case OP_GET_GLOBAL:
+            fprintf(t->out, "    {\n");
+            fprintf(t->out, "        ValueCell* cell = aotGlobal(frame, %d);\n", code[1]);
+            fprintf(t->out, "        if (cell == NULL) return AOT_EXIT(%d, %d);\n", t->offset, t->depth);
+            fprintf(t->out, "        slots[%d] = cell->value;\n", t->depth);
+            fprintf(t->out, "    }\n");
+            break;
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_POP:
+            snprintf(condition, sizeof(condition), "!aotSetGlobal(routine, frame, %d, %d)", t->depth, code[1]);
+            exitHere(t, condition);
+            return true;
+        case OP_EQUAL:
+            snprintf(condition, sizeof(condition), "!aotEqual(frame, %d)", t->depth);
+            exitHere(t, condition);
+            return true;
+        case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_LESS: case OP_GREATER: {
+            int group = code[0] == OP_ADD ? 0 : code[0] == OP_SUBTRACT ? 1 : code[0] == OP_MULTIPLY ? 2 : code[0] == OP_LESS ? 3 : 4;
+            snprintf(condition, sizeof(condition), "!aotArithmetic(routine, frame, %d, %s, AOT_ANY)", t->depth, arithName(group));
+            exitHere(t, condition);
+            return true;
+        }
+        case OP_LEFT_SHIFT: case OP_RIGHT_SHIFT: case OP_BITOR: case OP_BITAND: case OP_BITXOR: {
+            const char* op = code[0] == OP_LEFT_SHIFT ? "AOT_LEFT_SHIFT" : code[0] == OP_RIGHT_SHIFT ? "AOT_RIGHT_SHIFT"
+                : code[0] == OP_BITOR ? "AOT_BITOR" : code[0] == OP_BITAND ? "AOT_BITAND" : "AOT_BITXOR";
+            snprintf(condition, sizeof(condition), "!aotBitwise(frame, %d, %s)", t->depth, op);
+            exitHere(t, condition);
+            return true;
+        }
+        case OP_NOT:
+            fprintf(t->out, "    slots[%d] = BOOL_VAL(aotFalsey(slots[%d]));\n", top, top);
+            break;
+        case OP_JUMP:
+            fprintf(t->out, "    goto op%d;\n", chunkJumpTarget(t->chunk, t->offset));
+            return true;
+        case OP_JUMP_IF_FALSE:
+        case OP_POP_JUMP_IF_FALSE:
+            // the fused form's pop is the OP_POP after it, or at its target
+            fprintf(t->out, "    if (aotFalsey(slots[%d])) goto op%d;\n", top, chunkJumpTarget(t->chunk, t->offset));
+            break;
+        case OP_LOOP:
+            // an error raised elsewhere in the routine is picked up by the interpreter
+            exitHere(t, "AOT_ERROR()");
+            fprintf(t->out, "    goto op%d;\n", chunkJumpTarget(t->chunk, t->offset));
+            return true;
+        default:
+            if (code[0] >= OP_ADD_SMALL_INT && code[0] <= OP_GREATER_DOUBLE) {
+                static const char* kinds[] = { "AOT_SMALL_INT", "AOT_I32", "AOT_UI32", "AOT_DOUBLE" };
+                int group = (code[0] - OP_ADD_SMALL_INT) / 4;
+                snprintf(condition, sizeof(condition), "!aotArithmetic(routine, frame, %d, %s, %s)",
+                         t->depth, arithName(group), kinds[(code[0] - OP_ADD_SMALL_INT) % 4]);
+                exitHere(t, condition);
+                return true;
+            }
+            return false;
+    }
+    t->usesSlots = true;
+    return true;
+}
+
+static bool isJump(uint8_t instruction) {
+    return instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE || instruction == OP_POP_JUMP_IF_FALSE
+        || instruction == OP_LOOP;
+}
+
+// Writes the function for a chunk, returning false where it has no loops to enter, or is
+// too large for its exits to be encoded. Only the code reachable from a loop head without
+// handing back to the interpreter is kept.
+static bool translateChunk(FILE* out, ObjFunction* function, int index) {
+    Chunk* chunk = &function->chunk;
+    int count = chunk->count;
+    if (count > AOT_EXIT_MAX) return false;
+    int* depths = malloc(sizeof(int) * count);
+    bool* loopHeads = malloc(sizeof(bool) * count);
+    bool* reached = malloc(sizeof(bool) * count);
+    bool* labelled = malloc(sizeof(bool) * count);
+    bool* ends = malloc(sizeof(bool) * count);
+    char** code = calloc(count, sizeof(char*));
+    int* pending = malloc(sizeof(int) * count);
+    bool translated = false;
+
+    if (depths == NULL || loopHeads == NULL || reached == NULL || labelled == NULL || ends == NULL
+        || code == NULL || pending == NULL || !chunkExactStackDepths(chunk, function->arity, depths, loopHeads)) {
+        goto done;
+    }
+
+    for (int offset = 0; offset < count; offset++) {
+        if (depths[offset] > AOT_EXIT_MAX) goto done;
+    }
+
+    Translation t = { .chunk = chunk, .usesSlots = false };
+    int pendingCount = 0;
+    for (int offset = 0; offset < count; offset++) {
+        reached[offset] = loopHeads[offset] && depths[offset] >= 0;
+        labelled[offset] = reached[offset];
+        if (reached[offset]) {
+            pending[pendingCount++] = offset;
+        }
+    }
+    if (pendingCount == 0) goto done;
+
+    while (pendingCount > 0) {
+        int offset = pending[--pendingCount];
+        size_t size;
+        t.out = open_memstream(&code[offset], &size);
+        if (t.out == NULL) goto done;
+        t.offset = offset;
+        t.depth = depths[offset];
+        uint8_t instruction = chunk->code[offset];
+        bool known = translateInstruction(&t);
+        if (!known) {
+            exitHere(&t, NULL);
+        }
+        fclose(t.out);
+        ends[offset] = !known || instruction == OP_JUMP || instruction == OP_LOOP;
+
+        int next = offset + chunkInstructionLength(chunk, offset);
+        if (!ends[offset] && next < count && !reached[next]) {
+            reached[next] = true;
+            pending[pendingCount++] = next;
+        }
+        if (known && isJump(instruction)) {
+            int target = chunkJumpTarget(chunk, offset);
+            labelled[target] = true;
+            if (!reached[target]) {
+                reached[target] = true;
+                pending[pendingCount++] = target;
+            }
+        }
+    }
+
+    const char* name = function->fName != NULL ? function->fName->chars : "script";
+    fprintf(out, "// %s\n", name);
+    fprintf(out, "static uint32_t chunk%d(ObjRoutine* routine, CallFrame* frame, uint32_t entry) {\n", index);
+    if (t.usesSlots) {
+        fprintf(out, "    Value* slots = frame->slots;\n");
+    }
+    fprintf(out, "    switch (entry) {\n");
+    for (int offset = 0; offset < count; offset++) {
+        if (loopHeads[offset] && depths[offset] >= 0) {
+            fprintf(out, "        case %d: goto op%d;\n", offset, offset);
+        }
+    }
+    fprintf(out, "        default: return AOT_NOT_ENTERED;\n");
+    fprintf(out, "    }\n");
+    // a path that falls into code that was not kept has left through an exit first
+    for (int offset = 0; offset < count; offset++) {
+        if (!reached[offset]) continue;
+        if (labelled[offset]) {
+            fprintf(out, "op%d:\n", offset);
+        }
+        fputs(code[offset], out);
+    }
+    fprintf(out, "}\n\n");
+    translated = true;
+
+done:
+    if (code != NULL) {
+        for (int offset = 0; offset < count; offset++) {
+            free(code[offset]);
+        }
+    }
+    free(code);
+    free(pending);
+    free(ends);
+    free(depths);
+    free(loopHeads);
+    free(reached);
+    free(labelled);
+    return translated;
+}
+
+int translatePackage(const char* path, const char* outputPath) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open package \"%s\".\n", path);
+        return EX_NOINPUT;
+    }
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    rewind(file);
+    uint8_t* buffer = malloc(size);
+    if (buffer == NULL || fread(buffer, 1, size, file) != size) {
+        fclose(file);
+        free(buffer);
+        fprintf(stderr, "Could not read package \"%s\".\n", path);
+        return EX_IOERR;
+    }
+    fclose(file);
+
+    uint32_t hash = aotPackageHash(buffer, size);
+    ObjFunction** functions;
+    int count = loadPackageFunctions(buffer, size, &functions);
+    if (count == 0) {
+        free(buffer);
+        fprintf(stderr, "\"%s\" is not a package for this version of cyarg.\n", path);
+        return EX_DATAERR;
+    }
+
+    FILE* out = fopen(outputPath, "w");
+    if (out == NULL) {
+        free(functions);
+        free(buffer);
+        return EX_CANTCREAT;
+    }
+
+    fprintf(out, "// Translated from %s by cyarg --aot. Linked into cyarg, it runs in place of\n", path);
+    fprintf(out, "// the loops of that package once load() has loaded it.\n\n");
+    fprintf(out, "#include \"aot.h\"\n\n");
+
+    bool* translated = malloc(sizeof(bool) * count);
+    for (int i = 0; i < count; i++) {
+        translated[i] = translateChunk(out, functions[i], i);
+    }
+
+    fprintf(out, "static const AotFn functions[] = {\n");
+    for (int i = 0; i < count; i++) {
+        if (translated[i]) {
+            fprintf(out, "    chunk%d,\n", i);
+        } else {
+            fprintf(out, "    NULL,\n");
+        }
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "static AotPackage package = {\n");
+    fprintf(out, "    .hash = 0x%08xu,\n", hash);
+    fprintf(out, "    .size = %zu,\n", size);
+    fprintf(out, "    .functionCount = %d,\n", count);
+    fprintf(out, "    .functions = functions,\n");
+    fprintf(out, "};\n\n");
+    fprintf(out, "AOT_REGISTER(package)\n");
+
+    int exitCode = ferror(out) ? EX_IOERR : EX_OK;
+    fclose(out);
+    free(translated);
+    free(functions);
+    free(buffer);
+    return exitCode;
+}
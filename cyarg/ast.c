@@ -366,6 +366,24 @@ void printExprBuiltin(ObjExprBuiltin* fn) {
     }
 }
 
+static void printTypeLiteral(ExprTypeLiteral type) {
+    switch (type) {
+        case EXPR_TYPE_LITERAL_MFLOAT64: printf("mfloat64"); break;
+        case EXPR_TYPE_LITERAL_INT8: printf("int8"); break;
+        case EXPR_TYPE_LITERAL_UINT8: printf("uint8"); break;
+        case EXPR_TYPE_LITERAL_INT16: printf("int16"); break;
+        case EXPR_TYPE_LITERAL_UINT16: printf("uint16"); break;
+        case EXPR_TYPE_LITERAL_INT32: printf("int32"); break;
+        case EXPR_TYPE_LITERAL_UINT32: printf("uint32"); break;
+        case EXPR_TYPE_LITERAL_INT64: printf("int64"); break;
+        case EXPR_TYPE_LITERAL_UINT64: printf("uint64"); break;
+        case EXPR_TYPE_LITERAL_BOOL: printf("bool"); break;
+        case EXPR_TYPE_LITERAL_STRING: printf("string"); break;
+        case EXPR_TYPE_LITERAL_INT: printf("int"); break;
+        default: printf("<unknown>"); break;
+    }
+}
+
 static void printExprType(ObjExpr* type) {
     if (type->obj.type == OBJ_EXPR_LITERAL) {
         ObjExprLiteral* literal = (ObjExprLiteral*)type;
@@ -375,22 +393,7 @@ static void printExprType(ObjExpr* type) {
         return;
     } else if (type->obj.type == OBJ_EXPR_TYPE) {
         ObjExprTypeLiteral* typeObject = (ObjExprTypeLiteral*)type;
-
-        switch (typeObject->type) {
-            case EXPR_TYPE_LITERAL_MFLOAT64: printf("mfloat64"); break;
-            case EXPR_TYPE_LITERAL_INT8: printf("int8"); break;
-            case EXPR_TYPE_LITERAL_UINT8: printf("uint8"); break;
-            case EXPR_TYPE_LITERAL_INT16: printf("int16"); break;
-            case EXPR_TYPE_LITERAL_UINT16: printf("uint16"); break;
-            case EXPR_TYPE_LITERAL_INT32: printf("int32"); break;
-            case EXPR_TYPE_LITERAL_UINT32: printf("uint32"); break;
-            case EXPR_TYPE_LITERAL_INT64: printf("int64"); break;
-            case EXPR_TYPE_LITERAL_UINT64: printf("uint64"); break;
-            case EXPR_TYPE_LITERAL_BOOL: printf("bool"); break;
-            case EXPR_TYPE_LITERAL_STRING: printf("string"); break;
-            case EXPR_TYPE_LITERAL_INT: printf("int"); break;
-            default: printf("<unknown>"); break;
-        }
+        printTypeLiteral(typeObject->type);
     } else {
         printf("<unexpected type>");
     }
@@ -436,6 +439,10 @@ void printExpr(ObjExpr* expr) {
                 case NUMBER_INT:
                     printf("%s", int_to_s(&num->bigInt, s, INT_STRLEN_FOR_INT254));
                     break;
+                case NUMBER_TYPED:
+                    printf("%" PRId64 " as ", (int64_t)num->typed.bits);
+                    printTypeLiteral(num->typed.type);
+                    break;
                 }
                 break;
             }
@@ -111,9 +111,25 @@ typedef struct {
     ExprLiteral literal;
 } ObjExprLiteral;
 
+typedef enum {
+    EXPR_TYPE_LITERAL_BOOL,
+    EXPR_TYPE_LITERAL_INT8,
+    EXPR_TYPE_LITERAL_UINT8,
+    EXPR_TYPE_LITERAL_INT16,
+    EXPR_TYPE_LITERAL_UINT16,
+    EXPR_TYPE_LITERAL_INT32,
+    EXPR_TYPE_LITERAL_UINT32,
+    EXPR_TYPE_LITERAL_INT64,
+    EXPR_TYPE_LITERAL_UINT64,
+    EXPR_TYPE_LITERAL_MFLOAT64,
+    EXPR_TYPE_LITERAL_STRING,
+    EXPR_TYPE_LITERAL_INT
+} ExprTypeLiteral;
+
 typedef enum {
     NUMBER_INT,
-    NUMBER_DOUBLE
+    NUMBER_DOUBLE,
+    NUMBER_TYPED    // folded or promoted by the optimiser, no longer a literal
 } NumberType;
 
 typedef struct {
@@ -122,6 +138,10 @@ typedef struct {
     union {
         Int bigInt;
         double dbl;
+        struct {
+            ExprTypeLiteral type;   // a machine int type, or int for a small int
+            uint64_t bits;
+        } typed;
     };
 } ObjExprNumber;
 
@@ -179,20 +199,6 @@ typedef struct {
     ObjExprCall* call;
 } ObjExprSuper;
 
-typedef enum {
-    EXPR_TYPE_LITERAL_BOOL,
-    EXPR_TYPE_LITERAL_INT8,
-    EXPR_TYPE_LITERAL_UINT8,
-    EXPR_TYPE_LITERAL_INT16,
-    EXPR_TYPE_LITERAL_UINT16,
-    EXPR_TYPE_LITERAL_INT32,
-    EXPR_TYPE_LITERAL_UINT32,
-    EXPR_TYPE_LITERAL_INT64,
-    EXPR_TYPE_LITERAL_UINT64,
-    EXPR_TYPE_LITERAL_MFLOAT64,
-    EXPR_TYPE_LITERAL_STRING,
-    EXPR_TYPE_LITERAL_INT
-} ExprTypeLiteral;
 
 typedef struct {
     ObjExpr expr;
@@ -44,13 +44,10 @@ bool readYargSourceBuiltin(ObjRoutine* routineContext, int argCount, Value* resu
     if (dotOn != 0 && strcmp(dotOn, ".yb") == 0) {
         size_t file_size = fileSize(filename);
 
-        ObjConcreteYargType* byteType = newYargTypeFromType(TypeUint8);
-        push(routineContext, OBJ_VAL(byteType));
-
-        ObjConcreteYargTypeArray* arrayType = (ObjConcreteYargTypeArray*)newYargArrayTypeFromType(OBJ_VAL(byteType));
+        ObjConcreteYargType* byteType = yargPrimitiveType(TypeUint8);
+        ObjConcreteYargTypeArray* arrayType = (ObjConcreteYargTypeArray*)internYargArrayType(OBJ_VAL(byteType), file_size);
         push(routineContext, OBJ_VAL(arrayType));
 
-        arrayType->cardinality = file_size;
         ObjPackedUniformArray* array = newPackedUniformArray(arrayType);
         push(routineContext, OBJ_VAL(array));
 
@@ -58,7 +55,7 @@ bool readYargSourceBuiltin(ObjRoutine* routineContext, int argCount, Value* resu
 
         *result = OBJ_VAL(array);
 
-        popN(routineContext, 3);
+        popN(routineContext, 2);
     }
     else {
         // assume a text file
@@ -391,16 +388,16 @@ bool lenBuiltin(ObjRoutine* routineContext, int argCount, Value* result) {
     if (IS_STRING(arg)) {
         ObjString* string = AS_STRING(arg);
         size_t length = string->length;
-        *result = OBJ_VAL(newIntU(length));
+        *result = intValue(length);
         return true;
     } else if (IS_UNIFORMARRAY(arg)) {
         ObjPackedUniformArray* array = AS_UNIFORMARRAY(arg);
-        *result = OBJ_VAL(newIntU(arrayCardinality(array->store)));
+        *result = intValue(arrayCardinality(array->store));
         return true;
     } else if (IS_MAP(arg)) {
         ObjMap* map = AS_MAP(arg);
         size_t count = map->entries.count;
-        *result = OBJ_VAL(newIntU(count));
+        *result = intValue(count);
         return true;
     } else {
         runtimeError(routineContext, "Expected a string, array or map.");
@@ -886,23 +883,24 @@ bool intBuiltin(ObjRoutine* routineContext, int argCount, Value* result) {
         char *s = AS_CSTRING(arg);
         int il = INT_DIGITS_FOR_S(strlen(s));
         ObjInt *newObj = allocateIntObject(il);
-        result->as.obj = &newObj->obj;
-        result->type = VAL_OBJ;
+        *result = OBJ_VAL(newObj);
         int_set_s(s, &newObj->bigInt);
         return true;
+    } else if (IS_SMALL_INT(arg)) {
+        *result = SMALL_INT_VAL(AS_SMALL_INT(arg));
+        return true;
     } else if (IS_INT(arg)) {
         Int *from = AS_INT(arg);
         int il = from->d_;
         ObjInt *newObj = allocateIntObject(il);
-        result->as.obj = &newObj->obj;
-        result->type = VAL_OBJ;
+        *result = OBJ_VAL(newObj);
         int_set_t(from, &newObj->bigInt);
         return true;
     } else {
         return false;
     }
 
-    *result = OBJ_VAL(newInt(i));
+    *result = intValue(i);
     return true;
 }
 
@@ -947,8 +945,7 @@ bool floatBuiltin(ObjRoutine* routineContext, int argCount, Value* result) {
     } else {
         return false;
     }
-    result->as.dbl = f;
-    result->type = VAL_DOUBLE;
+    *result = DOUBLE_VAL(f);
     return true;
 }
 
@@ -959,39 +956,54 @@ bool stringBuiltin(ObjRoutine* routineContext, int argCount, Value* result) {
     return true;
 }
 
-Value getBuiltin(uint8_t builtin) {
+static BuiltinFun builtinFunction(uint8_t builtin) {
     switch (builtin) {
-        case BUILTIN_PEEK: return OBJ_VAL(newBuiltin(peekBuiltin));
-        case BUILTIN_READ_YARG_SOURCE: return OBJ_VAL(newBuiltin(readYargSourceBuiltin));
-        case BUILTIN_COMPILE: return OBJ_VAL(newBuiltin(compileBuiltin));
-        case BUILTIN_MAKE_ROUTINE: return OBJ_VAL(newBuiltin(makeRoutineBuiltin));
-        case BUILTIN_RESUME: return OBJ_VAL(newBuiltin(resumeBuiltin));
-        case BUILTIN_START: return OBJ_VAL(newBuiltin(startBuiltin));
-        case BUILTIN_MAKE_CHANNEL: return OBJ_VAL(newBuiltin(makeChannelBuiltin));
-        case BUILTIN_SEND: return OBJ_VAL(newBuiltin(sendChannelBuiltin));
-        case BUILTIN_RECEIVE: return OBJ_VAL(newBuiltin(receiveBuiltin));
-        case BUILTIN_SHARE: return OBJ_VAL(newBuiltin(shareChannelBuiltin));
-        case BUILTIN_CPEEK: return OBJ_VAL(newBuiltin(cpeekBuiltin));
-        case BUILTIN_MAKE_SYNCGROUP: return OBJ_VAL(newBuiltin(makeSyncGroupBuiltin));
-        case BUILTIN_LEN: return OBJ_VAL(newBuiltin(lenBuiltin));
-        case BUILTIN_PIN: return OBJ_VAL(newBuiltin(pinBuiltin));
-        case BUILTIN_NEW: return OBJ_VAL(newBuiltin(new_Builtin));
-        case BUILTIN_INT8: return OBJ_VAL(newBuiltin(int8Builtin));
-        case BUILTIN_INT16: return OBJ_VAL(newBuiltin(int16Builtin));
-        case BUILTIN_UINT16: return OBJ_VAL(newBuiltin(uint16Builtin));
-        case BUILTIN_UINT8: return OBJ_VAL(newBuiltin(uint8Builtin));
-        case BUILTIN_INT32: return OBJ_VAL(newBuiltin(int32Builtin));
-        case BUILTIN_UINT32: return OBJ_VAL(newBuiltin(uint32Builtin));
-        case BUILTIN_INT64: return OBJ_VAL(newBuiltin(int64Builtin));
-        case BUILTIN_UINT64: return OBJ_VAL(newBuiltin(uint64Builtin));
-        case BUILTIN_INT: return OBJ_VAL(newBuiltin(intBuiltin));
-        case BUILTIN_MFLOAT64: return OBJ_VAL(newBuiltin(floatBuiltin));
-        case BUILTIN_STRING: return OBJ_VAL(newBuiltin(stringBuiltin));
-        case BUILTIN_LOAD: return OBJ_VAL(newBuiltin(loadBuiltin));
+        case BUILTIN_PEEK: return peekBuiltin;
+        case BUILTIN_READ_YARG_SOURCE: return readYargSourceBuiltin;
+        case BUILTIN_COMPILE: return compileBuiltin;
+        case BUILTIN_MAKE_ROUTINE: return makeRoutineBuiltin;
+        case BUILTIN_RESUME: return resumeBuiltin;
+        case BUILTIN_START: return startBuiltin;
+        case BUILTIN_MAKE_CHANNEL: return makeChannelBuiltin;
+        case BUILTIN_SEND: return sendChannelBuiltin;
+        case BUILTIN_RECEIVE: return receiveBuiltin;
+        case BUILTIN_SHARE: return shareChannelBuiltin;
+        case BUILTIN_CPEEK: return cpeekBuiltin;
+        case BUILTIN_MAKE_SYNCGROUP: return makeSyncGroupBuiltin;
+        case BUILTIN_LEN: return lenBuiltin;
+        case BUILTIN_PIN: return pinBuiltin;
+        case BUILTIN_NEW: return new_Builtin;
+        case BUILTIN_INT8: return int8Builtin;
+        case BUILTIN_INT16: return int16Builtin;
+        case BUILTIN_UINT16: return uint16Builtin;
+        case BUILTIN_UINT8: return uint8Builtin;
+        case BUILTIN_INT32: return int32Builtin;
+        case BUILTIN_UINT32: return uint32Builtin;
+        case BUILTIN_INT64: return int64Builtin;
+        case BUILTIN_UINT64: return uint64Builtin;
+        case BUILTIN_INT: return intBuiltin;
+        case BUILTIN_MFLOAT64: return floatBuiltin;
+        case BUILTIN_STRING: return stringBuiltin;
+        case BUILTIN_LOAD: return loadBuiltin;
 #ifndef CYARG_FEATURE_TEST_SYSTEM
-        default: return NIL_VAL;
+        default: return NULL;
 #else
         default: return getTestSystemBuiltin(builtin);
 #endif
     }
 }
+
+void initBuiltins() {
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        BuiltinFun function = builtinFunction(i);
+        if (function) {
+            vm.builtins[i] = OBJ_VAL(newBuiltin(function));
+        } else {
+            vm.builtins[i] = NIL_VAL;
+        }
+    }
+}
+
+Value getBuiltin(uint8_t builtin) {
+    return builtin < BUILTIN_COUNT ? vm.builtins[builtin] : NIL_VAL;
+}
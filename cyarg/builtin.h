@@ -3,6 +3,7 @@
 
 #include "value.h"
 
+void initBuiltins();
 Value getBuiltin(uint8_t builtin);
 
 #endif
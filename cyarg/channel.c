@@ -54,7 +54,7 @@ ObjChannelContainer* newChannel(ObjRoutine* routine, size_t capacity) {
     return channel;
 }
 
-void freeChannelObject(Obj* object) {
+size_t freeChannelObject(Obj* object) {
     ObjChannelContainer* channel = (ObjChannelContainer*)object;
     vm_mutex_deinit(&channel->lock);
 #ifdef CYARG_PTHREADS_SYNC    
@@ -62,7 +62,7 @@ void freeChannelObject(Obj* object) {
 #endif
 
     FREE_ARRAY(Value, channel->buffer, channel->bufferSize);
-    FREE(ObjChannelContainer, object); 
+    return sizeof(ObjChannelContainer);
 }
 
 size_t readCursor(ObjChannelContainer* channel) {
@@ -10,7 +10,7 @@ typedef struct ObjSyncGroup ObjSyncGroup;
 
 ObjChannelContainer* newChannel(ObjRoutine* routine, size_t capacity);
 
-void freeChannelObject(Obj* channel);
+size_t freeChannelObject(Obj* channel);
 void markChannel(ObjChannelContainer* channel);
 
 ObjString* channelToString(ObjChannelContainer* channel);
@@ -3,6 +3,7 @@
 
 #include "chunk.h"
 #include "memory.h"
+#include "object.h"
 #include "vm.h"
 
 void initChunk(Chunk* chunk) {
@@ -13,6 +14,13 @@ void initChunk(Chunk* chunk) {
     chunk->lineCapacity = 0;
     chunk->lines = 0;
     initDynamicValueArray(&chunk->constants);
+    chunk->globalCells = NULL;
+    chunk->globalCellCount = 0;
+    chunk->inlineCaches = NULL;
+    chunk->inlineCacheCount = 0;
+    chunk->xip = false;
+    chunk->quickened = false;
+    chunk->xipCode = NULL;
 }
 
 void freeChunk(Chunk* chunk) {
@@ -21,6 +29,8 @@ void freeChunk(Chunk* chunk) {
     }
     FREE_ARRAY(ChunkSource, chunk->lines, chunk->lineCapacity);
     freeDynamicValueArray(&chunk->constants);
+    FREE_ARRAY(ValueCell*, chunk->globalCells, chunk->globalCellCount);
+    FREE_ARRAY(InlineCache, chunk->inlineCaches, chunk->inlineCacheCount);
     initChunk(chunk);
 }
 
@@ -40,10 +50,10 @@ int addConstant(Chunk* chunk, Value value) {
     for (int i = 0; i < chunk->constants.count; i++) {
         Value *is = &chunk->constants.values[i];
 
-        if (is->type != value.type) continue;
-        switch (value.type) {
+        if (VALUE_TYPE(*is) != VALUE_TYPE(value)) continue;
+        switch (VALUE_TYPE(value)) {
         case VAL_DOUBLE:
-            if (is->as.dbl == value.as.dbl) break;
+            if (AS_DOUBLE(*is) == AS_DOUBLE(value)) break;
             continue;
 //        case VAL_BOOL: if (is->as.boolean == value.as.boolean) break; continue;
 //        case VAL_NIL: break;
@@ -55,13 +65,13 @@ int addConstant(Chunk* chunk, Value value) {
 //        case VAL_UI32: if (is->as.ui32 == value.as.ui32) break; continue;
 //        case VAL_UI64:
 //        case VAL_I64: if (is->as.i64 == value.as.i64) break; continue;
-        case VAL_BOOL: case VAL_NIL: case VAL_I8: case VAL_UI8: case VAL_I16: case VAL_UI16: case VAL_I32: case VAL_UI32: case VAL_UI64: case VAL_I64:
+        case VAL_BOOL: case VAL_NIL: case VAL_I8: case VAL_UI8: case VAL_I16: case VAL_UI16: case VAL_I32: case VAL_UI32: case VAL_UI64: case VAL_I64: case VAL_SMALL_INT:
             assert(!"native int consts are not supported; nil, true, false are encoded");
-        case VAL_ADDRESS: if (is->as.address != value.as.address) continue; break;
+        case VAL_ADDRESS: if (AS_ADDRESS(*is) != AS_ADDRESS(value)) continue; break;
         case VAL_OBJ:
-            if (is->as.obj == value.as.obj) break;
-            if (is->as.obj->type != value.as.obj->type) continue;
-            switch (value.as.obj->type) {
+            if (AS_OBJ(*is) == AS_OBJ(value)) break;
+            if (AS_OBJ(*is)->type != AS_OBJ(value)->type) continue;
+            switch (AS_OBJ(value)->type) {
             case OBJ_INT:
                 if (int_is(AS_INT(*is), AS_INT(value)) == INT_EQ) break;
                 continue;
@@ -85,3 +95,282 @@ int addConstant(Chunk* chunk, Value value) {
     tempRootPop();
     return chunk->constants.count - 1;
 }
+
+// OP_IMMEDIATE_TYPED is followed by its type and then the value, least significant
+// byte first.
+int typedImmediateLength(uint8_t typeLiteral) {
+    switch (typeLiteral) {
+        case TYPE_LITERAL_INT8:
+        case TYPE_LITERAL_UINT8:
+            return 1;
+        case TYPE_LITERAL_INT16:
+        case TYPE_LITERAL_UINT16:
+            return 2;
+        case TYPE_LITERAL_INT64:
+        case TYPE_LITERAL_UINT64:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+static int stackEffect(Chunk* chunk, int offset, int* length) {
+    uint8_t* code = &chunk->code[offset];
+    *length = 1;
+    switch (code[0]) {
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+            return 1;
+        case OP_CONSTANT:
+        case OP_GET_BUILTIN:
+        case OP_GET_LOCAL:
+        case OP_ADD_LOCALS:
+        case OP_LOCAL_ARITH_CONST:
+        case OP_LOCAL_COMPARE_CONST_JUMP:
+        case OP_GET_GLOBAL:
+        case OP_GET_UPVALUE:
+        case OP_CLASS:
+        case OP_TYPE_LITERAL:
+        case OP_IMMEDIATE_P8:
+        case OP_IMMEDIATE_N8:
+            *length = 2;
+            return 1;
+        case OP_TYPE_DEFAULT:
+            return 1;
+        case OP_IMMEDIATE_P16:
+        case OP_IMMEDIATE_N16:
+            *length = 3;
+            return 1;
+        case OP_IMMEDIATE_P24:
+        case OP_IMMEDIATE_N24:
+            *length = 4;
+            return 1;
+        case OP_IMMEDIATE_TYPED:
+            *length = 2 + typedImmediateLength(code[1]);
+            return 1;
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_TYPED:
+        case OP_SET_GLOBAL:
+        case OP_SET_UPVALUE:
+        case OP_SET_LOCAL_POP:
+        case OP_SET_GLOBAL_POP:
+            *length = 2;
+            return 0;
+        case OP_GET_PROPERTY:
+            *length = 3;
+            return 0;
+        case OP_SET_PROPERTY:
+            *length = 3;
+            return -1;
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_SUPER:
+        case OP_METHOD:
+            *length = 2;
+            return -1;
+        case OP_DEFINE_TYPED_GLOBAL:
+            *length = 2;
+            return -2;
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_YIELD:
+        case OP_INITIALISE:
+        case OP_DEREF_PTR:
+            return 0;
+        case OP_POKE:
+        case OP_SET_ELEMENT:
+            return -2;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_POP_JUMP_IF_FALSE:
+        case OP_LOOP:
+            *length = 3;
+            return 0;
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            *length = 2;
+            return -code[1];
+        case OP_CALL_BUILTIN:
+            *length = 3;
+            return 1 - code[2];
+        case OP_INVOKE:
+            *length = 4;
+            return -code[2];
+        case OP_SUPER_INVOKE:
+            *length = 3;
+            return -code[2] - 1;
+        case OP_CLOSURE: {
+            ObjFunction* function = AS_FUNCTION(chunk->constants.values[code[1]]);
+            *length = 2 + 2 * function->upvalueCount;
+            return 1;
+        }
+        case OP_TYPE_STRUCT:
+            *length = 2;
+            return 1 - 3 * code[1];
+        default:
+            // OP_POP, OP_INITIALISE_TYPED, binary operators, OP_PRINT, OP_CLOSE_UPVALUE, OP_RETURN,
+            // OP_INHERIT, OP_ELEMENT, OP_TYPE_INDEXED_COLLECTION, OP_SET_PTR_TARGET, OP_PLACE
+            return -1;
+    }
+}
+
+int chunkInstructionLength(Chunk* chunk, int offset) {
+    int length;
+    stackEffect(chunk, offset, &length);
+    return length;
+}
+
+// The most cells a frame running this chunk occupies, counting the callee and its
+// arguments. Every path through the code is followed, so branches that leave values
+// on the stack are accounted for.
+int chunkStackDepth(Chunk* chunk, int arity) {
+    int maxDepth = arity + 1;
+    if (chunk->count == 0) return maxDepth;
+
+    // scratch space comes from malloc rather than the collector, as the package loader
+    // calls this while its functions are not yet reachable.
+    int* depths = malloc(sizeof(int) * chunk->count);
+    int* pending = malloc(sizeof(int) * chunk->count);
+    bool* queued = malloc(sizeof(bool) * chunk->count);
+    int pendingCount = 0;
+    for (int i = 0; i < chunk->count; i++) {
+        depths[i] = -1;
+        queued[i] = false;
+    }
+
+    depths[0] = maxDepth;
+    pending[pendingCount++] = 0;
+    queued[0] = true;
+
+    while (pendingCount > 0) {
+        int offset = pending[--pendingCount];
+        int depth = depths[offset];
+        queued[offset] = false;
+
+        while (offset < chunk->count) {
+            int length;
+            uint8_t instruction = chunk->code[offset];
+            depth += stackEffect(chunk, offset, &length);
+            if (depth > maxDepth) maxDepth = depth;
+
+            int next = offset + length;
+            int target = -1;
+            if (instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE || instruction == OP_POP_JUMP_IF_FALSE
+                || instruction == OP_LOOP) {
+                uint16_t jump = (uint16_t)((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+                target = instruction == OP_LOOP ? next - jump : next + jump;
+            }
+            if (target >= 0 && target < chunk->count && depths[target] < depth) {
+                depths[target] = depth;
+                if (!queued[target]) {
+                    pending[pendingCount++] = target;
+                    queued[target] = true;
+                }
+            }
+            if (instruction == OP_JUMP || instruction == OP_LOOP || instruction == OP_RETURN) break;
+            if (next >= chunk->count || depths[next] >= depth) break;
+
+            depths[next] = depth;
+            offset = next;
+        }
+    }
+
+    free(depths);
+    free(pending);
+    free(queued);
+    return maxDepth;
+}
+
+// Where the jump or loop instruction at the offset goes to.
+int chunkJumpTarget(Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    uint16_t distance = (uint16_t)((code[1] << 8) | code[2]);
+    return code[0] == OP_LOOP ? offset + 3 - distance : offset + 3 + distance;
+}
+
+// The stack depth before each instruction, or -1 where it is unreachable, and which
+// instructions a loop goes back to. Code that compiles to native code addresses slots by
+// these, so this fails where paths meet at different depths.
+bool chunkExactStackDepths(Chunk* chunk, int arity, int* depths, bool* loopHeads) {
+    int* pending = malloc(sizeof(int) * chunk->count);
+    if (pending == NULL) return false;
+    int pendingCount = 0;
+    bool consistent = true;
+    for (int i = 0; i < chunk->count; i++) {
+        depths[i] = -1;
+        loopHeads[i] = false;
+    }
+
+    depths[0] = arity + 1;
+    pending[pendingCount++] = 0;
+    while (pendingCount > 0 && consistent) {
+        int offset = pending[--pendingCount];
+        int depth = depths[offset];
+
+        while (offset < chunk->count) {
+            int length;
+            uint8_t instruction = chunk->code[offset];
+            int after = depth + stackEffect(chunk, offset, &length);
+            int next = offset + length;
+
+            if (instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE || instruction == OP_POP_JUMP_IF_FALSE
+                || instruction == OP_LOOP) {
+                int target = chunkJumpTarget(chunk, offset);
+                if (target < 0 || target >= chunk->count) {
+                    consistent = false;
+                    break;
+                }
+                if (instruction == OP_LOOP) {
+                    loopHeads[target] = true;
+                }
+                if (depths[target] < 0) {
+                    depths[target] = after;
+                    pending[pendingCount++] = target;
+                } else if (depths[target] != after) {
+                    consistent = false;
+                    break;
+                }
+            }
+            if (instruction == OP_JUMP || instruction == OP_LOOP || instruction == OP_RETURN) break;
+            if (next >= chunk->count) break;
+            if (depths[next] >= 0) {
+                consistent = depths[next] == after;
+                break;
+            }
+            depths[next] = after;
+            offset = next;
+            depth = after;
+        }
+    }
+
+    free(pending);
+    return consistent;
+}
+
+// One more than the highest inline cache index used by the chunk's property and invoke sites.
+int chunkInlineCacheCount(Chunk* chunk) {
+    int count = 0;
+    int offset = 0;
+    while (offset < chunk->count) {
+        int length;
+        stackEffect(chunk, offset, &length);
+        uint8_t* code = &chunk->code[offset];
+        int cache = -1;
+        switch (code[0]) {
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+                cache = code[2];
+                break;
+            case OP_INVOKE:
+                cache = code[3];
+                break;
+            default:
+                break;
+        }
+        if (cache >= count) {
+            count = cache + 1;
+        }
+        offset += length;
+    }
+    return count;
+}
@@ -13,10 +13,13 @@ typedef enum {
     OP_GET_BUILTIN,
     OP_GET_LOCAL,
     OP_SET_LOCAL,
+    OP_SET_LOCAL_TYPED,
     OP_GET_GLOBAL,
     OP_DEFINE_GLOBAL,
+    OP_DEFINE_TYPED_GLOBAL,
     OP_SET_GLOBAL,
     OP_INITIALISE,
+    OP_INITIALISE_TYPED,
     OP_GET_UPVALUE,
     OP_SET_UPVALUE,
     OP_GET_PROPERTY,
@@ -43,6 +46,8 @@ typedef enum {
     OP_JUMP_IF_FALSE,
     OP_LOOP,
     OP_CALL,
+    OP_TAIL_CALL,
+    OP_CALL_BUILTIN,
     OP_INVOKE,
     OP_SUPER_INVOKE,
     OP_CLOSURE,
@@ -63,17 +68,68 @@ typedef enum {
     OP_TYPE_LITERAL,
     OP_TYPE_STRUCT,
     OP_TYPE_INDEXED_COLLECTION,
-    OP_SET_CELL_TYPE,
+    OP_TYPE_DEFAULT,
     OP_DEREF_PTR,
     OP_SET_PTR_TARGET,
-    OP_PLACE
+    OP_PLACE,
+    OP_IMMEDIATE_TYPED,
+    // Specialised forms, emitted where the compiler knows the operand types and
+    // otherwise rewritten to by hot code. Each group is in QuickKind order.
+    OP_ADD_SMALL_INT,
+    OP_ADD_I32,
+    OP_ADD_UI32,
+    OP_ADD_DOUBLE,
+    OP_SUBTRACT_SMALL_INT,
+    OP_SUBTRACT_I32,
+    OP_SUBTRACT_UI32,
+    OP_SUBTRACT_DOUBLE,
+    OP_MULTIPLY_SMALL_INT,
+    OP_MULTIPLY_I32,
+    OP_MULTIPLY_UI32,
+    OP_MULTIPLY_DOUBLE,
+    OP_LESS_SMALL_INT,
+    OP_LESS_I32,
+    OP_LESS_UI32,
+    OP_LESS_DOUBLE,
+    OP_GREATER_SMALL_INT,
+    OP_GREATER_I32,
+    OP_GREATER_UI32,
+    OP_GREATER_DOUBLE,
+    // Superinstructions, written by the peephole pass over the first instruction of the
+    // sequence each stands for. The rest of the sequence stays in place behind it, so
+    // they keep its length and, where the operands don't suit, carry on as that first
+    // instruction.
+    OP_SET_LOCAL_POP,               // OP_SET_LOCAL; OP_POP
+    OP_SET_GLOBAL_POP,              // OP_SET_GLOBAL; OP_POP
+    OP_POP_JUMP_IF_FALSE,           // OP_JUMP_IF_FALSE to an OP_POP; OP_POP
+    OP_ADD_LOCALS,                  // OP_GET_LOCAL; OP_GET_LOCAL; OP_ADD
+    OP_LOCAL_ARITH_CONST,           // OP_GET_LOCAL; immediate; OP_ADD or OP_SUBTRACT
+    OP_LOCAL_COMPARE_CONST_JUMP     // OP_GET_LOCAL; immediate; OP_LESS or OP_GREATER; OP_POP_JUMP_IF_FALSE; OP_POP
 } OpCode;
 
+// Flags in the first byte of each OP_CLOSURE upvalue pair. A typed local keeps its type
+// in the slot just below it.
+#define UPVALUE_LOCAL 1
+#define UPVALUE_TYPED 2
+
 typedef struct {
     uint16_t address;
     uint16_t line;
 } ChunkSource;
 
+// What a property or invoke site last resolved its name to. The caches live beside the
+// code rather than in it, so code executed in place from flash stays read-only.
+typedef struct {
+    uint32_t version;   // odd while the entry is being rewritten
+    ObjString* name;
+    Obj* holder;        // the class the method came from, or the struct type the field is in
+    Value method;
+    size_t structIndex;
+    struct ObjShape* shape;         // the instance layout fieldIndex was resolved against
+    struct ObjShape* transition;    // for a store that adds the field, the layout it moves to
+    int fieldIndex;                 // -1 when the shape has no such field
+} InlineCache;
+
 typedef struct Chunk {
     int count;
     int capacity;
@@ -82,9 +138,25 @@ typedef struct Chunk {
     int lineCapacity;
     ChunkSource *lines;
     DynamicValueArray constants;
+    // the global each name constant was bound to, filled in as the code first uses it.
+    ValueCell** globalCells;
+    int globalCellCount;
+    InlineCache* inlineCaches;
+    int inlineCacheCount;
     bool xip;
+    bool quickened;     // code is in RAM and may be rewritten by quickenInstruction
+    uint8_t* xipCode;   // the flash copy, once code has been copied to RAM
 } Chunk;
 
+// Frames which entered a function before its code was copied out of flash carry on
+// there, so an ip is measured from whichever copy holds it.
+static inline size_t chunkCodeOffset(Chunk* chunk, const uint8_t* ip) {
+    if (chunk->xipCode != NULL && ip >= chunk->xipCode && ip <= chunk->xipCode + chunk->count) {
+        return (size_t)(ip - chunk->xipCode);
+    }
+    return (size_t)(ip - chunk->code);
+}
+
 typedef enum {
     BUILTIN_READ_YARG_SOURCE,
     BUILTIN_COMPILE,
@@ -120,6 +192,8 @@ typedef enum {
     BUILTIN_LOAD
 } BuiltinFn;
 
+#define BUILTIN_COUNT (BUILTIN_LOAD + 1)
+
 typedef enum {
     TYPE_LITERAL_BOOL,
     TYPE_LITERAL_INT8,
@@ -139,5 +213,11 @@ void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 int addConstant(Chunk* chunk, Value value);
+int typedImmediateLength(uint8_t typeLiteral);
+int chunkInstructionLength(Chunk* chunk, int offset);
+int chunkStackDepth(Chunk* chunk, int arity);
+int chunkJumpTarget(Chunk* chunk, int offset);
+bool chunkExactStackDepths(Chunk* chunk, int arity, int* depths, bool* loopHeads);
+int chunkInlineCacheCount(Chunk* chunk);
 
 #endif
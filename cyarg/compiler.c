@@ -9,6 +9,7 @@
 #include "memory.h"
 #include "object.h"
 #include "scanner.h"
+#include "optimiser.h"
 
 static void generateExpr(ObjExpr* expr);
 
@@ -19,10 +20,22 @@ typedef enum {
     TYPE_SCRIPT
 } FunctionType;
 
+// What the compiler can tell of a value's type without running it. A literal int
+// takes on the type of the other operand, so it fits with any of the others.
+typedef enum {
+    STATIC_ANY,
+    STATIC_LITERAL_INT,
+    STATIC_I32,
+    STATIC_UI32,
+    STATIC_DOUBLE
+} StaticType;
+
 typedef struct {
     ObjString* name;
     int depth;
     bool isCaptured;
+    bool isTyped;   // the slot below holds its type
+    StaticType staticType;
 } Local;
 
 typedef struct {
@@ -43,6 +56,7 @@ typedef struct Compiler {
     int localCount;
     Upvalue upvalues[UINT8_COUNT];
     int scopeDepth;
+    int inlineCacheCount;
 } Compiler;
 
 typedef struct ClassCompiler {
@@ -66,6 +80,7 @@ static void initCompiler(Compiler* compiler, FunctionType type, ObjString* name)
 
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
+    compiler->inlineCacheCount = 0;
 
     compiler->ast = newObjAst();
     current = compiler;
@@ -80,6 +95,8 @@ static void initCompiler(Compiler* compiler, FunctionType type, ObjString* name)
     local->name = NULL;
     local->depth = 0;
     local->isCaptured = false;
+    local->isTyped = false;
+    local->staticType = STATIC_ANY;
     if (type != TYPE_FUNCTION) {
         local->name = copyString("this", 4);
     } else {
@@ -176,6 +193,8 @@ static void addLocal(ObjString* name) {
     local->name = name;
     local->depth = -1;
     local->isCaptured = false;
+    local->isTyped = false;
+    local->staticType = STATIC_ANY;
 }
 
 static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal, ObjString* name) {
@@ -232,19 +251,19 @@ static void emitConstant(Value value) {
     // DOUBLE_VAL, ADDRESS_VAL or OBJ_VAL(String or Int)
     int32_t v = 0;
     bool asObject = true;
-    switch (value.type) {
+    switch (VALUE_TYPE(value)) {
     case VAL_ADDRESS: // fall through
     case VAL_DOUBLE:
         break;
     case VAL_OBJ:
         if (IS_INT(value)) {
-            ObjInt *oi = (ObjInt *) value.as.obj;
+            ObjInt *oi = (ObjInt *) AS_OBJ(value);
             if (int_is_range(&oi->bigInt, -UINT24_MAX, UINT24_MAX) == INT_WITHIN) {
                 v = int_to_i32(&oi->bigInt);
                 asObject = false;
             }
         } else {
-            assert(value.as.obj->type == OBJ_STRING);
+            assert(AS_OBJ(value)->type == OBJ_STRING);
         }
         break;
     default:
@@ -346,8 +365,21 @@ static uint8_t parseVariable(ObjString* name) {
 
 static void generateStmt(ObjStmt* stmt);
 
+static uint8_t typeLiteralId(ExprTypeLiteral type);
+
+static void emitTypedImmediate(ExprTypeLiteral type, uint64_t bits) {
+    uint8_t typeLiteral = typeLiteralId(type);
+    emitBytes(OP_IMMEDIATE_TYPED, typeLiteral);
+    for (int i = 0; i < typedImmediateLength(typeLiteral); i++) {
+        emitByte((uint8_t)(bits >> (8 * i)));
+    }
+}
+
 static void generateNumber(ObjExprNumber* num) {
     switch(num->type) {
+    case NUMBER_TYPED:
+        emitTypedImmediate(num->typed.type, num->typed.bits);
+        break;
     case NUMBER_DOUBLE:
         emitConstant(DOUBLE_VAL(num->dbl));
         break;
@@ -403,39 +435,201 @@ static void generateExprAssignable(ObjExprOperation* op) {
     }
 }
 
-static void generateArithOperation(ObjExprOperation* op) {    
-    generateExpr(op->rhs);
+static StaticType exprStaticType(ObjExpr* expr);
+
+static StaticType localStaticType(ObjString* name) {
+    for (int i = current->localCount - 1; i >= 0; i--) {
+        Local* local = &current->locals[i];
+        if (identifiersEqual(name, local->name)) {
+            return local->depth == -1 ? STATIC_ANY : local->staticType;
+        }
+    }
+    return STATIC_ANY;
+}
+
+static StaticType declaredStaticType(ObjExpr* type) {
+    if (type->obj.type != OBJ_EXPR_TYPE || type->nextExpr != NULL) return STATIC_ANY;
+
+    switch (((ObjExprTypeLiteral*)type)->type) {
+        case EXPR_TYPE_LITERAL_INT32: return STATIC_I32;
+        case EXPR_TYPE_LITERAL_UINT32: return STATIC_UI32;
+        case EXPR_TYPE_LITERAL_MFLOAT64: return STATIC_DOUBLE;
+        default: return STATIC_ANY;
+    }
+}
+
+static StaticType numberStaticType(ObjExprNumber* num) {
+    switch (num->type) {
+        case NUMBER_INT: return STATIC_LITERAL_INT;
+        case NUMBER_DOUBLE: return STATIC_DOUBLE;
+        case NUMBER_TYPED:
+            if (num->typed.type == EXPR_TYPE_LITERAL_INT32) return STATIC_I32;
+            if (num->typed.type == EXPR_TYPE_LITERAL_UINT32) return STATIC_UI32;
+            return STATIC_ANY;
+    }
+    return STATIC_ANY;
+}
+
+static StaticType builtinStaticType(ObjExprBuiltin* fn) {
+    switch (fn->builtin) {
+        case EXPR_BUILTIN_INT32: return STATIC_I32;
+        case EXPR_BUILTIN_UINT32: return STATIC_UI32;
+        case EXPR_BUILTIN_MFLOAT64: return STATIC_DOUBLE;
+        default: return STATIC_ANY;
+    }
+}
+
+// The operands of arithmetic agree when they have the same type, or when one is a
+// literal int which promote() converts to the type of the other.
+static StaticType operandsStaticType(StaticType a, StaticType b) {
+    if (a == STATIC_LITERAL_INT) a = b == STATIC_DOUBLE ? STATIC_ANY : b;
+    if (b == STATIC_LITERAL_INT) b = a == STATIC_DOUBLE ? STATIC_ANY : a;
+    return a == b && a != STATIC_LITERAL_INT ? a : STATIC_ANY;
+}
+
+static StaticType operationStaticType(ObjExprOperation* op, StaticType lhs) {
+    StaticType operands = operandsStaticType(lhs, exprStaticType(op->rhs));
+
+    switch (op->operation) {
+        case EXPR_OP_ADD:
+        case EXPR_OP_SUBTRACT:
+        case EXPR_OP_MULTIPLY:
+            return operands;
+        case EXPR_OP_LEFT_SHIFT:
+        case EXPR_OP_RIGHT_SHIFT:
+        case EXPR_OP_BIT_OR:
+        case EXPR_OP_BIT_AND:
+        case EXPR_OP_BIT_XOR:
+            return operands == STATIC_UI32 ? STATIC_UI32 : STATIC_ANY;
+        default:
+            return STATIC_ANY;
+    }
+}
+
+// The type of the value an element of an expression leaves on the stack, given the
+// type of the value left by the elements before it.
+static StaticType eltStaticType(ObjExpr* expr, StaticType lhs) {
+    switch (expr->obj.type) {
+        case OBJ_EXPR_NUMBER:
+            return numberStaticType((ObjExprNumber*)expr);
+        case OBJ_EXPR_GROUPING:
+            return exprStaticType(((ObjExprGrouping*)expr)->expression);
+        case OBJ_EXPR_NAMEDVARIABLE: {
+            ObjExprNamedVariable* var = (ObjExprNamedVariable*)expr;
+            return var->assignment ? STATIC_ANY : localStaticType(var->name);
+        }
+        case OBJ_EXPR_OPERATION:
+            return operationStaticType((ObjExprOperation*)expr, lhs);
+        default:
+            return STATIC_ANY;
+    }
+}
+
+static StaticType exprStaticType(ObjExpr* expr) {
+    StaticType type = STATIC_ANY;
+    while (expr != NULL) {
+        if (expr->obj.type == OBJ_EXPR_BUILTIN
+            && expr->nextExpr && expr->nextExpr->obj.type == OBJ_EXPR_CALL) {
+            type = builtinStaticType((ObjExprBuiltin*)expr);
+            expr = expr->nextExpr->nextExpr;
+            continue;
+        }
+        type = eltStaticType(expr, type);
+        expr = expr->nextExpr;
+    }
+    return type;
+}
+
+// Each group of specialised instructions is in small int, i32, ui32, double order.
+static uint8_t specialisedOp(uint8_t generic, uint8_t group, StaticType operands) {
+    switch (operands) {
+        case STATIC_I32: return group + 1;
+        case STATIC_UI32: return group + 2;
+        case STATIC_DOUBLE: return group + 3;
+        default: return generic;
+    }
+}
+
+static bool promotesOperands(ExprOp operation) {
+    switch (operation) {
+        case EXPR_OP_EQUAL:
+        case EXPR_OP_NOT_EQUAL:
+        case EXPR_OP_GREATER:
+        case EXPR_OP_GREATER_EQUAL:
+        case EXPR_OP_LESS:
+        case EXPR_OP_LESS_EQUAL:
+        case EXPR_OP_ADD:
+        case EXPR_OP_SUBTRACT:
+        case EXPR_OP_MULTIPLY:
+        case EXPR_OP_DIVIDE:
+        case EXPR_OP_MODULO:
+        case EXPR_OP_LEFT_SHIFT:
+        case EXPR_OP_RIGHT_SHIFT:
+        case EXPR_OP_BIT_OR:
+        case EXPR_OP_BIT_AND:
+        case EXPR_OP_BIT_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// A literal int operand is converted to the type of the other operand here, rather
+// than by promote() each time the operation runs.
+static bool generatePromotedLiteral(ObjExpr* expr, StaticType type) {
+#if defined(CYARG_AST_OPTIMISE)
+    if (expr->obj.type != OBJ_EXPR_NUMBER || ((ObjExprNumber*)expr)->type != NUMBER_INT) return false;
+
+    Int* literal = &((ObjExprNumber*)expr)->bigInt;
+    if (type == STATIC_I32 && int_is_range(literal, INT32_MIN, INT32_MAX) == INT_WITHIN) {
+        emitTypedImmediate(EXPR_TYPE_LITERAL_INT32, (uint32_t)int_to_i32(literal));
+        return true;
+    }
+    if (type == STATIC_UI32 && int_is_range(literal, 0, UINT32_MAX) == INT_WITHIN) {
+        emitTypedImmediate(EXPR_TYPE_LITERAL_UINT32, int_to_u32(literal));
+        return true;
+    }
+#endif
+    return false;
+}
+
+static void generateArithOperation(ObjExprOperation* op, StaticType lhs) {
+    StaticType operands = operandsStaticType(lhs, exprStaticType(op->rhs));
+    if (op->rhs->nextExpr != NULL || !promotesOperands(op->operation)
+        || !generatePromotedLiteral(op->rhs, lhs)) {
+        generateExpr(op->rhs);
+    }
 
     switch (op->operation) {
         case EXPR_OP_EQUAL: emitByte(OP_EQUAL); return;
-        case EXPR_OP_GREATER: emitByte(OP_GREATER); return;
+        case EXPR_OP_GREATER: emitByte(specialisedOp(OP_GREATER, OP_GREATER_SMALL_INT, operands)); return;
         case EXPR_OP_RIGHT_SHIFT: emitByte(OP_RIGHT_SHIFT); return;
-        case EXPR_OP_LESS: emitByte(OP_LESS); return;
+        case EXPR_OP_LESS: emitByte(specialisedOp(OP_LESS, OP_LESS_SMALL_INT, operands)); return;
         case EXPR_OP_LEFT_SHIFT: emitByte(OP_LEFT_SHIFT); return;
-        case EXPR_OP_ADD: emitByte(OP_ADD); return;
-        case EXPR_OP_SUBTRACT: emitByte(OP_SUBTRACT); return;
-        case EXPR_OP_MULTIPLY: emitByte(OP_MULTIPLY); return;
+        case EXPR_OP_ADD: emitByte(specialisedOp(OP_ADD, OP_ADD_SMALL_INT, operands)); return;
+        case EXPR_OP_SUBTRACT: emitByte(specialisedOp(OP_SUBTRACT, OP_SUBTRACT_SMALL_INT, operands)); return;
+        case EXPR_OP_MULTIPLY: emitByte(specialisedOp(OP_MULTIPLY, OP_MULTIPLY_SMALL_INT, operands)); return;
         case EXPR_OP_DIVIDE: emitByte(OP_DIVIDE); return;
         case EXPR_OP_BIT_OR: emitByte(OP_BITOR); return;
         case EXPR_OP_BIT_AND: emitByte(OP_BITAND); return;
         case EXPR_OP_BIT_XOR: emitByte(OP_BITXOR); return;
         case EXPR_OP_MODULO: emitByte(OP_MODULO); return;
         case EXPR_OP_NOT_EQUAL: emitBytes(OP_EQUAL, OP_NOT); return;
-        case EXPR_OP_GREATER_EQUAL: emitBytes(OP_LESS, OP_NOT); return;
-        case EXPR_OP_LESS_EQUAL: emitBytes(OP_GREATER, OP_NOT); return;
+        case EXPR_OP_GREATER_EQUAL: emitBytes(specialisedOp(OP_LESS, OP_LESS_SMALL_INT, operands), OP_NOT); return;
+        case EXPR_OP_LESS_EQUAL: emitBytes(specialisedOp(OP_GREATER, OP_GREATER_SMALL_INT, operands), OP_NOT); return;
         case EXPR_OP_NOT: emitByte(OP_NOT); return;
         case EXPR_OP_NEGATE: emitByte(OP_NEGATE); return;
         default: return; // unreachable
     }
 }
 
-static void generateExprOperation(ObjExprOperation* op) {
+static void generateExprOperation(ObjExprOperation* op, StaticType lhs) {
 
     switch (op->operation) {
         case EXPR_OP_LOGICAL_AND: generateExprLogicalAnd(op); return;
         case EXPR_OP_LOGICAL_OR: generateExprLogicalOr(op); return;
         case EXPR_OP_DEREF_PTR: generateExprAssignable(op); return;
-        default: generateArithOperation(op); return;
+        default: generateArithOperation(op, lhs); return;
     }
 }
 
@@ -471,7 +665,11 @@ static void generateExprNamedVariable(ObjExprNamedVariable* var) {
     int arg = resolveLocal(current, var->name);
     if (arg != -1) {
         getOp = OP_GET_LOCAL;
-        setOp = OP_SET_LOCAL;
+        Local* local = &current->locals[arg];
+        bool checked = local->isTyped
+            && !(var->assignment && local->staticType != STATIC_ANY
+                 && exprStaticType(var->assignment) == local->staticType);
+        setOp = checked ? OP_SET_LOCAL_TYPED : OP_SET_LOCAL;
     } else if ((arg = resolveUpvalue(current, var->name)) != -1) {
         getOp = OP_GET_UPVALUE;
         setOp = OP_SET_UPVALUE;
@@ -511,7 +709,6 @@ static void generateExprCall(ObjExprCall* call) {
 
 static void generateExprCollectionInit(ObjExprCollectionInitializer* collection) {
  
-    emitBytes(OP_GET_BUILTIN, BUILTIN_NEW);
     emitByte(OP_NIL);
     if (collection->isMap) {
         emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_STRING);
@@ -519,7 +716,8 @@ static void generateExprCollectionInit(ObjExprCollectionInitializer* collection)
         generateExpr(collection->cardinality);
     }
     emitByte(OP_TYPE_INDEXED_COLLECTION);
-    emitBytes(OP_CALL, 1);
+    emitByte(OP_CALL_BUILTIN);
+    emitBytes(BUILTIN_NEW, 1);
  
     for (int i = 0; i < collection->initializers.objectCount; i++) {
         Obj* item_or_pair = collection->initializers.objects[i];
@@ -551,41 +749,54 @@ static void generateExprCollectionElement(ObjExprCollectionElement* collection)
     }
 }
 
-static void generateExprBuiltin(ObjExprBuiltin* fn) {
+static uint8_t builtinId(ObjExprBuiltin* fn) {
     switch(fn->builtin) {
-        case EXPR_BUILTIN_READ_YARG_SOURCE: emitBytes(OP_GET_BUILTIN, BUILTIN_READ_YARG_SOURCE); break;
-        case EXPR_BUILTIN_COMPILE: emitBytes(OP_GET_BUILTIN, BUILTIN_COMPILE); break;
-        case EXPR_BUILTIN_MAKE_ROUTINE: emitBytes(OP_GET_BUILTIN, BUILTIN_MAKE_ROUTINE); break;
-        case EXPR_BUILTIN_MAKE_CHANNEL: emitBytes(OP_GET_BUILTIN, BUILTIN_MAKE_CHANNEL); break;
-        case EXPR_BUILTIN_MAKE_SYNCGROUP: emitBytes(OP_GET_BUILTIN, BUILTIN_MAKE_SYNCGROUP); break;
-        case EXPR_BUILTIN_RESUME: emitBytes(OP_GET_BUILTIN, BUILTIN_RESUME); break;
-        case EXPR_BUILTIN_START: emitBytes(OP_GET_BUILTIN, BUILTIN_START); break;
-        case EXPR_BUILTIN_RECEIVE: emitBytes(OP_GET_BUILTIN, BUILTIN_RECEIVE); break;
-        case EXPR_BUILTIN_SEND: emitBytes(OP_GET_BUILTIN, BUILTIN_SEND); break;
-        case EXPR_BUILTIN_CPEEK: emitBytes(OP_GET_BUILTIN, BUILTIN_CPEEK); break;
-        case EXPR_BUILTIN_SHARE: emitBytes(OP_GET_BUILTIN, BUILTIN_SHARE); break;
-        case EXPR_BUILTIN_PEEK: emitBytes(OP_GET_BUILTIN, BUILTIN_PEEK); break;
-        case EXPR_BUILTIN_LEN: emitBytes(OP_GET_BUILTIN, BUILTIN_LEN); break;
-        case EXPR_BUILTIN_PIN: emitBytes(OP_GET_BUILTIN, BUILTIN_PIN); break;
-        case EXPR_BUILTIN_NEW: emitBytes(OP_GET_BUILTIN, BUILTIN_NEW); break;
-        case EXPR_BUILTIN_INT8: emitBytes(OP_GET_BUILTIN, BUILTIN_INT8); break;
-        case EXPR_BUILTIN_UINT8: emitBytes(OP_GET_BUILTIN, BUILTIN_UINT8); break;
-        case EXPR_BUILTIN_INT16: emitBytes(OP_GET_BUILTIN, BUILTIN_INT16); break;
-        case EXPR_BUILTIN_UINT16: emitBytes(OP_GET_BUILTIN, BUILTIN_UINT16); break;
-        case EXPR_BUILTIN_INT32: emitBytes(OP_GET_BUILTIN, BUILTIN_INT32); break;
-        case EXPR_BUILTIN_UINT32: emitBytes(OP_GET_BUILTIN, BUILTIN_UINT32); break;
-        case EXPR_BUILTIN_INT64: emitBytes(OP_GET_BUILTIN, BUILTIN_INT64); break;
-        case EXPR_BUILTIN_UINT64: emitBytes(OP_GET_BUILTIN, BUILTIN_UINT64); break;
-        case EXPR_BUILTIN_TS_SET: emitBytes(OP_GET_BUILTIN, BUILTIN_TS_SET); break;
-        case EXPR_BUILTIN_TS_READ: emitBytes(OP_GET_BUILTIN, BUILTIN_TS_READ); break;
-        case EXPR_BUILTIN_TS_WRITE: emitBytes(OP_GET_BUILTIN, BUILTIN_TS_WRITE); break;
-        case EXPR_BUILTIN_TS_INTERRUPT: emitBytes(OP_GET_BUILTIN, BUILTIN_TS_INTERRUPT); break;
-        case EXPR_BUILTIN_TS_SYNC: emitBytes(OP_GET_BUILTIN, BUILTIN_TS_SYNC); break;
-        case EXPR_BUILTIN_INT: emitBytes(OP_GET_BUILTIN, BUILTIN_INT); break;
-        case EXPR_BUILTIN_MFLOAT64: emitBytes(OP_GET_BUILTIN, BUILTIN_MFLOAT64); break;
-        case EXPR_BUILTIN_STRING: emitBytes(OP_GET_BUILTIN, BUILTIN_STRING); break;
-        case EXPR_BUILTIN_LOAD: emitBytes(OP_GET_BUILTIN, BUILTIN_LOAD); break;
+        case EXPR_BUILTIN_READ_YARG_SOURCE: return BUILTIN_READ_YARG_SOURCE;
+        case EXPR_BUILTIN_COMPILE: return BUILTIN_COMPILE;
+        case EXPR_BUILTIN_MAKE_ROUTINE: return BUILTIN_MAKE_ROUTINE;
+        case EXPR_BUILTIN_MAKE_CHANNEL: return BUILTIN_MAKE_CHANNEL;
+        case EXPR_BUILTIN_MAKE_SYNCGROUP: return BUILTIN_MAKE_SYNCGROUP;
+        case EXPR_BUILTIN_RESUME: return BUILTIN_RESUME;
+        case EXPR_BUILTIN_START: return BUILTIN_START;
+        case EXPR_BUILTIN_RECEIVE: return BUILTIN_RECEIVE;
+        case EXPR_BUILTIN_SEND: return BUILTIN_SEND;
+        case EXPR_BUILTIN_CPEEK: return BUILTIN_CPEEK;
+        case EXPR_BUILTIN_SHARE: return BUILTIN_SHARE;
+        case EXPR_BUILTIN_PEEK: return BUILTIN_PEEK;
+        case EXPR_BUILTIN_LEN: return BUILTIN_LEN;
+        case EXPR_BUILTIN_PIN: return BUILTIN_PIN;
+        case EXPR_BUILTIN_NEW: return BUILTIN_NEW;
+        case EXPR_BUILTIN_INT8: return BUILTIN_INT8;
+        case EXPR_BUILTIN_UINT8: return BUILTIN_UINT8;
+        case EXPR_BUILTIN_INT16: return BUILTIN_INT16;
+        case EXPR_BUILTIN_UINT16: return BUILTIN_UINT16;
+        case EXPR_BUILTIN_INT32: return BUILTIN_INT32;
+        case EXPR_BUILTIN_UINT32: return BUILTIN_UINT32;
+        case EXPR_BUILTIN_INT64: return BUILTIN_INT64;
+        case EXPR_BUILTIN_UINT64: return BUILTIN_UINT64;
+        case EXPR_BUILTIN_TS_SET: return BUILTIN_TS_SET;
+        case EXPR_BUILTIN_TS_READ: return BUILTIN_TS_READ;
+        case EXPR_BUILTIN_TS_WRITE: return BUILTIN_TS_WRITE;
+        case EXPR_BUILTIN_TS_INTERRUPT: return BUILTIN_TS_INTERRUPT;
+        case EXPR_BUILTIN_TS_SYNC: return BUILTIN_TS_SYNC;
+        case EXPR_BUILTIN_INT: return BUILTIN_INT;
+        case EXPR_BUILTIN_MFLOAT64: return BUILTIN_MFLOAT64;
+        case EXPR_BUILTIN_STRING: return BUILTIN_STRING;
+        case EXPR_BUILTIN_LOAD: return BUILTIN_LOAD;
+    }
+    return UINT8_MAX; // unreachable.
+}
+
+static void generateExprBuiltin(ObjExprBuiltin* fn) {
+    emitBytes(OP_GET_BUILTIN, builtinId(fn));
+}
+
+// Sites beyond the last cache share it. Each cache checks its name, so sharing only costs hits.
+static uint8_t inlineCacheSlot() {
+    if (current->inlineCacheCount < UINT8_MAX) {
+        return (uint8_t)current->inlineCacheCount++;
     }
+    return UINT8_MAX;
 }
 
 static void generateExprDot(ObjExprDot* dot) {
@@ -597,12 +808,14 @@ static void generateExprDot(ObjExprDot* dot) {
     } else if (dot->assignment) {
         generateExpr(dot->assignment);
         emitBytes(OP_SET_PROPERTY, name);
+        emitByte(inlineCacheSlot());
     } else if (dot->call) {
         generateExprSet(&dot->call->arguments);
         emitBytes(OP_INVOKE, name);
-        emitByte(dot->call->arguments.objectCount);
+        emitBytes(dot->call->arguments.objectCount, inlineCacheSlot());
     } else {
         emitBytes(OP_GET_PROPERTY, name);
+        emitByte(inlineCacheSlot());
     }
 }
 
@@ -634,22 +847,26 @@ static void generateExprSuper(ObjExprSuper* super) {
     tempRootPop();
 }
 
-static void generateExprType(ObjExprTypeLiteral* type) {
-    switch (type->type) {
-        case EXPR_TYPE_LITERAL_BOOL: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_BOOL); return;
-        case EXPR_TYPE_LITERAL_INT8: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_INT8); return;
-        case EXPR_TYPE_LITERAL_UINT8: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_UINT8); return;
-        case EXPR_TYPE_LITERAL_INT16: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_INT16); return;
-        case EXPR_TYPE_LITERAL_UINT16: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_UINT16); return;
-        case EXPR_TYPE_LITERAL_INT32: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_INT32); return;
-        case EXPR_TYPE_LITERAL_MFLOAT64: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_MACHINE_FLOAT64); return;
-        case EXPR_TYPE_LITERAL_UINT32: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_UINT32); return;
-        case EXPR_TYPE_LITERAL_INT64: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_INT64); return;
-        case EXPR_TYPE_LITERAL_UINT64: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_UINT64); return;
-        case EXPR_TYPE_LITERAL_STRING: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_STRING); return;
-        case EXPR_TYPE_LITERAL_INT: emitBytes(OP_TYPE_LITERAL, TYPE_LITERAL_INT); return;
-        default: return; // unreachable.
+static uint8_t typeLiteralId(ExprTypeLiteral type) {
+    switch (type) {
+        case EXPR_TYPE_LITERAL_BOOL: return TYPE_LITERAL_BOOL;
+        case EXPR_TYPE_LITERAL_INT8: return TYPE_LITERAL_INT8;
+        case EXPR_TYPE_LITERAL_UINT8: return TYPE_LITERAL_UINT8;
+        case EXPR_TYPE_LITERAL_INT16: return TYPE_LITERAL_INT16;
+        case EXPR_TYPE_LITERAL_UINT16: return TYPE_LITERAL_UINT16;
+        case EXPR_TYPE_LITERAL_INT32: return TYPE_LITERAL_INT32;
+        case EXPR_TYPE_LITERAL_MFLOAT64: return TYPE_LITERAL_MACHINE_FLOAT64;
+        case EXPR_TYPE_LITERAL_UINT32: return TYPE_LITERAL_UINT32;
+        case EXPR_TYPE_LITERAL_INT64: return TYPE_LITERAL_INT64;
+        case EXPR_TYPE_LITERAL_UINT64: return TYPE_LITERAL_UINT64;
+        case EXPR_TYPE_LITERAL_STRING: return TYPE_LITERAL_STRING;
+        case EXPR_TYPE_LITERAL_INT: return TYPE_LITERAL_INT;
     }
+    return UINT8_MAX; // unreachable.
+}
+
+static void generateExprType(ObjExprTypeLiteral* type) {
+    emitBytes(OP_TYPE_LITERAL, typeLiteralId(type->type));
 }
 
 static void generateExprTypeStruct(ObjExprTypeStruct* struct_) {
@@ -672,7 +889,7 @@ static void generateExprTypeIndexedCollection(ObjExprTypeIndexedCollection* coll
     emitByte(OP_TYPE_INDEXED_COLLECTION);
 }
 
-static void generateExprElt(ObjExpr* expr) {
+static void generateExprElt(ObjExpr* expr, StaticType lhs) {
     
     switch (expr->obj.type) {
         case OBJ_EXPR_NUMBER: {
@@ -682,7 +899,7 @@ static void generateExprElt(ObjExpr* expr) {
         }
         case OBJ_EXPR_OPERATION: {
             ObjExprOperation* op = (ObjExprOperation*)expr;
-            generateExprOperation(op);
+            generateExprOperation(op, lhs);
             break;
         }
         case OBJ_EXPR_GROUPING: {
@@ -761,9 +978,31 @@ static void generateExprElt(ObjExpr* expr) {
 }
 
 static void generateExpr(ObjExpr* expr) {
+    StaticType type = STATIC_ANY;
 
     while (expr != NULL) {
-        generateExprElt(expr);
+        // a builtin that is called straight away doesn't need its callee on the stack.
+        if (expr->obj.type == OBJ_EXPR_BUILTIN
+            && expr->nextExpr && expr->nextExpr->obj.type == OBJ_EXPR_CALL) {
+            ObjExprCall* call = (ObjExprCall*)expr->nextExpr;
+            generateExprSet(&call->arguments);
+            emitByte(OP_CALL_BUILTIN);
+            emitBytes(builtinId((ObjExprBuiltin*)expr), call->arguments.objectCount);
+            type = builtinStaticType((ObjExprBuiltin*)expr);
+            expr = call->expr.nextExpr;
+            continue;
+        }
+        if (expr->nextExpr && expr->nextExpr->obj.type == OBJ_EXPR_OPERATION) {
+            ObjExprOperation* op = (ObjExprOperation*)expr->nextExpr;
+            StaticType rhs = exprStaticType(op->rhs);
+            if (promotesOperands(op->operation) && generatePromotedLiteral(expr, rhs)) {
+                type = rhs;
+                expr = expr->nextExpr;
+                continue;
+            }
+        }
+        generateExprElt(expr, type);
+        type = eltStaticType(expr, type);
         expr = expr->nextExpr;
     }
 }
@@ -792,23 +1031,52 @@ static void generateStmtPoke(ObjStmtPoke* stmt) {
     emitByte(OP_POKE);
 }
 
+// A typed variable's type is evaluated once, into a hidden local just below a local
+// variable, or straight into the cell of a global one. Stores to a typed local are
+// checked against that slot, unless the compiler can see the value already has the
+// type; stores to an untyped local aren't checked at all.
 static void generateVarDeclaration(ObjStmtVarDeclaration* decl) {
-    uint8_t global = parseVariable(decl->name);
+    if (!decl->type) {
+        uint8_t global = parseVariable(decl->name);
+        if (decl->initialiser) {
+            generateExpr(decl->initialiser);
+            emitByte(OP_INITIALISE);
+        } else {
+            emitByte(OP_NIL);
+        }
+        defineVariable(global);
+        return;
+    }
 
-    if (decl->type) {
-        generateExpr(decl->type);
+    StaticType declared = declaredStaticType(decl->type);
+    generateExpr(decl->type);
+    if (current->scopeDepth > 0) {
+        addLocal(copyString("", 0));
+        markInitialized();
     }
-    else {
-        emitByte(OP_NIL);
+
+    uint8_t global = parseVariable(decl->name);
+    if (current->scopeDepth > 0) {
+        current->locals[current->localCount - 1].isTyped = true;
+        current->locals[current->localCount - 1].staticType = declared;
     }
-    emitByte(OP_SET_CELL_TYPE);
 
-    if (decl->initialiser) {
+    if (decl->initialiser && declared != STATIC_ANY
+        && exprStaticType(decl->initialiser) == declared) {
         generateExpr(decl->initialiser);
-        emitByte(OP_INITIALISE);
+    } else {
+        emitByte(OP_TYPE_DEFAULT);
+        if (decl->initialiser) {
+            generateExpr(decl->initialiser);
+            emitByte(OP_INITIALISE_TYPED);
+        }
     }
 
-    defineVariable(global);
+    if (current->scopeDepth > 0) {
+        markInitialized();
+    } else {
+        emitBytes(OP_DEFINE_TYPED_GLOBAL, global);
+    }
 }
 
 static void generatePlaceDeclaration(ObjStmtPlaceDeclaration* decl) {
@@ -881,12 +1149,17 @@ static void generateFunction(FunctionType type, ObjStmtFunDeclaration* decl) {
 
     generate(decl->body);
 
+    current->function->arity = decl->parameters.objectCount;
     ObjFunction* function = endCompiler();
-    function->arity = decl->parameters.objectCount;
     emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
 
     for (int i = 0; i < function->upvalueCount; i++) {
-        emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+        uint8_t flags = 0;
+        if (compiler.upvalues[i].isLocal) {
+            flags = UPVALUE_LOCAL;
+            if (current->locals[compiler.upvalues[i].index].isTyped) flags |= UPVALUE_TYPED;
+        }
+        emitByte(flags);
         emitByte(compiler.upvalues[i].index);
     }
 }
@@ -931,6 +1204,17 @@ static void generateStmtYield(ObjStmtExpression* stmt) {
     }
 }
 
+// Whether an expression ends in a plain call, whose result is what is returned. A call
+// on a builtin is generated as OP_CALL_BUILTIN instead.
+static bool isTailCall(ObjExpr* expr) {
+    ObjExpr* previous = NULL;
+    while (expr->nextExpr != NULL) {
+        previous = expr;
+        expr = expr->nextExpr;
+    }
+    return expr->obj.type == OBJ_EXPR_CALL && previous != NULL && previous->obj.type != OBJ_EXPR_BUILTIN;
+}
+
 static void generateStmtReturn(ObjStmtExpression* stmt) {
     if (current->type == TYPE_SCRIPT) {
         errorAt("return", "Can't return from top-level code.");
@@ -944,6 +1228,9 @@ static void generateStmtReturn(ObjStmtExpression* stmt) {
         }
 
         generateExpr(stmt->expression);
+        if (isTailCall(stmt->expression)) {
+            currentChunk()->code[currentChunk()->count - 2] = OP_TAIL_CALL;
+        }
         emitByte(OP_RETURN);
     }
 }
@@ -1124,8 +1411,131 @@ static void generate(ObjStmt* stmt) {
     }
 }
 
+static int jumpTarget(Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    int jump = (code[1] << 8) | code[2];
+    return code[0] == OP_LOOP ? offset + 3 - jump : offset + 3 + jump;
+}
+
+static void setJump(Chunk* chunk, int offset, uint8_t instruction, int jump) {
+    chunk->code[offset] = instruction;
+    chunk->code[offset + 1] = (jump >> 8) & 0xff;
+    chunk->code[offset + 2] = jump & 0xff;
+}
+
+static bool isOpInGroup(uint8_t instruction, uint8_t generic, uint8_t specialised) {
+    return instruction == generic || (instruction >= specialised && instruction <= specialised + 3);
+}
+
+// The length of an immediate OP_LOCAL_ARITH_CONST and OP_LOCAL_COMPARE_CONST_JUMP can
+// take as their operand, or 0.
+static int fusableImmediateLength(Chunk* chunk, int offset) {
+    if (offset >= chunk->count) return 0;
+    switch (chunk->code[offset]) {
+        case OP_IMMEDIATE_P8:
+        case OP_IMMEDIATE_N8:
+        case OP_IMMEDIATE_P16:
+        case OP_IMMEDIATE_N16:
+        case OP_IMMEDIATE_P24:
+        case OP_IMMEDIATE_N24:
+            return chunkInstructionLength(chunk, offset);
+        case OP_IMMEDIATE_TYPED:
+            if (chunk->code[offset + 1] == TYPE_LITERAL_INT32 || chunk->code[offset + 1] == TYPE_LITERAL_UINT32) {
+                return chunkInstructionLength(chunk, offset);
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static bool isPopAt(Chunk* chunk, int offset) {
+    return offset < chunk->count && chunk->code[offset] == OP_POP;
+}
+
+static void fuseGetLocal(Chunk* chunk, int offset) {
+    int next = offset + 2;
+    if (next + 2 < chunk->count && chunk->code[next] == OP_GET_LOCAL
+        && isOpInGroup(chunk->code[next + 2], OP_ADD, OP_ADD_SMALL_INT)) {
+        chunk->code[offset] = OP_ADD_LOCALS;
+        return;
+    }
+
+    int immediateLength = fusableImmediateLength(chunk, next);
+    int op = next + immediateLength;
+    if (immediateLength == 0 || op >= chunk->count) return;
+
+    uint8_t instruction = chunk->code[op];
+    if (isOpInGroup(instruction, OP_LESS, OP_LESS_SMALL_INT) || isOpInGroup(instruction, OP_GREATER, OP_GREATER_SMALL_INT)) {
+        int jump = op + 1;
+        if (jump + 3 < chunk->count && chunk->code[jump] == OP_JUMP_IF_FALSE
+            && isPopAt(chunk, jump + 3) && isPopAt(chunk, jumpTarget(chunk, jump))) {
+            chunk->code[offset] = OP_LOCAL_COMPARE_CONST_JUMP;
+        }
+    } else if (isOpInGroup(instruction, OP_ADD, OP_ADD_SMALL_INT) || isOpInGroup(instruction, OP_SUBTRACT, OP_SUBTRACT_SMALL_INT)) {
+        chunk->code[offset] = OP_LOCAL_ARITH_CONST;
+    }
+}
+
+// A jump to an unconditional jump goes straight to where that one leads, becoming a loop
+// if that is backwards.
+static void threadJump(Chunk* chunk, int offset) {
+    int target = jumpTarget(chunk, offset);
+    bool threaded = false;
+    while (target < chunk->count && chunk->code[target] == OP_JUMP) {
+        target = jumpTarget(chunk, target);
+        threaded = true;
+    }
+
+    if (target < chunk->count && chunk->code[target] == OP_LOOP) {
+        int loopTarget = jumpTarget(chunk, target);
+        if (loopTarget < offset + 3) {
+            setJump(chunk, offset, OP_LOOP, offset + 3 - loopTarget);
+            return;
+        }
+    }
+    if (threaded && target - (offset + 3) <= UINT16_MAX) {
+        setJump(chunk, offset, OP_JUMP, target - (offset + 3));
+    }
+}
+
+// Rewrites common instruction sequences as superinstructions, which are written in
+// place, so jump offsets and the line table still hold.
+static void peephole(Chunk* chunk) {
+    int offset = 0;
+    while (offset < chunk->count) {
+        int next = offset + chunkInstructionLength(chunk, offset);
+        switch (chunk->code[offset]) {
+            case OP_GET_LOCAL:
+                fuseGetLocal(chunk, offset);
+                break;
+            case OP_SET_LOCAL:
+                if (isPopAt(chunk, next)) chunk->code[offset] = OP_SET_LOCAL_POP;
+                break;
+            case OP_SET_GLOBAL:
+                if (isPopAt(chunk, next)) chunk->code[offset] = OP_SET_GLOBAL_POP;
+                break;
+            case OP_JUMP_IF_FALSE:
+                if (isPopAt(chunk, next) && isPopAt(chunk, jumpTarget(chunk, offset))) {
+                    chunk->code[offset] = OP_POP_JUMP_IF_FALSE;
+                }
+                break;
+            case OP_JUMP:
+                threadJump(chunk, offset);
+                break;
+            default:
+                break;
+        }
+        offset = next;
+    }
+}
+
 static ObjFunction* endCompiler() {
     emitReturn();
+    if (!current->hadError) {
+        peephole(currentChunk());
+    }
+    current->function->maxStackDepth = chunkStackDepth(currentChunk(), current->function->arity);
 
     current->ast = NULL;
     current->recent = NULL;
@@ -1158,7 +1568,9 @@ ObjFunction* compile(const char* source) {
 #endif
 
     if (!parseError) {
-
+#if defined(CYARG_AST_OPTIMISE)
+        optimiseAst(current->ast);
+#endif
         generate(current->ast->statements);
     }
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <assert.h>
 
@@ -30,7 +31,7 @@ void disassembleChunk(Chunk* chunk, const char* name) {
 }
 
 static char const *valueType(Value *v) {
-    switch (v->type) {
+    switch (VALUE_TYPE(*v)) {
     case VAL_BOOL: return "bool";
     case VAL_NIL: return "";
     case VAL_DOUBLE: return "double";
@@ -43,6 +44,7 @@ static char const *valueType(Value *v) {
     case VAL_UI64: return "ui64";
     case VAL_I64: return "i64";
     case VAL_ADDRESS: return "address";
+    case VAL_SMALL_INT: return "int";
     case VAL_OBJ:
         switch (AS_OBJ(*v)->type) {
         case OBJ_INT: return "int";
@@ -70,6 +72,25 @@ static int invokeInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 3;
 }
 
+static int cachedInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t constant = chunk->code[offset + 1];
+    uint8_t cache = chunk->code[offset + 2];
+    printf("%-16s %4d ", name, constant);
+    printValue(chunk->constants.values[constant]);
+    printf(" ic %d\n", cache);
+    return offset + 3;
+}
+
+static int cachedInvokeInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t constant = chunk->code[offset + 1];
+    uint8_t argCount = chunk->code[offset + 2];
+    uint8_t cache = chunk->code[offset + 3];
+    printf("%-16s (%d args) %4d:'", name, argCount, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("' ic %d\n", cache);
+    return offset + 4;
+}
+
 static int simpleInstruction(const char* name, int offset) {
     printf("%s\n", name);
     return offset + 1;
@@ -103,9 +124,7 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
     return offset + 3;
 }
 
-static int builtinInstruction(const char* name, Chunk* chunk, int offset) {
-    uint8_t slot = chunk->code[offset + 1];
-    printf("%-16s ", name);
+static void printBuiltin(uint8_t slot) {
     switch (slot) {
         case BUILTIN_PEEK: printf("peek"); break;
         case BUILTIN_READ_YARG_SOURCE: printf("read_yarg_source"); break;
@@ -141,13 +160,23 @@ static int builtinInstruction(const char* name, Chunk* chunk, int offset) {
         case BUILTIN_LOAD: printf("load"); break;
         default: printf("<unknown %4d>", slot); break;
     }
+}
+
+static int builtinInstruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-16s ", name);
+    printBuiltin(chunk->code[offset + 1]);
     printf("\n");
     return offset + 2;
 }
 
-static int typeLiteralInstruction(const char* name, Chunk* chunk, int offset) {
-    uint8_t type = chunk->code[offset + 1];
+static int callBuiltinInstruction(const char* name, Chunk* chunk, int offset) {
     printf("%-16s ", name);
+    printBuiltin(chunk->code[offset + 1]);
+    printf(" %d\n", chunk->code[offset + 2]);
+    return offset + 3;
+}
+
+static void printTypeLiteral(uint8_t type) {
     switch (type) {
         case TYPE_LITERAL_BOOL: printf("bool"); break;
         case TYPE_LITERAL_INT8: printf("int8"); break;
@@ -163,10 +192,34 @@ static int typeLiteralInstruction(const char* name, Chunk* chunk, int offset) {
         case TYPE_LITERAL_INT: printf("int"); break;
         default: printf("<unknown %4d>", type); break;
     }
+}
+
+static int typeLiteralInstruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-16s ", name);
+    printTypeLiteral(chunk->code[offset + 1]);
     printf("\n");
     return offset + 2;
 }
 
+static int typedImmediateInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t type = chunk->code[offset + 1];
+    int length = typedImmediateLength(type);
+    uint64_t bits = 0;
+    for (int i = 0; i < length; i++) {
+        bits |= (uint64_t)chunk->code[offset + 2 + i] << (8 * i);
+    }
+    printf("%-16s ", name);
+    printTypeLiteral(type);
+    if (type == TYPE_LITERAL_UINT8 || type == TYPE_LITERAL_UINT16
+        || type == TYPE_LITERAL_UINT32 || type == TYPE_LITERAL_UINT64) {
+        printf(" %" PRIu64 "\n", bits);
+    } else {
+        int shift = 64 - 8 * length;
+        printf(" %" PRId64 "\n", (int64_t)(bits << shift) >> shift);
+    }
+    return offset + 2 + length;
+}
+
 int disassembleInstruction(Chunk* chunk, int offset) {
     printf("%04d ", offset);
     for (int s = 0;; s++) {
@@ -197,22 +250,28 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return byteInstruction("OP_GET_LOCAL", chunk, offset);
         case OP_SET_LOCAL:
             return byteInstruction("OP_SET_LOCAL", chunk, offset);
+        case OP_SET_LOCAL_TYPED:
+            return byteInstruction("OP_SET_LOCAL_TYPED", chunk, offset);
         case OP_GET_GLOBAL:
             return constantInstruction("OP_GET_GLOBAL", chunk, offset);
         case OP_DEFINE_GLOBAL:
             return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        case OP_DEFINE_TYPED_GLOBAL:
+            return constantInstruction("OP_DEFINE_TYPED_GLOBAL", chunk, offset);
         case OP_SET_GLOBAL:
             return constantInstruction("OP_SET_GLOBAL", chunk, offset);
         case OP_INITIALISE:
             return simpleInstruction("OP_INITIALISE", offset);
+        case OP_INITIALISE_TYPED:
+            return simpleInstruction("OP_INITIALISE_TYPED", offset);
         case OP_GET_UPVALUE:
             return byteInstruction("OP_GET_UPVALUE", chunk, offset);
         case OP_SET_UPVALUE:
             return byteInstruction("OP_SET_UPVALUE", chunk, offset);
         case OP_GET_PROPERTY:
-            return constantInstruction("OP_GET_PROPERTY", chunk, offset);
+            return cachedInstruction("OP_GET_PROPERTY", chunk, offset);
         case OP_SET_PROPERTY:
-            return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+            return cachedInstruction("OP_SET_PROPERTY", chunk, offset);
         case OP_GET_SUPER:
             return constantInstruction("OP_GET_SUPER", chunk, offset);
         case OP_EQUAL:
@@ -257,8 +316,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return jumpInstruction("OP_LOOP", -1, chunk, offset);
         case OP_CALL:
             return byteInstruction("OP_CALL", chunk, offset);
+        case OP_TAIL_CALL:
+            return byteInstruction("OP_TAIL_CALL", chunk, offset);
+        case OP_CALL_BUILTIN:
+            return callBuiltinInstruction("OP_CALL_BUILTIN", chunk, offset);
         case OP_INVOKE:
-            return invokeInstruction("OP_INVOKE", chunk, offset);
+            return cachedInvokeInstruction("OP_INVOKE", chunk, offset);
         case OP_SUPER_INVOKE:
             return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
         case OP_CLOSURE: {
@@ -273,8 +336,9 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             for (int j = 0; j < function->upvalueCount; j++) {
                 int isLocal = chunk->code[offset++];
                 int index = chunk->code[offset++];
-                printf("%04d       |                    %s %d\n",
-                       offset - 2, isLocal ? "local" : "upvalue", index);
+                printf("%04d       |                    %s %d%s\n",
+                       offset - 2, isLocal ? "local" : "upvalue", index,
+                       isLocal & UPVALUE_TYPED ? " typed" : "");
             }
 
             return offset;
@@ -313,14 +377,68 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return byteInstruction("OP_TYPE_STRUCT", chunk, offset);
         case OP_TYPE_INDEXED_COLLECTION:
             return simpleInstruction("OP_TYPE_INDEXED_COLLECTION", offset);
-        case OP_SET_CELL_TYPE:
-            return simpleInstruction("OP_SET_CELL_TYPE", offset);
+        case OP_TYPE_DEFAULT:
+            return simpleInstruction("OP_TYPE_DEFAULT", offset);
         case OP_DEREF_PTR:
             return simpleInstruction("OP_DEREF_PTR", offset);
         case OP_SET_PTR_TARGET:
             return simpleInstruction("OP_SET_PTR_TARGET", offset);
         case OP_PLACE:
             return simpleInstruction("OP_PLACE", offset);
+        case OP_IMMEDIATE_TYPED:
+            return typedImmediateInstruction("OP_IMMEDIATE_TYPED", chunk, offset);
+        case OP_ADD_SMALL_INT:
+            return simpleInstruction("OP_ADD_SMALL_INT", offset);
+        case OP_ADD_I32:
+            return simpleInstruction("OP_ADD_I32", offset);
+        case OP_ADD_UI32:
+            return simpleInstruction("OP_ADD_UI32", offset);
+        case OP_ADD_DOUBLE:
+            return simpleInstruction("OP_ADD_DOUBLE", offset);
+        case OP_SUBTRACT_SMALL_INT:
+            return simpleInstruction("OP_SUBTRACT_SMALL_INT", offset);
+        case OP_SUBTRACT_I32:
+            return simpleInstruction("OP_SUBTRACT_I32", offset);
+        case OP_SUBTRACT_UI32:
+            return simpleInstruction("OP_SUBTRACT_UI32", offset);
+        case OP_SUBTRACT_DOUBLE:
+            return simpleInstruction("OP_SUBTRACT_DOUBLE", offset);
+        case OP_MULTIPLY_SMALL_INT:
+            return simpleInstruction("OP_MULTIPLY_SMALL_INT", offset);
+        case OP_MULTIPLY_I32:
+            return simpleInstruction("OP_MULTIPLY_I32", offset);
+        case OP_MULTIPLY_UI32:
+            return simpleInstruction("OP_MULTIPLY_UI32", offset);
+        case OP_MULTIPLY_DOUBLE:
+            return simpleInstruction("OP_MULTIPLY_DOUBLE", offset);
+        case OP_LESS_SMALL_INT:
+            return simpleInstruction("OP_LESS_SMALL_INT", offset);
+        case OP_LESS_I32:
+            return simpleInstruction("OP_LESS_I32", offset);
+        case OP_LESS_UI32:
+            return simpleInstruction("OP_LESS_UI32", offset);
+        case OP_LESS_DOUBLE:
+            return simpleInstruction("OP_LESS_DOUBLE", offset);
+        case OP_GREATER_SMALL_INT:
+            return simpleInstruction("OP_GREATER_SMALL_INT", offset);
+        case OP_GREATER_I32:
+            return simpleInstruction("OP_GREATER_I32", offset);
+        case OP_GREATER_UI32:
+            return simpleInstruction("OP_GREATER_UI32", offset);
+        case OP_GREATER_DOUBLE:
+            return simpleInstruction("OP_GREATER_DOUBLE", offset);
+        case OP_SET_LOCAL_POP:
+            return byteInstruction("OP_SET_LOCAL_POP", chunk, offset);
+        case OP_SET_GLOBAL_POP:
+            return constantInstruction("OP_SET_GLOBAL_POP", chunk, offset);
+        case OP_POP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_ADD_LOCALS:
+            return byteInstruction("OP_ADD_LOCALS", chunk, offset);
+        case OP_LOCAL_ARITH_CONST:
+            return byteInstruction("OP_LOCAL_ARITH_CONST", chunk, offset);
+        case OP_LOCAL_COMPARE_CONST_JUMP:
+            return byteInstruction("OP_LOCAL_COMPARE_CONST_JUMP", chunk, offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
@@ -0,0 +1,699 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+#include "chunk.h"
+#include "common.h"
+#include "quicken.h"
+#include "vm.h"
+
+#if defined(CYARG_COMPACT_VALUE) || !defined(__x86_64__)
+#error "The JIT emits x86-64 code for 16 byte values."
+#endif
+
+_Static_assert(sizeof(ValueType) == 4 && sizeof(AnyValue) == 8, "templates address a Value as a type and a payload");
+_Static_assert(sizeof(ExecState) == 4, "templates compare the routine state as 32 bits");
+
+// Compiled code runs one frame, holding its slots in rbx and a pointer to the routine's
+// state in r12. The value stack stays in the frame's slots, at the depth the bytecode
+// has it, so the interpreter can take over at any instruction. Each instruction has a
+// template of native code; those that have none, and type guards that fail, return the
+// bytecode offset and stack depth to resume at.
+typedef uint64_t (*JitFn)(Value* slots, const uint8_t* entry, volatile ExecState* state);
+
+#define EXIT_DEOPT ((uint64_t)1 << 63)
+#define EXIT_CODE(offset, depth, deopt) \
+    ((uint64_t)(uint32_t)(offset) | ((uint64_t)(uint32_t)(depth) << 32) | ((deopt) ? EXIT_DEOPT : 0))
+#define EXIT_OFFSET(exit) ((uint32_t)(exit))
+#define EXIT_DEPTH(exit) ((uint32_t)((exit) >> 32) & 0x7fffffff)
+
+#define TYPE_AT(depth) ((int32_t)((depth) * sizeof(Value) + offsetof(Value, type)))
+#define PAYLOAD_AT(depth) ((int32_t)((depth) * sizeof(Value) + offsetof(Value, as)))
+#define LITERAL_AT(depth) ((int32_t)((depth) * sizeof(Value) + offsetof(Value, as.smallInt.isLiteral)))
+#define VALUE_AT(depth) ((int32_t)((depth) * sizeof(Value)))
+
+enum { RAX = 0, RCX = 1, RBX = 3, RSI = 6, RDI = 7 };
+enum { CC_O = 0x0, CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_L = 0xc, CC_G = 0xf };
+
+static bool jitEnabled = true;
+
+void initJit() {
+    const char* setting = getenv("CYARG_JIT");
+    jitEnabled = setting == NULL || strcmp(setting, "off") != 0;
+}
+
+void freeJitCode(JitCode* jit) {
+    if (jit == NULL) return;
+    if (jit->code != NULL) {
+        munmap(jit->code, jit->size);
+    }
+    free(jit->entries);
+    free(jit);
+}
+
+typedef struct {
+    size_t at;      // of the rel32 to patch
+    int offset;     // bytecode offset it goes to
+    bool deopt;
+} Exit;
+
+typedef struct {
+    size_t at;
+    int target;
+} Fixup;
+
+// Buffers are scratch space from malloc, as in chunkStackDepth(); only the finished code
+// is mapped executable.
+typedef struct {
+    uint8_t* bytes;
+    size_t count;
+    size_t capacity;
+    Exit* exits;
+    int exitCount;
+    int exitCapacity;
+    Fixup* fixups;
+    int fixupCount;
+    int fixupCapacity;
+    bool failed;
+
+    Chunk* chunk;
+    int* depths;
+    int32_t* native;
+    int offset;     // of the instruction being compiled
+    int depth;      // of the stack before it
+} Assembler;
+
+static bool reserve(void** array, int* capacity, int count, size_t size) {
+    if (count < *capacity) return true;
+    int grown = *capacity < 8 ? 8 : *capacity * 2;
+    void* resized = realloc(*array, grown * size);
+    if (resized == NULL) return false;
+    *array = resized;
+    *capacity = grown;
+    return true;
+}
+
+static void emitByte(Assembler* as, uint8_t byte) {
+    if (as->count == as->capacity) {
+        size_t grown = as->capacity < 256 ? 256 : as->capacity * 2;
+        uint8_t* resized = realloc(as->bytes, grown);
+        if (resized == NULL) {
+            as->failed = true;
+            as->count = 0;
+            return;
+        }
+        as->bytes = resized;
+        as->capacity = grown;
+    }
+    as->bytes[as->count++] = byte;
+}
+
+static void emitBytes(Assembler* as, const uint8_t* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        emitByte(as, bytes[i]);
+    }
+}
+
+#define EMIT(as, ...) emitBytes((as), (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void emit32(Assembler* as, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        emitByte(as, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void emit64(Assembler* as, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        emitByte(as, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void patch32(Assembler* as, size_t at, size_t to) {
+    if (as->failed) return;
+    int32_t relative = (int32_t)(to - (at + 4));
+    memcpy(&as->bytes[at], &relative, sizeof(relative));
+}
+
+// ModRM for [base + disp32]; the base is never rsp or r12, which would need a SIB byte.
+static void emitMemory(Assembler* as, int reg, int base, int32_t disp) {
+    emitByte(as, (uint8_t)(0x80 | (reg << 3) | base));
+    emit32(as, (uint32_t)disp);
+}
+
+static size_t jumpIf(Assembler* as, int condition) {
+    EMIT(as, 0x0f, 0x80 | condition);
+    emit32(as, 0);
+    return as->count - 4;
+}
+
+static size_t jump(Assembler* as) {
+    EMIT(as, 0xe9);
+    emit32(as, 0);
+    return as->count - 4;
+}
+
+static void land(Assembler* as, size_t at) {
+    patch32(as, at, as->count);
+}
+
+static void exitAt(Assembler* as, size_t at, bool deopt) {
+    if (!reserve((void**)&as->exits, &as->exitCapacity, as->exitCount, sizeof(Exit))) {
+        as->failed = true;
+        return;
+    }
+    as->exits[as->exitCount++] = (Exit){ .at = at, .offset = as->offset, .deopt = deopt };
+}
+
+static void exitIf(Assembler* as, int condition, bool deopt) {
+    exitAt(as, jumpIf(as, condition), deopt);
+}
+
+static void jumpTo(Assembler* as, size_t at, int target) {
+    if (!reserve((void**)&as->fixups, &as->fixupCapacity, as->fixupCount, sizeof(Fixup))) {
+        as->failed = true;
+        return;
+    }
+    as->fixups[as->fixupCount++] = (Fixup){ .at = at, .target = target };
+}
+
+static void movImmediate64(Assembler* as, int reg, uint64_t value) {
+    EMIT(as, 0x48, 0xb8 + reg);
+    emit64(as, value);
+}
+
+// cmp dword [base + disp], imm32
+static void compareType(Assembler* as, int base, int32_t disp, ValueType type) {
+    EMIT(as, 0x81);
+    emitMemory(as, 7, base, disp);
+    emit32(as, (uint32_t)type);
+}
+
+// movdqu xmm0, [from]; movdqu [to], xmm0
+static void copyValue(Assembler* as, int fromBase, int32_t from, int toBase, int32_t to) {
+    EMIT(as, 0xf3, 0x0f, 0x6f);
+    emitMemory(as, 0, fromBase, from);
+    EMIT(as, 0xf3, 0x0f, 0x7f);
+    emitMemory(as, 0, toBase, to);
+}
+
+static void storeConstant(Assembler* as, int depth, Value value) {
+    uint64_t halves[2];
+    memcpy(halves, &value, sizeof(halves));
+    movImmediate64(as, RAX, halves[0]);
+    EMIT(as, 0x48, 0x89);
+    emitMemory(as, RAX, RBX, VALUE_AT(depth));
+    movImmediate64(as, RAX, halves[1]);
+    EMIT(as, 0x48, 0x89);
+    emitMemory(as, RAX, RBX, VALUE_AT(depth) + 8);
+}
+
+static void callHelper(Assembler* as, void* function) {
+    movImmediate64(as, RAX, (uint64_t)(uintptr_t)function);
+    EMIT(as, 0xff, 0xd0);
+}
+
+// As noLongerLiteralInt() on the value at [base + disp]; only an int object needs the call.
+static void clearLiteral(Assembler* as, int base, int32_t disp) {
+    compareType(as, base, disp + (int32_t)offsetof(Value, type), VAL_SMALL_INT);
+    size_t notSmall = jumpIf(as, CC_NE);
+    EMIT(as, 0xc6);
+    emitMemory(as, 0, base, disp + (int32_t)offsetof(Value, as.smallInt.isLiteral));
+    EMIT(as, 0x00);
+    size_t done = jump(as);
+    land(as, notSmall);
+    compareType(as, base, disp + (int32_t)offsetof(Value, type), VAL_OBJ);
+    size_t notObject = jumpIf(as, CC_NE);
+    EMIT(as, 0x48, 0x8d);
+    emitMemory(as, RDI, base, disp);
+    callHelper(as, (void*)noLongerLiteralInt);
+    land(as, done);
+    land(as, notObject);
+}
+
+// Either operand may be a literal int that promote() would make the other's type, but
+// not both, as a literal only takes the type of a typed operand.
+static void guardPromotable(Assembler* as, int depth, ValueType type) {
+    compareType(as, RBX, TYPE_AT(depth), type);
+    size_t typed = jumpIf(as, CC_E);
+    compareType(as, RBX, TYPE_AT(depth), VAL_SMALL_INT);
+    exitIf(as, CC_NE, true);
+    EMIT(as, 0x80);
+    emitMemory(as, 7, RBX, LITERAL_AT(depth));
+    EMIT(as, 0x00);
+    exitIf(as, CC_E, true);
+    if (type == VAL_UI32) {
+        EMIT(as, 0x81);
+        emitMemory(as, 7, RBX, PAYLOAD_AT(depth));
+        emit32(as, 0);
+        exitIf(as, CC_L, true);
+    }
+    land(as, typed);
+}
+
+static void guardOperands(Assembler* as, ValueType type, bool deopt) {
+    int a = as->depth - 2;
+    int b = as->depth - 1;
+    if (type == VAL_I32 || type == VAL_UI32) {
+        guardPromotable(as, a, type);
+        guardPromotable(as, b, type);
+        compareType(as, RBX, TYPE_AT(a), type);
+        size_t typed = jumpIf(as, CC_E);
+        compareType(as, RBX, TYPE_AT(b), type);
+        exitIf(as, CC_NE, true);
+        land(as, typed);
+    } else {
+        compareType(as, RBX, TYPE_AT(a), type);
+        exitIf(as, CC_NE, deopt);
+        compareType(as, RBX, TYPE_AT(b), type);
+        exitIf(as, CC_NE, deopt);
+    }
+}
+
+typedef enum { ARITH_ADD, ARITH_SUBTRACT, ARITH_MULTIPLY, ARITH_LESS, ARITH_GREATER } Arith;
+
+// The result replaces the first operand; a 32 bit result is written as 64 bits, which
+// also clears the literal flag of a small int.
+static void arithmetic(Assembler* as, Arith op, ValueType type, bool deopt) {
+    int a = as->depth - 2;
+    int b = as->depth - 1;
+    guardOperands(as, type, deopt);
+
+    if (type == VAL_DOUBLE) {
+        static const uint8_t opcodes[] = { 0x58, 0x5c, 0x59 };
+        if (op == ARITH_LESS || op == ARITH_GREATER) {
+            // comisd leaves a NaN unordered, which seta treats as false
+            EMIT(as, 0xf2, 0x0f, 0x10);
+            emitMemory(as, 0, RBX, PAYLOAD_AT(op == ARITH_LESS ? b : a));
+            EMIT(as, 0x66, 0x0f, 0x2f);
+            emitMemory(as, 0, RBX, PAYLOAD_AT(op == ARITH_LESS ? a : b));
+            EMIT(as, 0x0f, 0x90 | CC_A, 0xc0);
+        } else {
+            EMIT(as, 0xf2, 0x0f, 0x10);
+            emitMemory(as, 0, RBX, PAYLOAD_AT(a));
+            EMIT(as, 0xf2, 0x0f, opcodes[op]);
+            emitMemory(as, 0, RBX, PAYLOAD_AT(b));
+            EMIT(as, 0xf2, 0x0f, 0x11);
+            emitMemory(as, 0, RBX, PAYLOAD_AT(a));
+            return;
+        }
+    } else {
+        EMIT(as, 0x8b);
+        emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+        switch (op) {
+            case ARITH_ADD: EMIT(as, 0x03); break;
+            case ARITH_SUBTRACT: EMIT(as, 0x2b); break;
+            case ARITH_MULTIPLY: EMIT(as, 0x0f, 0xaf); break;
+            default: EMIT(as, 0x3b); break;
+        }
+        emitMemory(as, RAX, RBX, PAYLOAD_AT(b));
+
+        if (op == ARITH_LESS || op == ARITH_GREATER) {
+            bool isUnsigned = type == VAL_UI32;
+            int condition = op == ARITH_LESS ? (isUnsigned ? CC_B : CC_L) : (isUnsigned ? CC_A : CC_G);
+            EMIT(as, 0x0f, 0x90 | condition, 0xc0);
+        } else {
+            // a small int result that needs an int object is left to the interpreter
+            if (type == VAL_SMALL_INT) {
+                exitIf(as, CC_O, deopt);
+            }
+            if (type == VAL_I32 || type == VAL_UI32) {
+                compareType(as, RBX, TYPE_AT(a), type);
+                size_t typed = jumpIf(as, CC_E);
+                EMIT(as, 0xc7);
+                emitMemory(as, 0, RBX, TYPE_AT(a));
+                emit32(as, (uint32_t)type);
+                land(as, typed);
+            }
+            EMIT(as, 0x48, 0x89);
+            emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+            return;
+        }
+    }
+
+    // movzx eax, al; the boolean replaces the first operand
+    EMIT(as, 0x0f, 0xb6, 0xc0);
+    EMIT(as, 0x48, 0xc7);
+    emitMemory(as, 0, RBX, TYPE_AT(a));
+    emit32(as, VAL_BOOL);
+    EMIT(as, 0x48, 0x89);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+}
+
+static void equal(Assembler* as) {
+    int a = as->depth - 2;
+    int b = as->depth - 1;
+    EMIT(as, 0x8b);
+    emitMemory(as, RAX, RBX, TYPE_AT(a));
+    EMIT(as, 0x3b);
+    emitMemory(as, RAX, RBX, TYPE_AT(b));
+    exitIf(as, CC_NE, false);
+
+    size_t words[3];
+    ValueType wordTypes[] = { VAL_SMALL_INT, VAL_I32, VAL_UI32 };
+    for (int i = 0; i < 3; i++) {
+        EMIT(as, 0x3d);
+        emit32(as, wordTypes[i]);
+        words[i] = jumpIf(as, CC_E);
+    }
+    EMIT(as, 0x3d);
+    emit32(as, VAL_BOOL);
+    exitIf(as, CC_NE, false);
+    EMIT(as, 0x8a);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+    EMIT(as, 0x3a);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(b));
+    size_t compared = jump(as);
+    for (int i = 0; i < 3; i++) {
+        land(as, words[i]);
+    }
+    EMIT(as, 0x8b);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+    EMIT(as, 0x3b);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(b));
+    land(as, compared);
+
+    EMIT(as, 0x0f, 0x90 | CC_E, 0xc0);
+    EMIT(as, 0x0f, 0xb6, 0xc0);
+    EMIT(as, 0x48, 0xc7);
+    emitMemory(as, 0, RBX, TYPE_AT(a));
+    emit32(as, VAL_BOOL);
+    EMIT(as, 0x48, 0x89);
+    emitMemory(as, RAX, RBX, PAYLOAD_AT(a));
+}
+
+// Jumps to the target if the top of the stack is nil or false, as isFalsey().
+static void jumpIfFalsey(Assembler* as, int target) {
+    int top = as->depth - 1;
+    EMIT(as, 0x8b);
+    emitMemory(as, RAX, RBX, TYPE_AT(top));
+    EMIT(as, 0x3d);
+    emit32(as, VAL_NIL);
+    jumpTo(as, jumpIf(as, CC_E), target);
+    EMIT(as, 0x3d);
+    emit32(as, VAL_BOOL);
+    size_t truthy = jumpIf(as, CC_NE);
+    EMIT(as, 0x80);
+    emitMemory(as, 7, RBX, PAYLOAD_AT(top));
+    EMIT(as, 0x00);
+    jumpTo(as, jumpIf(as, CC_E), target);
+    land(as, truthy);
+}
+
+static void logicalNot(Assembler* as) {
+    int top = as->depth - 1;
+    EMIT(as, 0xb9);
+    emit32(as, 1);
+    EMIT(as, 0x8b);
+    emitMemory(as, RAX, RBX, TYPE_AT(top));
+    EMIT(as, 0x3d);
+    emit32(as, VAL_NIL);
+    size_t isNil = jumpIf(as, CC_E);
+    EMIT(as, 0x3d);
+    emit32(as, VAL_BOOL);
+    size_t notBool = jumpIf(as, CC_NE);
+    EMIT(as, 0x80);
+    emitMemory(as, 7, RBX, PAYLOAD_AT(top));
+    EMIT(as, 0x00);
+    size_t isFalse = jumpIf(as, CC_E);
+    land(as, notBool);
+    EMIT(as, 0x31, 0xc9);
+    land(as, isNil);
+    land(as, isFalse);
+    EMIT(as, 0x48, 0xc7);
+    emitMemory(as, 0, RBX, TYPE_AT(top));
+    emit32(as, VAL_BOOL);
+    EMIT(as, 0x48, 0x89);
+    emitMemory(as, RCX, RBX, PAYLOAD_AT(top));
+}
+
+static ValueCell* boundGlobal(Chunk* chunk, uint8_t constant) {
+    if (chunk->globalCells == NULL || constant >= chunk->globalCellCount) return NULL;
+    return chunk->globalCells[constant];
+}
+
+// An assignment to a typed global, when the value is not an object, so that the check
+// of its type allocates nothing.
+static bool assignTypedGlobal(ValueCell* cell, Value* value) {
+    if (IS_OBJ(*value)) return false;
+    ValueCellTarget target = { .cellType = cell->cellType, .value = &cell->value };
+    return assignToValueCellTarget(target, *value);
+}
+
+static void setGlobal(Assembler* as, ValueCell* cell) {
+    int top = as->depth - 1;
+    movImmediate64(as, RAX, (uint64_t)(uintptr_t)cell);
+    EMIT(as, 0x48, 0x83, 0x78, (uint8_t)offsetof(ValueCell, cellType), 0x00);
+    size_t typed = jumpIf(as, CC_NE);
+    copyValue(as, RBX, VALUE_AT(top), RAX, 0);
+    clearLiteral(as, RAX, 0);
+    size_t done = jump(as);
+    land(as, typed);
+    EMIT(as, 0x48, 0x89, 0xc7);
+    EMIT(as, 0x48, 0x8d);
+    emitMemory(as, RSI, RBX, VALUE_AT(top));
+    callHelper(as, (void*)assignTypedGlobal);
+    EMIT(as, 0x84, 0xc0);
+    exitIf(as, CC_E, true);
+    land(as, done);
+}
+
+static Value immediateValue(uint8_t* code) {
+    uint8_t instruction = code[0];
+    if (instruction == OP_IMMEDIATE_TYPED) {
+        int length = typedImmediateLength(code[1]);
+        uint64_t bits = 0;
+        for (int i = 0; i < length; i++) {
+            bits |= (uint64_t)code[2 + i] << (8 * i);
+        }
+        switch (code[1]) {
+            case TYPE_LITERAL_INT8: return I8_VAL((int8_t)bits);
+            case TYPE_LITERAL_UINT8: return UI8_VAL((uint8_t)bits);
+            case TYPE_LITERAL_INT16: return I16_VAL((int16_t)bits);
+            case TYPE_LITERAL_UINT16: return UI16_VAL((uint16_t)bits);
+            case TYPE_LITERAL_INT32: return I32_VAL((int32_t)bits);
+            case TYPE_LITERAL_UINT32: return UI32_VAL((uint32_t)bits);
+            case TYPE_LITERAL_INT64: return I64_VAL((int64_t)bits);
+            case TYPE_LITERAL_UINT64: return UI64_VAL(bits);
+            default: return SMALL_INT_VAL((int32_t)bits);
+        }
+    }
+
+    uint32_t num = code[1];
+    if (instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_P16 || instruction == OP_IMMEDIATE_N24 || instruction == OP_IMMEDIATE_P24) {
+        num += 256 * code[2];
+    }
+    if (instruction == OP_IMMEDIATE_N24 || instruction == OP_IMMEDIATE_P24) {
+        num += 65536 * code[3];
+    }
+    bool negative = instruction == OP_IMMEDIATE_N8 || instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_N24;
+    return SMALL_INT_LITERAL_VAL(negative ? -(int32_t)num : (int32_t)num);
+}
+
+// Emits the template for one instruction, returning false if it has none.
+static bool compileInstruction(Assembler* as) {
+    Chunk* chunk = as->chunk;
+    uint8_t* code = &chunk->code[as->offset];
+    int depth = as->depth;
+
+    switch (code[0]) {
+        case OP_CONSTANT: {
+            movImmediate64(as, RAX, (uint64_t)(uintptr_t)&chunk->constants.values[code[1]]);
+            copyValue(as, RAX, 0, RBX, VALUE_AT(depth));
+            return true;
+        }
+        case OP_NIL: storeConstant(as, depth, NIL_VAL); return true;
+        case OP_TRUE: storeConstant(as, depth, BOOL_VAL(true)); return true;
+        case OP_FALSE: storeConstant(as, depth, BOOL_VAL(false)); return true;
+        case OP_IMMEDIATE_N8: case OP_IMMEDIATE_P8: case OP_IMMEDIATE_N16: case OP_IMMEDIATE_P16:
+        case OP_IMMEDIATE_N24: case OP_IMMEDIATE_P24: case OP_IMMEDIATE_TYPED:
+            storeConstant(as, depth, immediateValue(code));
+            return true;
+        case OP_POP:
+            return true;
+        // superinstructions start as the instruction they replace, which is all that is
+        // needed here as the instructions they fuse follow it
+        case OP_GET_LOCAL:
+        case OP_ADD_LOCALS:
+        case OP_LOCAL_ARITH_CONST:
+        case OP_LOCAL_COMPARE_CONST_JUMP:
+            copyValue(as, RBX, VALUE_AT(code[1]), RBX, VALUE_AT(depth));
+            return true;
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+            copyValue(as, RBX, VALUE_AT(depth - 1), RBX, VALUE_AT(code[1]));
+            clearLiteral(as, RBX, VALUE_AT(code[1]));
+            return true;
+        case OP_INITIALISE:
+            clearLiteral(as, RBX, VALUE_AT(depth - 1));
+            return true;
+        case OP_GET_GLOBAL: {
+            ValueCell* cell = boundGlobal(chunk, code[1]);
+            if (cell == NULL) return false;
+            movImmediate64(as, RAX, (uint64_t)(uintptr_t)&cell->value);
+            copyValue(as, RAX, 0, RBX, VALUE_AT(depth));
+            return true;
+        }
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_POP: {
+            ValueCell* cell = boundGlobal(chunk, code[1]);
+            if (cell == NULL) return false;
+            setGlobal(as, cell);
+            return true;
+        }
+        case OP_EQUAL: equal(as); return true;
+        case OP_ADD: arithmetic(as, ARITH_ADD, VAL_SMALL_INT, false); return true;
+        case OP_SUBTRACT: arithmetic(as, ARITH_SUBTRACT, VAL_SMALL_INT, false); return true;
+        case OP_MULTIPLY: arithmetic(as, ARITH_MULTIPLY, VAL_SMALL_INT, false); return true;
+        case OP_LESS: arithmetic(as, ARITH_LESS, VAL_SMALL_INT, false); return true;
+        case OP_GREATER: arithmetic(as, ARITH_GREATER, VAL_SMALL_INT, false); return true;
+        case OP_NOT: logicalNot(as); return true;
+        case OP_JUMP:
+            jumpTo(as, jump(as), chunkJumpTarget(chunk, as->offset));
+            return true;
+        case OP_JUMP_IF_FALSE:
+        case OP_POP_JUMP_IF_FALSE:
+            // the fused form's pop is the OP_POP after it, or at its target
+            jumpIfFalsey(as, chunkJumpTarget(chunk, as->offset));
+            return true;
+        case OP_LOOP:
+            // an error raised elsewhere in the routine is picked up by the interpreter
+            EMIT(as, 0x41, 0x83, 0x3c, 0x24, EXEC_ERROR);
+            exitIf(as, CC_E, false);
+            jumpTo(as, jump(as), chunkJumpTarget(chunk, as->offset));
+            return true;
+        default:
+            break;
+    }
+
+    if (code[0] >= OP_ADD_SMALL_INT && code[0] <= OP_GREATER_DOUBLE) {
+        static const ValueType kinds[] = { VAL_SMALL_INT, VAL_I32, VAL_UI32, VAL_DOUBLE };
+        int group = (code[0] - OP_ADD_SMALL_INT) / 4;
+        arithmetic(as, (Arith)group, kinds[(code[0] - OP_ADD_SMALL_INT) % 4], true);
+        return true;
+    }
+    return false;
+}
+
+static JitCode* compileChunk(ObjFunction* function) {
+    Chunk* chunk = &function->chunk;
+    JitCode* jit = malloc(sizeof(JitCode));
+    if (jit == NULL) return NULL;
+    jit->code = NULL;
+    jit->size = 0;
+    jit->entries = NULL;
+    jit->deopts = 0;
+    jit->usable = false;
+
+    Assembler as = { 0 };
+    as.chunk = chunk;
+    as.depths = malloc(sizeof(int) * chunk->count);
+    as.native = malloc(sizeof(int32_t) * chunk->count);
+    bool* loopHeads = malloc(sizeof(bool) * chunk->count);
+    jit->entries = malloc(sizeof(int32_t) * chunk->count);
+    if (as.depths == NULL || as.native == NULL || loopHeads == NULL || jit->entries == NULL
+        || !chunkExactStackDepths(chunk, function->arity, as.depths, loopHeads)) {
+        as.failed = true;
+    }
+
+    // push rbx; push r12; sub rsp, 8 keeps calls aligned; then into the loop
+    size_t epilogue = 0;
+    if (!as.failed) {
+        EMIT(&as, 0x53, 0x41, 0x54, 0x48, 0x83, 0xec, 0x08);
+        EMIT(&as, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xd4, 0xff, 0xe6);
+        epilogue = as.count;
+        EMIT(&as, 0x48, 0x83, 0xc4, 0x08, 0x41, 0x5c, 0x5b, 0xc3);
+    }
+
+    for (int offset = 0; offset < chunk->count && !as.failed; offset += chunkInstructionLength(chunk, offset)) {
+        as.native[offset] = -1;
+        if (as.depths[offset] < 0) continue;
+
+        as.offset = offset;
+        as.depth = as.depths[offset];
+        as.native[offset] = (int32_t)as.count;
+        if (!compileInstruction(&as)) {
+            movImmediate64(&as, RAX, EXIT_CODE(offset, as.depth, false));
+            patch32(&as, jump(&as), epilogue);
+        }
+    }
+
+    // exits from the templates, one per instruction and kind
+    for (int i = 0; i < as.exitCount && !as.failed; i++) {
+        Exit* exit = &as.exits[i];
+        size_t stub = as.count;
+        for (int j = 0; j < i; j++) {
+            if (as.exits[j].offset == exit->offset && as.exits[j].deopt == exit->deopt) {
+                int32_t relative;
+                memcpy(&relative, &as.bytes[as.exits[j].at], sizeof(relative));
+                stub = as.exits[j].at + 4 + relative;
+                break;
+            }
+        }
+        if (stub == as.count) {
+            movImmediate64(&as, RAX, EXIT_CODE(exit->offset, as.depths[exit->offset], exit->deopt));
+            patch32(&as, jump(&as), epilogue);
+        }
+        patch32(&as, exit->at, stub);
+    }
+    for (int i = 0; i < as.fixupCount && !as.failed; i++) {
+        patch32(&as, as.fixups[i].at, (size_t)as.native[as.fixups[i].target]);
+    }
+
+    if (!as.failed) {
+        uint8_t* code = mmap(NULL, as.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code != MAP_FAILED) {
+            memcpy(code, as.bytes, as.count);
+            if (mprotect(code, as.count, PROT_READ | PROT_EXEC) == 0) {
+                jit->code = code;
+                jit->size = as.count;
+                jit->usable = true;
+                for (int offset = 0; offset < chunk->count; offset++) {
+                    jit->entries[offset] = loopHeads[offset] && as.depths[offset] >= 0 ? as.native[offset] : -1;
+                }
+            } else {
+                munmap(code, as.count);
+            }
+        }
+    }
+
+    free(as.bytes);
+    free(as.exits);
+    free(as.fixups);
+    free(as.depths);
+    free(as.native);
+    free(loopHeads);
+    return jit;
+}
+
+bool jitLoop(ObjRoutine* routine, CallFrame* frame) {
+    ObjFunction* function = frame->closure->function;
+    JitCode* jit = function->jit;
+    if (jit == NULL) {
+        if (!jitEnabled || routine->traceExecution || ++function->hotness < QUICKEN_THRESHOLD + JIT_THRESHOLD) {
+            return false;
+        }
+        vm_mutex_enter_blocking(&vm.env);
+        if (function->jit == NULL) {
+            function->jit = compileChunk(function);
+        }
+        jit = function->jit;
+        vm_mutex_exit(&vm.env);
+        if (jit == NULL) return false;
+    }
+    if (!jit->usable || routine->traceExecution) return false;
+
+    Chunk* chunk = &function->chunk;
+    if (frame->ip < chunk->code || frame->ip >= chunk->code + chunk->count) return false;
+    int32_t entry = jit->entries[frame->ip - chunk->code];
+    if (entry < 0) return false;
+
+    uint64_t exit = ((JitFn)(void*)jit->code)(frame->slots, jit->code + entry, &routine->state);
+    frame->ip = chunk->code + EXIT_OFFSET(exit);
+    routine->stackTopIndex = frame->stackEntryIndex + EXIT_DEPTH(exit);
+    if ((exit & EXIT_DEOPT) && ++jit->deopts >= JIT_DEOPT_LIMIT) {
+        jit->usable = false;
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef cyarg_jit_h
+#define cyarg_jit_h
+
+#include "routine.h"
+
+// Loop iterations, once a function is quickened, after which its chunk is compiled.
+#define JIT_THRESHOLD 200
+// Type guard failures after which compiled code is no longer entered.
+#define JIT_DEOPT_LIMIT 64
+
+typedef struct JitCode {
+    uint8_t* code;
+    size_t size;
+    int32_t* entries;   // native offset of each loop head, by bytecode offset, or -1
+    int deopts;
+    bool usable;
+} JitCode;
+
+void initJit();
+void freeJitCode(JitCode* jit);
+
+// Runs the loop the frame is about to start an iteration of as native code, when its
+// function is hot enough, returning false if it did not. Otherwise the frame's ip and
+// the routine's stack top are left where the native code handed back to the interpreter.
+bool jitLoop(ObjRoutine* routine, CallFrame* frame);
+
+#endif
@@ -15,6 +15,9 @@
 #ifdef CYARG_FEATURE_HOSTED_REPL
 #include "hosted.h"
 #endif
+#ifdef CYARG_AOT
+#include "aot.h"
+#endif
 
 #ifdef CYARG_FEATURE_HOSTED_REPL
 void usageMessage(FILE* destination) {
@@ -29,6 +32,9 @@ void usageMessage(FILE* destination) {
           "\tcyarg --help\n"
           "\tDisplay this help message.\n"
           "\n"
+          "\tcyarg --heap-size <size>[K|M] ...\n"
+          "\tRun any of the above with a heap of <size> bytes, rather than 10000K.\n"
+          "\n"
           "\tcyarg --bootstrap <path>\n"
           "\tExecute a Yarg script, without the language context. For testing of cyarg.\n"
           "\n"
@@ -38,6 +44,11 @@ void usageMessage(FILE* destination) {
           "\n"
           "\tcyarg --disassemble <path>\n"
           "\tDisassemble a Yarg script, displaying the generated bytecode.\n"
+#ifdef CYARG_AOT
+          "\n"
+          "\tcyarg --aot <package> <output>\n"
+          "\tTranslate the loops of a binary script to C in <output>, to build into cyarg.\n"
+#endif
          , destination);
 }
 
@@ -49,6 +60,23 @@ const char* getArgument(int argc, const char* argv[], const char* name) {
     }
     return NULL;
 }
+
+// a size in bytes, or in kilobytes or megabytes with a K or M after it.
+bool parseSize(const char* text, size_t* size) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return false;
+    if (*end == 'K' || *end == 'k') {
+        value *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        value *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || value > SIZE_MAX) return false;
+    *size = (size_t)value;
+    return true;
+}
 #endif
 
 #if defined(CYARG_FEATURE_SELF_HOSTED_REPL)
@@ -80,6 +108,19 @@ int main(int argc, const char* argv[]) {
         return EX_OK;
     }
 
+    // the heap size comes first, and is taken off the arguments the rest are found by.
+    if (argc > 2 && strcmp(argv[1], "--heap-size") == 0) {
+        size_t heapSize;
+        if (!parseSize(argv[2], &heapSize) || heapSize < HEAP_SIZE_MIN) {
+            fprintf(stderr, "Heap size must be at least %dK.\n", HEAP_SIZE_MIN / 1024);
+            return EX_USAGE;
+        }
+        setHeapSize(heapSize);
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     initVMMemory();
 
     const char* libPath = getArgument(argc, argv, "--lib");
@@ -102,6 +143,10 @@ int main(int argc, const char* argv[]) {
         returnCode = runHostedFile(NULL, argv[2]);
     } else if (argc == 3 && strcmp(argv[1], "--disassemble") == 0) {
         returnCode = disassembleFile(argv[2]);
+#ifdef CYARG_AOT
+    } else if (argc == 4 && strcmp(argv[1], "--aot") == 0) {
+        returnCode = translatePackage(argv[2], argv[3]);
+#endif
     } else if ((argc == 3 || argc == 4) && strcmp(argv[1], "--lib") == 0) {
         returnCode = runHostedFile(libPath, "cyarg-hosted.ya");
     } else if (argc > 4 && strcmp(argv[1], "--lib") == 0 && strcmp(argv[4], "--") == 0) {
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdalign.h>
 #include <assert.h>
+#include <string.h>
+#include <time.h>
 
 #include "compiler.h"
 #include "memory.h"
@@ -10,30 +12,329 @@
 #include "ast.h"
 #include "channel.h"
 #include "sync_group.h"
+#include "shape.h"
 #include "vm_mutex.h"
+#if defined(CYARG_JIT)
+#include "jit.h"
+#endif
 
 #include "../external/o1heap/o1heap/o1heap.h"
 
+#if defined(CYARG_PICO_SDK_TARGET)
+#include <pico/platform.h>
+#include <pico/time.h>
+#endif
+
 #ifdef DEBUG_LOG_GC
 #include "debug.h"
 #endif
 
-#define GC_HEAP_GROW_FACTOR 2
+static void beginCollection();
+static bool hasWriteBarrier(ObjType type);
+static void addRemembered(Obj* object);
 
-void init_heap_instance(O1HeapInstance** instance) {
-
-#if defined(CYARG_SELF_HOSTED)
-    static alignas(O1HEAP_ALIGNMENT)uint8_t heapArena[190 * 1024];
+#if defined(CYARG_PICO_SDK_TARGET)
+// an interrupt handler enters its context over that of the code it interrupts.
+static AllocContext* currentContexts[2];
+#define CURRENT_CONTEXT currentContexts[get_core_num()]
 #else
-    static alignas(O1HEAP_ALIGNMENT)uint8_t heapArena[10000 * 1024];
+static _Thread_local AllocContext* currentContext;
+#define CURRENT_CONTEXT currentContext
 #endif
 
+// the frames of each routine may take up to this much of the heap before it is a stack overflow
+#define CALL_STACK_MAX (vm.heapSize / 8)
+
+#if defined(CYARG_SELF_HOSTED)
+void setHeapSize(size_t size) {
+    ; // the arena is static.
+}
+
+void init_heap_instance(O1HeapInstance** instance) {
+
+    static alignas(O1HEAP_ALIGNMENT)uint8_t heapArena[HEAP_SIZE_DEFAULT];
+
+    vm.heapSize = sizeof(heapArena);
     *instance = o1heapInit(heapArena, sizeof(heapArena));
     if (*instance == NULL) {
         PRINTERR("Failed to initialize heap instance.\n");
         exit(1);
     }
 }
+#else
+static size_t heapArenaSize = HEAP_SIZE_DEFAULT;
+
+void setHeapSize(size_t size) {
+    heapArenaSize = (size + O1HEAP_ALIGNMENT - 1) / O1HEAP_ALIGNMENT * O1HEAP_ALIGNMENT;
+}
+
+void init_heap_instance(O1HeapInstance** instance) {
+
+    static uint8_t* heapArena = NULL;
+    if (heapArena == NULL) {
+        heapArena = aligned_alloc(O1HEAP_ALIGNMENT, heapArenaSize);
+    }
+
+    vm.heapSize = heapArenaSize;
+    *instance = heapArena != NULL ? o1heapInit(heapArena, heapArenaSize) : NULL;
+    if (*instance == NULL) {
+        PRINTERR("Failed to initialize heap instance.\n");
+        exit(1);
+    }
+}
+#endif
+
+// A slab page is the size of a heap fragment, header and all. Its blocks follow its own
+// header; free ones are linked through their first word. Pages hold either objects or
+// other blocks. A page of objects has a bit set for each block holding an object the heap
+// has been handed, which is what sweeping it goes through.
+struct SlabPage {
+    SlabPage* next;
+    SlabPage* prev;
+    void* freeBlocks;
+    uint32_t sweptEpoch;
+    uint16_t liveCount;
+    uint8_t sizeClass;
+    bool isPartial;
+    bool holdsObjects;
+    bool hasYoung;
+    uint32_t objectBits[SLAB_BITMAP_WORDS];
+};
+
+// free blocks are poisoned, so that the sanitizer still sees them used after being freed.
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define SLAB_POISON(block, size) ASAN_POISON_MEMORY_REGION((block), (size))
+#define SLAB_UNPOISON(block, size) ASAN_UNPOISON_MEMORY_REGION((block), (size))
+#else
+#define SLAB_POISON(block, size) ((void)0)
+#define SLAB_UNPOISON(block, size) ((void)0)
+#endif
+
+#define SLAB_PAGE_BYTES (SLAB_PAGE_SIZE - O1HEAP_ALIGNMENT)
+#define SLAB_HEADER_SIZE ((sizeof(SlabPage) + SLAB_CLASS_SIZE - 1) / SLAB_CLASS_SIZE * SLAB_CLASS_SIZE)
+#define SLAB_BLOCK_SIZE(sizeClass) (SLAB_CLASS_SIZE * ((size_t)(sizeClass) + 1))
+#define LARGE_HEADER_SIZE ((sizeof(LargeObject) + SLAB_CLASS_SIZE - 1) / SLAB_CLASS_SIZE * SLAB_CLASS_SIZE)
+
+static inline int slabClassOf(size_t size) {
+    return (int)((size - 1) / SLAB_CLASS_SIZE);
+}
+
+static inline SlabClass* pageClass(SlabPage* page) {
+    return page->holdsObjects ? &vm.objectClasses[page->sizeClass] : &vm.slabClasses[page->sizeClass];
+}
+
+static inline LargeObject* largeObjectOf(Obj* object) {
+    return (LargeObject*)((uint8_t*)object - LARGE_HEADER_SIZE);
+}
+
+static inline Obj* largeObjectBody(LargeObject* large) {
+    return (Obj*)((uint8_t*)large + LARGE_HEADER_SIZE);
+}
+
+static inline Obj* pageObject(SlabPage* page, size_t index) {
+    return (Obj*)((uint8_t*)page + SLAB_HEADER_SIZE + index * SLAB_BLOCK_SIZE(page->sizeClass));
+}
+
+// can only be called with the heap critical section held, as can the rest of the slab.
+static SlabPage* findSlabPage(void* pointer) {
+    int low = 0;
+    int high = vm.slabPageCount - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        uint8_t* page = (uint8_t*)vm.slabPages[middle];
+        if ((uint8_t*)pointer < page) {
+            high = middle - 1;
+        } else if ((uint8_t*)pointer >= page + SLAB_PAGE_BYTES) {
+            low = middle + 1;
+        } else {
+            return (SlabPage*)page;
+        }
+    }
+    return NULL;
+}
+
+static void linkPartialPage(SlabPage* page) {
+    SlabClass* slabClass = pageClass(page);
+    page->prev = NULL;
+    page->next = slabClass->partialPages;
+    if (page->next != NULL) {
+        page->next->prev = page;
+    }
+    slabClass->partialPages = page;
+    page->isPartial = true;
+}
+
+static void unlinkPartialPage(SlabPage* page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        pageClass(page)->partialPages = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    }
+    page->isPartial = false;
+}
+
+// vm.pageCursor is left on the same page as pages come and go before it.
+static SlabPage* newSlabPage(int sizeClass, bool holdsObjects) {
+    SlabPage* page = o1heapAllocate(vm.heap_instance, SLAB_PAGE_BYTES);
+    if (page == NULL) return NULL;
+
+    if (vm.slabPageCapacity < vm.slabPageCount + 1) {
+        vm.slabPageCapacity = GROW_CAPACITY(vm.slabPageCapacity);
+        vm.slabPages = (SlabPage**)o1heapReallocate(vm.heap_instance, vm.slabPages, sizeof(SlabPage*) * vm.slabPageCapacity);
+
+        if (vm.slabPages == NULL) exit(1);
+    }
+    int index = vm.slabPageCount;
+    while (index > 0 && vm.slabPages[index - 1] > page) {
+        vm.slabPages[index] = vm.slabPages[index - 1];
+        index--;
+    }
+    vm.slabPages[index] = page;
+    vm.slabPageCount++;
+    if (index < vm.pageCursor) {
+        vm.pageCursor++;
+    }
+
+    page->liveCount = 0;
+    page->sizeClass = (uint8_t)sizeClass;
+    page->holdsObjects = holdsObjects;
+    page->hasYoung = false;
+    page->sweptEpoch = vm.sweepEpoch;
+    memset(page->objectBits, 0, sizeof(page->objectBits));
+    page->freeBlocks = NULL;
+    size_t blockSize = SLAB_BLOCK_SIZE(sizeClass);
+    for (size_t i = (SLAB_PAGE_BYTES - SLAB_HEADER_SIZE) / blockSize; i > 0; i--) {
+        void** block = (void**)((uint8_t*)page + SLAB_HEADER_SIZE + (i - 1) * blockSize);
+        *block = page->freeBlocks;
+        page->freeBlocks = block;
+        SLAB_POISON(block, blockSize);
+    }
+    linkPartialPage(page);
+    pageClass(page)->pageCount++;
+    return page;
+}
+
+static void freeSlabPage(SlabPage* page) {
+    unlinkPartialPage(page);
+    pageClass(page)->pageCount--;
+
+    int index = 0;
+    while (vm.slabPages[index] != page) {
+        index++;
+    }
+    if (index < vm.pageCursor) {
+        vm.pageCursor--;
+    }
+    vm.slabPageCount--;
+    for (; index < vm.slabPageCount; index++) {
+        vm.slabPages[index] = vm.slabPages[index + 1];
+    }
+    SLAB_UNPOISON(page, SLAB_PAGE_BYTES);
+    o1heapFree(vm.heap_instance, page);
+}
+
+static void pushFreeBlock(SlabPage* page, void* pointer) {
+    void** block = pointer;
+    *block = page->freeBlocks;
+    page->freeBlocks = block;
+    SLAB_POISON(block, SLAB_BLOCK_SIZE(page->sizeClass));
+    page->liveCount--;
+    pageClass(page)->liveCount--;
+
+    if (!page->isPartial) {
+        linkPartialPage(page);
+    }
+}
+
+// An empty page goes back to the heap, unless it is the only one of its class with room.
+static void releaseEmptyPage(SlabPage* page) {
+    if (page->liveCount == 0 && (page->next != NULL || page->prev != NULL)) {
+        freeSlabPage(page);
+    }
+}
+
+static void slabFree(SlabPage* page, void* pointer) {
+    pushFreeBlock(page, pointer);
+    releaseEmptyPage(page);
+}
+
+static size_t releaseObject(Obj* object);
+
+// Frees the objects on a page that the last marking left unmarked. Returns how many
+// objects it looked at. After a young collection, only pages that have had objects
+// added since the one before can have any.
+static size_t sweepPage(SlabPage* page) {
+    page->sweptEpoch = vm.sweepEpoch;
+    if (!page->hasYoung && !vm.sweepingOldGeneration) return 0;
+    page->hasYoung = false;
+    size_t before = vm.bytesAllocated;
+    size_t count = 0;
+
+    for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+        uint32_t bits = page->objectBits[word];
+        while (bits != 0) {
+            int bit = __builtin_ctz(bits);
+            bits &= bits - 1;
+            count++;
+
+            Obj* object = pageObject(page, (size_t)word * 32 + bit);
+            if (!object->isMarked) {
+                page->objectBits[word] &= ~((uint32_t)1 << bit);
+                vm.bytesAllocated -= releaseObject(object);
+                pushFreeBlock(page, object);
+            }
+        }
+    }
+
+    // the nursery is counted from what is left once the garbage is gone.
+    size_t freed = before - vm.bytesAllocated;
+    vm.nextYoungGC = vm.nextYoungGC > freed ? vm.nextYoungGC - freed : 0;
+    return count;
+}
+
+static void* slabAllocate(int sizeClass, bool holdsObjects) {
+    SlabClass* slabClass = holdsObjects ? &vm.objectClasses[sizeClass] : &vm.slabClasses[sizeClass];
+    SlabPage* page = slabClass->partialPages;
+    if (page != NULL && page->sweptEpoch != vm.sweepEpoch) {
+        sweepPage(page);
+    }
+    if (page == NULL) {
+        page = newSlabPage(sizeClass, holdsObjects);
+        if (page == NULL) return NULL;
+    }
+
+    void** block = page->freeBlocks;
+    SLAB_UNPOISON(block, SLAB_BLOCK_SIZE(sizeClass));
+    page->freeBlocks = *block;
+    page->liveCount++;
+    slabClass->liveCount++;
+    if (page->freeBlocks == NULL) {
+        unlinkPartialPage(page);
+    }
+    return block;
+}
+
+uint32_t slabLive(int sizeClass) {
+    return vm.slabClasses[sizeClass].liveCount + vm.objectClasses[sizeClass].liveCount;
+}
+
+uint32_t slabCapacity(int sizeClass) {
+    size_t perPage = (SLAB_PAGE_BYTES - SLAB_HEADER_SIZE) / SLAB_BLOCK_SIZE(sizeClass);
+    return (vm.slabClasses[sizeClass].pageCount + vm.objectClasses[sizeClass].pageCount) * (uint32_t)perPage;
+}
+
+static void freeBlock(void* pointer) {
+    SlabPage* page = pointer != NULL ? findSlabPage(pointer) : NULL;
+    if (page != NULL) {
+        slabFree(page, pointer);
+    } else {
+        o1heapFree(vm.heap_instance, pointer);
+    }
+}
 
 // can only be called during gc, so the heap critical section is already held.
 void* gc_free(void* pointer, size_t oldSize, size_t newSize) {
@@ -43,31 +344,241 @@ void* gc_free(void* pointer, size_t oldSize, size_t newSize) {
     }
     vm.bytesAllocated += newSize - oldSize;
 
-    o1heapFree(vm.heap_instance, pointer);
+    freeBlock(pointer);
     return NULL;
 }
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+// Large objects are listed by whether they have been swept since the last marking.
+static void linkLargeObject(LargeObject* large) {
+    large->next = vm.largeObjects;
+    if (vm.largeObjects == NULL) {
+        vm.largeObjectsTail = &large->next;
+    }
+    vm.largeObjects = large;
+}
+
+static void sweepLargeObject(LargeObject* large) {
+    Obj* object = largeObjectBody(large);
+    if (object->isMarked) {
+        linkLargeObject(large);
+        return;
+    }
+
+    size_t size = releaseObject(object);
+    size_t before = vm.bytesAllocated;
+    gc_free(large, LARGE_HEADER_SIZE + size, 0);
+    size_t freed = before - vm.bytesAllocated;
+    vm.nextYoungGC = vm.nextYoungGC > freed ? vm.nextYoungGC - freed : 0;
+}
+
+static inline bool sweepPending() {
+    return vm.pageCursor < vm.slabPageCount || vm.unsweptLarge != NULL;
+}
+
+static void sizeNextCollection();
+
+// Sweeps the pages, then the large objects, the last marking left behind, until about
+// budget objects have been looked at. Returns whether all of them have been.
+static bool sweepStep(size_t budget) {
+    while (vm.pageCursor < vm.slabPageCount) {
+        if (budget == 0) return false;
+        SlabPage* page = vm.slabPages[vm.pageCursor++];
+        if (!page->holdsObjects || page->sweptEpoch == vm.sweepEpoch) continue;
+
+        size_t count = sweepPage(page);
+        budget -= count < budget ? count : budget;
+        releaseEmptyPage(page);
+    }
+    for (; vm.unsweptLarge != NULL; budget--) {
+        if (budget == 0) return false;
+        LargeObject* large = vm.unsweptLarge;
+        vm.unsweptLarge = large->next;
+        sweepLargeObject(large);
+    }
+
+    if (vm.sweepingOldGeneration) {
+        vm.sweepingOldGeneration = false;
+        sizeNextCollection();
+    }
+    return true;
+}
+
+// After a marking, every object is left to be swept again.
+static void flipSweepEpoch() {
+    vm.sweepEpoch++;
+    vm.pageCursor = 0;
+
+    *vm.largeObjectsTail = vm.unsweptLarge;
+    vm.unsweptLarge = vm.largeObjects;
+    vm.largeObjects = NULL;
+    vm.largeObjectsTail = &vm.largeObjects;
+}
+
+static AllocContext* allocContext() {
+    AllocContext* context = CURRENT_CONTEXT;
+    return context != NULL ? context : &vm.allocContexts[0];
+}
+
+void initAllocContext(AllocContext* context) {
+    context->tempRoots = NULL;
+    context->tempRootCount = 0;
+    context->tempRootCapacity = 0;
+}
+
+// Hands the objects a context has made since it last took the heap to the heap, setting
+// their bits in the pages they were allocated in. While the old generation is being
+// marked they are marked too; while its marks are being cleared, so are theirs.
+static void addNewObjects(AllocContext* context) {
+    vm.bytesAllocated += context->bytesPending;
+    context->bytesPending = 0;
+
+    for (int i = 0; i < context->newObjectCount; i++) {
+        Obj* object = context->newObjects[i];
+        if (object->isLarge) {
+            linkLargeObject(largeObjectOf(object));
+        } else {
+            SlabPage* page = findSlabPage(object);
+            if (page->sweptEpoch != vm.sweepEpoch) {
+                sweepPage(page);
+            }
+            size_t index = ((uint8_t*)object - (uint8_t*)page - SLAB_HEADER_SIZE) / SLAB_BLOCK_SIZE(page->sizeClass);
+            page->objectBits[index / 32] |= (uint32_t)1 << (index % 32);
+            page->hasYoung = true;
+        }
+
+        if (vm.gcPhase == GC_CLEAR) {
+            object->isMarked = false;
+        } else if (vm.gcPhase == GC_MARK) {
+            markObject(object);
+        }
+    }
+    context->newObjectCount = 0;
+}
+
+AllocContext* enterAllocContext(AllocContext* context) {
+    AllocContext* outer = allocContext();
+    CURRENT_CONTEXT = context;
+    return outer;
+}
+
+void leaveAllocContext(AllocContext* outer) {
     vm_mutex_enter_blocking(&vm.heap);
+    addNewObjects(allocContext());
+    vm_mutex_exit(&vm.heap);
+    CURRENT_CONTEXT = outer;
+}
 
-    vm.bytesAllocated += newSize - oldSize;
-    if (newSize > oldSize) {
+static void sweepGarbageStep(size_t budget);
+
+// can only be called with the heap critical section held.
+static void collectIfDue() {
 #ifdef DEBUG_STRESS_GC
+    static unsigned stressCount = 0;
+    if (vm.gcPhase != GC_IDLE) {
+        collectGarbageStep(1);
+    } else if (++stressCount % 16 == 0) {
         collectGarbage();
+    } else if (stressCount % 8 == 0) {
+        collectYoungGarbage();
+        if (vm.gcPhase == GC_IDLE) {
+            beginCollection();
+        }
+    } else {
+        collectYoungGarbage();
+    }
 #endif
 
-        if (vm.bytesAllocated > vm.nextGC) {
-            collectGarbage();
+    if (vm.gcPhase != GC_IDLE) {
+        collectGarbageStep(vm.gcStepObjects == 0 ? SIZE_MAX : vm.gcStepObjects);
+    } else if (vm.bytesAllocated > vm.nextYoungGC) {
+        collectYoungGarbage();
+    } else if (sweepPending()) {
+        sweepGarbageStep(vm.gcStepObjects);
+    }
+}
+
+static void refillBlocks(AllocContext* context, int sizeClass, bool holdsObjects) {
+    vm_mutex_enter_blocking(&vm.heap);
+
+    addNewObjects(context);
+    collectIfDue();
+
+    void** blocks = holdsObjects ? context->objectBlocks : context->freeBlocks;
+    for (int i = 0; i < ALLOC_BATCH; i++) {
+        void** block = slabAllocate(sizeClass, holdsObjects);
+        if (block == NULL) break;
+        *block = blocks[sizeClass];
+        blocks[sizeClass] = block;
+    }
+    if (blocks[sizeClass] == NULL) {
+        PRINTERR("help! no memory.");
+        exit(1);
+    }
+
+    vm_mutex_exit(&vm.heap);
+}
+
+static void* allocateSmall(size_t size, bool holdsObjects) {
+    AllocContext* context = allocContext();
+    void** blocks = holdsObjects ? context->objectBlocks : context->freeBlocks;
+
+    int sizeClass = slabClassOf(size);
+    if (blocks[sizeClass] == NULL) {
+        refillBlocks(context, sizeClass, holdsObjects);
+    }
+
+    context->bytesPending += size;
+    void** block = blocks[sizeClass];
+    blocks[sizeClass] = *block;
+    return block;
+}
+
+// can only be called with the heap critical section held.
+static void* resizeBlock(void* pointer, size_t newSize) {
+    SlabPage* page = pointer != NULL ? findSlabPage(pointer) : NULL;
+    if (page == NULL) {
+        if (pointer == NULL && newSize <= SLAB_MAX) {
+            void* block = slabAllocate(slabClassOf(newSize), false);
+            if (block != NULL) return block;
         }
+        return o1heapReallocate(vm.heap_instance, pointer, newSize);
+    }
+
+    size_t blockSize = SLAB_BLOCK_SIZE(page->sizeClass);
+    if (newSize <= blockSize) return pointer;
+
+    void* result = resizeBlock(NULL, newSize);
+    if (result != NULL) {
+        memcpy(result, pointer, blockSize);
+        slabFree(page, pointer);
+    }
+    return result;
+}
+
+void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+    // small blocks come from the buffer, except while the old generation is being
+    // collected, when each allocation takes a step of it.
+#ifndef DEBUG_STRESS_GC
+    if (pointer == NULL && newSize > 0 && newSize <= SLAB_MAX && vm.gcPhase == GC_IDLE) {
+        return allocateSmall(newSize, false);
+    }
+#endif
+
+    vm_mutex_enter_blocking(&vm.heap);
+
+    addNewObjects(allocContext());
+    vm.bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize) {
+        collectIfDue();
     }
 
     if (newSize == 0) {
-        o1heapFree(vm.heap_instance, pointer);
+        freeBlock(pointer);
         vm_mutex_exit(&vm.heap);
         return NULL;
     }
 
-    void* result = o1heapReallocate(vm.heap_instance, pointer, newSize);
+    void* result = resizeBlock(pointer, newSize);
     if (result == NULL) {
         PRINTERR("help! no memory.");
         exit(1);
@@ -76,26 +587,72 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
     return result;
 }
 
-void tempRootPush(Value value) {
+// Small objects are kept on pages of their own, large ones each behind a header.
+void* allocateObjectMemory(size_t size) {
+    if (size > SLAB_MAX) {
+        LargeObject* large = reallocate(NULL, 0, LARGE_HEADER_SIZE + size);
+        return largeObjectBody(large);
+    }
+#ifndef DEBUG_STRESS_GC
+    if (vm.gcPhase == GC_IDLE) {
+        return allocateSmall(size, true);
+    }
+#endif
 
     vm_mutex_enter_blocking(&vm.heap);
 
-    *vm.tempRootsTop = value;
-    vm.tempRootsTop++;
+    addNewObjects(allocContext());
+    vm.bytesAllocated += size;
+    collectIfDue();
 
-    if (vm.tempRootsTop - &vm.tempRoots[0] >= TEMP_ROOTS_MAX) {
-        fatalVMError("Allocation Stash Max Exeeded.");
+    void* result = slabAllocate(slabClassOf(size), true);
+    if (result == NULL) {
+        PRINTERR("help! no memory.");
+        exit(1);
     }
-
     vm_mutex_exit(&vm.heap);
+    return result;
+}
+
+// Each routine's call stack may grow to an eighth of the heap, whatever else is live, so
+// that runaway recursion is reported rather than running the heap out.
+bool callStackMayGrow(size_t size) {
+    return size <= CALL_STACK_MAX;
+}
+
+// The stack is grown outside the collected heap, as the gray stack is, so that pushing
+// a value never collects before it is rooted.
+void tempRootPush(Value value) {
+    AllocContext* context = allocContext();
+
+    if (context->tempRootCapacity < context->tempRootCount + 1) {
+        vm_mutex_enter_blocking(&vm.heap);
+        context->tempRootCapacity = GROW_CAPACITY(context->tempRootCapacity);
+        context->tempRoots = (Value*)o1heapReallocate(vm.heap_instance, context->tempRoots, sizeof(Value) * context->tempRootCapacity);
+        vm_mutex_exit(&vm.heap);
+
+        if (context->tempRoots == NULL) exit(1);
+    }
+
+    context->tempRoots[context->tempRootCount++] = value;
 }
 
 Value tempRootPop() {
-    vm_mutex_enter_blocking(&vm.heap);
-    vm.tempRootsTop--;
-    Value result = *vm.tempRootsTop;
-    vm_mutex_exit(&vm.heap);
-    return result;
+    AllocContext* context = allocContext();
+    return context->tempRoots[--context->tempRootCount];
+}
+
+// can only be called during gc, or with the heap critical section held.
+static void addRemembered(Obj* object) {
+    if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+        vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+        vm.remembered = (Obj**)o1heapReallocate(vm.heap_instance, vm.remembered, sizeof(Obj*) * vm.rememberedCapacity);
+
+        if (vm.remembered == NULL) exit(1);
+    }
+
+    object->isRemembered = true;
+    vm.remembered[vm.rememberedCount++] = object;
 }
 
 void markObject(Obj* object) {
@@ -109,6 +666,10 @@ void markObject(Obj* object) {
 #endif
 
     object->isMarked = true;
+    // old objects without a write barrier are traced by every young collection.
+    if (!object->isRemembered && !hasWriteBarrier(object->type)) {
+        addRemembered(object);
+    }
 
     if (vm.grayCapacity < vm.grayCount + 1) {
         vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
@@ -122,6 +683,9 @@ void markObject(Obj* object) {
 
 void markValue(Value value) {
     if (IS_OBJ(value)) markObject(AS_OBJ(value));
+#ifdef CYARG_COMPACT_VALUE
+    else if (IS_BOXED(value)) markObject(AS_OBJ(value));
+#endif
 }
 
 void markValueCell(ValueCell* cell) {
@@ -154,6 +718,14 @@ void markDynamicObjArray(DynamicObjArray* array) {
 void markFunction(ObjFunction* function) {
     markObject((Obj*)function->fName);
     markArray(&function->chunk.constants);
+    for (int i = 0; i < function->chunk.inlineCacheCount; i++) {
+        InlineCache* cache = &function->chunk.inlineCaches[i];
+        markObject((Obj*)cache->name);
+        markObject(cache->holder);
+        markValue(cache->method);
+        markObject((Obj*)cache->shape);
+        markObject((Obj*)cache->transition);
+    }
 }
 
 static void blackenObject(Obj* object) {
@@ -174,6 +746,7 @@ static void blackenObject(Obj* object) {
             ObjClass* klass = (ObjClass*)object;
             markObject((Obj*)klass->name);
             markTable(&klass->methods);
+            markObject((Obj*)klass->rootShape);
             break;
         }
         case OBJ_CLOSURE: {
@@ -193,11 +766,19 @@ static void blackenObject(Obj* object) {
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
             markObject((Obj*)instance->klass);
-            markTable(&instance->fields);
+            markInstanceFields(instance);
+            break;
+        }
+        case OBJ_SHAPE: {
+            ObjShape* shape = (ObjShape*)object;
+            markObject((Obj*)shape->parent);
+            markObject((Obj*)shape->name);
+            markTable(&shape->transitions);
             break;
         }
         case OBJ_UPVALUE:
-            markValueCell(&((ObjUpvalue*)object)->closed);
+            markValue(((ObjUpvalue*)object)->closed);
+            markObject((Obj*)((ObjUpvalue*)object)->type);
             break;
         case OBJ_ROUTINE: {
             ObjRoutine* stack = (ObjRoutine*)object;
@@ -221,6 +802,8 @@ static void blackenObject(Obj* object) {
             /* fall through */
         case OBJ_PACKEDUNIFORMARRAY: {
             ObjPackedUniformArray* array = (ObjPackedUniformArray*)object;
+            // an empty array has no storage, but its type is still needed to free it.
+            markObject((Obj*)array->store.storedType);
             markPackedValue(array->store);
             break;
         }
@@ -240,6 +823,9 @@ static void blackenObject(Obj* object) {
         }
         case OBJ_STRING: break;
         case OBJ_INT: break;
+#ifdef CYARG_COMPACT_VALUE
+        case OBJ_BOXED: break;
+#endif
         case OBJ_MAP: {
             ObjMap* map = (ObjMap*)object;
             markObject((Obj*)map->type);
@@ -477,164 +1063,177 @@ static void blackenObject(Obj* object) {
     }
 }
 
-static void freeObject(Obj* object) {
+// Frees what an object owns, leaving the object's own memory to its sweeper, and returns
+// the size it was allocated with. It may not look at other objects, which may have been
+// freed in the same sweep.
+static size_t releaseObject(Obj* object) {
 #ifdef DEBUG_LOG_GC
     PRINTERR("%p free type %d\n", (void*)object, object->type);
 #endif
 
     switch (object->type) {
-        case OBJ_BOUND_METHOD: FREE(ObjBoundMethod, object); break;
+        case OBJ_BOUND_METHOD: return sizeof(ObjBoundMethod);
         case OBJ_CLASS: {
             ObjClass* klass = (ObjClass*)object;
             freeTable(&klass->methods);
-            FREE(ObjClass, object);
-            break;
+            return sizeof(ObjClass);
         }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
             FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->cUpvalueCount);
-            FREE(ObjClosure, object);
-            break;
+            return sizeof(ObjClosure);
         }
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
             freeChunk(&function->chunk);
-            FREE(ObjFunction, object);
-            break;
+#if defined(CYARG_JIT)
+            freeJitCode(function->jit);
+#endif
+            return sizeof(ObjFunction);
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
-            freeTable(&instance->fields);
-            FREE(ObjInstance, object);
-            break;
+            freeInstanceFields(instance);
+            return sizeof(ObjInstance) + sizeof(Value) * instance->inlineCapacity;
         }
-        case OBJ_NATIVE: FREE(ObjNative, object); break;
-        case OBJ_BUILTIN: FREE(ObjBuiltin, object); break;
+        case OBJ_SHAPE: {
+            ObjShape* shape = (ObjShape*)object;
+            freeTable(&shape->transitions);
+            return sizeof(ObjShape);
+        }
+        case OBJ_NATIVE: return sizeof(ObjNative);
+        case OBJ_BUILTIN: return sizeof(ObjBuiltin);
         case OBJ_ROUTINE:
-            FREE(ObjRoutine, object);
-            break;
+            freeRoutine((ObjRoutine*)object);
+            return sizeof(ObjRoutine);
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
             FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
-            break;
+            return sizeof(ObjString);
         }
-        case OBJ_UPVALUE: FREE(ObjUpvalue, object); break;
-        case OBJ_CHANNELCONTAINER: freeChannelObject(object); break;
-        case OBJ_UNOWNED_PACKEDPOINTER: FREE(ObjPackedPointer, object); break;
+        case OBJ_UPVALUE: return sizeof(ObjUpvalue);
+        case OBJ_CHANNELCONTAINER: return freeChannelObject(object);
+        case OBJ_UNOWNED_PACKEDPOINTER: return sizeof(ObjPackedPointer);
         case OBJ_PACKEDPOINTER: {
             ObjPackedPointer* ptr = (ObjPackedPointer*) object;
-            Value targetType = ptr->type->target_type == NULL ? NIL_VAL : OBJ_VAL(ptr->type->target_type);
-            ptr->destination = gc_free(ptr->destination, yt_sizeof_type_storage(targetType), 0);
-            FREE(ObjPackedPointer, object); 
-            break;
+            ptr->destination = gc_free(ptr->destination, ptr->storageSize, 0);
+            return sizeof(ObjPackedPointer);
         }
-        case OBJ_UNOWNED_UNIFORMARRAY: FREE(ObjPackedUniformArray, object); break;
+        case OBJ_UNOWNED_UNIFORMARRAY: return sizeof(ObjPackedUniformArray);
         case OBJ_PACKEDUNIFORMARRAY: {
             ObjPackedUniformArray* array = (ObjPackedUniformArray*)object;
-            ObjConcreteYargTypeArray* arrayType = (ObjConcreteYargTypeArray*)array->store.storedType;
-            size_t element_size = arrayElementSize(arrayType);
-            array->store.storedValue = gc_free(array->store.storedValue, arrayType->cardinality * element_size, 0);
-            FREE(ObjPackedUniformArray, object);
-            break;
+            array->store.storedValue = gc_free(array->store.storedValue, array->storageSize, 0);
+            return sizeof(ObjPackedUniformArray);
         }
-        case OBJ_UNOWNED_PACKEDSTRUCT: FREE(ObjPackedStruct, object); break;
+        case OBJ_UNOWNED_PACKEDSTRUCT: return sizeof(ObjPackedStruct);
         case OBJ_PACKEDSTRUCT: {
             ObjPackedStruct* struct_ = (ObjPackedStruct*) object;
-            struct_->store.storedValue = gc_free(struct_->store.storedValue, ((ObjConcreteYargTypeStruct*)(struct_->store.storedType))->storage_size, 0);
-            FREE(ObjPackedStruct, object);
-            break;            
+            struct_->store.storedValue = gc_free(struct_->store.storedValue, struct_->storageSize, 0);
+            return sizeof(ObjPackedStruct);            
         }
         case OBJ_MAP: {
             ObjMap* map = (ObjMap*)object;
             freeTable(&map->entries);
-            FREE(ObjMap, object);
-            break;
+            return sizeof(ObjMap);
         }
-        case OBJ_YARGTYPE: FREE(ObjConcreteYargType, object); break;
-        case OBJ_YARGTYPE_ARRAY: FREE(ObjConcreteYargTypeArray, object); break;
+        case OBJ_YARGTYPE: return sizeof(ObjConcreteYargType);
+        case OBJ_YARGTYPE_ARRAY: return sizeof(ObjConcreteYargTypeArray);
         case OBJ_YARGTYPE_STRUCT: {
             ObjConcreteYargTypeStruct* t = (ObjConcreteYargTypeStruct*)object;
             FREE_ARRAY(ObjConcreteYargType*, t->field_types, t->field_count);
             FREE_ARRAY(size_t, t->field_indexes, t->field_count);
             freeTable(&t->field_names);
-            FREE(ObjConcreteYargTypeStruct, object);
-            break;
+            return sizeof(ObjConcreteYargTypeStruct);
+        }
+        case OBJ_YARGTYPE_MAP: return sizeof(ObjConcreteYargTypeMap);
+        case OBJ_YARGTYPE_POINTER: return sizeof(ObjConcreteYargTypePointer);
+        case OBJ_SYNCGROUP: return freeSyncGroup(object);
+        case OBJ_STACKSLICE: {
+            ObjStackSlice* slice = (ObjStackSlice*)object;
+            return sizeof(ObjStackSlice) + sizeof(StackSlice) * slice->count;
         }
-        case OBJ_YARGTYPE_MAP: FREE(ObjConcreteYargTypeMap, object); break;
-        case OBJ_YARGTYPE_POINTER: FREE(ObjConcreteYargTypePointer, object); break;
-        case OBJ_SYNCGROUP: freeSyncGroup(object); break;
-        case OBJ_STACKSLICE: FREE(ObjStackSlice, object); break;
-        case OBJ_AST: FREE(ObjAst, object); break;
-        case OBJ_PLACEALIAS: FREE(ObjPlaceAlias, object); break;
+        case OBJ_AST: return sizeof(ObjAst);
+        case OBJ_PLACEALIAS: return sizeof(ObjPlaceAlias);
         case OBJ_STMT_RETURN: // fall through
         case OBJ_STMT_YIELD:
         case OBJ_STMT_PRINT:
-        case OBJ_STMT_EXPRESSION: FREE(ObjStmtExpression, object); break;
-        case OBJ_STMT_POKE: FREE(ObjStmtPoke, object); break;
-        case OBJ_STMT_VARDECLARATION: FREE(ObjStmtVarDeclaration, object); break;
-        case OBJ_STMT_FIELDDECLARATION: FREE(ObjStmtFieldDeclaration, object); break;
+        case OBJ_STMT_EXPRESSION: return sizeof(ObjStmtExpression);
+        case OBJ_STMT_POKE: return sizeof(ObjStmtPoke);
+        case OBJ_STMT_VARDECLARATION: return sizeof(ObjStmtVarDeclaration);
+        case OBJ_STMT_FIELDDECLARATION: return sizeof(ObjStmtFieldDeclaration);
         case OBJ_STMT_PLACEDECLARATION: {
             ObjStmtPlaceDeclaration* stmt = (ObjStmtPlaceDeclaration*)object;
             freeDynamicObjArray(&stmt->aliases);
-            FREE(ObjStmtPlaceDeclaration, object);
-            break;
+            return sizeof(ObjStmtPlaceDeclaration);
         }
-        case OBJ_STMT_BLOCK: FREE(ObjStmtBlock, object); break;
-        case OBJ_STMT_IF: FREE(ObjStmtIf, object); break;
+        case OBJ_STMT_BLOCK: return sizeof(ObjStmtBlock);
+        case OBJ_STMT_IF: return sizeof(ObjStmtIf);
         case OBJ_STMT_FUNDECLARATION: {
             ObjStmtFunDeclaration* fun = (ObjStmtFunDeclaration*)object;
             freeDynamicObjArray(&fun->parameters);
-            FREE(ObjStmtFunDeclaration, object); 
-            break;
+            return sizeof(ObjStmtFunDeclaration);
         }
-        case OBJ_STMT_WHILE: FREE(ObjStmtWhile, object); break;
-        case OBJ_STMT_FOR: FREE(ObjStmtFor, object); break;
+        case OBJ_STMT_WHILE: return sizeof(ObjStmtWhile);
+        case OBJ_STMT_FOR: return sizeof(ObjStmtFor);
         case OBJ_STMT_CLASSDECLARATION: {
             ObjStmtClassDeclaration* decl = (ObjStmtClassDeclaration*)object;
             freeDynamicObjArray(&decl->methods);
-            FREE(ObjStmtClassDeclaration, object);
-            break;
+            return sizeof(ObjStmtClassDeclaration);
         }
-        case OBJ_EXPR_NUMBER: FREE(ObjExprNumber, object); break;
-        case OBJ_EXPR_ADDRESS: FREE(ObjExprAddress, object); break;
-        case OBJ_EXPR_OPERATION: FREE(ObjExprOperation, object); break;
-        case OBJ_EXPR_GROUPING: FREE(ObjExprGrouping, object); break;
-        case OBJ_EXPR_NAMEDVARIABLE: FREE(ObjExprNamedVariable, object); break;
-        case OBJ_EXPR_LITERAL: FREE(ObjExprLiteral, object); break;
-        case OBJ_EXPR_STRING: FREE(ObjExprString, object); break;
+        case OBJ_EXPR_NUMBER: return sizeof(ObjExprNumber);
+        case OBJ_EXPR_ADDRESS: return sizeof(ObjExprAddress);
+        case OBJ_EXPR_OPERATION: return sizeof(ObjExprOperation);
+        case OBJ_EXPR_GROUPING: return sizeof(ObjExprGrouping);
+        case OBJ_EXPR_NAMEDVARIABLE: return sizeof(ObjExprNamedVariable);
+        case OBJ_EXPR_LITERAL: return sizeof(ObjExprLiteral);
+        case OBJ_EXPR_STRING: return sizeof(ObjExprString);
         case OBJ_EXPR_CALL: {
             ObjExprCall* call = (ObjExprCall*)object;
             freeDynamicObjArray(&call->arguments);
-            FREE(ObjExprCall, object); 
-            break;
+            return sizeof(ObjExprCall);
         }
         case OBJ_EXPR_COLLECTION_INITIALIZER: {
             ObjExprCollectionInitializer* init = (ObjExprCollectionInitializer*)object;
             freeDynamicObjArray(&init->initializers);
-            FREE(ObjExprCollectionInitializer, object); 
-            break;
+            return sizeof(ObjExprCollectionInitializer);
         }
-        case OBJ_EXPR_COLLECTION_ELEMENT: FREE(ObjExprCollectionElement, object); break;
-        case OBJ_EXPR_PAIR: FREE(ObjExprPair, object); break;
-        case OBJ_EXPR_BUILTIN: FREE(ObjExprBuiltin, object); break;
-        case OBJ_EXPR_DOT: FREE(ObjExprDot, object); break;
-        case OBJ_EXPR_SUPER: FREE(ObjExprSuper, object); break;
-        case OBJ_EXPR_TYPE: FREE(ObjExprTypeLiteral, object); break;
+        case OBJ_EXPR_COLLECTION_ELEMENT: return sizeof(ObjExprCollectionElement);
+        case OBJ_EXPR_PAIR: return sizeof(ObjExprPair);
+        case OBJ_EXPR_BUILTIN: return sizeof(ObjExprBuiltin);
+        case OBJ_EXPR_DOT: return sizeof(ObjExprDot);
+        case OBJ_EXPR_SUPER: return sizeof(ObjExprSuper);
+        case OBJ_EXPR_TYPE: return sizeof(ObjExprTypeLiteral);
         case OBJ_EXPR_TYPE_STRUCT: {
             ObjExprTypeStruct* expr = (ObjExprTypeStruct*)object;
             freeDynamicValueArray(&expr->fieldsByIndex);
-            FREE(ObjExprTypeStruct, object);
-            break;
+            return sizeof(ObjExprTypeStruct);
         }
-        case OBJ_EXPR_TYPE_INDEXED_COLLECTION: FREE(ObjExprTypeIndexedCollection, object); break;
-        case OBJ_INT: FREE(ObjInt, object); break;
+        case OBJ_EXPR_TYPE_INDEXED_COLLECTION: return sizeof(ObjExprTypeIndexedCollection);
+        case OBJ_INT: return sizeof(ObjInt) + ((ObjInt*)object)->bigInt.m_ * sizeof(uint16_t);
+#ifdef CYARG_COMPACT_VALUE
+        case OBJ_BOXED: return sizeof(ObjBoxed);
+#endif
     }
 }
 
 static void markRoots() {
     markVMRoots();
     markCompilerRoots();
+
+    // objects not yet handed to the heap are traced whether or not they were marked before.
+    // A context may be adding to them meanwhile; each is stored before the count covers it.
+    for (int i = 0; i < ALLOC_CONTEXTS; i++) {
+        AllocContext* context = &vm.allocContexts[i];
+        int count = __atomic_load_n(&context->newObjectCount, __ATOMIC_ACQUIRE);
+        for (int j = 0; j < count; j++) {
+            Obj* object = context->newObjects[j];
+            if (object->isMarked) {
+                blackenObject(object);
+            } else {
+                markObject(object);
+            }
+        }
+    }
 }
 
 static void traceReferences() {
@@ -644,75 +1243,385 @@ static void traceReferences() {
     }
 }
 
-static void sweep() {
-    Obj* previous = NULL;
-    Obj* object = vm.objects;
-    while (object != NULL) {
-        if (object->isMarked) {
-            object->isMarked = false;
-            previous = object;
-            object = object->next;
-        } else {
-            Obj* unreached = object;
-            object = object->next;
-            if (previous != NULL) {
-                previous->next = object;
-            } else {
-                vm.objects = object;
-            }
+static bool hasWriteBarrier(ObjType type) {
+    switch (type) {
+        case OBJ_BOUND_METHOD:
+        case OBJ_CLOSURE:
+        case OBJ_INSTANCE:
+        case OBJ_MAP:
+        case OBJ_UPVALUE:
+        // these refer to no other objects
+        case OBJ_NATIVE:
+        case OBJ_BUILTIN:
+        case OBJ_STRING:
+        case OBJ_INT:
+#ifdef CYARG_COMPACT_VALUE
+        case OBJ_BOXED:
+#endif
+        case OBJ_YARGTYPE:
+        case OBJ_STACKSLICE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static uint64_t gcClockMicros() {
+#if defined(CYARG_PICO_SDK_TARGET)
+    return time_us_64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
+
+static void recordPause(uint64_t start) {
+    uint64_t micros = gcClockMicros() - start;
+    vm.gcMicros += micros;
+    int bucket = 0;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && micros >= ((uint64_t)1 << bucket)) {
+        bucket++;
+    }
+    vm.gcPauses[bucket]++;
+}
+
+void registerObject(Obj* object) {
+    AllocContext* context = allocContext();
+    int count = context->newObjectCount;
+    context->newObjects[count] = object;
+    __atomic_store_n(&context->newObjectCount, count + 1, __ATOMIC_RELEASE);
+    if (count + 1 == ALLOC_PENDING) {
+        vm_mutex_enter_blocking(&vm.heap);
+        addNewObjects(context);
+        vm_mutex_exit(&vm.heap);
+    }
+}
 
-            freeObject(unreached);
+void writeBarrierSlow(Obj* holder, Obj* object) {
+    vm_mutex_enter_blocking(&vm.heap);
+
+    // while the heap is swept the marks still tell old objects from young, as when idle.
+    if ((vm.gcPhase == GC_IDLE || vm.gcPhase == GC_SWEEP) && !holder->isRemembered) {
+        addRemembered(holder);
+    } else if (vm.gcPhase == GC_MARK) {
+        markObject(object);
+    }
+
+    vm_mutex_exit(&vm.heap);
+}
+
+// Keeps the old objects without a write barrier, which are remembered as they are marked.
+static void forgetRemembered(bool keepUnbarriered) {
+    int kept = 0;
+    for (int i = 0; i < vm.rememberedCount; i++) {
+        Obj* object = vm.remembered[i];
+        if (keepUnbarriered && object->isMarked && !hasWriteBarrier(object->type)) {
+            vm.remembered[kept++] = object;
+        } else {
+            object->isRemembered = false;
         }
     }
+    vm.rememberedCount = kept;
 }
 
-void collectGarbage() {
+// Marks the young objects that are reachable, tracing from the roots and the remembered
+// old objects only. Objects outlive a young collection by becoming old: they stay
+// marked, so that the next young collection neither traces through nor frees them. The
+// rest are freed as their pages are swept.
+static void collectYoung() {
 
 #ifdef DEBUG_LOG_GC
-    PRINTERR("-- gc begin\n");
-    size_t before = vm.bytesAllocated;
+    PRINTERR("-- young gc begin\n");
 #endif
 
+    markRoots();
+    for (int i = 0; i < vm.rememberedCount; i++) {
+        blackenObject(vm.remembered[i]);
+    }
+    traceReferences();
+    tableRemoveWhite(&vm.strings);
+    yargTypeTableRemoveWhite(&vm.compositeTypes);
+
+    forgetRemembered(true);
+    flipSweepEpoch();
+    vm.gcYoungCollections++;
+
+    vm.nextYoungGC = vm.bytesAllocated + NURSERY_SIZE;
+
+#ifdef DEBUG_LOG_GC
+    PRINTERR("-- young gc end\n");
+    PRINTERR("   %zu bytes allocated before sweeping, next at %zu\n",
+             vm.bytesAllocated, vm.nextYoungGC);
+#endif
+}
+
+// The old generation is collected in steps of at most vm.gcStepObjects objects, one
+// step at each allocation until the collection is done. The last sweep is finished, the
+// marks cleared a page at a time, and the gray objects traced from the roots. Only
+// clearing the strings and types that are no longer reachable, after tracing once more
+// from the roots and from the objects without a write barrier, is done in one go. The
+// heap is then swept in steps too.
+static void beginCollection() {
+#ifdef DEBUG_LOG_GC
+    PRINTERR("-- gc begin\n");
+#endif
     assert(o1heapDoInvariantsHold(vm.heap_instance));
 
+    vm.gcPhase = GC_SWEEP;
+}
+
+static void finishMarking() {
     markRoots();
+    for (int i = 0; i < vm.rememberedCount; i++) {
+        if (vm.remembered[i]->isMarked) {
+            blackenObject(vm.remembered[i]);
+        }
+    }
     traceReferences();
     tableRemoveWhite(&vm.strings);
-    sweep();
+    yargTypeTableRemoveWhite(&vm.compositeTypes);
 
-    size_t candidateGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
-    vm.nextGC = candidateGC > ALWAYS_GC_ABOVE ? ALWAYS_GC_ABOVE : candidateGC;
+    forgetRemembered(true);
+    flipSweepEpoch();
+    vm.gcPhase = GC_SWEEP;
+    vm.gcCollections++;
+
+    // the next collection is sized once the garbage has been swept.
+    vm.sweepingOldGeneration = true;
+    vm.nextGC = SIZE_MAX;
+    vm.nextYoungGC = vm.bytesAllocated + NURSERY_SIZE;
 
 #ifdef DEBUG_LOG_GC
     PRINTERR("-- gc end\n");
-    PRINTERR("   collected %zu bytes (from %zu to %zu) next at %zu\n",
-             before - vm.bytesAllocated, before, vm.bytesAllocated,
-             vm.nextGC);
 #endif
+}
 
+// With a time budget, the growth allowed is scaled by how far over or under it the
+// collector has been since the last collection, but never below vm.gcGrowthPercent.
+static void paceCollections() {
+    uint64_t now = gcClockMicros();
+    uint64_t elapsed = now - vm.gcPacerStart;
+    uint64_t spent = vm.gcMicros - vm.gcPacerMicros;
+    vm.gcPacerStart = now;
+    vm.gcPacerMicros = vm.gcMicros;
+
+    if (vm.gcTimePercent == 0 || elapsed == 0) {
+        vm.gcPacedPercent = vm.gcGrowthPercent;
+        return;
+    }
+
+    uint64_t paced = vm.gcPacedPercent * spent * 100 / (elapsed * vm.gcTimePercent);
+    if (paced < vm.gcGrowthPercent) {
+        paced = vm.gcGrowthPercent;
+    } else if (paced > GC_PACED_MAX_PERCENT) {
+        paced = GC_PACED_MAX_PERCENT;
+    }
+    vm.gcPacedPercent = (uint32_t)paced;
+}
+
+// can only be called with the heap critical section held, and is again when the pacing
+// is changed. Until the sweep after a collection is done, there is nothing to size by.
+void paceNextCollection() {
+    if (vm.sweepingOldGeneration) return;
+
+    // once the live heap is above half the arena, collect whenever the old generation
+    // has grown by a nursery's worth.
+    size_t growth = vm.gcLiveBytes / 100 * vm.gcPacedPercent;
+    size_t limit = vm.heapSize / 2;
+    vm.nextGC = vm.gcLiveBytes + (growth > NURSERY_SIZE ? growth : NURSERY_SIZE);
+    if (vm.nextGC > limit) {
+        vm.nextGC = limit;
+    }
+    if (vm.nextGC < vm.gcLiveBytes + NURSERY_SIZE) {
+        vm.nextGC = vm.gcLiveBytes + NURSERY_SIZE;
+    }
+}
+
+static void sizeNextCollection() {
+    paceCollections();
+    vm.gcLiveBytes = vm.bytesAllocated;
+    paceNextCollection();
+
+#ifdef DEBUG_LOG_GC
+    PRINTERR("-- gc swept\n");
+    PRINTERR("   %zu bytes allocated, next at %zu\n", vm.bytesAllocated, vm.nextGC);
+#endif
 }
 
+static size_t clearPage(SlabPage* page) {
+    size_t count = 0;
+    for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+        uint32_t bits = page->objectBits[word];
+        while (bits != 0) {
+            int bit = __builtin_ctz(bits);
+            bits &= bits - 1;
+            pageObject(page, (size_t)word * 32 + bit)->isMarked = false;
+            count++;
+        }
+    }
+    return count;
+}
+
+static void collectionStep(size_t budget) {
+    switch (vm.gcPhase) {
+        case GC_IDLE:
+            break;
+        case GC_SWEEP: {
+            bool marked = vm.sweepingOldGeneration;
+            if (!sweepStep(budget)) break;
+            if (marked) {
+                vm.gcPhase = GC_IDLE;
+            } else {
+                vm.gcPhase = GC_CLEAR;
+                vm.pageCursor = 0;
+                vm.largeCursor = vm.largeObjects;
+            }
+            break;
+        }
+        case GC_CLEAR:
+            while (budget > 0 && vm.pageCursor < vm.slabPageCount) {
+                SlabPage* page = vm.slabPages[vm.pageCursor++];
+                if (page->holdsObjects) {
+                    size_t count = clearPage(page);
+                    budget -= count < budget ? count : budget;
+                }
+            }
+            for (; budget > 0 && vm.largeCursor != NULL; budget--) {
+                largeObjectBody(vm.largeCursor)->isMarked = false;
+                vm.largeCursor = vm.largeCursor->next;
+            }
+            if (vm.pageCursor == vm.slabPageCount && vm.largeCursor == NULL) {
+                vm.gcPhase = GC_MARK;
+                markRoots();
+            }
+            break;
+        case GC_MARK:
+            for (; budget > 0 && vm.grayCount > 0; budget--) {
+                blackenObject(vm.grayStack[--vm.grayCount]);
+            }
+            if (vm.grayCount == 0) {
+                finishMarking();
+            }
+            break;
+    }
+}
+
+void collectGarbageStep(size_t budget) {
+    uint64_t start = gcClockMicros();
+    collectionStep(budget);
+    recordPause(start);
+}
+
+// Without a step size, the old generation is collected, and swept, in one go.
+static void collectOldGeneration() {
+    beginCollection();
+    if (vm.gcStepObjects == 0) {
+        while (vm.gcPhase != GC_IDLE) {
+            collectionStep(SIZE_MAX);
+        }
+    }
+}
+
+static void sweepGarbageStep(size_t budget) {
+    uint64_t start = gcClockMicros();
+    sweepStep(budget == 0 ? SIZE_MAX : budget);
+    recordPause(start);
+}
+
+// Whatever the last collection left to sweep is swept first, so that the heap is
+// measured by what is live when deciding whether the old generation is due.
+void collectYoungGarbage() {
+    if (vm.gcPhase != GC_IDLE) return;
+
+    uint64_t start = gcClockMicros();
+    sweepStep(SIZE_MAX);
+    if (vm.bytesAllocated > vm.nextGC) {
+        collectOldGeneration();
+    } else {
+        collectYoung();
+        if (vm.gcStepObjects == 0) {
+            sweepStep(SIZE_MAX);
+        }
+    }
+    recordPause(start);
+}
+
+void collectGarbage() {
+    uint64_t start = gcClockMicros();
+    if (vm.gcPhase == GC_IDLE) {
+        beginCollection();
+    }
+    while (vm.gcPhase != GC_IDLE) {
+        collectionStep(SIZE_MAX);
+    }
+    sweepStep(SIZE_MAX);
+    recordPause(start);
+}
+
+static void freeLargeObjects(LargeObject* large) {
+    while (large != NULL) {
+        LargeObject* next = large->next;
+        releaseObject(largeObjectBody(large));
+        o1heapFree(vm.heap_instance, large);
+        large = next;
+    }
+}
+
+// Objects are freed in no particular order, and pages may go as their blocks are freed,
+// so the page cursor keeps the place.
 void freeObjects() {
-    Obj* object = vm.objects;
-    while (object != NULL) {
-        Obj* next = object->next;
-        freeObject(object);
-        object = next;
+    for (int i = 0; i < ALLOC_CONTEXTS; i++) {
+        addNewObjects(&vm.allocContexts[i]);
+        o1heapFree(vm.heap_instance, vm.allocContexts[i].tempRoots);
+        initAllocContext(&vm.allocContexts[i]);
     }
+    for (vm.pageCursor = 0; vm.pageCursor < vm.slabPageCount;) {
+        SlabPage* page = vm.slabPages[vm.pageCursor++];
+        if (!page->holdsObjects) continue;
+        for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+            for (uint32_t bits = page->objectBits[word]; bits != 0; bits &= bits - 1) {
+                releaseObject(pageObject(page, (size_t)word * 32 + __builtin_ctz(bits)));
+            }
+        }
+    }
+    freeLargeObjects(vm.largeObjects);
+    freeLargeObjects(vm.unsweptLarge);
 
     o1heapFree(vm.heap_instance, vm.grayStack);
+    o1heapFree(vm.heap_instance, vm.remembered);
+    for (int i = 0; i < vm.slabPageCount; i++) {
+        SLAB_UNPOISON(vm.slabPages[i], SLAB_PAGE_BYTES);
+        o1heapFree(vm.heap_instance, vm.slabPages[i]);
+    }
+    o1heapFree(vm.heap_instance, vm.slabPages);
+}
+
+static void printObject(Obj* object) {
+    PRINTERR("%p ", (void*)object);
+    fprintValue(stderr, OBJ_VAL(object));
+    PRINTERR("\n");
 }
 
 void printObjects() {
     PRINTERR("=== Objects ===\n");
-    Obj* object = vm.objects;
     size_t count = 0;
-    while (object != NULL) {
-        PRINTERR("%p ", (void*)object);
-        fprintValue(stderr, OBJ_VAL(object));
-        PRINTERR("\n");
-        object = object->next;
-        count++;
+    for (int i = 0; i < vm.slabPageCount; i++) {
+        SlabPage* page = vm.slabPages[i];
+        if (!page->holdsObjects) continue;
+        for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+            for (uint32_t bits = page->objectBits[word]; bits != 0; bits &= bits - 1) {
+                printObject(pageObject(page, (size_t)word * 32 + __builtin_ctz(bits)));
+                count++;
+            }
+        }
+    }
+    LargeObject* lists[] = { vm.largeObjects, vm.unsweptLarge };
+    for (int i = 0; i < 2; i++) {
+        for (LargeObject* large = lists[i]; large != NULL; large = large->next) {
+            printObject(largeObjectBody(large));
+            count++;
+        }
     }
     PRINTERR("=== End Objects (%zu) ===\n", count);
 }
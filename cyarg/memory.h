@@ -6,11 +6,85 @@
 
 typedef struct O1HeapInstance O1HeapInstance;
 
+#if defined(CYARG_SELF_HOSTED)
+#define HEAP_SIZE_DEFAULT (190 * 1024)
+#else
+#define HEAP_SIZE_DEFAULT (10000 * 1024)
+#endif
+#define HEAP_SIZE_MIN (64 * 1024)
+
+// On a hosted build the arena is allocated at startup, and may be given another size first.
+void setHeapSize(size_t size);
 void init_heap_instance(O1HeapInstance** instance);
 
-#define TEMP_ROOTS_MAX 8
 #define FIRST_GC_AT 50 * 1024
-#define ALWAYS_GC_ABOVE 100 * 1024
+// the old generation may grow by this much of what survived it before it is collected
+// again, or by up to GC_PACED_MAX_PERCENT while the collector is over its time budget.
+#define GC_GROWTH_PERCENT 100
+#define GC_PACED_MAX_PERCENT 1600
+#if defined(CYARG_SELF_HOSTED)
+#define NURSERY_SIZE 8 * 1024
+#else
+#define NURSERY_SIZE 64 * 1024
+#endif
+#ifndef GC_STEP_OBJECTS
+#define GC_STEP_OBJECTS 64
+#endif
+// pauses are counted by the power of two microseconds they are under
+#define GC_PAUSE_BUCKETS 16
+
+// Blocks of up to SLAB_MAX bytes are carved from slab pages taken from the heap, in
+// classes SLAB_CLASS_SIZE apart, rather than each rounded up to a power of two. They are
+// handed out to allocation contexts ALLOC_BATCH at a time.
+#define SLAB_CLASS_SIZE 16
+#define SLAB_CLASS_COUNT 8
+#define SLAB_MAX (SLAB_CLASS_SIZE * SLAB_CLASS_COUNT)
+#if defined(CYARG_SELF_HOSTED)
+#define SLAB_PAGE_SIZE 2048
+#else
+#define SLAB_PAGE_SIZE 4096
+#endif
+#define ALLOC_BATCH 8
+#define ALLOC_PENDING 16
+#define SLAB_BITMAP_WORDS ((SLAB_PAGE_SIZE / SLAB_CLASS_SIZE + 31) / 32)
+
+typedef struct SlabPage SlabPage;
+
+// Objects too big for a slab page each have a header of their own, to be listed by.
+typedef struct LargeObject {
+    struct LargeObject* next;
+} LargeObject;
+
+typedef struct {
+    SlabPage* partialPages;
+    uint32_t pageCount;
+    uint32_t liveCount;
+} SlabClass;
+
+typedef enum {
+    GC_IDLE,
+    GC_SWEEP,   // before clearing marks, and after marking
+    GC_CLEAR,
+    GC_MARK,
+} GcPhase;
+
+// Each core, and each pinned routine's handler, allocates in a context of its own. Small
+// blocks and objects come from its buffers and its objects are kept to itself, so
+// neither takes vm.heap; that is taken to refill a buffer, or once ALLOC_PENDING objects
+// have been made, which also hands the objects to the heap and collects if it is due.
+// Until then the collector traces them as roots, as it does the values on its stack of
+// temporary roots.
+typedef struct AllocContext {
+    void* freeBlocks[SLAB_CLASS_COUNT];
+    void* objectBlocks[SLAB_CLASS_COUNT];
+    size_t bytesPending;
+    Obj* newObjects[ALLOC_PENDING];
+    int newObjectCount;
+
+    Value* tempRoots;
+    int tempRootCount;
+    int tempRootCapacity;
+} AllocContext;
 
 #define ALLOCATE(type, count) \
     (type*)reallocate(NULL, 0, sizeof(type) * (count))
@@ -28,17 +102,48 @@ void init_heap_instance(O1HeapInstance** instance);
     gc_free(pointer, sizeof(type) * oldCount, 0)
 
 void* gc_free(void* pointer, size_t oldSize, size_t newSize);
+uint32_t slabLive(int sizeClass);
+uint32_t slabCapacity(int sizeClass);
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+void* allocateObjectMemory(size_t size);
+bool callStackMayGrow(size_t size);
+
+void initAllocContext(AllocContext* context);
+AllocContext* enterAllocContext(AllocContext* context);
+void leaveAllocContext(AllocContext* outer);
 
 void tempRootPush(Value value);
 Value tempRootPop();
 
+void registerObject(Obj* object);
+void writeBarrierSlow(Obj* holder, Obj* object);
+
+// Stores of references into instances, maps, closures and upvalues are followed by a
+// write barrier. It remembers old objects given young ones, for a young collection to
+// trace from, and marks unmarked objects stored while the old generation is being
+// marked. Objects of other types are traced again by each instead.
+static inline void writeBarrierObj(Obj* holder, Obj* object) {
+    if (holder->isMarked && !holder->isRemembered && object != NULL && !object->isMarked) {
+        writeBarrierSlow(holder, object);
+    }
+}
+
+static inline void writeBarrier(Obj* holder, Value value) {
+    if (IS_OBJ(value)) writeBarrierObj(holder, AS_OBJ(value));
+#ifdef CYARG_COMPACT_VALUE
+    else if (IS_BOXED(value)) writeBarrierObj(holder, AS_OBJ(value));
+#endif
+}
+
 void markObject(Obj* object);
 void markDynamicObjArray(DynamicObjArray* array);
 void markValue(Value value);
 void markValueCell(ValueCell* value);
 void markFunction(ObjFunction* function);
+void collectYoungGarbage();
+void collectGarbageStep(size_t budget);
 void collectGarbage();
+void paceNextCollection();
 void freeObjects();
 void printObjects();
 void pinObj(Obj* object);
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "common.h"
@@ -121,6 +122,125 @@ bool clock_get_hzNative(ObjRoutine* routine, int argCount, Value* result) {
     return true;
 }
 
+bool gc_pausesNative(ObjRoutine* routine, int argCount, Value* result) {
+    if (argCount != 1) {
+        runtimeError(routine, "Expected 1 arguments but got %d.", argCount);
+        return false;
+    }
+    Value bucketVal = nativeArgument(routine, argCount, 0);
+
+    if (!is_positive_integer32(bucketVal)) {
+        runtimeError(routine, "Argument must be a positive integer");
+        return false;
+    }
+
+    // the number of collector pauses under 2^bucket us, and at least half that.
+    uint32_t bucket = as_positive_integer32(bucketVal);
+    *result = UI32_VAL(bucket < GC_PAUSE_BUCKETS ? vm.gcPauses[bucket] : 0);
+    return true;
+}
+
+// slab classes are numbered from 0, for blocks of up to SLAB_CLASS_SIZE bytes.
+static bool slabClassArgument(ObjRoutine* routine, int argCount, uint32_t* sizeClass) {
+    if (argCount != 1) {
+        runtimeError(routine, "Expected 1 arguments but got %d.", argCount);
+        return false;
+    }
+    Value classVal = nativeArgument(routine, argCount, 0);
+
+    if (!is_positive_integer32(classVal)) {
+        runtimeError(routine, "Argument must be a positive integer");
+        return false;
+    }
+    *sizeClass = as_positive_integer32(classVal);
+    return true;
+}
+
+bool gc_slab_liveNative(ObjRoutine* routine, int argCount, Value* result) {
+    uint32_t sizeClass;
+    if (!slabClassArgument(routine, argCount, &sizeClass)) return false;
+
+    // blocks in use, including those allocation contexts hold ready to hand out.
+    *result = UI32_VAL(sizeClass < SLAB_CLASS_COUNT ? slabLive((int)sizeClass) : 0);
+    return true;
+}
+
+bool gc_slab_capacityNative(ObjRoutine* routine, int argCount, Value* result) {
+    uint32_t sizeClass;
+    if (!slabClassArgument(routine, argCount, &sizeClass)) return false;
+
+    *result = UI32_VAL(sizeClass < SLAB_CLASS_COUNT ? slabCapacity((int)sizeClass) : 0);
+    return true;
+}
+
+// gc_config(name) gives a setting or count of the collector, gc_config(name, value) sets
+// one of "growth", "time" and "step". Growth is the percentage by which the old generation
+// may grow over what survived it before it is collected again; time the percentage of
+// time the collector aims to stay under, raising growth as needed, or 0 for no aim; step
+// the objects traced or swept at each step, or 0 to collect in one go.
+bool gc_configNative(ObjRoutine* routine, int argCount, Value* result) {
+    if (argCount != 1 && argCount != 2) {
+        runtimeError(routine, "Expected 1 or 2 arguments but got %d.", argCount);
+        return false;
+    }
+    Value nameVal = nativeArgument(routine, argCount, 0);
+    if (!IS_STRING(nameVal)) {
+        runtimeError(routine, "Argument must be a string");
+        return false;
+    }
+    const char* name = AS_CSTRING(nameVal);
+
+    uint32_t* setting = NULL;
+    uint32_t step = (uint32_t)vm.gcStepObjects;
+    if (strcmp(name, "growth") == 0) {
+        setting = &vm.gcGrowthPercent;
+    } else if (strcmp(name, "time") == 0) {
+        setting = &vm.gcTimePercent;
+    } else if (strcmp(name, "step") == 0) {
+        setting = &step;
+    }
+
+    if (argCount == 2) {
+        Value value = nativeArgument(routine, argCount, 1);
+        if (setting == NULL) {
+            runtimeError(routine, "Cannot set '%s'.", name);
+            return false;
+        }
+        if (!is_positive_integer32(value)) {
+            runtimeError(routine, "Argument must be a positive integer");
+            return false;
+        }
+        vm_mutex_enter_blocking(&vm.heap);
+        *setting = as_positive_integer32(value);
+        vm.gcStepObjects = step;
+        if (setting == &vm.gcGrowthPercent) {
+            vm.gcPacedPercent = vm.gcGrowthPercent;
+        }
+        if (setting != &step) {
+            paceNextCollection();
+        }
+        vm_mutex_exit(&vm.heap);
+    }
+
+    if (setting != NULL) {
+        *result = UI32_VAL(*setting);
+    } else if (strcmp(name, "collections") == 0) {
+        *result = UI32_VAL(vm.gcCollections);
+    } else if (strcmp(name, "young") == 0) {
+        *result = UI32_VAL(vm.gcYoungCollections);
+    } else if (strcmp(name, "micros") == 0) {
+        *result = UI32_VAL(vm.gcMicros);
+    } else if (strcmp(name, "heap") == 0) {
+        *result = UI32_VAL(vm.heapSize);
+    } else if (strcmp(name, "allocated") == 0) {
+        *result = UI32_VAL(vm.bytesAllocated);
+    } else {
+        runtimeError(routine, "Unknown collector setting '%s'.", name);
+        return false;
+    }
+    return true;
+}
+
 bool stdin_getsNative(ObjRoutine* routine, int argCount, Value* result) {
     if (argCount != 0) {
         runtimeError(routine, "Expected 0 arguments but got %d.", argCount);
@@ -5,6 +5,10 @@
 
 bool clockNative(ObjRoutine* routine, int argCount, Value* result);
 bool clock_get_hzNative(ObjRoutine* routine, int argCount, Value* result);
+bool gc_pausesNative(ObjRoutine* routine, int argCount, Value* result);
+bool gc_slab_liveNative(ObjRoutine* routine, int argCount, Value* result);
+bool gc_slab_capacityNative(ObjRoutine* routine, int argCount, Value* result);
+bool gc_configNative(ObjRoutine* routine, int argCount, Value* result);
 
 bool irq_add_shared_handlerNative(ObjRoutine* routine, int argCount, Value* result);
 bool irq_remove_handlerNative(ObjRoutine* routine, int argCount, Value* result);
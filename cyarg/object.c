@@ -10,23 +10,21 @@
 #include "yargtype.h"
 #include "channel.h"
 #include "sync_group.h"
+#include "shape.h"
 
 #define ALLOCATE_OBJ(type, objectType) \
     (type*)allocateObject(sizeof(type), objectType)
 
 Obj* allocateObject(size_t size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+    Obj* object = (Obj*)allocateObjectMemory(size);
     memset(object, 0, size);
 
     object->type = type;
     object->isMarked = false;
+    object->isRemembered = false;
+    object->isLarge = size > SLAB_MAX;
 
-    vm_mutex_enter_blocking(&vm.heap);
-
-    object->next = vm.objects;
-    vm.objects = object;
-    
-    vm_mutex_exit(&vm.heap);
+    registerObject(object);
 
 #ifdef DEBUG_LOG_GC
     PRINTERR("%p allocate %zu for %d\n", (void*)object, size, type);
@@ -35,6 +33,23 @@ Obj* allocateObject(size_t size, ObjType type) {
     return object;
 }
 
+#ifdef CYARG_COMPACT_VALUE
+Value boxValue(ValueType type, uint64_t bits) {
+    ObjBoxed* boxed = ALLOCATE_OBJ(ObjBoxed, OBJ_BOXED);
+    boxed->type = type;
+    boxed->bits = bits;
+    return (Value){ VALUE_SIGN_BIT | VALUE_QNAN | VALUE_WIDE_BIT | (uint64_t)(uintptr_t)boxed };
+}
+
+ValueType boxedValueType(Value value) {
+    return ((ObjBoxed*)AS_OBJ(value))->type;
+}
+
+uint64_t boxedValueBits(Value value) {
+    return ((ObjBoxed*)AS_OBJ(value))->bits;
+}
+#endif
+
 ObjInt* allocateIntObject(size_t numDigits) {
     numDigits += numDigits % 2; // numDigits is always even
     assert(numDigits <= 254 && numDigits >= 2);
@@ -89,6 +104,8 @@ ObjClass* newClass(ObjString* name) {
     ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
     klass->name = name;
     initTable(&klass->methods);
+    klass->rootShape = NULL;
+    klass->fieldCountHint = 0;
     return klass;
 }
 
@@ -115,14 +132,31 @@ void initFunction(ObjFunction* function) {
     // may not be called after alloc, so init all fields.
     function->arity = 0;
     function->upvalueCount = 0;
+    function->maxStackDepth = 0;
+    function->hotness = 0;
     function->fName = NULL;
+#if defined(CYARG_JIT)
+    function->jit = NULL;
+#endif
+#if defined(CYARG_AOT)
+    function->aot = NULL;
+#endif
     initChunk(&function->chunk);
 }
 
 ObjInstance* newInstance(ObjClass* klass) {
-    ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+    if (klass->rootShape == NULL) {
+        klass->rootShape = newShape(NULL, NULL);
+    }
+    int inlineCapacity = klass->fieldCountHint;
+    ObjInstance* instance = (ObjInstance*)allocateObject(
+        sizeof(ObjInstance) + sizeof(Value) * inlineCapacity, OBJ_INSTANCE);
     instance->klass = klass;
-    initTable(&instance->fields);
+    instance->shape = klass->rootShape;
+    instance->fields = instance->inlineFields;
+    instance->dictionary = NULL;
+    instance->fieldCapacity = inlineCapacity;
+    instance->inlineCapacity = inlineCapacity;
     return instance;
 }
 
@@ -150,10 +184,32 @@ ObjInt* newIntU(uint64_t value) {
     return i;
 }
 
+// Only ints that do not fit in 32 bits are allocated.
+Value intValue(int64_t value) {
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        return SMALL_INT_VAL((int32_t)value);
+    }
+    return OBJ_VAL(newInt(value));
+}
+
+Int* intFromValue(Value value, IntConcrete2* scratch) {
+    if (IS_SMALL_INT(value)) {
+        Int* i = int_init_concrete2(scratch);
+        int_set_i(AS_SMALL_INT(value), i);
+        return i;
+    }
+    return &AS_INTOBJ(value)->bigInt;
+}
+
+bool isLiteralInt(Value value) {
+    if (IS_SMALL_INT(value)) {
+        return IS_SMALL_INT_LITERAL(value);
+    }
+    return IS_INT(value) && AS_INTOBJ(value)->isLiteral;
+}
+
 Value defaultIntValue() {
-    ObjInt *intObj = allocateIntObject(1);
-    int_init(&intObj->bigInt);
-    return OBJ_VAL(intObj);
+    return SMALL_INT_VAL(0);
 }
 
 PackedValue arrayElement(PackedValue array, size_t index) {
@@ -175,14 +231,12 @@ ObjPackedUniformArray* newPackedUniformArray(ObjConcreteYargTypeArray* type) {
     tempRootPush(OBJ_VAL(array));
 
     PackedValue new_array = { .storedType = (ObjConcreteYargType*) type, .storedValue = NULL };
-    new_array.storedValue = reallocate(NULL, 0, arrayElementSize(type) * type->cardinality);
-
-    for (size_t i = 0; i < type->cardinality; i++) {
-        PackedValue el = arrayElement(new_array, i);
-        initialisePackedValue(el);
-    }
+    size_t storageSize = type->core.layout.storage_size;
+    new_array.storedValue = reallocate(NULL, 0, storageSize);
+    initialisePackedValue(new_array);
 
     array->store = new_array;
+    array->storageSize = storageSize;
     tempRootPop();
     return array;
 }
@@ -213,21 +267,22 @@ ObjMap* newMap(ObjConcreteYargTypeMap* type) {
 }
 
 ObjPackedPointer* newPointerForHeapCell(PackedValue location) {
-
+    Value targetType = location.storedType ? OBJ_VAL(location.storedType) : NIL_VAL;
+    ObjConcreteYargTypePointer* type = (ObjConcreteYargTypePointer*) internYargPointerType(targetType);
+    tempRootPush(OBJ_VAL(type));
     ObjPackedPointer* ptr = ALLOCATE_OBJ(ObjPackedPointer, OBJ_PACKEDPOINTER);
-    tempRootPush(OBJ_VAL(ptr));
-    ptr->type = (ObjConcreteYargTypePointer*) newYargTypeFromType(TypePointer);
-    ptr->type->target_type = location.storedType;
+    ptr->type = type;
     ptr->destination = location.storedValue;
+    ptr->storageSize = yt_sizeof_type_storage(targetType);
     tempRootPop();
     return ptr;
 }
 
 ObjPackedPointer* newPointerAtHeapCell(PackedValue location) {
+    ObjConcreteYargTypePointer* type = (ObjConcreteYargTypePointer*) internYargPointerType(location.storedType ? OBJ_VAL(location.storedType) : NIL_VAL);
+    tempRootPush(OBJ_VAL(type));
     ObjPackedPointer* ptr = ALLOCATE_OBJ(ObjPackedPointer, OBJ_UNOWNED_PACKEDPOINTER);
-    tempRootPush(OBJ_VAL(ptr));
-    ptr->type = (ObjConcreteYargTypePointer*) newYargTypeFromType(TypePointer);
-    ptr->type->target_type = location.storedType;
+    ptr->type = type;
     ptr->destination = location.storedValue;
     tempRootPop();
     return ptr;
@@ -241,8 +296,7 @@ void offsetPointerDestination(ObjPackedPointer* pointer, size_t offset) {
 
 bool isAddressValue(Value val) {
     if (IS_INT(val)) {
-        ObjInt *i = AS_INTOBJ(val);
-        return i->isLiteral;
+        return isLiteralInt(val);
     } else if (IS_ADDRESS(val)) {
         return true;
     } else {
@@ -319,14 +373,11 @@ ObjPackedStruct* newPackedStruct(ObjConcreteYargTypeStruct* type) {
     tempRootPush(OBJ_VAL(object));
 
     PackedValue new_struct = { .storedType = (ObjConcreteYargType*) type, .storedValue = NULL };
-    new_struct.storedValue = reallocate(new_struct.storedValue, 0, type->storage_size);
-
-    for (size_t i = 0; i < type->field_count; i++) {
-        PackedValue f = structField(new_struct, i);
-        initialisePackedValue(f);
-    }
+    new_struct.storedValue = reallocate(new_struct.storedValue, 0, type->core.layout.storage_size);
+    initialisePackedValue(new_struct);
 
     object->store = new_struct;
+    object->storageSize = type->core.layout.storage_size;
 
     tempRootPop();
     return object;
@@ -382,7 +433,7 @@ static uint32_t hashString(const char* key, int length) {
     uint32_t hash = 2166136261u;
     for (int i = 0; i < length; i++) {
         hash ^= (uint8_t)key[i];
-        hash += 16777619;
+        hash *= 16777619;
     }
     return hash;
 }
@@ -439,10 +490,10 @@ ObjString* copyStringWithEscapes(const char* chars, int length)
 }
 
 
-ObjUpvalue* newUpvalue(ValueCell* slot, size_t stackOffset) {
+ObjUpvalue* newUpvalue(Value* slot, size_t stackOffset, ObjConcreteYargType* type) {
     ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
-    upvalue->closed.value = NIL_VAL;
-    upvalue->closed.cellType = NULL;
+    upvalue->closed = NIL_VAL;
+    upvalue->type = type;
     upvalue->contents = slot;
     upvalue->stackOffset = stackOffset;
     upvalue->next = NULL;
@@ -473,7 +524,9 @@ static ObjString* arrayToString(ObjPackedUniformArray* array) {
     for (int i = 0; i < arrayType->cardinality; i++) {
         PackedValue element = arrayElement(array->store, i);
         Value unpackedValue = unpackValue(element);
+        tempRootPush(unpackedValue);
         ObjString* candidate = valueToString(unpackedValue);
+        tempRootPop();
         snprintf(buffer + cursor, sizeof(buffer) - cursor, "%s", candidate->chars);
         cursor = strlen(buffer);
         if (i < arrayType->cardinality - 1) {
@@ -510,12 +563,14 @@ static ObjString* pointerToString(ObjPackedPointer* ptr) {
 static ObjString* structToString(ObjPackedStruct* st) {
     ObjConcreteYargTypeStruct* structType = (ObjConcreteYargTypeStruct*)st->store.storedType;
     char buffer[1024];
-    snprintf(buffer, sizeof(buffer), "struct{|%zu:%zu|", structType->field_count, structType->storage_size);
+    snprintf(buffer, sizeof(buffer), "struct{|%zu:%zu|", structType->field_count, structType->core.layout.storage_size);
     size_t cursor = strlen(buffer);
     for (size_t i = 0; i < structType->field_count; i++) {
         PackedValue f = structField(st->store, i);
         Value logValue = unpackValue(f);
+        tempRootPush(logValue);
         ObjString* fieldStr = valueToString(logValue);
+        tempRootPop();
         snprintf(buffer + cursor, sizeof(buffer) - cursor, "%s; ", fieldStr->chars);
         cursor = strlen(buffer);
     }
@@ -11,6 +11,7 @@ typedef struct ObjConcreteYargTypeArray ObjConcreteYargTypeArray;
 typedef struct ObjConcreteYargTypeStruct ObjConcreteYargTypeStruct;
 typedef struct ObjConcreteYargTypePointer ObjConcreteYargTypePointer;
 typedef struct ObjConcreteYargTypeMap ObjConcreteYargTypeMap;
+struct CallFrame;
 
 #define OBJ_TYPE(value)     (AS_OBJ(value)->type)
 
@@ -51,8 +52,11 @@ typedef struct ObjConcreteYargTypeMap ObjConcreteYargTypeMap;
 #define AS_STRUCT(value)       ((ObjPackedStruct*)AS_OBJ(value))
 #define AS_SYNCGROUP(value)    ((ObjSyncGroup*)AS_OBJ(value))
 #define AS_INTOBJ(value)       ((ObjInt*)AS_OBJ(value))
-#define AS_INT(value)          (&(AS_INTOBJ(value)->bigInt))
+// A small int is expanded into a block-scoped scratch Int, so the result is
+// valid until the end of the enclosing block.
+#define AS_INT(value)          (intFromValue((value), &(IntConcrete2){0}))
 #define AS_MAP(value)          ((ObjMap*)AS_OBJ(value))
+#define AS_SHAPE(value)        ((ObjShape*)AS_OBJ(value))
 
 typedef enum {
     OBJ_BOUND_METHOD,
@@ -60,6 +64,7 @@ typedef enum {
     OBJ_CLOSURE,
     OBJ_FUNCTION,
     OBJ_INSTANCE,
+    OBJ_SHAPE,
     OBJ_NATIVE,
     OBJ_BUILTIN,
     OBJ_ROUTINE,
@@ -113,13 +118,18 @@ typedef enum {
     OBJ_EXPR_TYPE,
     OBJ_EXPR_TYPE_STRUCT,
     OBJ_EXPR_TYPE_INDEXED_COLLECTION,
-    OBJ_INT
+    OBJ_INT,
+#ifdef CYARG_COMPACT_VALUE
+    OBJ_BOXED,
+#endif
 } ObjType;
 
+// Objects are found through the pages they are allocated in, so need no link of their own.
 struct Obj {
     ObjType type;
-    bool isMarked;
-    struct Obj* next;
+    bool isMarked;      // outside of a collection, set on the old generation
+    bool isRemembered;
+    bool isLarge;       // too big for a slab page
 };
 
 typedef struct {
@@ -133,8 +143,16 @@ typedef struct ObjFunction {
     Obj obj;
     int arity;
     int upvalueCount;
+    int maxStackDepth;
+    int hotness;        // calls and loop iterations, counted until the chunk is quickened
     Chunk chunk;
     ObjString* fName;
+#if defined(CYARG_JIT)
+    struct JitCode* jit;
+#endif
+#if defined(CYARG_AOT)
+    uint32_t (*aot)(ObjRoutine* routine, struct CallFrame* frame, uint32_t entry);
+#endif
 } ObjFunction;
 
 typedef bool (*NativeFn)(ObjRoutine* routine, int argCount, Value* result);
@@ -164,11 +182,21 @@ typedef struct ObjInt {
     Int bigInt;
 } ObjInt;
 
+#ifdef CYARG_COMPACT_VALUE
+// a value too wide for a compact Value's payload.
+typedef struct {
+    Obj obj;
+    ValueType type;
+    uint64_t bits;
+} ObjBoxed;
+#endif
+
 typedef struct ObjUpvalue {
     Obj obj;
-    ValueCell* contents;
+    Value* contents;
     size_t stackOffset;
-    ValueCell closed;
+    Value closed;
+    ObjConcreteYargType* type;
     struct ObjUpvalue* next;
 } ObjUpvalue;
 
@@ -179,16 +207,33 @@ typedef struct ObjClosure {
     int cUpvalueCount;
 } ObjClosure;
 
+// A field layout shared by instances that gained the same fields in the same order. Each
+// shape adds one field to its parent; transitions maps a field name to the shape it leads to.
+typedef struct ObjShape {
+    Obj obj;
+    struct ObjShape* parent;
+    ObjString* name;
+    int fieldCount;
+    ValueTable transitions;
+} ObjShape;
+
 typedef struct {
     Obj obj;
     ObjString* name;
     ValueTable methods;
+    ObjShape* rootShape;
+    int fieldCountHint;     // most fields an instance has reached, to size the next inline
 } ObjClass;
 
 typedef struct {
     Obj obj;
     ObjClass* klass;
-    ValueTable fields;
+    ObjShape* shape;        // NULL once the instance has fallen back to dictionary
+    Value* fields;          // indexed by shape, inlineFields until it outgrows them
+    ValueTable* dictionary;
+    int fieldCapacity;
+    int inlineCapacity;
+    Value inlineFields[];
 } ObjInstance;
 
 typedef struct {
@@ -197,20 +242,24 @@ typedef struct {
     ObjClosure* method;
 } ObjBoundMethod;
 
+// Owned storage is freed by its size, as its type may be freed in the same sweep.
 typedef struct ObjPackedUniformArray {
     Obj obj;
     PackedValue store;
+    size_t storageSize;
 } ObjPackedUniformArray;
 
 typedef struct {
     Obj obj;
     ObjConcreteYargTypePointer* type;
     PackedValueStore* destination;
+    size_t storageSize;
 } ObjPackedPointer;
 
 typedef struct {
     Obj obj;
     PackedValue store;
+    size_t storageSize;
 } ObjPackedStruct;
 
 typedef struct {
@@ -244,9 +293,12 @@ ObjMap* newMap(ObjConcreteYargTypeMap* type);
 ObjString* takeString(char* chars, int length);
 ObjString* copyString(const char* chars, int length);
 ObjString* copyStringWithEscapes(const char* chars, int length);
-ObjUpvalue* newUpvalue(ValueCell* slot, size_t stackOffset);
+ObjUpvalue* newUpvalue(Value* slot, size_t stackOffset, ObjConcreteYargType* type);
 ObjInt* newInt(int64_t value);
 ObjInt* newIntU(uint64_t value);
+Value intValue(int64_t value);
+Int* intFromValue(Value value, IntConcrete2* scratch);
+bool isLiteralInt(Value value);
 
 PackedValue arrayElement(PackedValue array, size_t index);
 size_t arrayCardinality(PackedValue array);
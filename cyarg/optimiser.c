@@ -0,0 +1,555 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "optimiser.h"
+
+#include "common.h"
+#include "memory.h"
+
+// Folding follows what the vm would do with the same values, so an expression that
+// would fail at run time, or whose result depends on more than its operands (big ints,
+// division by zero), is left for the vm.
+typedef enum {
+    CONST_LITERAL_INT,
+    CONST_INT,          // an int that is no longer a literal, so won't be promoted
+    CONST_TYPED,        // a machine int
+    CONST_DOUBLE,
+    CONST_BOOL,
+    CONST_NIL
+} ConstantKind;
+
+typedef struct {
+    ConstantKind kind;
+    ExprTypeLiteral type;
+    union {
+        int64_t i;      // ints, sign or zero extended from their width
+        double d;
+        bool b;
+    };
+} Constant;
+
+static ObjExpr* optimiseExpr(ObjExpr* expr);
+static ObjStmt* optimiseStmts(ObjStmt* stmts);
+
+static int typeBits(ExprTypeLiteral type) {
+    switch (type) {
+        case EXPR_TYPE_LITERAL_INT8:
+        case EXPR_TYPE_LITERAL_UINT8:
+            return 8;
+        case EXPR_TYPE_LITERAL_INT16:
+        case EXPR_TYPE_LITERAL_UINT16:
+            return 16;
+        case EXPR_TYPE_LITERAL_INT64:
+        case EXPR_TYPE_LITERAL_UINT64:
+            return 64;
+        default:
+            return 32;
+    }
+}
+
+static bool isUnsignedType(ExprTypeLiteral type) {
+    return type == EXPR_TYPE_LITERAL_UINT8 || type == EXPR_TYPE_LITERAL_UINT16
+        || type == EXPR_TYPE_LITERAL_UINT32 || type == EXPR_TYPE_LITERAL_UINT64;
+}
+
+// Truncates to the width of the type, as storing to a C variable of that type does.
+static int64_t narrow(ExprTypeLiteral type, uint64_t bits) {
+    int shift = 64 - typeBits(type);
+    if (isUnsignedType(type)) {
+        return (int64_t)((bits << shift) >> shift);
+    }
+    return (int64_t)(bits << shift) >> shift;
+}
+
+static bool fitsType(ExprTypeLiteral type, int64_t value) {
+    return narrow(type, (uint64_t)value) == value && (!isUnsignedType(type) || value >= 0);
+}
+
+static bool isSmallInt(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static bool constantOf(ObjExpr* expr, Constant* constant) {
+    if (expr->obj.type == OBJ_EXPR_LITERAL) {
+        switch (((ObjExprLiteral*)expr)->literal) {
+            case EXPR_LITERAL_TRUE: *constant = (Constant){ .kind = CONST_BOOL, .b = true }; return true;
+            case EXPR_LITERAL_FALSE: *constant = (Constant){ .kind = CONST_BOOL, .b = false }; return true;
+            case EXPR_LITERAL_NIL: *constant = (Constant){ .kind = CONST_NIL }; return true;
+        }
+        return false;
+    }
+    if (expr->obj.type != OBJ_EXPR_NUMBER) return false;
+
+    ObjExprNumber* num = (ObjExprNumber*)expr;
+    switch (num->type) {
+        case NUMBER_INT:
+            if (int_is_range(&num->bigInt, INT64_MIN, INT64_MAX) != INT_WITHIN) return false;
+            *constant = (Constant){ .kind = CONST_LITERAL_INT, .i = int_to_i64(&num->bigInt) };
+            return true;
+        case NUMBER_DOUBLE:
+            *constant = (Constant){ .kind = CONST_DOUBLE, .d = num->dbl };
+            return true;
+        case NUMBER_TYPED:
+            *constant = (Constant){
+                .kind = num->typed.type == EXPR_TYPE_LITERAL_INT ? CONST_INT : CONST_TYPED,
+                .type = num->typed.type,
+                .i = (int64_t)num->typed.bits
+            };
+            return true;
+    }
+    return false;
+}
+
+// The folded value goes into the node that held an operand. Only a bool or nil made
+// from numbers needs a new node.
+static ObjExpr* constantExpr(ObjExpr* reuse, Constant constant) {
+    if (constant.kind == CONST_BOOL || constant.kind == CONST_NIL) {
+        ExprLiteral literal = constant.kind == CONST_NIL ? EXPR_LITERAL_NIL
+            : constant.b ? EXPR_LITERAL_TRUE : EXPR_LITERAL_FALSE;
+        if (reuse->obj.type == OBJ_EXPR_LITERAL) {
+            ((ObjExprLiteral*)reuse)->literal = literal;
+            return reuse;
+        }
+        return (ObjExpr*)newExprLiteral(literal);
+    }
+
+    ObjExprNumber* num = (ObjExprNumber*)reuse;
+    if (constant.kind == CONST_DOUBLE) {
+        num->type = NUMBER_DOUBLE;
+        num->dbl = constant.d;
+    } else {
+        num->type = NUMBER_TYPED;
+        num->typed.type = constant.kind == CONST_INT ? EXPR_TYPE_LITERAL_INT : constant.type;
+        num->typed.bits = (uint64_t)constant.i;
+    }
+    return reuse;
+}
+
+static bool foldConversion(ExprBuiltin builtin, Constant arg, Constant* result) {
+    if (arg.kind != CONST_LITERAL_INT && arg.kind != CONST_INT) return false;
+
+    ExprTypeLiteral type;
+    switch (builtin) {
+        case EXPR_BUILTIN_INT8: type = EXPR_TYPE_LITERAL_INT8; break;
+        case EXPR_BUILTIN_UINT8: type = EXPR_TYPE_LITERAL_UINT8; break;
+        case EXPR_BUILTIN_INT16: type = EXPR_TYPE_LITERAL_INT16; break;
+        case EXPR_BUILTIN_UINT16: type = EXPR_TYPE_LITERAL_UINT16; break;
+        case EXPR_BUILTIN_INT32: type = EXPR_TYPE_LITERAL_INT32; break;
+        case EXPR_BUILTIN_UINT32: type = EXPR_TYPE_LITERAL_UINT32; break;
+        case EXPR_BUILTIN_INT64: type = EXPR_TYPE_LITERAL_INT64; break;
+        case EXPR_BUILTIN_UINT64: type = EXPR_TYPE_LITERAL_UINT64; break;
+        case EXPR_BUILTIN_MFLOAT64:
+            // exactly representable, so the same as the builtin's conversion via a string
+            if (arg.i < -(INT64_C(1) << 53) || arg.i > (INT64_C(1) << 53)) return false;
+            *result = (Constant){ .kind = CONST_DOUBLE, .d = (double)arg.i };
+            return true;
+        default:
+            return false;
+    }
+    if (!fitsType(type, arg.i)) return false;
+
+    *result = (Constant){ .kind = CONST_TYPED, .type = type, .i = arg.i };
+    return true;
+}
+
+static bool foldComparison(ExprOp operation, bool less, bool greater, bool equal, Constant* result) {
+    bool value;
+    switch (operation) {
+        case EXPR_OP_LESS: value = less; break;
+        case EXPR_OP_GREATER: value = greater; break;
+        // compiled as the negation of the opposite comparison, which matters for NaN
+        case EXPR_OP_LESS_EQUAL: value = !greater; break;
+        case EXPR_OP_GREATER_EQUAL: value = !less; break;
+        case EXPR_OP_EQUAL: value = equal; break;
+        case EXPR_OP_NOT_EQUAL: value = !equal; break;
+        default: return false;
+    }
+    *result = (Constant){ .kind = CONST_BOOL, .b = value };
+    return true;
+}
+
+// As promote() does: a literal int takes on the type of a machine int operand, if it
+// fits. Two ints of any kind are combined as ints.
+static bool promoteConstants(Constant* a, Constant* b) {
+    bool aIsInt = a->kind == CONST_LITERAL_INT || a->kind == CONST_INT;
+    bool bIsInt = b->kind == CONST_LITERAL_INT || b->kind == CONST_INT;
+    if (aIsInt && bIsInt) {
+        if (!isSmallInt(a->i) || !isSmallInt(b->i)) return false;
+        a->kind = b->kind = CONST_INT;
+        return true;
+    }
+
+    Constant* literal = a->kind == CONST_LITERAL_INT ? a : b->kind == CONST_LITERAL_INT ? b : NULL;
+    if (literal != NULL) {
+        Constant* other = literal == a ? b : a;
+        if (other->kind != CONST_TYPED || !fitsType(other->type, literal->i)) return false;
+        literal->kind = CONST_TYPED;
+        literal->type = other->type;
+    }
+    return a->kind == b->kind && (a->kind != CONST_TYPED || a->type == b->type);
+}
+
+static bool foldInt(ExprOp operation, int64_t a, int64_t b, Constant* result) {
+    int64_t value;
+    switch (operation) {
+        case EXPR_OP_ADD: value = a + b; break;
+        case EXPR_OP_SUBTRACT: value = a - b; break;
+        case EXPR_OP_MULTIPLY: value = a * b; break;
+        default: return foldComparison(operation, a < b, a > b, a == b, result);
+    }
+    if (!isSmallInt(value)) return false;
+
+    *result = (Constant){ .kind = CONST_INT, .i = value };
+    return true;
+}
+
+static bool foldTyped(ExprOp operation, ExprTypeLiteral type, int64_t a, int64_t b, Constant* result) {
+    uint64_t x = (uint64_t)a;
+    uint64_t y = (uint64_t)b;
+    bool isUnsigned = isUnsignedType(type);
+    uint64_t value;
+
+    switch (operation) {
+        case EXPR_OP_ADD: value = x + y; break;
+        case EXPR_OP_SUBTRACT: value = x - y; break;
+        case EXPR_OP_MULTIPLY: value = x * y; break;
+        case EXPR_OP_DIVIDE:
+            if (b == 0 || typeBits(type) == 64 || (typeBits(type) == 32 && a == INT32_MIN && b == -1)) return false;
+            value = isUnsigned ? x / y : (uint64_t)(a / b);
+            break;
+        case EXPR_OP_LEFT_SHIFT:
+        case EXPR_OP_RIGHT_SHIFT:
+            if (!isUnsigned || y >= (uint64_t)typeBits(type)) return false;
+            value = operation == EXPR_OP_LEFT_SHIFT ? x << y : x >> y;
+            break;
+        case EXPR_OP_BIT_OR:
+        case EXPR_OP_BIT_AND:
+        case EXPR_OP_BIT_XOR:
+            if (!isUnsigned) return false;
+            value = operation == EXPR_OP_BIT_OR ? x | y : operation == EXPR_OP_BIT_AND ? x & y : x ^ y;
+            break;
+        default:
+            if (isUnsigned) return foldComparison(operation, x < y, x > y, x == y, result);
+            return foldComparison(operation, a < b, a > b, a == b, result);
+    }
+
+    *result = (Constant){ .kind = CONST_TYPED, .type = type, .i = narrow(type, value) };
+    return true;
+}
+
+static bool foldDouble(ExprOp operation, double a, double b, Constant* result) {
+    double value;
+    switch (operation) {
+        case EXPR_OP_ADD: value = a + b; break;
+        case EXPR_OP_SUBTRACT: value = a - b; break;
+        case EXPR_OP_MULTIPLY: value = a * b; break;
+        case EXPR_OP_DIVIDE: value = a / b; break;
+        default: return foldComparison(operation, a < b, a > b, a == b, result);
+    }
+    *result = (Constant){ .kind = CONST_DOUBLE, .d = value };
+    return true;
+}
+
+static bool foldBinary(ExprOp operation, Constant a, Constant b, Constant* result) {
+    if (!promoteConstants(&a, &b)) return false;
+
+    switch (a.kind) {
+        case CONST_INT: return foldInt(operation, a.i, b.i, result);
+        case CONST_TYPED: return foldTyped(operation, a.type, a.i, b.i, result);
+        case CONST_DOUBLE: return foldDouble(operation, a.d, b.d, result);
+        default: return false;
+    }
+}
+
+static bool foldUnary(ExprOp operation, Constant a, Constant* result) {
+    if (operation == EXPR_OP_NOT) {
+        bool falsey = a.kind == CONST_NIL || (a.kind == CONST_BOOL && !a.b);
+        *result = (Constant){ .kind = CONST_BOOL, .b = falsey };
+        return true;
+    }
+
+    switch (a.kind) {
+        case CONST_LITERAL_INT:
+        case CONST_INT:
+            if (!isSmallInt(a.i) || !isSmallInt(-a.i)) return false;
+            *result = (Constant){ .kind = CONST_INT, .i = -a.i };
+            return true;
+        case CONST_TYPED:
+            if (isUnsignedType(a.type)) return false;
+            *result = (Constant){ .kind = CONST_TYPED, .type = a.type, .i = narrow(a.type, -(uint64_t)a.i) };
+            return true;
+        case CONST_DOUBLE:
+            *result = (Constant){ .kind = CONST_DOUBLE, .d = -a.d };
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isConstant(ObjExpr* expr, Constant* constant) {
+    return expr != NULL && expr->nextExpr == NULL && constantOf(expr, constant);
+}
+
+// Folds the start of an expression, returning what replaces it.
+static ObjExpr* foldHead(ObjExpr* head) {
+    Constant a, b, result;
+
+    switch (head->obj.type) {
+        case OBJ_EXPR_GROUPING: {
+            ObjExpr* inner = ((ObjExprGrouping*)head)->expression;
+            if (!isConstant(inner, &a)) return head;
+            inner->nextExpr = head->nextExpr;
+            return inner;
+        }
+        case OBJ_EXPR_BUILTIN: {
+            ObjExpr* next = head->nextExpr;
+            if (next == NULL || next->obj.type != OBJ_EXPR_CALL) return head;
+            ObjExprCall* call = (ObjExprCall*)next;
+            if (call->arguments.objectCount != 1) return head;
+            ObjExpr* arg = (ObjExpr*)call->arguments.objects[0];
+            if (!isConstant(arg, &a) || !foldConversion(((ObjExprBuiltin*)head)->builtin, a, &result)) return head;
+
+            ObjExpr* folded = constantExpr(arg, result);
+            folded->nextExpr = call->expr.nextExpr;
+            return folded;
+        }
+        case OBJ_EXPR_OPERATION: {
+            ObjExprOperation* op = (ObjExprOperation*)head;
+            if (op->operation != EXPR_OP_NEGATE && op->operation != EXPR_OP_NOT) return head;
+            if (!isConstant(op->rhs, &a) || !foldUnary(op->operation, a, &result)) return head;
+
+            ObjExpr* folded = constantExpr(op->rhs, result);
+            folded->nextExpr = head->nextExpr;
+            return folded;
+        }
+        default: {
+            ObjExpr* next = head->nextExpr;
+            if (next == NULL || next->obj.type != OBJ_EXPR_OPERATION || !constantOf(head, &a)) return head;
+            ObjExprOperation* op = (ObjExprOperation*)next;
+            if (!isConstant(op->rhs, &b) || !foldBinary(op->operation, a, b, &result)) return head;
+
+            ObjExpr* folded = constantExpr(head, result);
+            folded->nextExpr = op->expr.nextExpr;
+            return folded;
+        }
+    }
+}
+
+static void optimiseExprArray(DynamicObjArray* exprs) {
+    for (int i = 0; i < exprs->objectCount; i++) {
+        exprs->objects[i] = (Obj*)optimiseExpr((ObjExpr*)exprs->objects[i]);
+    }
+}
+
+static void optimiseElt(ObjExpr* expr) {
+    switch (expr->obj.type) {
+        case OBJ_EXPR_OPERATION: {
+            ObjExprOperation* op = (ObjExprOperation*)expr;
+            op->rhs = optimiseExpr(op->rhs);
+            op->assignment = optimiseExpr(op->assignment);
+            break;
+        }
+        case OBJ_EXPR_GROUPING: {
+            ObjExprGrouping* grp = (ObjExprGrouping*)expr;
+            grp->expression = optimiseExpr(grp->expression);
+            break;
+        }
+        case OBJ_EXPR_NAMEDVARIABLE: {
+            ObjExprNamedVariable* var = (ObjExprNamedVariable*)expr;
+            var->assignment = optimiseExpr(var->assignment);
+            break;
+        }
+        case OBJ_EXPR_CALL:
+            optimiseExprArray(&((ObjExprCall*)expr)->arguments);
+            break;
+        case OBJ_EXPR_COLLECTION_INITIALIZER: {
+            ObjExprCollectionInitializer* collection = (ObjExprCollectionInitializer*)expr;
+            collection->cardinality = optimiseExpr(collection->cardinality);
+            for (int i = 0; i < collection->initializers.objectCount; i++) {
+                Obj* item_or_pair = collection->initializers.objects[i];
+                if (item_or_pair->type == OBJ_EXPR_PAIR) {
+                    ObjExprPair* pair = (ObjExprPair*)item_or_pair;
+                    pair->a = optimiseExpr(pair->a);
+                    pair->b = optimiseExpr(pair->b);
+                } else {
+                    collection->initializers.objects[i] = (Obj*)optimiseExpr((ObjExpr*)item_or_pair);
+                }
+            }
+            break;
+        }
+        case OBJ_EXPR_COLLECTION_ELEMENT: {
+            ObjExprCollectionElement* element = (ObjExprCollectionElement*)expr;
+            element->element = optimiseExpr(element->element);
+            element->assignment = optimiseExpr(element->assignment);
+            break;
+        }
+        case OBJ_EXPR_DOT: {
+            ObjExprDot* dot = (ObjExprDot*)expr;
+            dot->offset = optimiseExpr(dot->offset);
+            dot->assignment = optimiseExpr(dot->assignment);
+            if (dot->call) optimiseExprArray(&dot->call->arguments);
+            break;
+        }
+        case OBJ_EXPR_SUPER: {
+            ObjExprSuper* super = (ObjExprSuper*)expr;
+            if (super->call) optimiseExprArray(&super->call->arguments);
+            break;
+        }
+        case OBJ_EXPR_TYPE_INDEXED_COLLECTION: {
+            ObjExprTypeIndexedCollection* collectionType = (ObjExprTypeIndexedCollection*)expr;
+            collectionType->indexing = optimiseExpr(collectionType->indexing);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static ObjExpr* optimiseExpr(ObjExpr* expr) {
+    if (expr == NULL) return NULL;
+
+    for (ObjExpr* elt = expr; elt != NULL; elt = elt->nextExpr) {
+        optimiseElt(elt);
+    }
+
+    // until the caller links it in, a folded node is only reachable from here.
+    ObjExpr* head = expr;
+    for (;;) {
+        tempRootPush(OBJ_VAL(head));
+        ObjExpr* folded = foldHead(head);
+        tempRootPop();
+        if (folded == head) return head;
+        head = folded;
+    }
+}
+
+static bool isConstantTest(ObjExpr* test, bool* falsey) {
+    Constant constant;
+    if (!isConstant(test, &constant)) return false;
+    *falsey = constant.kind == CONST_NIL || (constant.kind == CONST_BOOL && !constant.b);
+    return true;
+}
+
+static bool isDeclaration(ObjStmt* stmt) {
+    switch (stmt->obj.type) {
+        case OBJ_STMT_VARDECLARATION:
+        case OBJ_STMT_PLACEDECLARATION:
+        case OBJ_STMT_FUNDECLARATION:
+        case OBJ_STMT_CLASSDECLARATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns what replaces the statement, which is NULL if it has no effect.
+static ObjStmt* optimiseStmt(ObjStmt* stmt) {
+    switch (stmt->obj.type) {
+        case OBJ_STMT_EXPRESSION:
+        case OBJ_STMT_PRINT:
+        case OBJ_STMT_RETURN:
+        case OBJ_STMT_YIELD: {
+            ObjStmtExpression* expression = (ObjStmtExpression*)stmt;
+            expression->expression = optimiseExpr(expression->expression);
+            return stmt;
+        }
+        case OBJ_STMT_POKE: {
+            ObjStmtPoke* poke = (ObjStmtPoke*)stmt;
+            poke->location = optimiseExpr(poke->location);
+            poke->offset = optimiseExpr(poke->offset);
+            poke->assignment = optimiseExpr(poke->assignment);
+            return stmt;
+        }
+        case OBJ_STMT_VARDECLARATION: {
+            ObjStmtVarDeclaration* decl = (ObjStmtVarDeclaration*)stmt;
+            decl->type = optimiseExpr(decl->type);
+            decl->initialiser = optimiseExpr(decl->initialiser);
+            return stmt;
+        }
+        case OBJ_STMT_FIELDDECLARATION: {
+            ObjStmtFieldDeclaration* decl = (ObjStmtFieldDeclaration*)stmt;
+            decl->type = optimiseExpr(decl->type);
+            decl->offset = optimiseExpr(decl->offset);
+            return stmt;
+        }
+        case OBJ_STMT_PLACEDECLARATION: {
+            ObjStmtPlaceDeclaration* decl = (ObjStmtPlaceDeclaration*)stmt;
+            decl->type = optimiseExpr(decl->type);
+            for (int i = 0; i < decl->aliases.objectCount; i++) {
+                ObjPlaceAlias* alias = (ObjPlaceAlias*)decl->aliases.objects[i];
+                alias->location = optimiseExpr(alias->location);
+            }
+            return stmt;
+        }
+        case OBJ_STMT_BLOCK: {
+            ObjStmtBlock* block = (ObjStmtBlock*)stmt;
+            block->statements = optimiseStmts(block->statements);
+            return stmt;
+        }
+        case OBJ_STMT_IF: {
+            ObjStmtIf* ctrl = (ObjStmtIf*)stmt;
+            ctrl->test = optimiseExpr(ctrl->test);
+            ctrl->ifStmt = optimiseStmts(ctrl->ifStmt);
+            ctrl->elseStmt = optimiseStmts(ctrl->elseStmt);
+
+            bool falsey;
+            if (!isConstantTest(ctrl->test, &falsey)) return stmt;
+            ObjStmt* taken = falsey ? ctrl->elseStmt : ctrl->ifStmt;
+            if (taken != NULL && isDeclaration(taken)) return stmt;
+            return taken;
+        }
+        case OBJ_STMT_FUNDECLARATION: {
+            ObjStmtFunDeclaration* fun = (ObjStmtFunDeclaration*)stmt;
+            fun->body = optimiseStmts(fun->body);
+            return stmt;
+        }
+        case OBJ_STMT_WHILE: {
+            ObjStmtWhile* loop = (ObjStmtWhile*)stmt;
+            loop->test = optimiseExpr(loop->test);
+            loop->loop = optimiseStmts(loop->loop);
+            return stmt;
+        }
+        case OBJ_STMT_FOR: {
+            ObjStmtFor* loop = (ObjStmtFor*)stmt;
+            loop->initializer = optimiseStmts(loop->initializer);
+            loop->condition = optimiseExpr(loop->condition);
+            loop->loopExpression = optimiseExpr(loop->loopExpression);
+            loop->body = optimiseStmts(loop->body);
+            return stmt;
+        }
+        case OBJ_STMT_CLASSDECLARATION: {
+            ObjStmtClassDeclaration* decl = (ObjStmtClassDeclaration*)stmt;
+            for (int i = 0; i < decl->methods.objectCount; i++) {
+                optimiseStmt((ObjStmt*)decl->methods.objects[i]);
+            }
+            return stmt;
+        }
+        default:
+            return stmt;
+    }
+}
+
+// Nothing after a return runs, so the rest of its statement list is dropped.
+static ObjStmt* optimiseStmts(ObjStmt* stmts) {
+    ObjStmt* head = NULL;
+    ObjStmt** link = &head;
+
+    ObjStmt* stmt = stmts;
+    while (stmt != NULL) {
+        ObjStmt* next = stmt->nextStmt;
+        ObjStmt* kept = optimiseStmt(stmt);
+        if (kept != NULL) {
+            kept->nextStmt = next; // keeps the rest reachable while it is optimised
+            *link = kept;
+            link = &kept->nextStmt;
+            if (kept->obj.type == OBJ_STMT_RETURN) break;
+        }
+        stmt = next;
+    }
+    *link = NULL;
+    return head;
+}
+
+void optimiseAst(ObjAst* ast) {
+    ast->statements = optimiseStmts(ast->statements);
+}
@@ -0,0 +1,8 @@
+#ifndef cyarg_optimiser_h
+#define cyarg_optimiser_h
+
+#include "ast.h"
+
+void optimiseAst(ObjAst* ast);
+
+#endif
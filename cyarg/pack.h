@@ -9,5 +9,7 @@ struct ObjFunction;
 
 int packScript(char const *sourceFileName, struct ObjFunction const *scriptFn, bool includeLines, char const *path);
 struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize);
+// Loads each chunk of a package as a function, in package order, returning how many.
+int loadPackageFunctions(uint8_t* buffer, size_t bufferSize, struct ObjFunction ***chunkFunctions);
 
 #endif
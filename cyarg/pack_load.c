@@ -3,6 +3,10 @@
 
 #include "object.h"
 #include "memory.h"
+#include "vm.h"
+#if defined(CYARG_AOT)
+#include "aot.h"
+#endif
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,9 +15,9 @@
 enum { PACKAGE_OK = 0, PACKAGE_DATAERR = 65, PACKAGE_PROTOCOL = 71, PACKAGE_SOFTWARE = 70 };
 
 int8_t const packageMagic[PACKAGE_MAGIC_LEN] = {0x79, 0x0a, 0x72, 0x67, 0xff, 0x42};
-int16_t const packageVersion = 0x2602;
+int16_t const packageVersion = 0x2609;
 
-struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
+int loadPackageFunctions(uint8_t* buffer, size_t bufferSize, struct ObjFunction ***chunkFunctions) {
     int r = PACKAGE_OK;
 
     ObjFunction **functions = 0;
@@ -75,8 +79,10 @@ struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
     ObjFunction *currentFunction;
     functions = realloc(0, h->numChunks_ * sizeof (ObjFunction *));
 
+    vm.loadingFunctions = functions;
     for (int i = 0; i < h->numChunks_; i++) {
         functions[i] = newFunction();
+        vm.loadingFunctionCount = i + 1;
     }
 
     uint8_t const *startOfCode = next;
@@ -144,7 +150,9 @@ struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
                 char *thisString = (char *)&stringFile[index];
                 ObjString *obj = copyString(thisString, (int)strlen(thisString)); // mark as xip
                 Value value = OBJ_VAL(obj);
+                tempRootPush(value);
                 appendToDynamicValueArray(&currentFunction->chunk.constants, value);
+                tempRootPop();
                 DP(printf(":\"%s\"", thisString));
                 break;
             }
@@ -153,7 +161,9 @@ struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
                 ObjInt *obj = allocateIntObject(thisInt->d_);
                 memcpy(&obj->bigInt, thisInt, sizeof (Int) + obj->bigInt.m_ * sizeof (uint16_t)); // should be able to shallow copy
                 Value value = OBJ_VAL(obj);
+                tempRootPush(value);
                 appendToDynamicValueArray(&currentFunction->chunk.constants, value);
+                tempRootPop();
                 DP(printf(":");
                 int_print(thisInt));
                 break;
@@ -193,18 +203,36 @@ struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
         }
     }
 
-exit:
-    if (functions != 0) {
-        currentFunction = functions[0];
-        free(functions);
-    } else {
-        currentFunction = 0;
+    // the stack depth is not packed; it needs the closures' upvalue counts, so comes last.
+    for (int i = 0; i < h->numChunks_; i++) {
+        functions[i]->maxStackDepth = chunkStackDepth(&functions[i]->chunk, functions[i]->arity);
     }
 
+exit:
+    vm.loadingFunctions = 0;
+    vm.loadingFunctionCount = 0;
+
     DP(printf("chunks__:%u\nints__:%u\nstrings__:%u\ncode__:%u\nlines__:%u\nnames__:%u\nend__:%u\n", chunks__, ints__, strings__, code__, lines__, names__, end__));
 
-    if (r == PACKAGE_OK)
-        return currentFunction;
-    else
+    if (r == PACKAGE_OK && functions != 0) {
+        *chunkFunctions = functions;
+        return h->numChunks_;
+    }
+    free(functions);
+    return 0;
+}
+
+struct ObjFunction *loadPackageFromBuffer(uint8_t* buffer, size_t bufferSize) {
+    ObjFunction **functions;
+    int count = loadPackageFunctions(buffer, bufferSize, &functions);
+    if (count == 0) {
         return 0;
+    }
+
+    ObjFunction *script = functions[0];
+#if defined(CYARG_AOT)
+    attachAotCode(buffer, bufferSize, functions, count);
+#endif
+    free(functions);
+    return script;
 }
@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include "quicken.h"
+
+#include "common.h"
+#include "memory.h"
+#include "vm.h"
+
+typedef enum {
+    QUICK_SMALL_INT,
+    QUICK_I32,
+    QUICK_UI32,
+    QUICK_DOUBLE,
+    QUICK_NONE
+} QuickKind;
+
+// The rewritten code must be writable; a function executed in place from flash gets a
+// RAM copy. Frames already running the flash copy carry on there, unquickened.
+void warmFunction(CallFrame* frame) {
+    ObjFunction* function = frame->closure->function;
+    if (++function->hotness < QUICKEN_THRESHOLD) return;
+
+    Chunk* chunk = &function->chunk;
+    vm_mutex_enter_blocking(&vm.env);
+    if (!chunk->quickened) {
+        if (chunk->xip) {
+            uint8_t* code = ALLOCATE(uint8_t, chunk->count);
+            memcpy(code, chunk->code, chunk->count);
+            if (frame->ip >= chunk->code && frame->ip <= chunk->code + chunk->count) {
+                frame->ip = code + (frame->ip - chunk->code);
+            }
+            chunk->xipCode = chunk->code;
+            chunk->code = code;
+            chunk->capacity = chunk->count;
+            chunk->xip = false;
+        }
+        chunk->quickened = true;
+    }
+    vm_mutex_exit(&vm.env);
+}
+
+// A literal int takes on the type of the other operand, as promote() would make it.
+static QuickKind operandKind(Value a, Value b) {
+    if (IS_SMALL_INT(a) && IS_SMALL_INT(b)) return QUICK_SMALL_INT;
+    if (IS_DOUBLE(a) && IS_DOUBLE(b)) return QUICK_DOUBLE;
+
+    Value typed = isLiteralInt(a) ? b : a;
+    Value other = isLiteralInt(a) ? a : b;
+    if (IS_I32(typed) && (IS_I32(other) || isLiteralInt(other))) return QUICK_I32;
+    if (IS_UI32(typed) && (IS_UI32(other) || isLiteralInt(other))) return QUICK_UI32;
+    return QUICK_NONE;
+}
+
+void quickenInstruction(CallFrame* frame, uint8_t generic, Value a, Value b) {
+    Chunk* chunk = &frame->closure->function->chunk;
+    uint8_t* instruction = frame->ip - 1;
+    if (instruction < chunk->code || instruction >= chunk->code + chunk->count) return;
+
+    QuickKind kind = operandKind(a, b);
+    if (kind == QUICK_NONE) return;
+
+    switch (generic) {
+        case OP_ADD: *instruction = OP_ADD_SMALL_INT + kind; break;
+        case OP_SUBTRACT: *instruction = OP_SUBTRACT_SMALL_INT + kind; break;
+        case OP_MULTIPLY: *instruction = OP_MULTIPLY_SMALL_INT + kind; break;
+        case OP_LESS: *instruction = OP_LESS_SMALL_INT + kind; break;
+        case OP_GREATER: *instruction = OP_GREATER_SMALL_INT + kind; break;
+        default: break;
+    }
+}
+
+void unquickenInstruction(CallFrame* frame, uint8_t generic) {
+    Chunk* chunk = &frame->closure->function->chunk;
+    uint8_t* instruction = frame->ip - 1;
+    if (!chunk->quickened || instruction < chunk->code || instruction >= chunk->code + chunk->count) return;
+
+    *instruction = generic;
+}
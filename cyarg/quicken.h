@@ -0,0 +1,15 @@
+#ifndef cyarg_quicken_h
+#define cyarg_quicken_h
+
+#include "value.h"
+#include "routine.h"
+
+// Calls and loop iterations after which a function's arithmetic starts rewriting itself.
+#define QUICKEN_THRESHOLD 16
+
+void warmFunction(CallFrame* frame);
+void quickenInstruction(CallFrame* frame, uint8_t generic, Value a, Value b);
+// Code the compiler specialised, or that is still in flash, is left as it is.
+void unquickenInstruction(CallFrame* frame, uint8_t generic);
+
+#endif
@@ -12,7 +12,8 @@
 #include "vm.h"
 #include "debug.h"
 
-bool addSlice(ObjRoutine* routine);
+bool addSlice(ObjRoutine* routine, size_t count);
+static bool addFrameSegment(ObjRoutine* routine);
 
 void initRoutine(ObjRoutine* routine) {
     routine->entryFunction = NULL;
@@ -28,6 +29,12 @@ void initRoutine(ObjRoutine* routine) {
     routine->sliceCount = 1;
     routine->addSlice = addSlice;
 
+    routine->frameSegmentCapacity = 1;
+    routine->frameSegments = routine->inlineSegments;
+    routine->frameSegments[0] = routine->frames;
+    routine->frameSegmentCount = 1;
+    routine->addFrameSegment = addFrameSegment;
+
 #ifdef DEBUG_TRACE_EXECUTION
     routine->traceExecution = true;
 #else
@@ -46,22 +53,28 @@ void resetRoutine(ObjRoutine* routine) {
     routine->openUpvalues = NULL;
 }
 
-bool addSlice(ObjRoutine* routine) {
+// Adds count slices, allocated together so they are contiguous in memory.
+bool addSlice(ObjRoutine* routine, size_t count) {
 
-    ObjStackSlice* sliceObj = ALLOCATE_OBJ(ObjStackSlice, OBJ_STACKSLICE);
+    ObjStackSlice* sliceObj = (ObjStackSlice*)allocateObject(sizeof(ObjStackSlice) + sizeof(StackSlice) * count, OBJ_STACKSLICE);
     if (sliceObj == NULL) return false;
+    sliceObj->count = count;
 
     tempRootPush(OBJ_VAL(sliceObj));
 
-    if (routine->stackSliceCapacity < routine->sliceCount + 1) {
+    if (routine->stackSliceCapacity < routine->sliceCount + count) {
         size_t oldCapacity = routine->stackSliceCapacity;
-        routine->stackSliceCapacity = GROW_CAPACITY(routine->stackSliceCapacity);
+        while (routine->stackSliceCapacity < routine->sliceCount + count) {
+            routine->stackSliceCapacity = GROW_CAPACITY(routine->stackSliceCapacity);
+        }
         routine->stackSlices = GROW_ARRAY(StackSlice*, routine->stackSlices, oldCapacity, routine->stackSliceCapacity);
     }
 
     if (routine->stackSlices) {
-        routine->stackSlices[routine->sliceCount] = &sliceObj->slice;
-        routine->sliceCount++;
+        for (size_t i = 0; i < count; i++) {
+            routine->stackSlices[routine->sliceCount] = &sliceObj->slices[i];
+            routine->sliceCount++;
+        }
         appendToDynamicObjArray(&routine->additionalSlicesArray, (Obj*)sliceObj);
     }
 
@@ -70,6 +83,41 @@ bool addSlice(ObjRoutine* routine) {
     return (routine->stackSlices != NULL);
 }
 
+static void appendFrameSegment(ObjRoutine* routine) {
+    CallFrame* segment = ALLOCATE(CallFrame, FRAME_SEGMENT_MAX);
+
+    if (routine->frameSegmentCapacity < routine->frameSegmentCount + 1) {
+        size_t oldCapacity = routine->frameSegmentCapacity;
+        routine->frameSegmentCapacity = GROW_CAPACITY(oldCapacity);
+        if (routine->frameSegments == routine->inlineSegments) {
+            CallFrame** segments = ALLOCATE(CallFrame*, routine->frameSegmentCapacity);
+            memcpy(segments, routine->inlineSegments, sizeof(routine->inlineSegments));
+            routine->frameSegments = segments;
+        } else {
+            routine->frameSegments = GROW_ARRAY(CallFrame*, routine->frameSegments, oldCapacity, routine->frameSegmentCapacity);
+        }
+    }
+    routine->frameSegments[routine->frameSegmentCount++] = segment;
+}
+
+// Adds room for another FRAME_SEGMENT_MAX frames, if the routine's call stack is within bounds.
+static bool addFrameSegment(ObjRoutine* routine) {
+    if (!callStackMayGrow(sizeof(CallFrame) * FRAME_SEGMENT_MAX * (routine->frameSegmentCount + 1))) return false;
+
+    appendFrameSegment(routine);
+    return true;
+}
+
+void freeRoutine(ObjRoutine* routine) {
+    for (size_t i = 1; i < routine->frameSegmentCount; i++) {
+        FREE_ARRAY(CallFrame, routine->frameSegments[i], FRAME_SEGMENT_MAX);
+    }
+    if (routine->frameSegments != routine->inlineSegments) {
+        FREE_ARRAY(CallFrame*, routine->frameSegments, routine->frameSegmentCapacity);
+    }
+    FREE_ARRAY(StackSlice*, routine->stackSlices, routine->stackSliceCapacity);
+}
+
 ObjRoutine* newRoutine() {
     ObjRoutine* routine = ALLOCATE_OBJ(ObjRoutine, OBJ_ROUTINE);
     tempRootPush(OBJ_VAL(routine));
@@ -94,7 +142,12 @@ bool pinRoutine(ObjRoutine* routine, uintptr_t* address) {
     if (installPinnedRoutine(routine, address)) {
         pushEntryElements(routine);
         enterEntryFunction(routine);
+        // it cannot allocate once pinned, so room for its frames is reserved now
+        while (routine->frameSegmentCount * FRAME_SEGMENT_MAX < PINNED_FRAMES_MAX) {
+            appendFrameSegment(routine);
+        }
         routine->addSlice = NULL;
+        routine->addFrameSegment = NULL;
         return true;
     }
     return false;
@@ -203,10 +256,69 @@ bool receiveFromRoutine(ObjRoutine* routine, Value* result) {
     }
 }
 
-ValueCell* frameSlot(ObjRoutine* routine, CallFrame* frame, size_t index) {
-    size_t stackElementIndex = frame->stackEntryIndex + index;
+static Value* slot(ObjRoutine* routine, size_t index) {
+    size_t sliceIndex = index / SLICE_MAX;
+
+    return &routine->stackSlices[sliceIndex]->elements[index % SLICE_MAX];
+}
+
+static bool contiguousSlices(ObjRoutine* routine, size_t first, size_t last) {
+    if (last >= routine->sliceCount) return false;
 
-    return peekCell(routine, (int) (routine->stackTopIndex - (stackElementIndex + 1)));
+    for (size_t i = first; i < last; i++) {
+        if (routine->stackSlices[i + 1] != routine->stackSlices[i] + 1) return false;
+    }
+    return true;
+}
+
+// A frame's slots, from the callee at *entryIndex up to depth slots, must be contiguous
+// so that run() can address them directly. If they would straddle slices that are not,
+// the callee and its arguments are moved up to the start of a run of slices that is.
+// The slot just past the frame must also exist, as push() writes before it grows.
+Value* reserveFrameStack(ObjRoutine* routine, size_t* entryIndex, size_t depth) {
+    size_t entry = *entryIndex;
+    size_t first = entry / SLICE_MAX;
+
+    if (contiguousSlices(routine, first, (entry + depth) / SLICE_MAX)) {
+        return slot(routine, entry);
+    }
+
+    if (!routine->addSlice) {
+        runtimeError(routine, "Fixed Value stack size exceeded.");
+        return NULL;
+    }
+
+    size_t needed = (depth + SLICE_MAX) / SLICE_MAX;
+    size_t target = first + 1;
+    while (target + needed <= routine->sliceCount && !contiguousSlices(routine, target, target + needed - 1)) {
+        target++;
+    }
+    if (target + needed > routine->sliceCount) {
+        target = routine->sliceCount;
+        if (!routine->addSlice(routine, needed)) {
+            runtimeError(routine, "Value stack size exceeded.");
+            return NULL;
+        }
+    }
+
+    size_t newEntry = target * SLICE_MAX;
+    size_t used = routine->stackTopIndex - entry;
+
+    // slots skipped over are below the stack top, so they must hold something the GC can mark.
+    for (size_t i = routine->stackTopIndex; i < newEntry; i++) {
+        *slot(routine, i) = NIL_VAL;
+    }
+    for (size_t i = used; i > 0; i--) {
+        *slot(routine, newEntry + i - 1) = *slot(routine, entry + i - 1);
+    }
+
+    routine->stackTopIndex = newEntry + used;
+    *entryIndex = newEntry;
+    return slot(routine, newEntry);
+}
+
+Value* frameSlot(ObjRoutine* routine, CallFrame* frame, size_t index) {
+    return &frame->slots[index];
 }
 
 size_t stackOffsetOf(CallFrame* frame, size_t frameIndex) {
@@ -216,12 +328,16 @@ size_t stackOffsetOf(CallFrame* frame, size_t frameIndex) {
 void markRoutine(ObjRoutine* routine) {
 
     size_t stackSize = routine->stackTopIndex;
-    for (int i = (int)(stackSize - 1); i >= 0; i--) {
-        markValueCell(peekCell(routine, i));
+    for (size_t base = 0; base < stackSize; base += SLICE_MAX) {
+        Value* elements = slot(routine, base);
+        size_t count = stackSize - base < SLICE_MAX ? stackSize - base : SLICE_MAX;
+        for (size_t i = 0; i < count; i++) {
+            markValue(elements[i]);
+        }
     }
 
     for (int i = 0; i < routine->frameCount; i++) {
-        markObject((Obj*)routine->frames[i].closure);
+        markObject((Obj*)routineFrame(routine, i)->closure);
     }
 
     for (ObjUpvalue* upvalue = routine->openUpvalues;
@@ -244,10 +360,17 @@ void runtimeError(ObjRoutine* routine, const char* format, ...) {
     va_end(args);
     fputs("\n", stderr);
 
+    // of a deep recursion, only the innermost and outermost calls are listed.
+    const int shownAtEachEnd = 10;
     for (int i = routine->frameCount - 1; i >= 0; i--) {
-        CallFrame* frame = &routine->frames[i];
+        if (i == routine->frameCount - 1 - shownAtEachEnd && i >= shownAtEachEnd) {
+            PRINTERR("[...] %d more calls\n", i - shownAtEachEnd + 1);
+            i = shownAtEachEnd;
+            continue;
+        }
+        CallFrame* frame = routineFrame(routine, i);
         ObjFunction* function = frame->closure->function;
-        size_t instruction = frame->ip - function->chunk.code - 1;
+        size_t instruction = chunkCodeOffset(&function->chunk, frame->ip) - 1;
         int16_t line = 0;
         for (int s = 0; s < function->chunk.numLines; s++) {
             if (function->chunk.lines[s].address > instruction) break;
@@ -265,22 +388,15 @@ void runtimeError(ObjRoutine* routine, const char* format, ...) {
     resetRoutine(routine);
 }
 
-static ValueCell* slot(ObjRoutine* routine, size_t index) {
-    size_t sliceIndex = index / SLICE_MAX;
-
-    return &routine->stackSlices[sliceIndex]->elements[index % SLICE_MAX];
-}
-
 void push(ObjRoutine* routine, Value value) {
-    ValueCell* nextSlot = slot(routine, routine->stackTopIndex);
+    Value* nextSlot = slot(routine, routine->stackTopIndex);
 
-    nextSlot->value = value;
-    nextSlot->cellType = NULL;
+    *nextSlot = value;
     routine->stackTopIndex++;
 
     if (((routine->stackTopIndex / SLICE_MAX) + 1) > routine->sliceCount) {
         if (routine->addSlice) {
-            if (!routine->addSlice(routine)) {
+            if (!routine->addSlice(routine, 1)) {
                 runtimeError(routine, "Value stack size exceeded.");
             }
         } else {
@@ -289,12 +405,6 @@ void push(ObjRoutine* routine, Value value) {
     }
 }
 
-void pushTyped(ObjRoutine* routine, Value value, Value type) {
-    push(routine, value);
-    ValueCell* top = peekCell(routine, 0);
-    top->cellType = IS_NIL(type) ? NULL : AS_YARGTYPE(type);
-}
-
 Value pop(ObjRoutine* routine) {
 
     Value ret = peek(routine, 0);
@@ -310,25 +420,15 @@ void popN(ObjRoutine* routine, size_t count) {
 }
 
 void popFrame(ObjRoutine* routine, CallFrame* frame) {
-    routine->stackTopIndex = frame->stackEntryIndex;
+    routine->stackTopIndex = frame->stackReturnIndex;
 }
 
 Value peek(ObjRoutine* routine, int distance) {
-    ValueCell* cell = peekCell(routine, distance);
-    return cell->value;
+    return *peekSlot(routine, distance);
 }
 
-ValueCell* peekCell(ObjRoutine* routine, int distance) {
-
-    ValueCell* targetCell = slot(routine, routine->stackTopIndex - 1 - distance);
-
-    return targetCell;
-}
-
-ValueCellTarget peekCellTarget(ObjRoutine* routine, int distance) {
-    ValueCell* target = peekCell(routine, distance);
-    ValueCellTarget result = { .value = &target->value, .cellType = target->cellType};
-    return result;
+Value* peekSlot(ObjRoutine* routine, int distance) {
+    return slot(routine, routine->stackTopIndex - 1 - distance);
 }
 
 static void traceValueStack(ObjRoutine* routine) {
@@ -356,8 +456,8 @@ static void traceValueStack(ObjRoutine* routine) {
         for (size_t cursor = 0; cursor < max_stack_line_width; cursor++) {
             size_t slot = (line - 1) * max_stack_line_width + cursor;
             if (slot >= stackSize) break;
-            ValueCell* cell = peekCell(routine, (int)(stackSize - 1 - slot));
-            ObjString* valueStr = valueToString(cell->value);
+            Value value = peek(routine, (int)(stackSize - 1 - slot));
+            ObjString* valueStr = valueToString(value);
             tempRootPush(OBJ_VAL(valueStr));
             char value_description[12];
             if (valueStr->length > 11) {
@@ -366,16 +466,7 @@ static void traceValueStack(ObjRoutine* routine) {
                 snprintf(value_description, sizeof(value_description), "%11.11s", valueStr->chars);
             }
             tempRootPop();
-            ObjString* typeStr = valueToString(cell->cellType ? OBJ_VAL(cell->cellType) : NIL_VAL);
-            tempRootPush(OBJ_VAL(typeStr));
-            char type_description[11] = "       any";
-            if (typeStr->length > 10 && cell->cellType) {
-                snprintf(type_description, sizeof(type_description), "%7.7s...", typeStr->chars);
-            } else if (cell->cellType) {
-                snprintf(type_description, sizeof(type_description), "%7.7s", typeStr->chars);
-            }
-            tempRootPop();
-            printf("[%s|%s]", value_description, type_description);
+            printf("[%s]", value_description);
         }
         printf("\n");
         if (line_cursor == max_stack_trace_lines - 1 && line > 0) {
@@ -385,11 +476,11 @@ static void traceValueStack(ObjRoutine* routine) {
 }
 
 void traceExecution(ObjRoutine* routine) {
-    CallFrame* frame = &routine->frames[routine->frameCount - 1];
+    CallFrame* frame = routineFrame(routine, routine->frameCount - 1);
 
     traceValueStack(routine);
     ObjString* routineStr = valueToString(OBJ_VAL(routine));
     printf("%s %s:", routineStr->chars, frame->closure->function->fName ? frame->closure->function->fName->chars : "script");
     disassembleInstruction(&frame->closure->function->chunk, 
-        (int)(frame->ip - frame->closure->function->chunk.code));
+        (int)chunkCodeOffset(&frame->closure->function->chunk, frame->ip));
 }
\ No newline at end of file
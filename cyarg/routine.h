@@ -4,13 +4,16 @@
 #include "value.h"
 #include "object.h"
 
-#define FRAMES_MAX 20
+#define FRAME_SEGMENT_MAX 8
+#define PINNED_FRAMES_MAX 20
 #define SLICE_MAX 64
 
-typedef struct {
+typedef struct CallFrame {
     ObjClosure* closure;
     uint8_t* ip;
     size_t stackEntryIndex;
+    size_t stackReturnIndex;
+    Value* slots;
 } CallFrame;
 
 typedef enum {
@@ -21,22 +24,30 @@ typedef enum {
     EXEC_ERROR
 } ExecState;
 
-typedef bool (*AddSliceFn)(ObjRoutine* routine);
+typedef bool (*AddSliceFn)(ObjRoutine* routine, size_t count);
+typedef bool (*AddFrameSegmentFn)(ObjRoutine* routine);
 
 typedef struct StackSlice {
-    ValueCell elements[SLICE_MAX];
+    Value elements[SLICE_MAX];
 } StackSlice;
 
 typedef struct ObjStackSlice{
     Obj obj;
-    StackSlice slice;
+    size_t count;
+    StackSlice slices[];
 } ObjStackSlice;
 
 typedef struct ObjRoutine {
     Obj obj;
 
-    CallFrame frames[FRAMES_MAX];
+    // frames are held in segments, which stay where they are as more are added.
+    CallFrame** frameSegments;
+    CallFrame* inlineSegments[1];   // frameSegments until a second segment is added
+    size_t frameSegmentCapacity;
+    size_t frameSegmentCount;
+    CallFrame frames[FRAME_SEGMENT_MAX];
     int frameCount;
+    AddFrameSegmentFn addFrameSegment;
 
     StackSlice** stackSlices;
     size_t stackSliceCapacity;
@@ -58,14 +69,20 @@ typedef struct ObjRoutine {
     bool traceExecution;
 } ObjRoutine;
 
+static inline CallFrame* routineFrame(ObjRoutine* routine, int index) {
+    return &routine->frameSegments[index / FRAME_SEGMENT_MAX][index % FRAME_SEGMENT_MAX];
+}
+
 void initRoutine(ObjRoutine* routine);
+void freeRoutine(ObjRoutine* routine);
 ObjRoutine* newRoutine();
 void resetRoutine(ObjRoutine* routine);
 bool bindEntryFn(ObjRoutine* routine, ObjClosure* closure);
 void bindEntryArgs(ObjRoutine* routine, Value entryArg);
 void pushEntryElements(ObjRoutine* routine);
 void enterEntryFunction(ObjRoutine* routine);
-ValueCell* frameSlot(ObjRoutine* routine, CallFrame* frame, size_t index);
+Value* reserveFrameStack(ObjRoutine* routine, size_t* entryIndex, size_t depth);
+Value* frameSlot(ObjRoutine* routine, CallFrame* frame, size_t index);
 size_t stackOffsetOf(CallFrame* frame, size_t frameIndex);
 
 bool pinRoutine(ObjRoutine* routine, uintptr_t* address);
@@ -80,13 +97,11 @@ bool receiveFromRoutine(ObjRoutine* routine, Value* result);
 void markRoutine(ObjRoutine* routine);
 
 void push(ObjRoutine* routine, Value value);
-void pushTyped(ObjRoutine* routine, Value value, Value type);
 Value pop(ObjRoutine* routine);
 void popN(ObjRoutine* routine, size_t count);
 void popFrame(ObjRoutine* routine, CallFrame* frame);
 Value peek(ObjRoutine* routine, int distance);
-ValueCell* peekCell(ObjRoutine* routine, int distance);
-ValueCellTarget peekCellTarget(ObjRoutine* routine, int distance);
+Value* peekSlot(ObjRoutine* routine, int distance);
 
 void runtimeError(ObjRoutine* routine, const char* format, ...);
 
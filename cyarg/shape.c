@@ -0,0 +1,138 @@
+#include <stdio.h>
+
+#include "shape.h"
+
+#include "common.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+ObjShape* newShape(ObjShape* parent, ObjString* name) {
+    ObjShape* shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+    shape->parent = parent;
+    shape->name = name;
+    shape->fieldCount = parent ? parent->fieldCount + 1 : 0;
+    initTable(&shape->transitions);
+    return shape;
+}
+
+int shapeFieldIndex(ObjShape* shape, ObjString* name) {
+    for (; shape->parent != NULL; shape = shape->parent) {
+        if (shape->name == name) {
+            return shape->fieldCount - 1;
+        }
+    }
+    return -1;
+}
+
+// NULL when the shape has run out of fields or transitions; the instance then goes to
+// dictionary mode rather than growing the tree further.
+static ObjShape* shapeTransition(ObjShape* shape, ObjString* name) {
+    vm_mutex_enter_blocking(&vm.env);
+    ObjShape* result = NULL;
+    Value child;
+    if (tableGet(&shape->transitions, name, &child)) {
+        result = AS_SHAPE(child);
+    } else if (shape->fieldCount < SHAPE_MAX_FIELDS
+               && shape->transitions.count < SHAPE_MAX_TRANSITIONS) {
+        result = newShape(shape, name);
+        tempRootPush(OBJ_VAL(result));
+        tableSet(&shape->transitions, name, OBJ_VAL(result));
+        tempRootPop();
+    }
+    vm_mutex_exit(&vm.env);
+    return result;
+}
+
+static void reserveFields(ObjInstance* instance, int count) {
+    if (count <= instance->fieldCapacity) {
+        return;
+    }
+    int capacity = GROW_CAPACITY(instance->fieldCapacity);
+    Value* fields = ALLOCATE(Value, capacity);
+    for (int i = 0; i < instance->shape->fieldCount; i++) {
+        fields[i] = instance->fields[i];
+    }
+    if (instance->fields != instance->inlineFields) {
+        FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+    }
+    instance->fields = fields;
+    instance->fieldCapacity = capacity;
+}
+
+static void convertToDictionary(ObjInstance* instance) {
+    ValueTable* dictionary = ALLOCATE(ValueTable, 1);
+    initTable(dictionary);
+    instance->dictionary = dictionary;
+    for (ObjShape* shape = instance->shape; shape->parent != NULL; shape = shape->parent) {
+        tableSet(dictionary, shape->name, instance->fields[shape->fieldCount - 1]);
+    }
+    if (instance->fields != instance->inlineFields) {
+        FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+    }
+    instance->fields = instance->inlineFields;
+    instance->fieldCapacity = instance->inlineCapacity;
+    instance->shape = NULL;
+}
+
+bool instanceGetField(ObjInstance* instance, ObjString* name, Value* value) {
+    if (instance->shape == NULL) {
+        return tableGet(instance->dictionary, name, value);
+    }
+    int index = shapeFieldIndex(instance->shape, name);
+    if (index < 0) {
+        return false;
+    }
+    *value = instance->fields[index];
+    return true;
+}
+
+void instanceSetField(ObjInstance* instance, ObjString* name, Value value) {
+    if (instance->shape != NULL) {
+        int index = shapeFieldIndex(instance->shape, name);
+        if (index >= 0) {
+            instance->fields[index] = value;
+            writeBarrier((Obj*)instance, value);
+            return;
+        }
+
+        ObjShape* next = shapeTransition(instance->shape, name);
+        if (next != NULL) {
+            reserveFields(instance, next->fieldCount);
+            instance->fields[next->fieldCount - 1] = value;
+            instance->shape = next;
+            writeBarrier((Obj*)instance, value);
+            writeBarrierObj((Obj*)instance, (Obj*)next);
+            if (next->fieldCount > instance->klass->fieldCountHint) {
+                instance->klass->fieldCountHint = next->fieldCount;
+            }
+            return;
+        }
+        convertToDictionary(instance);
+    }
+    tableSet(instance->dictionary, name, value);
+    writeBarrier((Obj*)instance, value);
+}
+
+void markInstanceFields(ObjInstance* instance) {
+    if (instance->shape == NULL) {
+        if (instance->dictionary != NULL) {
+            markTable(instance->dictionary);
+        }
+        return;
+    }
+    markObject((Obj*)instance->shape);
+    for (int i = 0; i < instance->shape->fieldCount; i++) {
+        markValue(instance->fields[i]);
+    }
+}
+
+void freeInstanceFields(ObjInstance* instance) {
+    if (instance->fields != instance->inlineFields) {
+        FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+    }
+    if (instance->dictionary != NULL) {
+        freeTable(instance->dictionary);
+        FREE(ValueTable, instance->dictionary);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef cyarg_shape_h
+#define cyarg_shape_h
+
+#include "value.h"
+#include "object.h"
+
+#define SHAPE_MAX_FIELDS 64
+#define SHAPE_MAX_TRANSITIONS 8
+
+ObjShape* newShape(ObjShape* parent, ObjString* name);
+int shapeFieldIndex(ObjShape* shape, ObjString* name);
+
+bool instanceGetField(ObjInstance* instance, ObjString* name, Value* value);
+void instanceSetField(ObjInstance* instance, ObjString* name, Value value);
+
+void markInstanceFields(ObjInstance* instance);
+void freeInstanceFields(ObjInstance* instance);
+
+#endif
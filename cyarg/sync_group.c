@@ -22,19 +22,18 @@ ObjSyncGroup* newSyncGroup(ObjRoutine* routine, ObjPackedUniformArray* items) {
     push(routine, OBJ_VAL(group));
     vm_mutex_init(&group->group_lock);
     group->channel_array = items;
-    ObjConcreteYargTypeArray* t = (ObjConcreteYargTypeArray*)newYargArrayTypeFromType(NIL_VAL);
+    ObjConcreteYargTypeArray* t = (ObjConcreteYargTypeArray*)internYargArrayType(NIL_VAL, arrayCardinality(items->store));
     push(routine, OBJ_VAL(t));
-    t->cardinality = arrayCardinality(items->store);
     group->result_array = newPackedUniformArray(t);
     pop(routine);
     pop(routine);
     return group;
 }
 
-void freeSyncGroup(Obj* obj) {
+size_t freeSyncGroup(Obj* obj) {
     ObjSyncGroup* group = (ObjSyncGroup*)obj;
     vm_mutex_deinit(&group->group_lock);
-    FREE(ObjSyncGroup, obj);
+    return sizeof(ObjSyncGroup);
 }
 
 void markSyncGroup(ObjSyncGroup* group) {
@@ -10,7 +10,7 @@ typedef struct ObjSyncGroup ObjSyncGroup;
 
 ObjSyncGroup* newSyncGroup(ObjRoutine* routine, ObjPackedUniformArray* items);
 
-void freeSyncGroup(Obj* group);
+size_t freeSyncGroup(Obj* group);
 void markSyncGroup(ObjSyncGroup* group);
 
 ObjString* syncGroupToString(ObjSyncGroup* group);
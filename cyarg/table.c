@@ -152,6 +152,9 @@ void markTable(ValueTable* table) {
     }
 }
 
+// marks a deleted entry, so probing continues past it.
+static ValueCell cellTombstone;
+
 void initCellTable(ValueCellTable* table) {
     table->count = 0;
     table->capacity = 0;
@@ -159,6 +162,12 @@ void initCellTable(ValueCellTable* table) {
 }
 
 void freeCellTable(ValueCellTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        EntryCell* entry = &table->entries[i];
+        if (entry->key != NULL) {
+            FREE(ValueCell, entry->cell);
+        }
+    }
     FREE_ARRAY(EntryCell, table->entries, table->capacity);
     initCellTable(table);
 }
@@ -170,7 +179,7 @@ static EntryCell* findCellEntry(EntryCell* entries, int capacity, ObjString* key
     for (;;) {
         EntryCell* entry = &entries[index];
         if (entry->key == NULL) {
-            if (IS_NIL(entry->cell.value)) {
+            if (entry->cell == NULL) {
                 // Empty entry.
                 return tombstone != NULL ? tombstone : entry;
             } else {
@@ -192,17 +201,18 @@ bool tableCellGet(ValueCellTable* table, ObjString* key, ValueCell* value) {
     EntryCell* entry = findCellEntry(table->entries, table->capacity, key);
     if (entry->key == NULL) return false;
 
-    *value = entry->cell;
+    *value = *entry->cell;
     return true;
 }
 
+// the place stays valid until the key is deleted or the table freed.
 bool tableCellGetPlace(ValueCellTable* table, ObjString* key, ValueCell** place) {
     if (table->count == 0) return false;
 
     EntryCell* entry = findCellEntry(table->entries, table->capacity, key);
     if (entry->key == NULL) return false;
 
-    *place = &entry->cell;
+    *place = entry->cell;
     return true;
 }
 
@@ -210,8 +220,7 @@ static void adjustCellCapacity(ValueCellTable* table, int capacity) {
     EntryCell* entries = ALLOCATE(EntryCell, capacity);
     for (int i = 0; i < capacity; i++) {
         entries[i].key = NULL;
-        entries[i].cell.value = NIL_VAL;
-        entries[i].cell.cellType = NULL;
+        entries[i].cell = NULL;
     }
 
     table->count = 0;
@@ -221,7 +230,7 @@ static void adjustCellCapacity(ValueCellTable* table, int capacity) {
 
         EntryCell* dest = findCellEntry(entries, capacity, entry->key);
         dest->key = entry->key;
-        dest->cell= entry->cell;
+        dest->cell = entry->cell;
         table->count++;
     }
 
@@ -238,10 +247,14 @@ bool tableCellSet(ValueCellTable* table, ObjString* key, ValueCell cell) {
 
     EntryCell* entry = findCellEntry(table->entries, table->capacity, key);
     bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NIL(entry->cell.value)) table->count++;
+    if (isNewKey) {
+        ValueCell* place = ALLOCATE(ValueCell, 1);
+        if (entry->cell == NULL) table->count++;
+        entry->cell = place;
+        entry->key = key;
+    }
 
-    entry->key = key;
-    entry->cell = cell;
+    *entry->cell = cell;
     return isNewKey;
 }
 
@@ -253,9 +266,9 @@ bool tableCellDelete(ValueCellTable* table, ObjString* key) {
     if (entry->key == NULL) return false;
 
     // Place a tombstone in the entry.
+    FREE(ValueCell, entry->cell);
     entry->key = NULL;
-    entry->cell.value = BOOL_VAL(true);
-    entry->cell.cellType = NULL;
+    entry->cell = &cellTombstone;
     return true;
 }
 
@@ -263,7 +276,7 @@ void tableCellAddAll(ValueCellTable* from, ValueCellTable* to) {
     for (int i = 0; i < from->capacity; i++) {
         EntryCell* entry = &from->entries[i];
         if (entry->key != NULL) {
-            tableCellSet(to, entry->key, entry->cell);
+            tableCellSet(to, entry->key, *entry->cell);
         }
     }
 }
@@ -276,7 +289,7 @@ ObjString* tableCellFindString(ValueCellTable* table, const char* chars, int len
         EntryCell* entry = &table->entries[index];
         if (entry->key == NULL) {
             // Stop if we find an empty non-tombstone entry.
-            if (IS_NIL(entry->cell.value)) return NULL;
+            if (entry->cell == NULL) return NULL;
         } else if (entry->key->length == length &&
                    entry->key->hash == hash &&
                    memcmp(entry->key->chars, chars, length) == 0) {
@@ -302,7 +315,7 @@ void markCellTable(ValueCellTable* table) {
         EntryCell* entry = &table->entries[i];
         if (entry->key != NULL) {
             markObject((Obj*)entry->key);
-            markValueCell(&entry->cell);
+            markValueCell(entry->cell);
         }
     }
 }
@@ -313,9 +326,9 @@ void printCellTable(ValueCellTable* table) {
         if (entry->key != NULL) {
             printValue(OBJ_VAL((Obj*)entry->key));
             FPRINTMSG(stderr, ":::");
-            printValue(entry->cell.value);
+            printValue(entry->cell->value);
             FPRINTMSG(stderr, ":::");
-            printValue(OBJ_VAL((Obj*)entry->cell.cellType));
+            printValue(OBJ_VAL((Obj*)entry->cell->cellType));
             FPRINTMSG(stderr, "\n");
         }
     }
@@ -25,9 +25,10 @@ ObjString* tableFindString(ValueTable* table, const char* chars, int length, uin
 void tableRemoveWhite(ValueTable* table);
 void markTable(ValueTable* table);
 
+// the cell is held outside the entries, so its address stays put as the table grows.
 typedef struct {
     ObjString* key;
-    ValueCell cell;
+    ValueCell* cell;
 } EntryCell;
 
 typedef struct {
@@ -21,15 +21,15 @@ static bool writeBuiltin(ObjRoutine *, int, Value *);
 static bool interruptBuiltin(ObjRoutine *, int, Value *);
 static bool syncBuiltin(ObjRoutine *, int, Value *);
 
-Value getTestSystemBuiltin(uint8_t builtin)
+BuiltinFun getTestSystemBuiltin(uint8_t builtin)
 {
     switch (builtin) {
-        case BUILTIN_TS_SET: return OBJ_VAL(newBuiltin(setBuiltin));
-        case BUILTIN_TS_READ: return OBJ_VAL(newBuiltin(readBuiltin));
-        case BUILTIN_TS_WRITE: return OBJ_VAL(newBuiltin(writeBuiltin));
-        case BUILTIN_TS_INTERRUPT: return OBJ_VAL(newBuiltin(interruptBuiltin));
-        case BUILTIN_TS_SYNC: return OBJ_VAL(newBuiltin(syncBuiltin));
-        default: return NIL_VAL;
+        case BUILTIN_TS_SET: return setBuiltin;
+        case BUILTIN_TS_READ: return readBuiltin;
+        case BUILTIN_TS_WRITE: return writeBuiltin;
+        case BUILTIN_TS_INTERRUPT: return interruptBuiltin;
+        case BUILTIN_TS_SYNC: return syncBuiltin;
+        default: return NULL;
     }
 }
 
@@ -135,12 +135,10 @@ bool syncBuiltin(ObjRoutine *routineContext, int argCount, Value *result)
 {
     TsLog *log = testIntrinsicsSync();
 
-    Obj emptyString;
-    ObjConcreteYargType *array = newYargArrayTypeFromType(OBJ_VAL(&emptyString));
+    ObjConcreteYargType *array = internYargArrayType(NIL_VAL, log->n_);
     tempRootPush(OBJ_VAL(array));
 
     ObjConcreteYargTypeArray *arrayAsArray = (ObjConcreteYargTypeArray *)array;
-    arrayAsArray->cardinality = log->n_;
     ObjPackedUniformArray* result_array = newPackedUniformArray(arrayAsArray);
     tempRootPop(); // array
     tempRootPush(OBJ_VAL(result_array));
@@ -22,20 +22,24 @@ PackedValue allocPackedValue(Value type) {
     return value;
 }
 
+// the types of the fields and elements are traced from the container's type, so storage
+// which holds no references need not be looked at.
 static void markPackedStruct(ObjConcreteYargTypeStruct* type, PackedValueStore* fields) {
-    if (fields) {
+    if (fields && type->core.layout.holds_references) {
         PackedValue s;
         s.storedType = (ObjConcreteYargType*)type;
         s.storedValue = fields;
         for (int i = 0; i < type->field_count; i++) {
             PackedValue f = structField(s, i);
-            markPackedValue(f);
+            if (f.storedType == NULL || f.storedType->layout.holds_references) {
+                markPackedValue(f);
+            }
         }
     }
 }
 
 static void markPackedArray(ObjConcreteYargTypeArray* type, PackedValueStore* elements) {
-    if (elements) {
+    if (elements && type->core.layout.holds_references) {
         PackedValue array = { .storedType = (ObjConcreteYargType*)type, .storedValue = elements };
         for (size_t i = 0; i < type->cardinality; i++) {
             PackedValue el = arrayElement(array, i);
@@ -108,16 +112,28 @@ void initialisePackedValue(PackedValue packedValue) {
             case TypeUint64: packedValue.storedValue->as.ui64 = 0; break;
             case TypeArray: {
                 ObjConcreteYargTypeArray* at = (ObjConcreteYargTypeArray*)packedValue.storedType;
-                if (at->cardinality > 0) {
-                    for (size_t i = 0; i < at->cardinality; i++) {
-                        PackedValue el = arrayElement(packedValue, i);
-                        initialisePackedValue(el);
-                    }
+                if (at->cardinality == 0) break;
+                uint8_t* elements = (uint8_t*)packedValue.storedValue;
+                size_t size = at->core.layout.storage_size;
+                if (at->core.layout.zero_initialised) {
+                    memset(elements, 0, size);
+                    break;
+                }
+                // the elements all start out the same, so the first is copied over the rest.
+                initialisePackedValue(arrayElement(packedValue, 0));
+                for (size_t done = arrayElementSize(at); done < size; done *= 2) {
+                    memcpy(elements + done, elements, done < size - done ? done : size - done);
                 }
                 break;
             }
             case TypeStruct: {
                 ObjConcreteYargTypeStruct* st = (ObjConcreteYargTypeStruct*)packedValue.storedType;
+                if (st->core.layout.zero_initialised) {
+                    if (st->core.layout.storage_size > 0) {
+                        memset(packedValue.storedValue, 0, st->core.layout.storage_size);
+                    }
+                    break;
+                }
                 for (size_t i = 0; i < st->field_count; i++) {
                     PackedValue f = structField(packedValue, i);
                     initialisePackedValue(f);
@@ -213,11 +229,19 @@ static void packValue(PackedValue packedStorageTarget, Value value) {
             case TypeRoutine:
             case TypeChannel:
             case TypeYargType:
-            case TypeInt:
             case TypeMap: {
                 packedStorageTarget.storedValue->as.obj = AS_OBJ(value);
                 break;
             }
+            case TypeInt: {
+                // packed ints are always held as an ObjInt.
+                if (IS_SMALL_INT(value)) {
+                    packedStorageTarget.storedValue->as.obj = (Obj*)newInt(AS_SMALL_INT(value));
+                } else {
+                    packedStorageTarget.storedValue->as.obj = AS_OBJ(value);
+                }
+                break;
+            }
             case TypeStruct:
             case TypeArray:
                 break;
@@ -225,11 +249,15 @@ static void packValue(PackedValue packedStorageTarget, Value value) {
     }
 }
 
-static void noLongerLiteralInt(Value *value)
+void noLongerLiteralInt(Value *value)
 {
-    if (IS_INT(*value))
+    if (IS_SMALL_INT(*value))
+    {
+        *value = SMALL_INT_VAL(AS_SMALL_INT(*value));
+    }
+    else if (IS_INT(*value))
     {
-        ((ObjInt *) value->as.obj)->isLiteral = false;
+        ((ObjInt *) AS_OBJ(*value))->isLiteral = false;
     }
 }
 
@@ -242,7 +270,7 @@ bool assignToPackedValue(PackedValue lhs, Value rhsValue) {
     } else {
         Value promoted;
         if (isInitialisableType(lhs.storedType, rhsValue, &promoted)) {
-            if (promoted.type == VAL_NIL)
+            if (IS_NIL(promoted))
             {
                 noLongerLiteralInt(&rhsValue);
                 packValue(lhs, rhsValue);
@@ -266,7 +294,7 @@ bool assignToValueCellTarget(ValueCellTarget lhs, Value rhsValue) {
     } else {
         Value promoted;
         if (isInitialisableType(lhs.cellType, rhsValue, &promoted)) {
-            if (promoted.type == VAL_NIL)
+            if (IS_NIL(promoted))
             {
                 noLongerLiteralInt(&rhsValue);
                 *(lhs.value) = rhsValue;
@@ -290,7 +318,7 @@ bool initialiseValueCellTarget(ValueCellTarget lhs, Value rhsValue) {
     } else {
         Value promoted;
         if (isInitialisableType(lhs.cellType, rhsValue, &promoted)) {
-            if (promoted.type == VAL_NIL)
+            if (IS_NIL(promoted))
             {
                 noLongerLiteralInt(&rhsValue);
                 *(lhs.value) = rhsValue;
@@ -445,7 +473,7 @@ ObjString* addressToString(uintptr_t value) {
 
 ObjString* valueToString(Value value) {
     ObjString* string = NULL;
-    switch (value.type) {
+    switch (VALUE_TYPE(value)) {
         case VAL_BOOL:
             string = AS_BOOL(value) ? copyString("true", 4) : copyString("false", 5);
             break;
@@ -461,6 +489,7 @@ ObjString* valueToString(Value value) {
         case VAL_UI64: string = ui64ToString(AS_UI64(value)); break;
         case VAL_ADDRESS: string = addressToString(AS_ADDRESS(value)); break;
         case VAL_OBJ: string = objectToString(value); break;
+        case VAL_SMALL_INT: string = i32ToString(AS_SMALL_INT(value)); break;
     }
     return string;
 }
@@ -477,8 +506,8 @@ void fprintValue(FILE* op, Value value) {
 }
 
 bool valuesEqual(Value a, Value b) {
-    if (a.type != b.type) return false;
-    switch (a.type) {
+    if (VALUE_TYPE(a) != VALUE_TYPE(b)) return false;
+    switch (VALUE_TYPE(a)) {
         case VAL_BOOL:     return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NIL:      return true;
         case VAL_DOUBLE:   return AS_DOUBLE(a) == AS_DOUBLE(b);
@@ -492,6 +521,7 @@ bool valuesEqual(Value a, Value b) {
         case VAL_UI64:     return AS_UI64(a) == AS_UI64(b);
         case VAL_ADDRESS:  return AS_ADDRESS(a) == AS_ADDRESS(b);
         case VAL_OBJ:      return AS_OBJ(a) == AS_OBJ(b);
+        case VAL_SMALL_INT: return AS_SMALL_INT(a) == AS_SMALL_INT(b);
         default:           return false; // Unreachable.
     }
 }
@@ -509,6 +539,8 @@ bool is_positive_integer32(Value a) {
         return true;
     } else if (IS_I64(a) && AS_I64(a) >= 0 && AS_I64(a) <= UINT32_MAX) {
         return true;
+    } else if (IS_SMALL_INT(a)) {
+        return AS_SMALL_INT(a) >= 0;
     } else if (IS_INT(a)) {
         return int_is_range(AS_INT(a), 0, UINT32_MAX) == INT_WITHIN;
     }
@@ -532,6 +564,8 @@ uint32_t as_positive_integer32(Value a) {
         return AS_UI16(a);
     } else if (IS_UI64(a) && AS_UI64(a) <= UINT32_MAX) {
         return (uint32_t) AS_UI64(a);
+    } else if (IS_SMALL_INT(a) && AS_SMALL_INT(a) >= 0) {
+        return (uint32_t) AS_SMALL_INT(a);
     } else if (IS_INT(a)) {
         if (int_is_range(AS_INT(a), 0, UINT32_MAX) == INT_WITHIN) {
             return int_to_u32(AS_INT(a));
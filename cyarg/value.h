@@ -26,6 +26,10 @@ typedef union {
     int64_t i64;
     uintptr_t address;
     Obj* obj;
+    struct {
+        int32_t i32;
+        bool isLiteral;
+    } smallInt;
 } AnyValue;
 
 typedef enum {
@@ -42,13 +46,9 @@ typedef enum {
     VAL_I64,
     VAL_ADDRESS,
     VAL_OBJ,
+    VAL_SMALL_INT, // an int which fits in 32 bits, held without an ObjInt
 } ValueType;
 
-typedef struct {
-    ValueType type;
-    AnyValue as;
-} Value;
-
 #if defined(__LP64__) || defined(_WIN64) || defined(__x86_64__) || defined(__aarch64__)
 #define IS_64BIT 1
 #define IS_32BIT 0
@@ -57,6 +57,133 @@ typedef struct {
 #define IS_32BIT 1
 #endif
 
+#ifdef CYARG_COMPACT_VALUE
+
+// NaN-boxed: a double is held as itself and everything else inside a quiet NaN. Objects carry
+// a 48-bit pointer under the sign bit; other values carry their ValueType above a 32-bit
+// payload. 64-bit integers, and addresses wider than 48 bits, are boxed on the heap.
+typedef struct {
+    uint64_t bits;
+} Value;
+
+#define VALUE_SIGN_BIT       ((uint64_t)0x8000000000000000)
+#define VALUE_QNAN           ((uint64_t)0x7ffc000000000000)
+#define VALUE_WIDE_BIT       ((uint64_t)0x0001000000000000) // boxed with the sign bit, else an address
+#define VALUE_TAG_MASK       ((uint64_t)0xffff000000000000)
+#define VALUE_PAYLOAD_MASK   ((uint64_t)0x0000ffffffffffff)
+#define VALUE_TYPE_SHIFT     32
+#define VALUE_LITERAL_BIT    ((uint64_t)1 << 40)
+#define VALUE_IMMEDIATE_MASK (VALUE_TAG_MASK | ((uint64_t)0xff << VALUE_TYPE_SHIFT))
+
+#define VALUE_IMMEDIATE(type, payload) \
+    ((Value){ VALUE_QNAN | ((uint64_t)(type) << VALUE_TYPE_SHIFT) | (uint32_t)(payload) })
+
+Value boxValue(ValueType type, uint64_t bits);
+ValueType boxedValueType(Value value);
+uint64_t boxedValueBits(Value value);
+
+#define IS_IMMEDIATE(value, type) (((value).bits & VALUE_IMMEDIATE_MASK) == VALUE_IMMEDIATE(type, 0).bits)
+#define IS_BOXED(value)    (((value).bits & VALUE_TAG_MASK) == (VALUE_SIGN_BIT | VALUE_QNAN | VALUE_WIDE_BIT))
+#define IS_BOXED_AS(value, type) (IS_BOXED(value) && boxedValueType(value) == (type))
+
+#define IS_BOOL(value)     IS_IMMEDIATE(value, VAL_BOOL)
+#define IS_NIL(value)      IS_IMMEDIATE(value, VAL_NIL)
+#define IS_DOUBLE(value)   (((value).bits & VALUE_QNAN) != VALUE_QNAN)
+#define IS_I8(value)       IS_IMMEDIATE(value, VAL_I8)
+#define IS_UI8(value)      IS_IMMEDIATE(value, VAL_UI8)
+#define IS_I16(value)      IS_IMMEDIATE(value, VAL_I16)
+#define IS_UI16(value)     IS_IMMEDIATE(value, VAL_UI16)
+#define IS_I32(value)      IS_IMMEDIATE(value, VAL_I32)
+#define IS_UI32(value)     IS_IMMEDIATE(value, VAL_UI32)
+#define IS_UI64(value)     IS_BOXED_AS(value, VAL_UI64)
+#define IS_I64(value)      IS_BOXED_AS(value, VAL_I64)
+#define IS_ADDRESS(value)  isCompactAddress(value)
+#define IS_OBJ(value)      (((value).bits & VALUE_TAG_MASK) == (VALUE_SIGN_BIT | VALUE_QNAN))
+#define IS_SMALL_INT(value) IS_IMMEDIATE(value, VAL_SMALL_INT)
+#define IS_INT(value)      (IS_SMALL_INT(value) || (IS_OBJ(value) && AS_OBJ(value)->type == OBJ_INT))
+
+static inline double valueToDouble(Value value) {
+    double result;
+    memcpy(&result, &value.bits, sizeof(double));
+    return result;
+}
+
+static inline Value doubleToValue(double number) {
+    Value result;
+    if (number != number) {
+        result.bits = (uint64_t)0x7ff8000000000000; // one quiet NaN, clear of the tagged range
+    } else {
+        memcpy(&result.bits, &number, sizeof(double));
+    }
+    return result;
+}
+
+static inline Value addressToValue(uintptr_t address) {
+    if ((uint64_t)address <= VALUE_PAYLOAD_MASK) {
+        return (Value){ VALUE_QNAN | VALUE_WIDE_BIT | (uint64_t)address };
+    }
+    return boxValue(VAL_ADDRESS, (uint64_t)address);
+}
+
+static inline bool isCompactAddress(Value value) {
+    return (value.bits & VALUE_TAG_MASK) == (VALUE_QNAN | VALUE_WIDE_BIT) || IS_BOXED_AS(value, VAL_ADDRESS);
+}
+
+static inline uintptr_t valueToAddress(Value value) {
+    if (IS_BOXED(value)) {
+        return (uintptr_t)boxedValueBits(value);
+    }
+    return (uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+static inline ValueType valueTypeOf(Value value) {
+    if (IS_DOUBLE(value)) return VAL_DOUBLE;
+    if (value.bits & VALUE_SIGN_BIT) {
+        return (value.bits & VALUE_WIDE_BIT) ? boxedValueType(value) : VAL_OBJ;
+    }
+    if (value.bits & VALUE_WIDE_BIT) return VAL_ADDRESS;
+    return (ValueType)((value.bits >> VALUE_TYPE_SHIFT) & 0xff);
+}
+
+#define AS_OBJ(value)      ((Obj*)(uintptr_t)((value).bits & VALUE_PAYLOAD_MASK))
+#define AS_BOOL(value)     (((value).bits & 1) != 0)
+#define AS_I8(value)       ((int8_t)(value).bits)
+#define AS_UI8(value)      ((uint8_t)(value).bits)
+#define AS_I16(value)      ((int16_t)(value).bits)
+#define AS_UI16(value)     ((uint16_t)(value).bits)
+#define AS_I32(value)      ((int32_t)(uint32_t)(value).bits)
+#define AS_UI32(value)     ((uint32_t)(value).bits)
+#define AS_UI64(value)     boxedValueBits(value)
+#define AS_I64(value)      ((int64_t)boxedValueBits(value))
+#define AS_ADDRESS(value)  valueToAddress(value)
+#define AS_DOUBLE(value)   valueToDouble(value)
+#define AS_SMALL_INT(value) ((int32_t)(uint32_t)(value).bits)
+#define IS_SMALL_INT_LITERAL(value) (((value).bits & VALUE_LITERAL_BIT) != 0)
+#define VALUE_TYPE(value)  valueTypeOf(value)
+
+#define BOOL_VAL(value)     VALUE_IMMEDIATE(VAL_BOOL, (value) ? 1 : 0)
+#define NIL_VAL             VALUE_IMMEDIATE(VAL_NIL, 0)
+#define DOUBLE_VAL(value)   doubleToValue(value)
+#define I8_VAL(value)       VALUE_IMMEDIATE(VAL_I8, (int8_t)(value))
+#define UI8_VAL(value)      VALUE_IMMEDIATE(VAL_UI8, (uint8_t)(value))
+#define I16_VAL(value)      VALUE_IMMEDIATE(VAL_I16, (int16_t)(value))
+#define UI16_VAL(value)     VALUE_IMMEDIATE(VAL_UI16, (uint16_t)(value))
+#define I32_VAL(value)      VALUE_IMMEDIATE(VAL_I32, (int32_t)(value))
+#define UI32_VAL(value)     VALUE_IMMEDIATE(VAL_UI32, (uint32_t)(value))
+#define I64_VAL(a)          boxValue(VAL_I64, (uint64_t)(int64_t)(a))
+#define UI64_VAL(a)         boxValue(VAL_UI64, (uint64_t)(a))
+#define ADDRESS_VAL(value)  addressToValue(value)
+#define OBJ_VAL(object)     ((Value){ VALUE_SIGN_BIT | VALUE_QNAN | (uint64_t)(uintptr_t)(object) })
+#define SMALL_INT_VAL(a)    VALUE_IMMEDIATE(VAL_SMALL_INT, (int32_t)(a))
+#define SMALL_INT_LITERAL_VAL(a) ((Value){ VALUE_IMMEDIATE(VAL_SMALL_INT, (int32_t)(a)).bits | VALUE_LITERAL_BIT })
+
+#else
+
+typedef struct {
+    ValueType type;
+    AnyValue as;
+} Value;
+
 #define IS_BOOL(value)     ((value).type == VAL_BOOL)
 #define IS_NIL(value)      ((value).type == VAL_NIL)
 #define IS_DOUBLE(value)   ((value).type == VAL_DOUBLE)
@@ -70,7 +197,8 @@ typedef struct {
 #define IS_I64(value)      ((value).type == VAL_I64)
 #define IS_ADDRESS(value)  ((value).type == VAL_ADDRESS)
 #define IS_OBJ(value)      ((value).type == VAL_OBJ)
-#define IS_INT(value)      ((value).type == VAL_OBJ && (value).as.obj->type == OBJ_INT)
+#define IS_SMALL_INT(value) ((value).type == VAL_SMALL_INT)
+#define IS_INT(value)      (IS_SMALL_INT(value) || (IS_OBJ(value) && AS_OBJ(value)->type == OBJ_INT))
 
 #define AS_OBJ(value)      ((value).as.obj)
 #define AS_BOOL(value)     ((value).as.boolean)
@@ -84,6 +212,9 @@ typedef struct {
 #define AS_I64(value)      ((value).as.i64)
 #define AS_ADDRESS(value)  ((value).as.address)
 #define AS_DOUBLE(value)   ((value).as.dbl)
+#define AS_SMALL_INT(value) ((value).as.smallInt.i32)
+#define IS_SMALL_INT_LITERAL(value) ((value).as.smallInt.isLiteral)
+#define VALUE_TYPE(value)  ((value).type)
 
 #define BOOL_VAL(value)     ((Value){VAL_BOOL, {.boolean = value }})
 #define NIL_VAL             ((Value){VAL_NIL, {.i32 = 0 }})
@@ -98,6 +229,11 @@ typedef struct {
 #define UI64_VAL(a)         ((Value){VAL_UI64, {.ui64 = a}})
 #define ADDRESS_VAL(value)  ((Value){VAL_ADDRESS, { .address = value}})
 #define OBJ_VAL(object)     ((Value){VAL_OBJ, {.obj = (Obj*)object}})
+#define SMALL_INT_VAL(a)    ((Value){VAL_SMALL_INT, {.smallInt = {.i32 = a, .isLiteral = false}}})
+#define SMALL_INT_LITERAL_VAL(a) ((Value){VAL_SMALL_INT, {.smallInt = {.i32 = a, .isLiteral = true}}})
+
+
+#endif // CYARG_COMPACT_VALUE
 
 #if IS_64BIT
 #define SIZE_T_UI_VAL(value)   UI64_VAL(value)
@@ -145,6 +281,7 @@ typedef struct {
     ObjConcreteYargType* cellType;
 } ValueCellTarget;
 
+void noLongerLiteralInt(Value* value);
 bool assignToValueCellTarget(ValueCellTarget lhs, Value rhsValue);
 bool initialiseValueCellTarget(ValueCellTarget lhs, Value rhsValue);
 
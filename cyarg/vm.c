@@ -22,6 +22,14 @@
 #include "routine.h"
 #include "channel.h"
 #include "yargtype.h"
+#include "shape.h"
+#include "quicken.h"
+#if defined(CYARG_JIT)
+#include "jit.h"
+#endif
+#if defined(CYARG_AOT)
+#include "aot.h"
+#endif
 
 VM vm;
 
@@ -31,7 +39,9 @@ static void unaryIntOp(ObjRoutine* routine, int op);
 
 void vmPinnedRoutineHandler(size_t handler) {
     ObjRoutine* routine = vm.pinnedRoutines[handler];
+    AllocContext* outer = enterAllocContext(&vm.allocContexts[2 + handler]);
     runAndRenter(routine);
+    leaveAllocContext(outer);
 }
 
 
@@ -81,7 +91,9 @@ void vmCore1Entry() {
 #endif
 
     ObjRoutine* core = vm.core1;
+    AllocContext* outer = enterAllocContext(&vm.allocContexts[1]);
     runAndRenter(core);
+    leaveAllocContext(outer);
     vm.core1 = NULL;
 }
 
@@ -132,9 +144,23 @@ void initVMMemory() {
 
     memset(&vm, 0, sizeof(VM));
 
-    vm.tempRootsTop = vm.tempRoots;
+    for (int i = 0; i < ALLOC_CONTEXTS; i++) {
+        initAllocContext(&vm.allocContexts[i]);
+    }
 
     vm.nextGC = FIRST_GC_AT;
+    vm.nextYoungGC = NURSERY_SIZE;
+    vm.gcPhase = GC_IDLE;
+    vm.largeObjectsTail = &vm.largeObjects;
+    vm.gcStepObjects = GC_STEP_OBJECTS;
+    vm.gcGrowthPercent = GC_GROWTH_PERCENT;
+    vm.gcPacedPercent = GC_GROWTH_PERCENT;
+#if defined(CYARG_OS_HOSTED)
+    const char* gcStep = getenv("CYARG_GC_STEP");
+    if (gcStep != NULL) {
+        vm.gcStepObjects = strtoul(gcStep, NULL, 10);
+    }
+#endif
 
     vm_mutex_init(&vm.heap);
     vm_mutex_init(&vm.env);
@@ -160,14 +186,23 @@ void initVMRuntime() {
 
     vm.bootFunction.obj.type = OBJ_FUNCTION;
     initFunction(&vm.bootFunction);
+#if defined(CYARG_JIT)
+    initJit();
+#endif
 
     initCellTable(&vm.globals);
     initTable(&vm.strings);
     
     vm.initString = copyString("init", 4);
+    initYargTypes();
+    initBuiltins();
 
     defineNative("clock", clockNative);
     defineNative("c_clock_get_hz", clock_get_hzNative);
+    defineNative("gc_pauses", gc_pausesNative);
+    defineNative("gc_slab_live", gc_slab_liveNative);
+    defineNative("gc_slab_capacity", gc_slab_capacityNative);
+    defineNative("gc_config", gc_configNative);
 
     defineNative("irq_remove_handler", irq_remove_handlerNative);
     defineNative("irq_add_shared_handler", irq_add_shared_handlerNative);
@@ -190,8 +225,13 @@ void initVMRuntime() {
 void freeVM() {
     freeCellTable(&vm.globals);
     freeTable(&vm.strings);
+    freeYargTypes();
+#ifdef DEBUG_INLINE_CACHE
+    PRINTERR("inline caches: %zu hits, %zu misses\n", vm.inlineCacheHits, vm.inlineCacheMisses);
+#endif
     vm.initString = NULL;
     vm.libraryPath = NULL;
+    freeRoutine(&vm.core0);
     freeObjects();
 }
 
@@ -207,15 +247,61 @@ void markVMRoots() {
         markObject((Obj*)vm.pinnedRoutines[i]);
     }
 
-    for (Value* slot = vm.tempRoots; slot < vm.tempRootsTop; slot++) {
-        markValue(*slot);
+    for (int i = 0; i < ALLOC_CONTEXTS; i++) {
+        AllocContext* context = &vm.allocContexts[i];
+        for (int j = 0; j < context->tempRootCount; j++) {
+            markValue(context->tempRoots[j]);
+        }
+    }
+    for (int i = 0; i < vm.loadingFunctionCount; i++) {
+        markObject((Obj*)vm.loadingFunctions[i]);
     }
 
     markObject((Obj*)vm.libraryPath);
+    markYargTypes();
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        markValue(vm.builtins[i]);
+    }
     markCellTable(&vm.globals);
     markObject((Obj*)vm.initString);
 }
 
+// Globals are late bound, so a chunk looks each name up once and then keeps the table's
+// cell, which never moves. Only that first lookup takes vm.env.
+static ValueCell* bindGlobalCell(Chunk* chunk, uint8_t constant) {
+    vm_mutex_enter_blocking(&vm.env);
+    ValueCell* cell = NULL;
+    if (tableCellGetPlace(&vm.globals, AS_STRING(chunk->constants.values[constant]), &cell)) {
+        if (chunk->globalCells == NULL) {
+            int count = chunk->constants.count;
+            ValueCell** cells = ALLOCATE(ValueCell*, count);
+            for (int i = 0; i < count; i++) {
+                cells[i] = NULL;
+            }
+            chunk->globalCellCount = count;
+            chunk->globalCells = cells;
+        }
+        if (constant < chunk->globalCellCount) {
+            chunk->globalCells[constant] = cell;
+        }
+    }
+    vm_mutex_exit(&vm.env);
+    return cell;
+}
+
+static inline ValueCell* globalCell(Chunk* chunk, uint8_t constant) {
+    ValueCell** cells = chunk->globalCells;
+    if (cells != NULL && constant < chunk->globalCellCount && cells[constant] != NULL) {
+        return cells[constant];
+    }
+    return bindGlobalCell(chunk, constant);
+}
+
+// A typed variable's type as it is held in a slot; nil is any.
+static inline ObjConcreteYargType* slotType(Value type) {
+    return IS_NIL(type) ? NULL : AS_YARGTYPE(type);
+}
+
 bool callfn(ObjRoutine* routine, ObjClosure* closure, int argCount) {
     if (argCount != closure->function->arity) {
         runtimeError(routine, "Expected %d arguments but got %d.",
@@ -223,15 +309,29 @@ bool callfn(ObjRoutine* routine, ObjClosure* closure, int argCount) {
         return false;
     }
 
-    if (routine->frameCount == FRAMES_MAX) {
+    if (routine->frameCount == (int)routine->frameSegmentCount * FRAME_SEGMENT_MAX
+        && (!routine->addFrameSegment || !routine->addFrameSegment(routine))) {
         runtimeError(routine, "Stack overflow.");
         return false;
     }
 
-    CallFrame* frame = &routine->frames[routine->frameCount++];
+    size_t returnIndex = routine->stackTopIndex - (argCount + 1);
+    size_t entryIndex = returnIndex;
+    size_t depth = closure->function->maxStackDepth > argCount + 1 ? closure->function->maxStackDepth : argCount + 1;
+    Value* slots = reserveFrameStack(routine, &entryIndex, depth);
+    if (slots == NULL) {
+        return false;
+    }
+
+    CallFrame* frame = routineFrame(routine, routine->frameCount++);
     frame->closure = closure;
     frame->ip = closure->function->chunk.code;
-    frame->stackEntryIndex = routine->stackTopIndex - (argCount + 1);
+    frame->stackEntryIndex = entryIndex;
+    frame->stackReturnIndex = returnIndex;
+    frame->slots = slots;
+    if (!closure->function->chunk.quickened) {
+        warmFunction(frame);
+    }
     return true;
 }
 
@@ -240,16 +340,13 @@ static InterpretResult callValue(ObjRoutine* routine, Value callee, int argCount
         switch (OBJ_TYPE(callee)) {
             case OBJ_BOUND_METHOD: {
                 ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
-                ValueCell* target = peekCell(routine, argCount);
-                target->value = bound->reciever;
-                target->cellType = NULL;
+                *peekSlot(routine, argCount) = bound->reciever;
                 return callfn(routine, bound->method, argCount) ? INTERPRET_OK : INTERPRET_RUNTIME_ERROR;
             }
             case OBJ_CLASS: {
                 ObjClass* klass = AS_CLASS(callee);
-                ValueCell* target = peekCell(routine, argCount);
-                target->value = OBJ_VAL(newInstance(klass));
-                target->cellType = NULL;
+                Value* target = peekSlot(routine, argCount);
+                *target = OBJ_VAL(newInstance(klass));
                 Value initializer;
                 if (tableGet(&klass->methods, vm.initString, &initializer)) {
                     return callfn(routine, AS_CLOSURE(initializer), argCount) ? INTERPRET_OK : INTERPRET_RUNTIME_ERROR;
@@ -301,7 +398,172 @@ static InterpretResult invokeFromClass(ObjRoutine* routine, ObjClass* klass, Obj
     return callfn(routine, AS_CLOSURE(method), argCount) ? INTERPRET_OK : INTERPRET_RUNTIME_ERROR;
 }
 
-static InterpretResult invoke(ObjRoutine* routine, ObjString* name, int argCount) {
+#ifdef DEBUG_INLINE_CACHE
+#define INLINE_CACHE_HIT() (vm.inlineCacheHits++)
+#define INLINE_CACHE_MISS() (vm.inlineCacheMisses++)
+#else
+#define INLINE_CACHE_HIT() do { } while (false)
+#define INLINE_CACHE_MISS() do { } while (false)
+#endif
+
+static void allocateInlineCaches(Chunk* chunk) {
+    vm_mutex_enter_blocking(&vm.env);
+    if (chunk->inlineCaches == NULL) {
+        int count = chunkInlineCacheCount(chunk);
+        InlineCache* caches = ALLOCATE(InlineCache, count);
+        for (int i = 0; i < count; i++) {
+            caches[i] = (InlineCache){ .version = 0, .name = NULL, .holder = NULL, .method = NIL_VAL, .fieldIndex = -1 };
+        }
+        chunk->inlineCacheCount = count;
+        chunk->inlineCaches = caches;
+    }
+    vm_mutex_exit(&vm.env);
+}
+
+static inline InlineCache* inlineCache(Chunk* chunk, uint8_t index) {
+    if (chunk->inlineCaches == NULL) {
+        allocateInlineCaches(chunk);
+    }
+    return &chunk->inlineCaches[index];
+}
+
+// The same code may run on both cores and in interrupts, so an entry is rewritten under
+// vm.env, between two bumps of its version, and what is read from it is only used if the
+// version was even and is unchanged after. A routine which interrupts an update, or runs
+// on the other core, sees either a whole entry or a miss.
+static inline uint32_t cacheReadBegin(InlineCache* cache) {
+    return __atomic_load_n(&cache->version, __ATOMIC_ACQUIRE);
+}
+
+static inline bool cacheReadValid(InlineCache* cache, uint32_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (version & 1) == 0 && __atomic_load_n(&cache->version, __ATOMIC_RELAXED) == version;
+}
+
+// An entry last written for another name (sites past UINT8_MAX share one) starts again empty.
+static void cacheWriteBegin(InlineCache* cache, ObjString* name) {
+    vm_mutex_enter_blocking(&vm.env);
+    __atomic_store_n(&cache->version, cache->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (cache->name != name) {
+        cache->holder = NULL;
+        cache->method = NIL_VAL;
+        cache->shape = NULL;
+        cache->transition = NULL;
+        cache->fieldIndex = -1;
+        cache->name = name;
+    }
+}
+
+static void cacheWriteEnd(InlineCache* cache) {
+    __atomic_store_n(&cache->version, cache->version + 1, __ATOMIC_RELEASE);
+    vm_mutex_exit(&vm.env);
+}
+
+// A shape hit also remembers that the field is absent, so a method lookup through an
+// instance with fields doesn't search them first.
+static inline bool cachedGetField(InlineCache* cache, ObjString* name, ObjInstance* instance, Value* value) {
+    ObjShape* shape = instance->shape;
+    if (shape == NULL) {
+        return tableGet(instance->dictionary, name, value);
+    }
+    uint32_t version = cacheReadBegin(cache);
+    bool hit = cache->name == name && cache->shape == shape && cache->transition == NULL;
+    int index = cache->fieldIndex;
+    if (hit && cacheReadValid(cache, version)) {
+        INLINE_CACHE_HIT();
+    } else {
+        INLINE_CACHE_MISS();
+        index = shapeFieldIndex(shape, name);
+        cacheWriteBegin(cache, name);
+        cache->fieldIndex = index;
+        cache->transition = NULL;
+        cache->shape = shape;
+        cacheWriteEnd(cache);
+    }
+    if (index < 0) {
+        return false;
+    }
+    *value = instance->fields[index];
+    return true;
+}
+
+static inline void cachedSetField(InlineCache* cache, ObjString* name, ObjInstance* instance, Value value) {
+    ObjShape* shape = instance->shape;
+    if (shape != NULL) {
+        uint32_t version = cacheReadBegin(cache);
+        bool hit = cache->name == name && cache->shape == shape;
+        int index = cache->fieldIndex;
+        ObjShape* transition = cache->transition;
+        if (hit && index >= 0 && cacheReadValid(cache, version)) {
+            if (transition == NULL) {
+                INLINE_CACHE_HIT();
+                instance->fields[index] = value;
+                writeBarrier((Obj*)instance, value);
+                return;
+            }
+            if (index < instance->fieldCapacity) {
+                INLINE_CACHE_HIT();
+                instance->fields[index] = value;
+                instance->shape = transition;
+                writeBarrier((Obj*)instance, value);
+                writeBarrierObj((Obj*)instance, (Obj*)transition);
+                return;
+            }
+        }
+    }
+    INLINE_CACHE_MISS();
+    instanceSetField(instance, name, value);
+    if (shape != NULL && instance->shape != NULL) {
+        ObjShape* transition = instance->shape == shape ? NULL : instance->shape;
+        int index = shapeFieldIndex(instance->shape, name);
+        cacheWriteBegin(cache, name);
+        cache->transition = transition;
+        cache->fieldIndex = index;
+        cache->shape = shape;
+        cacheWriteEnd(cache);
+    }
+}
+
+static inline bool cachedMethod(InlineCache* cache, ObjString* name, ObjClass* klass, Value* method) {
+    uint32_t version = cacheReadBegin(cache);
+    bool hit = cache->name == name && cache->holder == (Obj*)klass;
+    *method = cache->method;
+    if (hit && cacheReadValid(cache, version)) {
+        INLINE_CACHE_HIT();
+        return true;
+    }
+    INLINE_CACHE_MISS();
+    if (!tableGet(&klass->methods, name, method)) {
+        return false;
+    }
+    cacheWriteBegin(cache, name);
+    cache->method = *method;
+    cache->holder = (Obj*)klass;
+    cacheWriteEnd(cache);
+    return true;
+}
+
+static inline bool cachedStructField(InlineCache* cache, ObjString* name, ObjConcreteYargType* type, size_t* index) {
+    uint32_t version = cacheReadBegin(cache);
+    bool hit = cache->name == name && cache->holder == (Obj*)type;
+    *index = cache->structIndex;
+    if (hit && cacheReadValid(cache, version)) {
+        INLINE_CACHE_HIT();
+        return true;
+    }
+    INLINE_CACHE_MISS();
+    if (!structFieldIndex(type, name, index)) {
+        return false;
+    }
+    cacheWriteBegin(cache, name);
+    cache->structIndex = *index;
+    cache->holder = (Obj*)type;
+    cacheWriteEnd(cache);
+    return true;
+}
+
+static InterpretResult invokeCached(ObjRoutine* routine, InlineCache* cache, ObjString* name, int argCount) {
     Value receiver = peek(routine, argCount);
 
     if (!IS_INSTANCE(receiver)) {
@@ -312,15 +574,17 @@ static InterpretResult invoke(ObjRoutine* routine, ObjString* name, int argCount
     ObjInstance* instance = AS_INSTANCE(receiver);
 
     Value value;
-    if (tableGet(&instance->fields, name, &value)) {
-        ValueCell* target = peekCell(routine, argCount);
-
-        target->value = value;
-        target->cellType = NULL;
+    if (cachedGetField(cache, name, instance, &value)) {
+        *peekSlot(routine, argCount) = value;
         return callValue(routine, value, argCount);
     }
 
-    return invokeFromClass(routine, instance->klass, name, argCount);
+    Value method;
+    if (!cachedMethod(cache, name, instance->klass, &method)) {
+        runtimeError(routine, "Undefined property '%s'.", name->chars);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    return callfn(routine, AS_CLOSURE(method), argCount) ? INTERPRET_OK : INTERPRET_RUNTIME_ERROR;
 }
 
 static bool bindMethod(ObjRoutine* routine, ObjClass* klass, ObjString* name) {
@@ -336,7 +600,7 @@ static bool bindMethod(ObjRoutine* routine, ObjClass* klass, ObjString* name) {
     return true;
 }
 
-static ObjUpvalue* captureUpvalue(ObjRoutine* routine, ValueCell* local, size_t stackOffset) {
+static ObjUpvalue* captureUpvalue(ObjRoutine* routine, Value* local, size_t stackOffset, ObjConcreteYargType* type) {
     ObjUpvalue* prevUpvalue = NULL;
     ObjUpvalue* upvalue = routine->openUpvalues;
     while (upvalue != NULL && upvalue->stackOffset > stackOffset) {
@@ -348,7 +612,7 @@ static ObjUpvalue* captureUpvalue(ObjRoutine* routine, ValueCell* local, size_t
         return upvalue;
     }
 
-    ObjUpvalue* createdUpvalue = newUpvalue(local, stackOffset);
+    ObjUpvalue* createdUpvalue = newUpvalue(local, stackOffset, type);
     createdUpvalue->next = upvalue;
 
     if (prevUpvalue == NULL) {
@@ -365,10 +629,46 @@ static void closeUpvalues(ObjRoutine* routine, size_t last) {
         ObjUpvalue* upvalue = routine->openUpvalues;
         upvalue->closed = *upvalue->contents;
         upvalue->contents = &upvalue->closed;
+        writeBarrier((Obj*)upvalue, upvalue->closed);
         routine->openUpvalues = upvalue->next;
     }
 }
 
+// A call in tail position reuses the caller's frame, once the caller's upvalues are
+// closed, so recursion through it runs in constant space. Callees other than closures
+// and bound methods are called as usual.
+static InterpretResult tailCallValue(ObjRoutine* routine, CallFrame* frame, Value callee, int argCount) {
+    ObjClosure* closure;
+    if (IS_CLOSURE(callee)) {
+        closure = AS_CLOSURE(callee);
+    } else if (IS_BOUND_METHOD(callee)) {
+        closure = AS_BOUND_METHOD(callee)->method;
+    } else {
+        return callValue(routine, callee, argCount);
+    }
+    if (argCount != closure->function->arity) {
+        // reported with the caller's frame still in place
+        return callValue(routine, callee, argCount);
+    }
+    if (IS_BOUND_METHOD(callee)) {
+        *peekSlot(routine, argCount) = AS_BOUND_METHOD(callee)->reciever;
+    }
+
+    closeUpvalues(routine, frame->stackEntryIndex);
+    for (int i = 0; i <= argCount; i++) {
+        frame->slots[i] = *peekSlot(routine, argCount - i);
+    }
+    size_t returnIndex = frame->stackReturnIndex;
+    routine->stackTopIndex = frame->stackEntryIndex + argCount + 1;
+    routine->frameCount--;
+
+    if (!callfn(routine, closure, argCount)) {
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    routineFrame(routine, routine->frameCount - 1)->stackReturnIndex = returnIndex;
+    return INTERPRET_OK;
+}
+
 static void defineMethod(ObjRoutine* routine, ObjString* name) {
     Value method = peek(routine, 0);
     ObjClass* klass = AS_CLASS(peek(routine, 1));
@@ -471,6 +771,8 @@ static bool setMapElement(ObjRoutine* routine, ObjMap* map, Value key, Value rhs
         return false;
     }
     tableSet(&map->entries, AS_STRING(key), rhs);
+    writeBarrier((Obj*)map, key);
+    writeBarrier((Obj*)map, rhs);
     return true;
 }
 
@@ -525,24 +827,24 @@ static void concatenate(ObjRoutine* routine) {
     push(routine, OBJ_VAL(result));
 }
 
-static void promote(Value *left, Value *right)
+void promote(Value *left, Value *right)
 {
     assert(left != 0 && right != 0);
 
     Value *toPromote = 0, *promotionToTypeOf;
-    if (IS_INT(*left) && (AS_INTOBJ(*left)->isLiteral))
+    if (isLiteralInt(*left))
     {
         toPromote = left;
         promotionToTypeOf = right;
     }
-    else if (IS_INT(*right) && (AS_INTOBJ(*right)->isLiteral))
+    else if (isLiteralInt(*right))
     {
         toPromote = right;
         promotionToTypeOf = left;
     }
     if (toPromote != 0)
     {
-        ValueType promoteTo = promotionToTypeOf->type;
+        ValueType promoteTo = VALUE_TYPE(*promotionToTypeOf);
         Int *bigInt = AS_INT(*toPromote);
 
         switch (promoteTo)
@@ -550,57 +852,49 @@ static void promote(Value *left, Value *right)
         case VAL_I8:
             if (int_is_range(bigInt, INT8_MIN, INT8_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.i8 = (int8_t) int_to_i32(bigInt);
+                *toPromote = I8_VAL((int8_t) int_to_i32(bigInt));
             }
             break;
         case VAL_UI8:
             if (int_is_range(bigInt, 0, UINT8_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.ui8 = (uint8_t) int_to_u32(bigInt);
+                *toPromote = UI8_VAL((uint8_t) int_to_u32(bigInt));
             }
             break;
         case VAL_I16:
             if (int_is_range(bigInt, INT16_MIN, INT16_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.i16 = (int16_t) int_to_i32(bigInt);
+                *toPromote = I16_VAL((int16_t) int_to_i32(bigInt));
             }
             break;
         case VAL_UI16:
             if (int_is_range(bigInt, 0, UINT16_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.ui16 = (uint16_t) int_to_u32(bigInt);
+                *toPromote = UI16_VAL((uint16_t) int_to_u32(bigInt));
             }
             break;
         case VAL_I32:
             if (int_is_range(bigInt, INT32_MIN, INT32_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.i32 = int_to_i32(bigInt);
+                *toPromote = I32_VAL(int_to_i32(bigInt));
             }
             break;
         case VAL_UI32:
             if (int_is_range(bigInt, 0, UINT32_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.ui32 = int_to_u32(bigInt);
+                *toPromote = UI32_VAL(int_to_u32(bigInt));
             }
             break;
         case VAL_I64:
             if (int_is_range(bigInt, INT64_MIN, INT64_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.i64 = int_to_i64(bigInt);
+                *toPromote = I64_VAL(int_to_i64(bigInt));
             }
             break;
         case VAL_UI64:
             if (int_is_range(bigInt, 0, UINT64_MAX) == INT_WITHIN)
             {
-                toPromote->type = promoteTo;
-                toPromote->as.ui64 = int_to_u64(bigInt);
+                *toPromote = UI64_VAL(int_to_u64(bigInt));
             }
             break;
 
@@ -611,10 +905,98 @@ static void promote(Value *left, Value *right)
     }
 }
 
+typedef enum {
+    FUSED_SMALL_INT,
+    FUSED_I32,
+    FUSED_UI32
+} FusedKind;
+
+// Decodes the immediate operand of a superinstruction, returning the code after it.
+static inline uint8_t* fusedImmediate(uint8_t* code, FusedKind* kind, int64_t* value) {
+    uint8_t instruction = code[0];
+    if (instruction == OP_IMMEDIATE_TYPED) {
+        uint32_t bits = code[2] | (code[3] << 8) | (code[4] << 16) | ((uint32_t)code[5] << 24);
+        *kind = code[1] == TYPE_LITERAL_INT32 ? FUSED_I32 : FUSED_UI32;
+        *value = *kind == FUSED_I32 ? (int64_t)(int32_t)bits : (int64_t)bits;
+        return code + 6;
+    }
+
+    int64_t num = code[1];
+    int length = 2;
+    if (instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_P16 || instruction == OP_IMMEDIATE_N24 || instruction == OP_IMMEDIATE_P24) {
+        num += 256 * code[2];
+        length = 3;
+    }
+    if (instruction == OP_IMMEDIATE_N24 || instruction == OP_IMMEDIATE_P24) {
+        num += 65536 * code[3];
+        length = 4;
+    }
+    bool negative = instruction == OP_IMMEDIATE_N8 || instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_N24;
+    *kind = FUSED_SMALL_INT;
+    *value = negative ? -num : num;
+    return code + length;
+}
+
+// Whether a local and an immediate combine without promote(), as they would in the
+// matching quickened instruction. The kind becomes that of the result.
+static inline bool fusedOperands(Value local, FusedKind* kind, int64_t constant, int64_t* value) {
+    if (IS_SMALL_INT(local) && *kind == FUSED_SMALL_INT) {
+        *value = AS_SMALL_INT(local);
+        return true;
+    }
+    if (IS_I32(local) && *kind != FUSED_UI32) {
+        *kind = FUSED_I32;
+        *value = AS_I32(local);
+        return true;
+    }
+    if (IS_UI32(local) && (*kind == FUSED_UI32 || constant >= 0)) {
+        *kind = FUSED_UI32;
+        *value = AS_UI32(local);
+        return true;
+    }
+    return false;
+}
+
+static inline Value fusedValue(FusedKind kind, int64_t value) {
+    switch (kind) {
+        case FUSED_I32: return I32_VAL((int32_t)value);
+        case FUSED_UI32: return UI32_VAL((uint32_t)value);
+        default: return intValue(value);
+    }
+}
+
 InterpretResult run(ObjRoutine* routine) {
-    CallFrame* frame = &routine->frames[routine->frameCount - 1];
+    CallFrame* frame;
+    Value* frameSlots;
+    Value* stackTop;
     routine->state = EXEC_RUNNING;
 
+// callfn() keeps each frame's cells contiguous, so the stack top is cached as a pointer.
+// stackTopIndex is still maintained for the GC and for helpers which push and pop
+// through the routine; after calling one of those the cached top is reloaded.
+#define LOAD_STACK_TOP() (stackTop = frameSlots + (routine->stackTopIndex - frame->stackEntryIndex))
+
+#define LOAD_FRAME() \
+    do { \
+        frame = routineFrame(routine, routine->frameCount - 1); \
+        frameSlots = frame->slots; \
+        LOAD_STACK_TOP(); \
+    } while (false)
+
+#define PUSH(pushValue) \
+    do { \
+        Value pushed = (pushValue); \
+        *stackTop++ = pushed; \
+        routine->stackTopIndex++; \
+    } while (false)
+
+#define POP() (routine->stackTopIndex--, *--stackTop)
+#define PEEK(distance) (stackTop[-1 - (distance)])
+#define PEEK_SLOT(distance) (&stackTop[-1 - (distance)])
+#define FRAME_SLOT(index) (&frameSlots[(index)])
+
+    LOAD_FRAME();
+
 #define READ_BYTE() (*frame->ip++)
 
 #define READ_SHORT() \
@@ -627,124 +1009,291 @@ InterpretResult run(ObjRoutine* routine) {
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 #define BINARY_OP(routine, op) \
     do { \
-        promote(&peekCell(routine, 1)->value, &peekCell(routine, 0)->value); \
-        if (IS_I32(peek(routine, 0)) && IS_I32(peek(routine, 1))) { \
-            int32_t b = AS_I32(pop(routine)); \
-            int32_t a = AS_I32(pop(routine)); \
-            push(routine, I32_VAL(a op b)); \
-        } else if (IS_UI32(peek(routine, 0)) && IS_UI32(peek(routine, 1))) { \
-            uint32_t b = AS_UI32(pop(routine)); \
-            uint32_t a = AS_UI32(pop(routine)); \
-            push(routine, UI32_VAL(a op b)); \
-        } else if (IS_I8(peek(routine, 0)) && IS_I8(peek(routine, 1))) { \
-            int8_t b = AS_I8(pop(routine)); \
-            int8_t a = AS_I8(pop(routine)); \
-            push(routine, I8_VAL(a op b)); \
-        } else if (IS_UI8(peek(routine, 0)) && IS_UI8(peek(routine, 1))) { \
-            uint8_t b = AS_UI8(pop(routine)); \
-            uint8_t a = AS_UI8(pop(routine)); \
-            push(routine, UI8_VAL(a op b)); \
-        } else if (IS_I16(peek(routine, 0)) && IS_I16(peek(routine, 1))) { \
-            int16_t b = AS_I16(pop(routine)); \
-            int16_t a = AS_I16(pop(routine)); \
-            push(routine, I16_VAL(a op b)); \
-        } else if (IS_UI16(peek(routine, 0)) && IS_UI16(peek(routine, 1))) { \
-            uint16_t b = AS_UI16(pop(routine)); \
-            uint16_t a = AS_UI16(pop(routine)); \
-            push(routine, UI16_VAL(a op b)); \
-        } else if (IS_UI64(peek(routine, 0)) && IS_UI64(peek(routine, 1))) { \
-            int64_t b = AS_UI64(pop(routine)); \
-            int64_t a = AS_UI64(pop(routine)); \
-            push(routine, UI64_VAL(a op b)); \
-        } else if (IS_I64(peek(routine, 0)) && IS_I64(peek(routine, 1))) { \
-            int64_t b = AS_I64(pop(routine)); \
-            int64_t a = AS_I64(pop(routine)); \
-            push(routine, I64_VAL(a op b)); \
-        } else if (IS_DOUBLE(peek(routine, 0)) && IS_DOUBLE(peek(routine, 1))) { \
-            double b = AS_DOUBLE(pop(routine)); \
-            double a = AS_DOUBLE(pop(routine)); \
-            push(routine, DOUBLE_VAL(a op b)); \
-        } else if (IS_INT(peek(routine, 0)) && IS_INT(peek(routine, 1))) { \
+        promote(PEEK_SLOT(1), PEEK_SLOT(0)); \
+        if (IS_I32(PEEK(0)) && IS_I32(PEEK(1))) { \
+            int32_t b = AS_I32(POP()); \
+            int32_t a = AS_I32(POP()); \
+            PUSH(I32_VAL(a op b)); \
+        } else if (IS_UI32(PEEK(0)) && IS_UI32(PEEK(1))) { \
+            uint32_t b = AS_UI32(POP()); \
+            uint32_t a = AS_UI32(POP()); \
+            PUSH(UI32_VAL(a op b)); \
+        } else if (IS_I8(PEEK(0)) && IS_I8(PEEK(1))) { \
+            int8_t b = AS_I8(POP()); \
+            int8_t a = AS_I8(POP()); \
+            PUSH(I8_VAL(a op b)); \
+        } else if (IS_UI8(PEEK(0)) && IS_UI8(PEEK(1))) { \
+            uint8_t b = AS_UI8(POP()); \
+            uint8_t a = AS_UI8(POP()); \
+            PUSH(UI8_VAL(a op b)); \
+        } else if (IS_I16(PEEK(0)) && IS_I16(PEEK(1))) { \
+            int16_t b = AS_I16(POP()); \
+            int16_t a = AS_I16(POP()); \
+            PUSH(I16_VAL(a op b)); \
+        } else if (IS_UI16(PEEK(0)) && IS_UI16(PEEK(1))) { \
+            uint16_t b = AS_UI16(POP()); \
+            uint16_t a = AS_UI16(POP()); \
+            PUSH(UI16_VAL(a op b)); \
+        } else if (IS_UI64(PEEK(0)) && IS_UI64(PEEK(1))) { \
+            int64_t b = AS_UI64(POP()); \
+            int64_t a = AS_UI64(POP()); \
+            PUSH(UI64_VAL(a op b)); \
+        } else if (IS_I64(PEEK(0)) && IS_I64(PEEK(1))) { \
+            int64_t b = AS_I64(POP()); \
+            int64_t a = AS_I64(POP()); \
+            PUSH(I64_VAL(a op b)); \
+        } else if (IS_DOUBLE(PEEK(0)) && IS_DOUBLE(PEEK(1))) { \
+            double b = AS_DOUBLE(POP()); \
+            double a = AS_DOUBLE(POP()); \
+            PUSH(DOUBLE_VAL(a op b)); \
+        } else if (IS_INT(PEEK(0)) && IS_INT(PEEK(1))) { \
             binaryIntOp(routine, #op); \
+            LOAD_STACK_TOP(); \
         } else { \
-            runtimeError(routine, #op " Operands %d %d must both be numbers, integers or unsigned integers.", peek(routine, 0).type, peek(routine, 1).type); \
+            runtimeError(routine, #op " Operands %d %d must both be numbers, integers or unsigned integers.", VALUE_TYPE(PEEK(0)), VALUE_TYPE(PEEK(1))); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
     } while (false)
 #define BINARY_BOOLEAN_OP(routine, op) \
     do { \
-        if (IS_I32(peek(routine, 0)) && IS_I32(peek(routine, 1))) { \
-            int32_t b = AS_I32(pop(routine)); \
-            int32_t a = AS_I32(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_UI32(peek(routine, 0)) && IS_UI32(peek(routine, 1))) { \
-            uint32_t b = AS_UI32(pop(routine)); \
-            uint32_t a = AS_UI32(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_I8(peek(routine, 0)) && IS_I8(peek(routine, 1))) { \
-            int8_t b = AS_I8(pop(routine)); \
-            int8_t a = AS_I8(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_UI8(peek(routine, 0)) && IS_UI8(peek(routine, 1))) { \
-            uint8_t b = AS_UI8(pop(routine)); \
-            uint8_t a = AS_UI8(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_I16(peek(routine, 0)) && IS_I16(peek(routine, 1))) { \
-            int16_t b = AS_I16(pop(routine)); \
-            int16_t a = AS_I16(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_UI16(peek(routine, 0)) && IS_UI16(peek(routine, 1))) { \
-            uint16_t b = AS_UI16(pop(routine)); \
-            uint16_t a = AS_UI16(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_UI64(peek(routine, 0)) && IS_UI64(peek(routine, 1))) { \
-            uint64_t b = AS_UI64(pop(routine)); \
-            uint64_t a = AS_UI64(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_I64(peek(routine, 0)) && IS_I64(peek(routine, 1))) { \
-            int64_t b = AS_I64(pop(routine)); \
-            int64_t a = AS_I64(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_DOUBLE(peek(routine, 0)) && IS_DOUBLE(peek(routine, 1))) { \
-            double b = AS_DOUBLE(pop(routine)); \
-            double a = AS_DOUBLE(pop(routine)); \
-            push(routine, BOOL_VAL(a op b)); \
-        } else if (IS_INT(peek(routine, 0)) && IS_INT(peek(routine, 1))) { \
+        if (IS_I32(PEEK(0)) && IS_I32(PEEK(1))) { \
+            int32_t b = AS_I32(POP()); \
+            int32_t a = AS_I32(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_UI32(PEEK(0)) && IS_UI32(PEEK(1))) { \
+            uint32_t b = AS_UI32(POP()); \
+            uint32_t a = AS_UI32(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_I8(PEEK(0)) && IS_I8(PEEK(1))) { \
+            int8_t b = AS_I8(POP()); \
+            int8_t a = AS_I8(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_UI8(PEEK(0)) && IS_UI8(PEEK(1))) { \
+            uint8_t b = AS_UI8(POP()); \
+            uint8_t a = AS_UI8(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_I16(PEEK(0)) && IS_I16(PEEK(1))) { \
+            int16_t b = AS_I16(POP()); \
+            int16_t a = AS_I16(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_UI16(PEEK(0)) && IS_UI16(PEEK(1))) { \
+            uint16_t b = AS_UI16(POP()); \
+            uint16_t a = AS_UI16(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_UI64(PEEK(0)) && IS_UI64(PEEK(1))) { \
+            uint64_t b = AS_UI64(POP()); \
+            uint64_t a = AS_UI64(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_I64(PEEK(0)) && IS_I64(PEEK(1))) { \
+            int64_t b = AS_I64(POP()); \
+            int64_t a = AS_I64(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_DOUBLE(PEEK(0)) && IS_DOUBLE(PEEK(1))) { \
+            double b = AS_DOUBLE(POP()); \
+            double a = AS_DOUBLE(POP()); \
+            PUSH(BOOL_VAL(a op b)); \
+        } else if (IS_INT(PEEK(0)) && IS_INT(PEEK(1))) { \
             binaryIntBoolOp(routine, #op); \
+            LOAD_STACK_TOP(); \
         } else { \
-            runtimeError(routine, #op " Operands %d %d must both be numbers, integers or unsigned integers.", peek(routine, 0).type, peek(routine, 1).type); \
+            runtimeError(routine, #op " Operands %d %d must both be numbers, integers or unsigned integers.", VALUE_TYPE(PEEK(0)), VALUE_TYPE(PEEK(1))); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
     } while (false)
 #define BINARY_UINT_OP(routine, op) \
     do { \
-        promote(&peekCell(routine, 1)->value, &peekCell(routine, 0)->value); \
-        if (IS_UI32(peek(routine, 0)) && IS_UI32(peek(routine, 1))) { \
-            uint32_t b = AS_UI32(pop(routine)); \
-            uint32_t a = AS_UI32(pop(routine)); \
+        promote(PEEK_SLOT(1), PEEK_SLOT(0)); \
+        if (IS_UI32(PEEK(0)) && IS_UI32(PEEK(1))) { \
+            uint32_t b = AS_UI32(POP()); \
+            uint32_t a = AS_UI32(POP()); \
             uint32_t c = a op b; \
-            push(routine, UI32_VAL(c)); \
-        } else if (IS_UI8(peek(routine, 0)) && IS_UI8(peek(routine, 1))) { \
-            uint8_t b = AS_UI8(pop(routine)); \
-            uint8_t a = AS_UI8(pop(routine)); \
+            PUSH(UI32_VAL(c)); \
+        } else if (IS_UI8(PEEK(0)) && IS_UI8(PEEK(1))) { \
+            uint8_t b = AS_UI8(POP()); \
+            uint8_t a = AS_UI8(POP()); \
             uint8_t c = a op b; \
-            push(routine, UI8_VAL(c)); \
-        } else if (IS_UI16(peek(routine, 0)) && IS_UI16(peek(routine, 1))) { \
-            uint16_t b = AS_UI16(pop(routine)); \
-            uint16_t a = AS_UI16(pop(routine)); \
+            PUSH(UI8_VAL(c)); \
+        } else if (IS_UI16(PEEK(0)) && IS_UI16(PEEK(1))) { \
+            uint16_t b = AS_UI16(POP()); \
+            uint16_t a = AS_UI16(POP()); \
             uint16_t c = a op b; \
-            push(routine, UI16_VAL(c)); \
-        } else if (IS_UI64(peek(routine, 0)) && IS_UI64(peek(routine, 1))) { \
-            uint64_t b = AS_UI64(pop(routine)); \
-            uint64_t a = AS_UI64(pop(routine)); \
+            PUSH(UI16_VAL(c)); \
+        } else if (IS_UI64(PEEK(0)) && IS_UI64(PEEK(1))) { \
+            uint64_t b = AS_UI64(POP()); \
+            uint64_t a = AS_UI64(POP()); \
             uint64_t c = a op b; \
-            push(routine, UI64_VAL(c)); \
+            PUSH(UI64_VAL(c)); \
         } else { \
-            runtimeError(routine, #op " Operands %d %d must be unsigned integers.", peek(routine, 0).type, peek(routine, 1).type); \
+            runtimeError(routine, #op " Operands %d %d must be unsigned integers.", VALUE_TYPE(PEEK(0)), VALUE_TYPE(PEEK(1))); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+    } while (false)
+
+// Once its function is hot, a generic arithmetic instruction rewrites itself to the form
+// for the operand types it sees. The compiler also emits those forms where it knows the
+// types. Either way they re-check them, and on a mismatch execute the generic
+// instruction instead, putting it back if the code was rewritten.
+#define QUICKEN(generic) \
+    do { \
+        if (frame->closure->function->chunk.quickened) { \
+            quickenInstruction(frame, (generic), PEEK(1), PEEK(0)); \
+        } \
+    } while (false)
+#define QUICKENED_OP(generic, isType, asType, cType, resultVal, op) \
+    if ((isType(PEEK(0)) && isType(PEEK(1))) || \
+        (promote(PEEK_SLOT(1), PEEK_SLOT(0)), isType(PEEK(0)) && isType(PEEK(1)))) { \
+        cType b = asType(POP()); \
+        cType a = asType(POP()); \
+        PUSH(resultVal(a op b)); \
+    } else { \
+        unquickenInstruction(frame, (generic)); \
+        instruction = (generic); \
+        goto generic_##generic; \
+    } \
+    DISPATCH();
+
+#if defined(CYARG_THREADED_DISPATCH)
+#if !defined(__GNUC__)
+#error "CYARG_THREADED_DISPATCH needs labels as values (GCC or Clang)."
+#endif
+#define OPCODE(op) target_##op
+#define DISPATCH() goto *dispatchTable[instruction = READ_BYTE()]
+// There is no per-instruction error check outside of tracing, so errors raised
+// without unwinding run() (eg stack growth failure) are picked up at calls and loops.
+#define CHECK_ROUTINE_STATE() \
+    do { \
+        if (routine->state == EXEC_ERROR) { \
+            runtimeError(routine, "Error"); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
     } while (false)
 
+    // Unknown opcodes are skipped, as the switch dispatch does.
+    static void* const opcodeTargets[UINT8_COUNT] = {
+        [0 ... UINT8_MAX] = &&target_unknown,
+        [OP_CONSTANT] = &&target_OP_CONSTANT,
+        [OP_NIL] = &&target_OP_NIL,
+        [OP_TRUE] = &&target_OP_TRUE,
+        [OP_FALSE] = &&target_OP_FALSE,
+        [OP_POP] = &&target_OP_POP,
+        [OP_GET_BUILTIN] = &&target_OP_GET_BUILTIN,
+        [OP_GET_LOCAL] = &&target_OP_GET_LOCAL,
+        [OP_SET_LOCAL] = &&target_OP_SET_LOCAL,
+        [OP_SET_LOCAL_TYPED] = &&target_OP_SET_LOCAL_TYPED,
+        [OP_GET_GLOBAL] = &&target_OP_GET_GLOBAL,
+        [OP_DEFINE_GLOBAL] = &&target_OP_DEFINE_GLOBAL,
+        [OP_DEFINE_TYPED_GLOBAL] = &&target_OP_DEFINE_TYPED_GLOBAL,
+        [OP_SET_GLOBAL] = &&target_OP_SET_GLOBAL,
+        [OP_INITIALISE] = &&target_OP_INITIALISE,
+        [OP_INITIALISE_TYPED] = &&target_OP_INITIALISE_TYPED,
+        [OP_GET_UPVALUE] = &&target_OP_GET_UPVALUE,
+        [OP_SET_UPVALUE] = &&target_OP_SET_UPVALUE,
+        [OP_GET_PROPERTY] = &&target_OP_GET_PROPERTY,
+        [OP_SET_PROPERTY] = &&target_OP_SET_PROPERTY,
+        [OP_GET_SUPER] = &&target_OP_GET_SUPER,
+        [OP_EQUAL] = &&target_OP_EQUAL,
+        [OP_GREATER] = &&target_OP_GREATER,
+        [OP_LESS] = &&target_OP_LESS,
+        [OP_LEFT_SHIFT] = &&target_OP_LEFT_SHIFT,
+        [OP_RIGHT_SHIFT] = &&target_OP_RIGHT_SHIFT,
+        [OP_ADD] = &&target_OP_ADD,
+        [OP_SUBTRACT] = &&target_OP_SUBTRACT,
+        [OP_BITOR] = &&target_OP_BITOR,
+        [OP_BITAND] = &&target_OP_BITAND,
+        [OP_BITXOR] = &&target_OP_BITXOR,
+        [OP_MODULO] = &&target_OP_MODULO,
+        [OP_MULTIPLY] = &&target_OP_MULTIPLY,
+        [OP_DIVIDE] = &&target_OP_DIVIDE,
+        [OP_NOT] = &&target_OP_NOT,
+        [OP_NEGATE] = &&target_OP_NEGATE,
+        [OP_PRINT] = &&target_OP_PRINT,
+        [OP_POKE] = &&target_OP_POKE,
+        [OP_JUMP] = &&target_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&target_OP_JUMP_IF_FALSE,
+        [OP_LOOP] = &&target_OP_LOOP,
+        [OP_CALL] = &&target_OP_CALL,
+        [OP_TAIL_CALL] = &&target_OP_TAIL_CALL,
+        [OP_CALL_BUILTIN] = &&target_OP_CALL_BUILTIN,
+        [OP_INVOKE] = &&target_OP_INVOKE,
+        [OP_SUPER_INVOKE] = &&target_OP_SUPER_INVOKE,
+        [OP_CLOSURE] = &&target_OP_CLOSURE,
+        [OP_CLOSE_UPVALUE] = &&target_OP_CLOSE_UPVALUE,
+        [OP_RETURN] = &&target_OP_RETURN,
+        [OP_YIELD] = &&target_OP_YIELD,
+        [OP_CLASS] = &&target_OP_CLASS,
+        [OP_INHERIT] = &&target_OP_INHERIT,
+        [OP_METHOD] = &&target_OP_METHOD,
+        [OP_ELEMENT] = &&target_OP_ELEMENT,
+        [OP_SET_ELEMENT] = &&target_OP_SET_ELEMENT,
+        [OP_IMMEDIATE_P8] = &&target_OP_IMMEDIATE_P8,
+        [OP_IMMEDIATE_P16] = &&target_OP_IMMEDIATE_P16,
+        [OP_IMMEDIATE_P24] = &&target_OP_IMMEDIATE_P24,
+        [OP_IMMEDIATE_N8] = &&target_OP_IMMEDIATE_N8,
+        [OP_IMMEDIATE_N16] = &&target_OP_IMMEDIATE_N16,
+        [OP_IMMEDIATE_N24] = &&target_OP_IMMEDIATE_N24,
+        [OP_TYPE_LITERAL] = &&target_OP_TYPE_LITERAL,
+        [OP_TYPE_STRUCT] = &&target_OP_TYPE_STRUCT,
+        [OP_TYPE_INDEXED_COLLECTION] = &&target_OP_TYPE_INDEXED_COLLECTION,
+        [OP_TYPE_DEFAULT] = &&target_OP_TYPE_DEFAULT,
+        [OP_DEREF_PTR] = &&target_OP_DEREF_PTR,
+        [OP_SET_PTR_TARGET] = &&target_OP_SET_PTR_TARGET,
+        [OP_PLACE] = &&target_OP_PLACE,
+        [OP_IMMEDIATE_TYPED] = &&target_OP_IMMEDIATE_TYPED,
+        [OP_ADD_SMALL_INT] = &&target_OP_ADD_SMALL_INT,
+        [OP_ADD_I32] = &&target_OP_ADD_I32,
+        [OP_ADD_UI32] = &&target_OP_ADD_UI32,
+        [OP_ADD_DOUBLE] = &&target_OP_ADD_DOUBLE,
+        [OP_SUBTRACT_SMALL_INT] = &&target_OP_SUBTRACT_SMALL_INT,
+        [OP_SUBTRACT_I32] = &&target_OP_SUBTRACT_I32,
+        [OP_SUBTRACT_UI32] = &&target_OP_SUBTRACT_UI32,
+        [OP_SUBTRACT_DOUBLE] = &&target_OP_SUBTRACT_DOUBLE,
+        [OP_MULTIPLY_SMALL_INT] = &&target_OP_MULTIPLY_SMALL_INT,
+        [OP_MULTIPLY_I32] = &&target_OP_MULTIPLY_I32,
+        [OP_MULTIPLY_UI32] = &&target_OP_MULTIPLY_UI32,
+        [OP_MULTIPLY_DOUBLE] = &&target_OP_MULTIPLY_DOUBLE,
+        [OP_LESS_SMALL_INT] = &&target_OP_LESS_SMALL_INT,
+        [OP_LESS_I32] = &&target_OP_LESS_I32,
+        [OP_LESS_UI32] = &&target_OP_LESS_UI32,
+        [OP_LESS_DOUBLE] = &&target_OP_LESS_DOUBLE,
+        [OP_GREATER_SMALL_INT] = &&target_OP_GREATER_SMALL_INT,
+        [OP_GREATER_I32] = &&target_OP_GREATER_I32,
+        [OP_GREATER_UI32] = &&target_OP_GREATER_UI32,
+        [OP_GREATER_DOUBLE] = &&target_OP_GREATER_DOUBLE,
+        [OP_SET_LOCAL_POP] = &&target_OP_SET_LOCAL_POP,
+        [OP_SET_GLOBAL_POP] = &&target_OP_SET_GLOBAL_POP,
+        [OP_POP_JUMP_IF_FALSE] = &&target_OP_POP_JUMP_IF_FALSE,
+        [OP_ADD_LOCALS] = &&target_OP_ADD_LOCALS,
+        [OP_LOCAL_ARITH_CONST] = &&target_OP_LOCAL_ARITH_CONST,
+        [OP_LOCAL_COMPARE_CONST_JUMP] = &&target_OP_LOCAL_COMPARE_CONST_JUMP,
+    };
+    // When tracing, every opcode first passes through checked_dispatch.
+    static void* const checkedTargets[UINT8_COUNT] = {
+        [0 ... UINT8_MAX] = &&checked_dispatch
+    };
+    void* const* dispatchTable = routine->traceExecution ? checkedTargets : opcodeTargets;
+    uint8_t instruction;
+
+    DISPATCH();
+
+checked_dispatch:
+    frame->ip--;
+    if (routine->state == EXEC_ERROR) {
+        runtimeError(routine, "Error");
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    if (routine->traceExecution) {
+        traceExecution(routine);
+    }
+    instruction = READ_BYTE();
+    goto *opcodeTargets[instruction];
+
+target_unknown:
+    DISPATCH();
+#else
+#define OPCODE(op) case op
+#define DISPATCH() break
+#define CHECK_ROUTINE_STATE() do { } while (false)
+
     for (;;) {
         if (routine->state == EXEC_ERROR) {
             runtimeError(routine, "Error");
@@ -756,12 +1305,13 @@ InterpretResult run(ObjRoutine* routine) {
 
         uint8_t instruction;
         switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT: {
+#endif
+            OPCODE(OP_CONSTANT): {
                 Value constant = READ_CONSTANT();
-                push(routine, constant);
-                break;
+                PUSH(constant);
+                DISPATCH();
             }
-            case OP_IMMEDIATE_N8: case OP_IMMEDIATE_P8: case OP_IMMEDIATE_N16: case OP_IMMEDIATE_P16: case OP_IMMEDIATE_N24: case OP_IMMEDIATE_P24: {
+            OPCODE(OP_IMMEDIATE_N8): OPCODE(OP_IMMEDIATE_P8): OPCODE(OP_IMMEDIATE_N16): OPCODE(OP_IMMEDIATE_P16): OPCODE(OP_IMMEDIATE_N24): OPCODE(OP_IMMEDIATE_P24): {
                 uint32_t num = READ_BYTE();
                 if (instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_P16 || instruction == OP_IMMEDIATE_N24 || instruction == OP_IMMEDIATE_P24)
                 {
@@ -771,150 +1321,190 @@ InterpretResult run(ObjRoutine* routine) {
                 {
                     num += 65536 * READ_BYTE();
                 }
-                ObjInt *i = newIntU(num);
-                i->isLiteral = true;
-                i->bigInt.neg_ = instruction == OP_IMMEDIATE_N8 || instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_N24;
-                push(routine, OBJ_VAL(i));
-                break;
-            }
-            case OP_NIL: push(routine, NIL_VAL); break;
-            case OP_TRUE: push(routine, BOOL_VAL(true)); break;
-            case OP_FALSE: push(routine, BOOL_VAL(false)); break;
-            case OP_POP: pop(routine); break;
-            case OP_GET_BUILTIN: {
+                bool negative = instruction == OP_IMMEDIATE_N8 || instruction == OP_IMMEDIATE_N16 || instruction == OP_IMMEDIATE_N24;
+                PUSH(SMALL_INT_LITERAL_VAL(negative ? -(int32_t)num : (int32_t)num));
+                DISPATCH();
+            }
+            OPCODE(OP_IMMEDIATE_TYPED): {
+                uint8_t type = READ_BYTE();
+                int length = typedImmediateLength(type);
+                uint64_t bits = 0;
+                for (int i = 0; i < length; i++) {
+                    bits |= (uint64_t)READ_BYTE() << (8 * i);
+                }
+                switch (type) {
+                    case TYPE_LITERAL_INT8: PUSH(I8_VAL((int8_t)bits)); break;
+                    case TYPE_LITERAL_UINT8: PUSH(UI8_VAL((uint8_t)bits)); break;
+                    case TYPE_LITERAL_INT16: PUSH(I16_VAL((int16_t)bits)); break;
+                    case TYPE_LITERAL_UINT16: PUSH(UI16_VAL((uint16_t)bits)); break;
+                    case TYPE_LITERAL_INT32: PUSH(I32_VAL((int32_t)bits)); break;
+                    case TYPE_LITERAL_UINT32: PUSH(UI32_VAL((uint32_t)bits)); break;
+                    case TYPE_LITERAL_INT64: PUSH(I64_VAL((int64_t)bits)); break;
+                    case TYPE_LITERAL_UINT64: PUSH(UI64_VAL(bits)); break;
+                    default: PUSH(SMALL_INT_VAL((int32_t)bits)); break;
+                }
+                DISPATCH();
+            }
+            OPCODE(OP_NIL): PUSH(NIL_VAL); DISPATCH();
+            OPCODE(OP_TRUE): PUSH(BOOL_VAL(true)); DISPATCH();
+            OPCODE(OP_FALSE): PUSH(BOOL_VAL(false)); DISPATCH();
+            OPCODE(OP_POP): POP(); DISPATCH();
+            OPCODE(OP_GET_BUILTIN): {
                 uint8_t builtin = READ_BYTE();
                 Value bFn = getBuiltin(builtin);
-                push(routine, bFn);
-                break;
+                PUSH(bFn);
+                DISPATCH();
             }
-            case OP_SET_LOCAL: {
+            OPCODE(OP_SET_LOCAL): OPCODE(OP_SET_LOCAL_POP): {
                 uint8_t slot = READ_BYTE();
-                ValueCell* rhs = peekCell(routine, 0);
-                ValueCell* lhs = frameSlot(routine, frame, slot);
-                ValueCellTarget lhsTrg = { .cellType = lhs->cellType, .value = &lhs->value };
+                Value rhs = PEEK(0);
+                noLongerLiteralInt(&rhs);
+                *FRAME_SLOT(slot) = rhs;
+                if (instruction == OP_SET_LOCAL_POP) {
+                    POP();
+                    frame->ip++;
+                }
+                DISPATCH();
+            }
+            OPCODE(OP_SET_LOCAL_TYPED): {
+                uint8_t slot = READ_BYTE();
+                ValueCellTarget lhsTrg = { .cellType = slotType(*FRAME_SLOT(slot - 1)), .value = FRAME_SLOT(slot) };
 
-                if (!assignToValueCellTarget(lhsTrg, rhs->value)) {
+                if (!assignToValueCellTarget(lhsTrg, PEEK(0))) {
                     runtimeError(routine, "Cannot set local variable to incompatible type.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                DISPATCH();
             }
-            case OP_GET_LOCAL: {
+            OPCODE(OP_GET_LOCAL): {
                 uint8_t slot = READ_BYTE();
-                push(routine, frameSlot(routine, frame, slot)->value);
-                break;
+                PUSH(*FRAME_SLOT(slot));
+                DISPATCH();
             }
-            case OP_GET_GLOBAL: {
-                vm_mutex_enter_blocking(&vm.env);
-                ObjString* name = READ_STRING();
-                ValueCell cell;
-                if (!tableCellGet(&vm.globals, name, &cell)) {
+            OPCODE(OP_GET_GLOBAL): {
+                uint8_t constant = READ_BYTE();
+                ValueCell* cell = globalCell(&frame->closure->function->chunk, constant);
+                if (cell == NULL) {
+                    ObjString* name = AS_STRING(frame->closure->function->chunk.constants.values[constant]);
                     runtimeError(routine, "Undefined variable (OP_GET_GLOBAL) '%s'.", name->chars);
-                    vm_mutex_exit(&vm.env);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(routine, cell.value);
-                vm_mutex_exit(&vm.env);
-                break;
+                PUSH(cell->value);
+                DISPATCH();
             }
-            case OP_DEFINE_GLOBAL: {
+            OPCODE(OP_DEFINE_GLOBAL): {
                 vm_mutex_enter_blocking(&vm.env);
                 ObjString* name = READ_STRING();
-                tableCellSet(&vm.globals, name, *peekCell(routine, 0));
-                pop(routine);
+                ValueCell cell = { .value = PEEK(0), .cellType = NULL };
+                tableCellSet(&vm.globals, name, cell);
+                POP();
                 vm_mutex_exit(&vm.env);
-                break;
+                DISPATCH();
             }
-            case OP_SET_GLOBAL: {
+            OPCODE(OP_DEFINE_TYPED_GLOBAL): {
                 vm_mutex_enter_blocking(&vm.env);
                 ObjString* name = READ_STRING();
-                ValueCell* lhs = NULL;
-                if (tableCellGetPlace(&vm.globals, name, &lhs)) {
-                    ValueCell* rhs = peekCell(routine, 0);
-                    ValueCellTarget lhsTrg = { .cellType = lhs->cellType, .value = &lhs->value };
-
-                    if (!assignToValueCellTarget(lhsTrg, rhs->value)) {
-                        runtimeError(routine, "Cannot set global variable to incompatible type.");
-                        vm_mutex_exit(&vm.env);
-                        return INTERPRET_RUNTIME_ERROR;
-                    }
-                } else {
+                ValueCell cell = { .value = PEEK(0), .cellType = slotType(PEEK(1)) };
+                tableCellSet(&vm.globals, name, cell);
+                POP();
+                POP();
+                vm_mutex_exit(&vm.env);
+                DISPATCH();
+            }
+            OPCODE(OP_SET_GLOBAL): OPCODE(OP_SET_GLOBAL_POP): {
+                uint8_t constant = READ_BYTE();
+                ValueCell* lhs = globalCell(&frame->closure->function->chunk, constant);
+                if (lhs == NULL) {
+                    ObjString* name = AS_STRING(frame->closure->function->chunk.constants.values[constant]);
                     runtimeError(routine, "Undefined variable (OP_SET_GLOBAL) '%s'.", name->chars);
-                    vm_mutex_exit(&vm.env);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                vm_mutex_exit(&vm.env);
-                break;
+                ValueCellTarget lhsTrg = { .cellType = lhs->cellType, .value = &lhs->value };
+
+                if (!assignToValueCellTarget(lhsTrg, PEEK(0))) {
+                    runtimeError(routine, "Cannot set global variable to incompatible type.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (instruction == OP_SET_GLOBAL_POP) {
+                    POP();
+                    frame->ip++;
+                }
+                DISPATCH();
             }
-            case OP_INITIALISE: {
-                ValueCellTarget lhsTrg = peekCellTarget(routine, 1);
-                ValueCell* rhs = peekCell(routine, 0);
-                if (!initialiseValueCellTarget(lhsTrg, rhs->value)) {
+            OPCODE(OP_INITIALISE): {
+                noLongerLiteralInt(PEEK_SLOT(0));
+                DISPATCH();
+            }
+            OPCODE(OP_INITIALISE_TYPED): {
+                ValueCellTarget lhsTrg = { .cellType = slotType(PEEK(2)), .value = PEEK_SLOT(1) };
+                if (!initialiseValueCellTarget(lhsTrg, PEEK(0))) {
                     runtimeError(routine, "Cannot initialise variable with this value.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                pop(routine);
-                break;
+                POP();
+                DISPATCH();
             }
-            case OP_GET_UPVALUE: {
+            OPCODE(OP_GET_UPVALUE): {
                 uint8_t slot = READ_BYTE();
-                push(routine, frame->closure->upvalues[slot]->contents->value);
-                break;
+                PUSH(*frame->closure->upvalues[slot]->contents);
+                DISPATCH();
             }
-            case OP_SET_UPVALUE: {
+            OPCODE(OP_SET_UPVALUE): {
                 uint8_t slot = READ_BYTE();
-                ValueCell* rhs = peekCell(routine, 0);
-                ValueCellTarget lhsTrg = { 
-                    .cellType = frame->closure->upvalues[slot]->contents->cellType, 
-                    .value = &frame->closure->upvalues[slot]->contents->value 
-                };
+                ObjUpvalue* upvalue = frame->closure->upvalues[slot];
+                ValueCellTarget lhsTrg = { .cellType = upvalue->type, .value = upvalue->contents };
 
-                if (!assignToValueCellTarget(lhsTrg, rhs->value)) {
+                if (!assignToValueCellTarget(lhsTrg, PEEK(0))) {
                     runtimeError(routine, "Cannot set local variable to incompatible type.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                writeBarrier((Obj*)upvalue, *upvalue->contents);
+                DISPATCH();
             }
-            case OP_GET_PROPERTY: {
-                if (!IS_INSTANCE(peek(routine, 0)) && !IS_STRUCT(peek(routine, 0)) && !isStructPointer(peek(routine, 0)) && !IS_INT(peek(routine, 0))) {
+            OPCODE(OP_GET_PROPERTY): {
+                if (!IS_INSTANCE(PEEK(0)) && !IS_STRUCT(PEEK(0)) && !isStructPointer(PEEK(0)) && !IS_INT(PEEK(0))) {
                     // int is a very special case, so we'll document the general case for ease of understanding.
                     runtimeError(routine, "Only instances, structs, pointers to structs have properties.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                if (IS_INSTANCE(peek(routine, 0))) {
-                    ObjInstance* instance = AS_INSTANCE(peek(routine, 0));
-                    ObjString* name = READ_STRING();
+                ObjString* name = READ_STRING();
+                InlineCache* cache = inlineCache(&frame->closure->function->chunk, READ_BYTE());
+                if (IS_INSTANCE(PEEK(0))) {
+                    ObjInstance* instance = AS_INSTANCE(PEEK(0));
 
                     Value value;
-                    if (tableGet(&instance->fields, name, &value)) {
-                        pop(routine); // Instance
-                        push(routine, value);
-                        break;
+                    if (cachedGetField(cache, name, instance, &value)) {
+                        POP(); // Instance
+                        PUSH(value);
+                        DISPATCH();
                     }
 
-                    if (!bindMethod(routine, instance->klass, name)) {
+                    Value method;
+                    if (!cachedMethod(cache, name, instance->klass, &method)) {
+                        runtimeError(routine, "Undefined property '%s'.", name->chars);
                         runtimeError(routine, "Error");
                         return INTERPRET_RUNTIME_ERROR;
                     }
-                } else if (IS_STRUCT(peek(routine, 0))) {
-                    ObjPackedStruct* object = AS_STRUCT(peek(routine, 0));
-                    ObjString* name = READ_STRING();
+                    ObjBoundMethod* bound = newBoundMethod(PEEK(0), AS_CLOSURE(method));
+                    POP();
+                    PUSH(OBJ_VAL(bound));
+                } else if (IS_STRUCT(PEEK(0))) {
+                    ObjPackedStruct* object = AS_STRUCT(PEEK(0));
                     size_t index;
-                    if (!structFieldIndex(object->store.storedType, name, &index)) {
+                    if (!cachedStructField(cache, name, object->store.storedType, &index)) {
                         runtimeError(routine, "field not present in struct.");
                         return INTERPRET_RUNTIME_ERROR;
                     }
                     PackedValue f = structField(object->store, index);
                     Value result = unpackValue(f);
 
-                    pop(routine);
-                    push(routine, result);
-                } else if (isStructPointer(peek(routine, 0))) {
-                    ObjPackedStruct* object = (ObjPackedStruct*) destinationObject(peek(routine, 0));
+                    POP();
+                    PUSH(result);
+                } else if (isStructPointer(PEEK(0))) {
+                    ObjPackedStruct* object = (ObjPackedStruct*) destinationObject(PEEK(0));
                     tempRootPush(OBJ_VAL(object));
-                    ObjString* name = READ_STRING();
                     size_t index;
-                    if (!structFieldIndex(object->store.storedType, name, &index)) {
+                    if (!cachedStructField(cache, name, object->store.storedType, &index)) {
                         runtimeError(routine, "field not present in struct.");
                         return INTERPRET_RUNTIME_ERROR;
                     }
@@ -922,15 +1512,14 @@ InterpretResult run(ObjRoutine* routine) {
                     Value result = OBJ_VAL(newPointerAtHeapCell(f));
                     tempRootPop();
 
-                    pop(routine);
-                    push(routine, result);
-                } else if (IS_INT(peek(routine, 0)))
+                    POP();
+                    PUSH(result);
+                } else if (IS_INT(PEEK(0)))
                 {
-                    Int *b = AS_INT(pop(routine));
-                    ObjString* name = READ_STRING();
+                    Int *b = AS_INT(POP());
                     if (strcmp(name->chars, "overflow") == 0)
                     {
-                        push(routine, BOOL_VAL(b->overflow_));
+                        PUSH(BOOL_VAL(b->overflow_));
                     }
                     else
                     {
@@ -938,69 +1527,78 @@ InterpretResult run(ObjRoutine* routine) {
                         return INTERPRET_RUNTIME_ERROR;
                     }
                 }
-                break;
+                DISPATCH();
             }
-            case OP_SET_PROPERTY: {
-                if (!IS_INSTANCE(peek(routine, 1)) && !IS_STRUCT(peek(routine, 1))) {
+            OPCODE(OP_SET_PROPERTY): {
+                if (!IS_INSTANCE(PEEK(1)) && !IS_STRUCT(PEEK(1))) {
                     runtimeError(routine, "Only instances and structs have fields.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                if (IS_INSTANCE(peek(routine, 1))) {
-                    ObjInstance* instance = AS_INSTANCE(peek(routine, 1));
-                    tableSet(&instance->fields, READ_STRING(), peek(routine, 0));
-                    Value value = pop(routine);
-                    pop(routine);
-                    push(routine, value);
-                } else if (IS_STRUCT(peek(routine, 1))) {
-                    ObjPackedStruct* object = AS_STRUCT(peek(routine, 1));
-                    ObjString* name = READ_STRING();
+                ObjString* name = READ_STRING();
+                InlineCache* cache = inlineCache(&frame->closure->function->chunk, READ_BYTE());
+                if (IS_INSTANCE(PEEK(1))) {
+                    ObjInstance* instance = AS_INSTANCE(PEEK(1));
+                    cachedSetField(cache, name, instance, PEEK(0));
+                    Value value = POP();
+                    POP();
+                    PUSH(value);
+                } else if (IS_STRUCT(PEEK(1))) {
+                    ObjPackedStruct* object = AS_STRUCT(PEEK(1));
                     size_t index;
-                    if (!structFieldIndex(object->store.storedType, name, &index)) {
+                    if (!cachedStructField(cache, name, object->store.storedType, &index)) {
                         runtimeError(routine, "field not present in struct.");
                         return INTERPRET_RUNTIME_ERROR;
                     }
                     PackedValue trg = structField(object->store, index);
-                    if (!assignToPackedValue(trg, peek(routine, 0))) {
+                    if (!assignToPackedValue(trg, PEEK(0))) {
                         runtimeError(routine, "cannot assign to field type.");
                         return INTERPRET_RUNTIME_ERROR;
                     }
-                    Value result = pop(routine);                 
-                    pop(routine);
-                    push(routine, result);
+                    Value result = POP();                 
+                    POP();
+                    PUSH(result);
                 }
-                break;
+                DISPATCH();
             }
-            case OP_GET_SUPER: {
+            OPCODE(OP_GET_SUPER): {
                 ObjString* name = READ_STRING();
-                ObjClass* superclass = AS_CLASS(pop(routine));
+                ObjClass* superclass = AS_CLASS(POP());
 
                 if (!bindMethod(routine, superclass, name)) {
                     runtimeError(routine, "Error");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                LOAD_STACK_TOP();
+                DISPATCH();
             }
-            case OP_EQUAL: case OP_GREATER: case OP_LESS: {
-                if (IS_INT(peek(routine, 0)) && IS_INT(peek(routine, 1))) {
+            OPCODE(OP_EQUAL): OPCODE(OP_GREATER): OPCODE(OP_LESS): {
+                if (instruction != OP_EQUAL) {
+                    QUICKEN(instruction);
+                }
+            generic_OP_GREATER: generic_OP_LESS:
+                if (IS_INT(PEEK(0)) && IS_INT(PEEK(1))) {
                     switch (instruction) {
                     case OP_EQUAL:
                         binaryIntBoolOp(routine, "==");
+                        LOAD_STACK_TOP();
                         break;
                     case OP_GREATER:
                         binaryIntBoolOp(routine, ">");
+                        LOAD_STACK_TOP();
                         break;
                     case OP_LESS:
                         binaryIntBoolOp(routine, "<");
+                        LOAD_STACK_TOP();
                         break;
                     }
                 } else {
-                    promote(&peekCell(routine, 1)->value, &peekCell(routine, 0)->value);
+                    promote(PEEK_SLOT(1), PEEK_SLOT(0));
 
                     switch (instruction) {
                     case OP_EQUAL: {
-                        Value b = pop(routine);
-                        Value a = pop(routine);
-                        push(routine, BOOL_VAL(valuesEqual(a, b)));
+                        Value b = POP();
+                        Value a = POP();
+                        PUSH(BOOL_VAL(valuesEqual(a, b)));
                         break;
                     }
                     case OP_GREATER:
@@ -1011,170 +1609,178 @@ InterpretResult run(ObjRoutine* routine) {
                         break;
                     }
                 }
-                break;
-            }
-            case OP_LEFT_SHIFT:  BINARY_UINT_OP(routine, <<); break;
-            case OP_RIGHT_SHIFT: BINARY_UINT_OP(routine, >>); break;
-            case OP_BITOR:       BINARY_UINT_OP(routine, |); break;
-            case OP_BITAND:      BINARY_UINT_OP(routine, &); break;
-            case OP_BITXOR:      BINARY_UINT_OP(routine, ^); break;
-            case OP_ADD: {
-                promote(&peekCell(routine, 1)->value, &peekCell(routine, 0)->value);
-
-                if (IS_I32(peek(routine, 0)) && IS_I32(peek(routine, 1))) {
-                    int32_t b = AS_I32(pop(routine));
-                    int32_t a = AS_I32(pop(routine));
-                    push(routine, I32_VAL(a + b));
-                } else if (IS_UI32(peek(routine, 0)) && IS_UI32(peek(routine, 1))) {
-                    uint32_t b = AS_UI32(pop(routine));
-                    uint32_t a = AS_UI32(pop(routine));
-                    push(routine, UI32_VAL(a + b));
-                } else if (IS_I8(peek(routine, 0)) && IS_I8(peek(routine, 1))) {
-                    int8_t b = AS_I8(pop(routine));
-                    int8_t a = AS_I8(pop(routine));
-                    push(routine, I8_VAL(a + b));
-                } else if (IS_UI8(peek(routine, 0)) && IS_UI8(peek(routine, 1))) {
-                    uint8_t b = AS_UI8(pop(routine));
-                    uint8_t a = AS_UI8(pop(routine));
-                    push(routine, UI8_VAL(a + b));
-                } else if (IS_I16(peek(routine, 0)) && IS_I16(peek(routine, 1))) {
-                    int16_t b = AS_I16(pop(routine));
-                    int16_t a = AS_I16(pop(routine));
-                    push(routine, I16_VAL(a + b));
-                } else if (IS_UI16(peek(routine, 0)) && IS_UI16(peek(routine, 1))) {
-                    uint16_t b = AS_UI16(pop(routine));
-                    uint16_t a = AS_UI16(pop(routine));
-                    push(routine, UI16_VAL(a + b));
-                } else if (IS_I64(peek(routine, 0)) && IS_I64(peek(routine, 1))) {
-                    int64_t b = AS_I64(pop(routine));
-                    int64_t a = AS_I64(pop(routine));
-                    push(routine, I64_VAL(a + b));
-                } else if (IS_UI64(peek(routine, 0)) && IS_UI64(peek(routine, 1))) {
-                    uint64_t b = AS_UI64(pop(routine));
-                    uint64_t a = AS_UI64(pop(routine));
-                    push(routine, UI64_VAL(a + b));
-                } else if (IS_DOUBLE(peek(routine, 0)) && IS_DOUBLE(peek(routine, 1))) {
-                    double b = AS_DOUBLE(pop(routine));
-                    double a = AS_DOUBLE(pop(routine));
-                    push(routine, DOUBLE_VAL(a + b));
-                } else if (IS_ADDRESS(peek(routine, 1)) && IS_I32(peek(routine, 0))) {
-                    int32_t b = AS_I32(pop(routine));
-                    uintptr_t a = AS_ADDRESS(pop(routine));
-                    push(routine, ADDRESS_VAL(a + b));
-                } else if (IS_ADDRESS(peek(routine, 1)) && IS_UI32(peek(routine, 0))) {
-                    uint32_t b = AS_UI32(pop(routine));
-                    uintptr_t a = AS_ADDRESS(pop(routine));
-                    push(routine, ADDRESS_VAL(a + b));
-                } else if (IS_POINTER(peek(routine, 1)) && IS_UI32(peek(routine, 0))) {
-                    uint32_t b = AS_UI32(pop(routine));
-                    ObjPackedPointer* pointer = AS_POINTER(pop(routine));
+                DISPATCH();
+            }
+            OPCODE(OP_LEFT_SHIFT):  BINARY_UINT_OP(routine, <<); DISPATCH();
+            OPCODE(OP_RIGHT_SHIFT): BINARY_UINT_OP(routine, >>); DISPATCH();
+            OPCODE(OP_BITOR):       BINARY_UINT_OP(routine, |); DISPATCH();
+            OPCODE(OP_BITAND):      BINARY_UINT_OP(routine, &); DISPATCH();
+            OPCODE(OP_BITXOR):      BINARY_UINT_OP(routine, ^); DISPATCH();
+            OPCODE(OP_ADD): {
+                QUICKEN(OP_ADD);
+            generic_OP_ADD:
+                promote(PEEK_SLOT(1), PEEK_SLOT(0));
+
+                if (IS_I32(PEEK(0)) && IS_I32(PEEK(1))) {
+                    int32_t b = AS_I32(POP());
+                    int32_t a = AS_I32(POP());
+                    PUSH(I32_VAL(a + b));
+                } else if (IS_UI32(PEEK(0)) && IS_UI32(PEEK(1))) {
+                    uint32_t b = AS_UI32(POP());
+                    uint32_t a = AS_UI32(POP());
+                    PUSH(UI32_VAL(a + b));
+                } else if (IS_I8(PEEK(0)) && IS_I8(PEEK(1))) {
+                    int8_t b = AS_I8(POP());
+                    int8_t a = AS_I8(POP());
+                    PUSH(I8_VAL(a + b));
+                } else if (IS_UI8(PEEK(0)) && IS_UI8(PEEK(1))) {
+                    uint8_t b = AS_UI8(POP());
+                    uint8_t a = AS_UI8(POP());
+                    PUSH(UI8_VAL(a + b));
+                } else if (IS_I16(PEEK(0)) && IS_I16(PEEK(1))) {
+                    int16_t b = AS_I16(POP());
+                    int16_t a = AS_I16(POP());
+                    PUSH(I16_VAL(a + b));
+                } else if (IS_UI16(PEEK(0)) && IS_UI16(PEEK(1))) {
+                    uint16_t b = AS_UI16(POP());
+                    uint16_t a = AS_UI16(POP());
+                    PUSH(UI16_VAL(a + b));
+                } else if (IS_I64(PEEK(0)) && IS_I64(PEEK(1))) {
+                    int64_t b = AS_I64(POP());
+                    int64_t a = AS_I64(POP());
+                    PUSH(I64_VAL(a + b));
+                } else if (IS_UI64(PEEK(0)) && IS_UI64(PEEK(1))) {
+                    uint64_t b = AS_UI64(POP());
+                    uint64_t a = AS_UI64(POP());
+                    PUSH(UI64_VAL(a + b));
+                } else if (IS_DOUBLE(PEEK(0)) && IS_DOUBLE(PEEK(1))) {
+                    double b = AS_DOUBLE(POP());
+                    double a = AS_DOUBLE(POP());
+                    PUSH(DOUBLE_VAL(a + b));
+                } else if (IS_ADDRESS(PEEK(1)) && IS_I32(PEEK(0))) {
+                    int32_t b = AS_I32(POP());
+                    uintptr_t a = AS_ADDRESS(POP());
+                    PUSH(ADDRESS_VAL(a + b));
+                } else if (IS_ADDRESS(PEEK(1)) && IS_UI32(PEEK(0))) {
+                    uint32_t b = AS_UI32(POP());
+                    uintptr_t a = AS_ADDRESS(POP());
+                    PUSH(ADDRESS_VAL(a + b));
+                } else if (IS_POINTER(PEEK(1)) && IS_UI32(PEEK(0))) {
+                    uint32_t b = AS_UI32(POP());
+                    ObjPackedPointer* pointer = AS_POINTER(POP());
                     offsetPointerDestination(pointer, b);
-                    push(routine, OBJ_VAL(pointer));
-                } else if (IS_STRING(peek(routine, 0)) && IS_STRING(peek(routine, 1))) {
+                    PUSH(OBJ_VAL(pointer));
+                } else if (IS_STRING(PEEK(0)) && IS_STRING(PEEK(1))) {
                     concatenate(routine);
-                } else if (IS_INT(peek(routine, 0)) && IS_INT(peek(routine, 1))) {
+                    LOAD_STACK_TOP();
+                } else if (IS_INT(PEEK(0)) && IS_INT(PEEK(1))) {
                     binaryIntOp(routine, "+");
+                    LOAD_STACK_TOP();
                 } else {
                     runtimeError(routine, "Operands must be two numbers or two strings.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                DISPATCH();
             }
-            case OP_MODULO: {
-                promote(&peekCell(routine, 1)->value, &peekCell(routine, 0)->value);
+            OPCODE(OP_MODULO): {
+                promote(PEEK_SLOT(1), PEEK_SLOT(0));
 
-                if (IS_I32(peek(routine, 0)) && IS_I32(peek(routine, 1))) {
-                    int32_t b = AS_I32(pop(routine));
-                    int32_t a = AS_I32(pop(routine));
+                if (IS_I32(PEEK(0)) && IS_I32(PEEK(1))) {
+                    int32_t b = AS_I32(POP());
+                    int32_t a = AS_I32(POP());
                     int32_t r = a % b;
                     if (a < 0 && b > 0 || a > 0  && b < 0) {
                         r += b;
                     }
-                    push(routine, I32_VAL(r));
-                } else if (IS_I8(peek(routine, 0)) && IS_I8(peek(routine, 1))) {
-                    int8_t b = AS_I8(pop(routine));
-                    int8_t a = AS_I8(pop(routine));
+                    PUSH(I32_VAL(r));
+                } else if (IS_I8(PEEK(0)) && IS_I8(PEEK(1))) {
+                    int8_t b = AS_I8(POP());
+                    int8_t a = AS_I8(POP());
                     int8_t r = a % b;
                     if (a < 0 && b > 0 || a > 0  && b < 0) {
                         r += b;
                     }
-                    push(routine, I8_VAL(r));
-                } else if (IS_I16(peek(routine, 0)) && IS_I16(peek(routine, 1))) {
-                    int16_t b = AS_I16(pop(routine));
-                    int16_t a = AS_I16(pop(routine));
+                    PUSH(I8_VAL(r));
+                } else if (IS_I16(PEEK(0)) && IS_I16(PEEK(1))) {
+                    int16_t b = AS_I16(POP());
+                    int16_t a = AS_I16(POP());
                     int16_t r = a % b;
                     if (a < 0 && b > 0 || a > 0  && b < 0) {
                         r += b;
                     }
-                    push(routine, I16_VAL(r));
-                } else if (IS_I64(peek(routine, 0)) && IS_I64(peek(routine, 1))) {
-                    int64_t b = AS_I64(pop(routine));
-                    int64_t a = AS_I64(pop(routine));
+                    PUSH(I16_VAL(r));
+                } else if (IS_I64(PEEK(0)) && IS_I64(PEEK(1))) {
+                    int64_t b = AS_I64(POP());
+                    int64_t a = AS_I64(POP());
                     int64_t r = a % b;
                     if (a < 0 && b > 0 || a > 0  && b < 0) {
                         r += b;
                     }
-                    push(routine, I64_VAL(r));
-                } else if (IS_UI32(peek(routine, 0)) && IS_UI32(peek(routine, 1))) {
-                    uint32_t b = AS_UI32(pop(routine));
-                    uint32_t a = AS_UI32(pop(routine));
-                    push(routine, UI32_VAL(a % b));
-                } else if (IS_UI8(peek(routine, 0)) && IS_UI8(peek(routine, 1))) {
-                    uint8_t b = AS_UI8(pop(routine));
-                    uint8_t a = AS_UI8(pop(routine));
-                    push(routine, UI8_VAL(a % b));
-                } else if (IS_UI16(peek(routine, 0)) && IS_UI16(peek(routine, 1))) {
-                    uint16_t b = AS_UI16(pop(routine));
-                    uint16_t a = AS_UI16(pop(routine));
-                    push(routine, UI16_VAL(a % b));
-                } else if (IS_UI64(peek(routine, 0)) && IS_UI64(peek(routine, 1))) {
-                    uint64_t b = AS_UI64(pop(routine));
-                    uint64_t a = AS_UI64(pop(routine));
-                    push(routine, UI64_VAL(a % b));
-                } else if (IS_INT(peek(routine, 0)) && IS_INT(peek(routine, 1))) {
+                    PUSH(I64_VAL(r));
+                } else if (IS_UI32(PEEK(0)) && IS_UI32(PEEK(1))) {
+                    uint32_t b = AS_UI32(POP());
+                    uint32_t a = AS_UI32(POP());
+                    PUSH(UI32_VAL(a % b));
+                } else if (IS_UI8(PEEK(0)) && IS_UI8(PEEK(1))) {
+                    uint8_t b = AS_UI8(POP());
+                    uint8_t a = AS_UI8(POP());
+                    PUSH(UI8_VAL(a % b));
+                } else if (IS_UI16(PEEK(0)) && IS_UI16(PEEK(1))) {
+                    uint16_t b = AS_UI16(POP());
+                    uint16_t a = AS_UI16(POP());
+                    PUSH(UI16_VAL(a % b));
+                } else if (IS_UI64(PEEK(0)) && IS_UI64(PEEK(1))) {
+                    uint64_t b = AS_UI64(POP());
+                    uint64_t a = AS_UI64(POP());
+                    PUSH(UI64_VAL(a % b));
+                } else if (IS_INT(PEEK(0)) && IS_INT(PEEK(1))) {
                     binaryIntOp(routine, "%");
+                    LOAD_STACK_TOP();
                 } else {
                     runtimeError(routine, "Operands must integers or unsigned integers of same type.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
-            }
-            case OP_SUBTRACT: BINARY_OP(routine, -); break;
-            case OP_MULTIPLY: BINARY_OP(routine, *); break;
-            case OP_DIVIDE: BINARY_OP(routine, /); break;
-            case OP_NOT:
-                push(routine, BOOL_VAL(isFalsey(pop(routine))));
-                break;
-            case OP_NEGATE: {
-                if (IS_DOUBLE(peek(routine, 0))) {
-                    push(routine, DOUBLE_VAL(-AS_DOUBLE(pop(routine))));
-                } else if (IS_I32(peek(routine, 0))) {
-                    push(routine, I32_VAL(-AS_I32(pop(routine))));
-                } else if (IS_I8(peek(routine, 0))) {
-                    push(routine, I8_VAL(-AS_I8(pop(routine))));
-                } else if (IS_I16(peek(routine, 0))) {
-                    push(routine, I16_VAL(-AS_I16(pop(routine))));
-                } else if (IS_I64(peek(routine, 0))) {
-                    push(routine, I64_VAL(-AS_I64(pop(routine))));
-                } else if (IS_INT(peek(routine, 0))) {
+                DISPATCH();
+            }
+            OPCODE(OP_SUBTRACT): QUICKEN(OP_SUBTRACT);
+            generic_OP_SUBTRACT: BINARY_OP(routine, -); DISPATCH();
+            OPCODE(OP_MULTIPLY): QUICKEN(OP_MULTIPLY);
+            generic_OP_MULTIPLY: BINARY_OP(routine, *); DISPATCH();
+            OPCODE(OP_DIVIDE): BINARY_OP(routine, /); DISPATCH();
+            OPCODE(OP_NOT):
+                PUSH(BOOL_VAL(isFalsey(POP())));
+                DISPATCH();
+            OPCODE(OP_NEGATE): {
+                if (IS_DOUBLE(PEEK(0))) {
+                    PUSH(DOUBLE_VAL(-AS_DOUBLE(POP())));
+                } else if (IS_I32(PEEK(0))) {
+                    PUSH(I32_VAL(-AS_I32(POP())));
+                } else if (IS_I8(PEEK(0))) {
+                    PUSH(I8_VAL(-AS_I8(POP())));
+                } else if (IS_I16(PEEK(0))) {
+                    PUSH(I16_VAL(-AS_I16(POP())));
+                } else if (IS_I64(PEEK(0))) {
+                    PUSH(I64_VAL(-AS_I64(POP())));
+                } else if (IS_INT(PEEK(0))) {
                     unaryIntOp(routine, OP_NEGATE);
+                    LOAD_STACK_TOP();
                 } else {
                     runtimeError(routine, "Operand must be a number or integer.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                DISPATCH();
             }
-            case OP_PRINT: {
-                ObjString* string = valueToString(peek(routine, 0));
+            OPCODE(OP_PRINT): {
+                ObjString* string = valueToString(PEEK(0));
                 tempRootPush(OBJ_VAL(string));
                 printf("%s\n", string->chars);
                 tempRootPop();
-                pop(routine);
-                break;
+                POP();
+                DISPATCH();
             }
-            case OP_POKE: {
-                Value location = peek(routine, 0);
-                Value assignment = peek(routine, 1);
+            OPCODE(OP_POKE): {
+                Value location = PEEK(0);
+                Value assignment = PEEK(1);
                 Value assignment_type = concrete_typeof(assignment);
                 tempRootPush(assignment_type);
                 if (!(isAddressValue(location) || isUint32Pointer(location))) {
@@ -1226,76 +1832,132 @@ InterpretResult run(ObjRoutine* routine) {
                 printf("poke 0x%08lx, 0x%08x\n", nominal_address, val);
 #endif
                 tempRootPop();
-                pop(routine);
-                pop(routine);
+                POP();
+                POP();
 
-                break;
+                DISPATCH();
             }
-            case OP_JUMP: {
+            OPCODE(OP_JUMP): {
                 uint16_t offset = READ_SHORT();
                 frame->ip += offset;
-                break;
+                DISPATCH();
             }
-            case OP_JUMP_IF_FALSE: {
+            OPCODE(OP_JUMP_IF_FALSE): {
                 uint16_t offset = READ_SHORT();
-                if (isFalsey(peek(routine, 0))) frame->ip += offset;
-                break;
+                if (isFalsey(PEEK(0))) frame->ip += offset;
+                DISPATCH();
             }
-            case OP_LOOP: {
+            OPCODE(OP_POP_JUMP_IF_FALSE): {
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(POP())) frame->ip += offset;
+                frame->ip++;
+                DISPATCH();
+            }
+            OPCODE(OP_LOOP): {
                 uint16_t offset = READ_SHORT();
                 frame->ip -= offset;
-                break;
+                if (!frame->closure->function->chunk.quickened) {
+                    warmFunction(frame);
+                }
+                CHECK_ROUTINE_STATE();
+#if defined(CYARG_AOT)
+                if (frame->closure->function->aot != NULL) {
+                    if (aotLoop(routine, frame)) {
+                        LOAD_STACK_TOP();
+                    }
+                    DISPATCH();
+                }
+#endif
+#if defined(CYARG_JIT)
+                if (frame->closure->function->chunk.quickened && jitLoop(routine, frame)) {
+                    LOAD_STACK_TOP();
+                }
+#endif
+                DISPATCH();
             }
-            case OP_CALL: {
+            OPCODE(OP_CALL): {
                 int argCount = READ_BYTE();
-                InterpretResult result = callValue(routine, peek(routine, argCount), argCount);
+                InterpretResult result = callValue(routine, PEEK(argCount), argCount);
                 if (result != INTERPRET_OK) {
                     return result;
                 }
-                frame = &routine->frames[routine->frameCount - 1];
-                break;
+                CHECK_ROUTINE_STATE();
+                LOAD_FRAME();
+                DISPATCH();
             }
-            case OP_INVOKE: {
+            OPCODE(OP_TAIL_CALL): {
+                int argCount = READ_BYTE();
+                InterpretResult result = tailCallValue(routine, frame, PEEK(argCount), argCount);
+                if (result != INTERPRET_OK) {
+                    return result;
+                }
+                CHECK_ROUTINE_STATE();
+                LOAD_FRAME();
+                DISPATCH();
+            }
+            OPCODE(OP_CALL_BUILTIN): {
+                Value builtin = getBuiltin(READ_BYTE());
+                int argCount = READ_BYTE();
+                if (!IS_BUILTIN(builtin)) {
+                    runtimeError(routine, "Can only call functions and classes.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value result = NIL_VAL;
+                if (!AS_BUILTIN(builtin)(routine, argCount, &result)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                popN(routine, argCount);
+                push(routine, result);
+                CHECK_ROUTINE_STATE();
+                LOAD_FRAME();
+                DISPATCH();
+            }
+            OPCODE(OP_INVOKE): {
                 ObjString* method = READ_STRING();
                 int argCount = READ_BYTE();
-                InterpretResult result = invoke(routine, method, argCount);
+                InlineCache* cache = inlineCache(&frame->closure->function->chunk, READ_BYTE());
+                InterpretResult result = invokeCached(routine, cache, method, argCount);
                 if (result != INTERPRET_OK) {
                     return result;
                 }
-                frame = &routine->frames[routine->frameCount - 1];
-                break;
+                CHECK_ROUTINE_STATE();
+                LOAD_FRAME();
+                DISPATCH();
             }
-            case OP_SUPER_INVOKE: {
+            OPCODE(OP_SUPER_INVOKE): {
                 ObjString* method = READ_STRING();
                 int argCount = READ_BYTE();
-                ObjClass* superclass = AS_CLASS(pop(routine));
+                ObjClass* superclass = AS_CLASS(POP());
                 InterpretResult result = invokeFromClass(routine, superclass, method, argCount);
                 if (result != INTERPRET_OK) {
                     return result;
                 }
-                frame = &routine->frames[routine->frameCount - 1];
-                break;
+                CHECK_ROUTINE_STATE();
+                LOAD_FRAME();
+                DISPATCH();
             }
-            case OP_CLOSURE: {
+            OPCODE(OP_CLOSURE): {
                 ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
                 ObjClosure* closure = newClosure(function);
-                push(routine, OBJ_VAL(closure));
+                PUSH(OBJ_VAL(closure));
                 for (int i = 0; i < closure->cUpvalueCount; i++) {
                     uint8_t isLocal = READ_BYTE();
                     uint8_t index = READ_BYTE();
                     if (isLocal) {
-                        closure->upvalues[i] = captureUpvalue(routine, frameSlot(routine, frame, index), stackOffsetOf(frame, index));
+                        ObjConcreteYargType* type = isLocal & UPVALUE_TYPED ? slotType(*FRAME_SLOT(index - 1)) : NULL;
+                        closure->upvalues[i] = captureUpvalue(routine, FRAME_SLOT(index), stackOffsetOf(frame, index), type);
                     } else {
                         closure->upvalues[i] = frame->closure->upvalues[index];
                     }
+                    writeBarrierObj((Obj*)closure, (Obj*)closure->upvalues[i]);
                 }
-                break;
+                DISPATCH();
             }
-            case OP_CLOSE_UPVALUE:
+            OPCODE(OP_CLOSE_UPVALUE):
                 closeUpvalues(routine, routine->stackTopIndex - 1);
-                pop(routine);
-                break;
-            case OP_YIELD: {
+                POP();
+                DISPATCH();
+            OPCODE(OP_YIELD): {
                 if (routine == &vm.core0) {
                     runtimeError(routine, "Cannot yield from initial routine.");
                     return INTERPRET_RUNTIME_ERROR;
@@ -1303,8 +1965,8 @@ InterpretResult run(ObjRoutine* routine) {
                 yieldFromRoutine(routine);
                 return INTERPRET_OK;
             }
-            case OP_RETURN: {
-                Value result = pop(routine);
+            OPCODE(OP_RETURN): {
+                Value result = POP();
                 tempRootPush(result);
                 closeUpvalues(routine, frame->stackEntryIndex);
                 routine->frameCount--;
@@ -1315,149 +1977,142 @@ InterpretResult run(ObjRoutine* routine) {
                     returnFromRoutine(routine, result);
                     return INTERPRET_OK;
                 }
-                frame = &routine->frames[routine->frameCount - 1];
-                break;
-            }
-            case OP_CLASS:
-                push(routine, OBJ_VAL(newClass(READ_STRING())));
-                break;
-            case OP_INHERIT: {
-                Value superclass = peek(routine, 1);
+                LOAD_FRAME();
+                DISPATCH();
+            }
+            OPCODE(OP_CLASS):
+                PUSH(OBJ_VAL(newClass(READ_STRING())));
+                DISPATCH();
+            OPCODE(OP_INHERIT): {
+                Value superclass = PEEK(1);
                 if (!IS_CLASS(superclass)) {
                     runtimeError(routine, "Superclass must be a class.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
-                ObjClass* subclass = AS_CLASS(peek(routine, 0));
+                ObjClass* subclass = AS_CLASS(PEEK(0));
                 tableAddAll(&AS_CLASS(superclass)->methods, &subclass->methods);
-                pop(routine); // Subclass.
-                break;
+                POP(); // Subclass.
+                DISPATCH();
             }
-            case OP_METHOD:
+            OPCODE(OP_METHOD):
                 defineMethod(routine, READ_STRING());
-                break;
-            case OP_ELEMENT: {
+                LOAD_STACK_TOP();
+                DISPATCH();
+            OPCODE(OP_ELEMENT): {
                 if (!derefElement(routine)) {
                     runtimeError(routine, "Error");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                LOAD_STACK_TOP();
+                DISPATCH();
             }
-            case OP_SET_ELEMENT: {
+            OPCODE(OP_SET_ELEMENT): {
                 if (!setElement(routine)) {
                     runtimeError(routine, "Error");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                LOAD_STACK_TOP();
+                DISPATCH();
             }
-            case OP_TYPE_LITERAL: {
+            OPCODE(OP_TYPE_LITERAL): {
                 uint8_t typeCode = READ_BYTE();
                 ObjConcreteYargType* typeObj = NULL;
                 switch (typeCode) {
-                    case TYPE_LITERAL_BOOL: typeObj = newYargTypeFromType(TypeBool); break;
-                    case TYPE_LITERAL_INT8: typeObj = newYargTypeFromType(TypeInt8); break;
-                    case TYPE_LITERAL_UINT8: typeObj = newYargTypeFromType(TypeUint8); break;
-                    case TYPE_LITERAL_INT16: typeObj = newYargTypeFromType(TypeInt16); break;
-                    case TYPE_LITERAL_UINT16: typeObj = newYargTypeFromType(TypeUint16); break;
-                    case TYPE_LITERAL_INT32: typeObj = newYargTypeFromType(TypeInt32); break;
-                    case TYPE_LITERAL_UINT32: typeObj = newYargTypeFromType(TypeUint32); break;
-                    case TYPE_LITERAL_INT64: typeObj = newYargTypeFromType(TypeInt64); break;
-                    case TYPE_LITERAL_UINT64: typeObj = newYargTypeFromType(TypeUint64); break;
-                    case TYPE_LITERAL_MACHINE_FLOAT64: typeObj = newYargTypeFromType(TypeDouble); break;
-                    case TYPE_LITERAL_STRING: typeObj = newYargTypeFromType(TypeString); break;
-                    case TYPE_LITERAL_INT: typeObj = newYargTypeFromType(TypeInt); break;
+                    case TYPE_LITERAL_BOOL: typeObj = yargPrimitiveType(TypeBool); break;
+                    case TYPE_LITERAL_INT8: typeObj = yargPrimitiveType(TypeInt8); break;
+                    case TYPE_LITERAL_UINT8: typeObj = yargPrimitiveType(TypeUint8); break;
+                    case TYPE_LITERAL_INT16: typeObj = yargPrimitiveType(TypeInt16); break;
+                    case TYPE_LITERAL_UINT16: typeObj = yargPrimitiveType(TypeUint16); break;
+                    case TYPE_LITERAL_INT32: typeObj = yargPrimitiveType(TypeInt32); break;
+                    case TYPE_LITERAL_UINT32: typeObj = yargPrimitiveType(TypeUint32); break;
+                    case TYPE_LITERAL_INT64: typeObj = yargPrimitiveType(TypeInt64); break;
+                    case TYPE_LITERAL_UINT64: typeObj = yargPrimitiveType(TypeUint64); break;
+                    case TYPE_LITERAL_MACHINE_FLOAT64: typeObj = yargPrimitiveType(TypeDouble); break;
+                    case TYPE_LITERAL_STRING: typeObj = yargPrimitiveType(TypeString); break;
+                    case TYPE_LITERAL_INT: typeObj = yargPrimitiveType(TypeInt); break;
                 }
                 if (typeObj == NULL) {
                     runtimeError(routine, "Unknown type literal.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(routine, OBJ_VAL(typeObj));
-                break;
+                PUSH(OBJ_VAL(typeObj));
+                DISPATCH();
             }
-            case OP_TYPE_STRUCT: {
+            OPCODE(OP_TYPE_STRUCT): {
                 uint8_t fieldCount = READ_BYTE();
                 ObjConcreteYargTypeStruct* st = (ObjConcreteYargTypeStruct*) newYargStructType(fieldCount);
                 tempRootPush(OBJ_VAL(st));
                 size_t fieldOffset = 0;
                 for (uint8_t i = 0; i < fieldCount; i++) {
-                    fieldOffset = addFieldType(st, i, fieldOffset, peek(routine, 2), peek(routine, 1), peek(routine, 0));
-                    pop(routine);
-                    pop(routine);
-                    pop(routine);
+                    fieldOffset = addFieldType(st, i, fieldOffset, PEEK(2), PEEK(1), PEEK(0));
+                    POP();
+                    POP();
+                    POP();
                 }
-                push(routine, OBJ_VAL(st));
+                PUSH(OBJ_VAL(st));
                 tempRootPop();
-                break;
+                DISPATCH();
             }
-            case OP_TYPE_INDEXED_COLLECTION: {
-                Value indexer = peek(routine, 0);
+            OPCODE(OP_TYPE_INDEXED_COLLECTION): {
+                Value indexer = PEEK(0);
 
                 ObjConcreteYargType* typeObject = NULL;
 
                 if (IS_NIL(indexer) || IS_YARGTYPE(indexer)) {
-                    ObjConcreteYargTypeMap* mapType = ALLOCATE_OBJ(ObjConcreteYargTypeMap, OBJ_YARGTYPE_MAP);
-                    tempRootPush(OBJ_VAL(mapType));
-                    mapType->core.yt = TypeMap;
-                    mapType->key_type = IS_NIL(indexer) ? NULL : AS_YARGTYPE(indexer);
-                    mapType->value_type = IS_NIL(peek(routine, 1)) ? NULL : AS_YARGTYPE(peek(routine, 1));
-                    if (!isSupportedMapKeyType(OBJ_VAL(mapType))) {
+                    if (!isSupportedMapKeyType(indexer)) {
                         runtimeError(routine, "Unsupported map key type.");
-                        tempRootPop();
                         return INTERPRET_RUNTIME_ERROR;
                     }
-                    typeObject = (ObjConcreteYargType*) mapType;
-                    tempRootPop();
+                    typeObject = internYargMapType(indexer, PEEK(1));
                 } else if (is_positive_integer32(indexer)) {
                     uint32_t cardinality = as_positive_integer32(indexer);
                     if (cardinality == 0) {
                         runtimeError(routine, "Array cardinality must be non zero.");
                         return INTERPRET_RUNTIME_ERROR;
                     }
-                    ObjConcreteYargTypeArray* array = (ObjConcreteYargTypeArray*) newYargArrayTypeFromType(peek(routine, 1));
-                    array->cardinality = cardinality;
-                    typeObject = (ObjConcreteYargType*) array;
+                    typeObject = internYargArrayType(PEEK(1), cardinality);
                 } else {
                     runtimeError(routine, "Collection must be array or map.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
-                pop(routine);
-                pop(routine);
-                push(routine, OBJ_VAL(typeObject));
-                break;
+                POP();
+                POP();
+                PUSH(OBJ_VAL(typeObject));
+                DISPATCH();
             }
-            case OP_SET_CELL_TYPE: {
-                Value type = peek(routine, 0);
-                Value def = defaultValue(type);
-                pop(routine);
-                pushTyped(routine, def, type);
-                break;
+            OPCODE(OP_TYPE_DEFAULT): {
+                Value def = defaultValue(PEEK(0));
+                PUSH(def);
+                DISPATCH();
             }
-            case OP_DEREF_PTR: {
+            OPCODE(OP_DEREF_PTR): {
                 derefPtr(routine);
-                break;
+                LOAD_STACK_TOP();
+                DISPATCH();
             }
-            case OP_SET_PTR_TARGET: {
-                Value rhs = peek(routine, 0);
-                Value lhs = peek(routine, 1);
+            OPCODE(OP_SET_PTR_TARGET): {
+                Value rhs = PEEK(0);
+                Value lhs = PEEK(1);
                 ObjPackedPointer* pLhs = AS_POINTER(lhs);
                 PackedValue trgLhs = { 
                     .storedType = pLhs->type->target_type, 
                     .storedValue = pLhs->destination 
                 };
                 if (assignToPackedValue(trgLhs, rhs)) {
-                    pop(routine);
-                    pop(routine);
-                    push(routine, rhs);
+                    POP();
+                    POP();
+                    PUSH(rhs);
                 } else {
                     runtimeError(routine, "Cannot set pointer target to incompatible type.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                DISPATCH();
             }
-            case OP_PLACE: {
-                Value location = peek(routine, 0);
-                Value type = peek(routine, 1);
+            OPCODE(OP_PLACE): {
+                Value location = PEEK(0);
+                Value type = PEEK(1);
                 if (!is_placeable_type(type)) {
                     runtimeError(routine, "Cannot place this type.");
                     return INTERPRET_RUNTIME_ERROR;
@@ -1468,20 +2123,111 @@ InterpretResult run(ObjRoutine* routine) {
                 }
                 Value result = placeObjectAt(type, location);
 
-                pop(routine);
-                pop(routine);
-                push(routine, result);
-                break;
+                POP();
+                POP();
+                PUSH(result);
+                DISPATCH();
+            }
+            OPCODE(OP_ADD_SMALL_INT): QUICKENED_OP(OP_ADD, IS_SMALL_INT, AS_SMALL_INT, int64_t, intValue, +)
+            OPCODE(OP_ADD_I32): QUICKENED_OP(OP_ADD, IS_I32, AS_I32, int32_t, I32_VAL, +)
+            OPCODE(OP_ADD_UI32): QUICKENED_OP(OP_ADD, IS_UI32, AS_UI32, uint32_t, UI32_VAL, +)
+            OPCODE(OP_ADD_DOUBLE): QUICKENED_OP(OP_ADD, IS_DOUBLE, AS_DOUBLE, double, DOUBLE_VAL, +)
+            OPCODE(OP_SUBTRACT_SMALL_INT): QUICKENED_OP(OP_SUBTRACT, IS_SMALL_INT, AS_SMALL_INT, int64_t, intValue, -)
+            OPCODE(OP_SUBTRACT_I32): QUICKENED_OP(OP_SUBTRACT, IS_I32, AS_I32, int32_t, I32_VAL, -)
+            OPCODE(OP_SUBTRACT_UI32): QUICKENED_OP(OP_SUBTRACT, IS_UI32, AS_UI32, uint32_t, UI32_VAL, -)
+            OPCODE(OP_SUBTRACT_DOUBLE): QUICKENED_OP(OP_SUBTRACT, IS_DOUBLE, AS_DOUBLE, double, DOUBLE_VAL, -)
+            OPCODE(OP_MULTIPLY_SMALL_INT): QUICKENED_OP(OP_MULTIPLY, IS_SMALL_INT, AS_SMALL_INT, int64_t, intValue, *)
+            OPCODE(OP_MULTIPLY_I32): QUICKENED_OP(OP_MULTIPLY, IS_I32, AS_I32, int32_t, I32_VAL, *)
+            OPCODE(OP_MULTIPLY_UI32): QUICKENED_OP(OP_MULTIPLY, IS_UI32, AS_UI32, uint32_t, UI32_VAL, *)
+            OPCODE(OP_MULTIPLY_DOUBLE): QUICKENED_OP(OP_MULTIPLY, IS_DOUBLE, AS_DOUBLE, double, DOUBLE_VAL, *)
+            OPCODE(OP_LESS_SMALL_INT): QUICKENED_OP(OP_LESS, IS_SMALL_INT, AS_SMALL_INT, int32_t, BOOL_VAL, <)
+            OPCODE(OP_LESS_I32): QUICKENED_OP(OP_LESS, IS_I32, AS_I32, int32_t, BOOL_VAL, <)
+            OPCODE(OP_LESS_UI32): QUICKENED_OP(OP_LESS, IS_UI32, AS_UI32, uint32_t, BOOL_VAL, <)
+            OPCODE(OP_LESS_DOUBLE): QUICKENED_OP(OP_LESS, IS_DOUBLE, AS_DOUBLE, double, BOOL_VAL, <)
+            OPCODE(OP_GREATER_SMALL_INT): QUICKENED_OP(OP_GREATER, IS_SMALL_INT, AS_SMALL_INT, int32_t, BOOL_VAL, >)
+            OPCODE(OP_GREATER_I32): QUICKENED_OP(OP_GREATER, IS_I32, AS_I32, int32_t, BOOL_VAL, >)
+            OPCODE(OP_GREATER_UI32): QUICKENED_OP(OP_GREATER, IS_UI32, AS_UI32, uint32_t, BOOL_VAL, >)
+            OPCODE(OP_GREATER_DOUBLE): QUICKENED_OP(OP_GREATER, IS_DOUBLE, AS_DOUBLE, double, BOOL_VAL, >)
+            OPCODE(OP_ADD_LOCALS): {
+                uint8_t* code = frame->ip;
+                Value a = *FRAME_SLOT(code[0]);
+                Value b = *FRAME_SLOT(code[2]);
+                if (IS_SMALL_INT(a) && IS_SMALL_INT(b)) {
+                    PUSH(intValue((int64_t)AS_SMALL_INT(a) + AS_SMALL_INT(b)));
+                } else if (IS_I32(a) && IS_I32(b)) {
+                    PUSH(I32_VAL(AS_I32(a) + AS_I32(b)));
+                } else if (IS_UI32(a) && IS_UI32(b)) {
+                    PUSH(UI32_VAL(AS_UI32(a) + AS_UI32(b)));
+                } else if (IS_DOUBLE(a) && IS_DOUBLE(b)) {
+                    PUSH(DOUBLE_VAL(AS_DOUBLE(a) + AS_DOUBLE(b)));
+                } else {
+                    frame->ip++;
+                    PUSH(a);
+                    DISPATCH();
+                }
+                frame->ip = code + 4;
+                DISPATCH();
             }
+            OPCODE(OP_LOCAL_ARITH_CONST): {
+                uint8_t* code = frame->ip;
+                Value local = *FRAME_SLOT(code[0]);
+                FusedKind kind;
+                int64_t constant;
+                int64_t value;
+                uint8_t* op = fusedImmediate(code + 1, &kind, &constant);
+                if (!fusedOperands(local, &kind, constant, &value)) {
+                    frame->ip++;
+                    PUSH(local);
+                    DISPATCH();
+                }
+                bool add = *op == OP_ADD || (*op >= OP_ADD_SMALL_INT && *op <= OP_ADD_DOUBLE);
+                PUSH(fusedValue(kind, add ? value + constant : value - constant));
+                frame->ip = op + 1;
+                DISPATCH();
+            }
+            OPCODE(OP_LOCAL_COMPARE_CONST_JUMP): {
+                uint8_t* code = frame->ip;
+                Value local = *FRAME_SLOT(code[0]);
+                FusedKind kind;
+                int64_t constant;
+                int64_t value;
+                uint8_t* op = fusedImmediate(code + 1, &kind, &constant);
+                if (!fusedOperands(local, &kind, constant, &value)) {
+                    frame->ip++;
+                    PUSH(local);
+                    DISPATCH();
+                }
+                bool less = *op == OP_LESS || (*op >= OP_LESS_SMALL_INT && *op <= OP_LESS_DOUBLE);
+                uint16_t offset = (uint16_t)((op[2] << 8) | op[3]);
+                // past the jump's OP_POP, or the one at its target
+                frame->ip = op + 5;
+                if (!(less ? value < constant : value > constant)) frame->ip += offset;
+                DISPATCH();
+            }
+#if !defined(CYARG_THREADED_DISPATCH)
         }
     }
+#endif
 
+#undef LOAD_STACK_TOP
+#undef LOAD_FRAME
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef PEEK_SLOT
+#undef FRAME_SLOT
 #undef READ_BYTE
 #undef READ_SHORT
 #undef READ_CONSTANT
 #undef READ_STRING
 #undef BINARY_BOOLEAN_OP
+#undef BINARY_UINT_OP
 #undef BINARY_OP
+#undef QUICKEN
+#undef QUICKENED_OP
+#undef OPCODE
+#undef DISPATCH
+#undef CHECK_ROUTINE_STATE
 }
 
 typedef void (*bindBootstrapFunction)(ObjString* script);
@@ -1496,6 +2242,7 @@ static void bindBootstrapCode(const char* name, size_t nameLength,
     }
     uint8_t constant = addConstant(&vm.bootFunction.chunk, OBJ_VAL(script));
     assert(constant == vm.bootFunction.chunk.code[constantIndex]);
+    vm.bootFunction.maxStackDepth = chunkStackDepth(&vm.bootFunction.chunk, 0);
 }
 
 // note that it is assumed that the initial script is well-formed and won't
@@ -1559,6 +2306,11 @@ InterpretResult compileScript(ObjString* filename, Value* result) {
 
 void unaryIntOp(ObjRoutine* routine, int op) {
     assert(op == OP_NEGATE);
+    if (IS_SMALL_INT(peek(routine, 0))) {
+        int64_t a = AS_SMALL_INT(pop(routine));
+        push(routine, intValue(-a));
+        return;
+    }
     Int* a = AS_INT(peek(routine, 0));
     ObjInt *r = allocateIntObject(a->d_);
     int_set_t(a, &r->bigInt);
@@ -1567,8 +2319,43 @@ void unaryIntOp(ObjRoutine* routine, int op) {
     push(routine, OBJ_VAL(r));
 }
 
+// Both operands fit in 32 bits, so the result is exact in 64 bits and is only
+// allocated if it no longer fits in a small int.
+static void binarySmallIntOp(ObjRoutine* routine, char const *c)
+{
+    int64_t b = AS_SMALL_INT(peek(routine, 0));
+    int64_t a = AS_SMALL_INT(peek(routine, 1));
+    Value result;
+
+    switch (*c)
+    {
+    case '+': result = intValue(a + b); break;
+    case '-': result = intValue(a - b); break;
+    case '*': result = intValue(a * b); break;
+    case '/': case '%': {
+        // int_div keeps yarg's rounding and remainder sign
+        IntConcrete2 aScratch, bScratch;
+        IntConcrete4 q, r;
+        int_div(intFromValue(peek(routine, 1), &aScratch), intFromValue(peek(routine, 0), &bScratch),
+                int_init_concrete4(&q), int_init_concrete4(&r));
+        result = intValue(int_to_i64(*c == '/' ? (Int *) &q : (Int *) &r));
+        break;
+    }
+    default:
+        assert(!"IntOp");
+        result = NIL_VAL;
+    }
+    routine->stackTopIndex -= 2;
+    push(routine, result);
+}
+
 void binaryIntOp(ObjRoutine* routine, char const *c)
 {
+    if (IS_SMALL_INT(peek(routine, 0)) && IS_SMALL_INT(peek(routine, 1))) {
+        binarySmallIntOp(routine, c);
+        return;
+    }
+
     Int *a = AS_INT(peek(routine, 1));
     Int *b = AS_INT(peek(routine, 0));
 
@@ -1615,9 +2402,16 @@ void binaryIntOp(ObjRoutine* routine, char const *c)
 
 void binaryIntBoolOp(ObjRoutine* routine, char const *op)
 {
-    Int *b = AS_INT(pop(routine));
-    Int *a = AS_INT(pop(routine));
-    IntComp ic = int_is(a, b);
+    IntComp ic;
+    if (IS_SMALL_INT(peek(routine, 0)) && IS_SMALL_INT(peek(routine, 1))) {
+        int32_t b = AS_SMALL_INT(pop(routine));
+        int32_t a = AS_SMALL_INT(pop(routine));
+        ic = a < b ? INT_LT : a > b ? INT_GT : INT_EQ;
+    } else {
+        Int *b = AS_INT(pop(routine));
+        Int *a = AS_INT(pop(routine));
+        ic = int_is(a, b);
+    }
     bool r;
     switch (*op)
     {
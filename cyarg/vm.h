@@ -9,8 +9,11 @@
 #include "memory.h"
 #include "routine.h"
 #include "vm_mutex.h"
+#include "yargtype.h"
 
 #define MAX_PINNED_ROUTINES 10
+// one for each core, then one for each pinned routine
+#define ALLOC_CONTEXTS (2 + MAX_PINNED_ROUTINES)
 
 typedef void (*PinnedRoutineHandler)(void);
 
@@ -26,21 +29,65 @@ typedef struct {
     
     ValueCellTable globals;
     ValueTable strings;
+    ObjConcreteYargType* primitiveTypes[TypeYargType + 1];
+    YargTypeTable compositeTypes;
     ObjString* initString;
     ObjString* libraryPath;
 
+    // one shared ObjBuiltin per BuiltinFn, made in initVMRuntime.
+    Value builtins[BUILTIN_COUNT];
+    // the functions of a package being loaded, before its script function reaches them.
+    ObjFunction** loadingFunctions;
+    int loadingFunctionCount;
+
+#ifdef DEBUG_INLINE_CACHE
+    size_t inlineCacheHits;
+    size_t inlineCacheMisses;
+#endif
+
     vm_mutex heap;
     O1HeapInstance* heap_instance;
 
-    Value tempRoots[TEMP_ROOTS_MAX];
-    Value* tempRootsTop;
+    AllocContext allocContexts[ALLOC_CONTEXTS];
+    SlabClass slabClasses[SLAB_CLASS_COUNT];
+    SlabClass objectClasses[SLAB_CLASS_COUNT];
+    // sorted by address, to find the page a block is in.
+    SlabPage** slabPages;
+    int slabPageCount;
+    int slabPageCapacity;
 
     size_t bytesAllocated;
     size_t nextGC;
-    Obj* objects;
+    size_t nextYoungGC;
+    // those swept since the last marking, and those not yet.
+    LargeObject* largeObjects;
+    LargeObject** largeObjectsTail;
+    LargeObject* unsweptLarge;
     int grayCount;
     int grayCapacity;
     Obj** grayStack;
+    int rememberedCount;
+    int rememberedCapacity;
+    Obj** remembered;
+    GcPhase gcPhase;
+    uint32_t sweepEpoch;        // pages swept since the last marking carry it
+    int pageCursor;
+    LargeObject* largeCursor;
+    bool sweepingOldGeneration;
+    size_t gcStepObjects;
+    uint32_t gcPauses[GC_PAUSE_BUCKETS];
+    uint64_t gcMicros;
+    uint32_t gcCollections;
+    uint32_t gcYoungCollections;
+
+    // pacing of the old generation's collections, see gc_config().
+    size_t heapSize;
+    size_t gcLiveBytes;         // after the last collection was swept
+    uint32_t gcGrowthPercent;
+    uint32_t gcTimePercent;     // of the time the collector aims to stay under, if not 0
+    uint32_t gcPacedPercent;
+    uint64_t gcPacerStart;
+    uint64_t gcPacerMicros;
 } VM;
 
 extern VM vm;
@@ -56,6 +103,8 @@ InterpretResult compileScript(ObjString* filename, Value* compileResult);
 
 InterpretResult run(ObjRoutine* routine);
 bool callfn(ObjRoutine* routine, ObjClosure* closure, int argCount);
+// Gives a literal int operand of a binary operator the other operand's type, where it fits.
+void promote(Value* left, Value* right);
 void fatalVMError(const char* format, ...);
 
 bool installPinnedRoutine(ObjRoutine* pinnedRoutine, uintptr_t* address);
@@ -5,7 +5,41 @@
 #include "memory.h"
 #include "vm.h"
 
+static YargTypeLayout primitiveLayout(ConcreteYargType yt) {
+    switch (yt) {
+        case TypeAny: return (YargTypeLayout){ sizeof(Value), true, false };
+        case TypeBool:
+        case TypeDouble: return (YargTypeLayout){ sizeof(Value), false, false };
+        case TypeInt8: return (YargTypeLayout){ sizeof(int8_t), false, true };
+        case TypeUint8: return (YargTypeLayout){ sizeof(uint8_t), false, true };
+        case TypeInt16: return (YargTypeLayout){ sizeof(int16_t), false, true };
+        case TypeUint16: return (YargTypeLayout){ sizeof(uint16_t), false, true };
+        case TypeInt32: return (YargTypeLayout){ sizeof(int32_t), false, true };
+        case TypeUint32: return (YargTypeLayout){ sizeof(uint32_t), false, true };
+        case TypeInt64: return (YargTypeLayout){ sizeof(int64_t), false, true };
+        case TypeUint64: return (YargTypeLayout){ sizeof(uint64_t), false, true };
+        case TypeArray:
+        case TypeStruct: return (YargTypeLayout){ 0, false, true };
+        case TypeInt:
+        case TypeString:
+        case TypeClass:
+        case TypeInstance:
+        case TypeFunction:
+        case TypeRoutine:
+        case TypeChannel:
+        case TypePointer:
+        case TypeMap:
+        case TypeYargType: return (YargTypeLayout){ sizeof(Obj*), true, true };
+    }
+}
+
+// a missing type is any.
+static YargTypeLayout layoutOf(ObjConcreteYargType* type) {
+    return type ? type->layout : primitiveLayout(TypeAny);
+}
+
 ObjConcreteYargType* newYargTypeFromType(ConcreteYargType yt) {
+    ObjConcreteYargType* type = NULL;
     switch (yt) {
         case TypeAny:
         case TypeBool:
@@ -25,42 +59,234 @@ ObjConcreteYargType* newYargTypeFromType(ConcreteYargType yt) {
         case TypeRoutine:
         case TypeChannel:
         case TypeYargType:
-        case TypeInt : {
-            ObjConcreteYargType* t = ALLOCATE_OBJ(ObjConcreteYargType, OBJ_YARGTYPE);
-            t->yt = yt;
-            return t;
-        }
-        case TypeArray: {
-            ObjConcreteYargTypeArray* t = ALLOCATE_OBJ(ObjConcreteYargTypeArray, OBJ_YARGTYPE_ARRAY);
-            t->core.yt = yt;
-            return (ObjConcreteYargType*)t;
-        }
+        case TypeInt:
+            type = ALLOCATE_OBJ(ObjConcreteYargType, OBJ_YARGTYPE);
+            break;
+        case TypeArray:
+            type = (ObjConcreteYargType*)ALLOCATE_OBJ(ObjConcreteYargTypeArray, OBJ_YARGTYPE_ARRAY);
+            break;
         case TypeStruct: {
             ObjConcreteYargTypeStruct* s = ALLOCATE_OBJ(ObjConcreteYargTypeStruct, OBJ_YARGTYPE_STRUCT);
-            s->core.yt = yt;
             initTable(&s->field_names);
-            return (ObjConcreteYargType*)s;
+            type = (ObjConcreteYargType*)s;
+            break;
         }
-        case TypePointer: {
-            ObjConcreteYargTypePointer* p = ALLOCATE_OBJ(ObjConcreteYargTypePointer, OBJ_YARGTYPE_POINTER);
-            p->core.yt = yt;
-            return (ObjConcreteYargType*)p;
+        case TypePointer:
+            type = (ObjConcreteYargType*)ALLOCATE_OBJ(ObjConcreteYargTypePointer, OBJ_YARGTYPE_POINTER);
+            break;
+        case TypeMap:
+            type = (ObjConcreteYargType*)ALLOCATE_OBJ(ObjConcreteYargTypeMap, OBJ_YARGTYPE_MAP);
+            break;
+    }
+    type->yt = yt;
+    type->layout = primitiveLayout(yt);
+    return type;
+}
+
+#define TYPE_TABLE_MAX_LOAD 0.75
+
+// a deleted entry, which lookups probe past.
+static ObjConcreteYargType typeTombstone;
+#define TYPE_TOMBSTONE (&typeTombstone)
+
+typedef struct {
+    ConcreteYargType yt;
+    ObjConcreteYargType* first;
+    ObjConcreteYargType* second;
+    size_t cardinality;
+} TypeKey;
+
+static TypeKey typeKeyOf(ObjConcreteYargType* type) {
+    TypeKey key = { .yt = type->yt };
+    switch (type->yt) {
+        case TypeArray: {
+            ObjConcreteYargTypeArray* array = (ObjConcreteYargTypeArray*)type;
+            key.first = array->element_type;
+            key.cardinality = array->cardinality;
+            break;
         }
-        case TypeMap: {
-            ObjConcreteYargTypeMap* m = ALLOCATE_OBJ(ObjConcreteYargTypeMap, OBJ_YARGTYPE_MAP);
-            m->core.yt = yt;
-            return (ObjConcreteYargType*)m;
+        case TypePointer:
+            key.first = ((ObjConcreteYargTypePointer*)type)->target_type;
+            break;
+        case TypeMap:
+            key.first = ((ObjConcreteYargTypeMap*)type)->key_type;
+            key.second = ((ObjConcreteYargTypeMap*)type)->value_type;
+            break;
+        default:
+            break;
+    }
+    return key;
+}
+
+static uint32_t hashTypeKey(TypeKey key) {
+    uint64_t parts[] = { key.yt, (uintptr_t)key.first, (uintptr_t)key.second, key.cardinality };
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        hash ^= parts[i];
+        hash *= 1099511628211u;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static bool typeKeysEqual(TypeKey a, TypeKey b) {
+    return a.yt == b.yt && a.first == b.first && a.second == b.second && a.cardinality == b.cardinality;
+}
+
+static ObjConcreteYargType** findTypeEntry(ObjConcreteYargType** entries, int capacity, TypeKey key) {
+    uint32_t index = hashTypeKey(key) & (capacity - 1);
+    ObjConcreteYargType** tombstone = NULL;
+
+    for (;;) {
+        ObjConcreteYargType** entry = &entries[index];
+        if (*entry == NULL) {
+            return tombstone != NULL ? tombstone : entry;
+        } else if (*entry == TYPE_TOMBSTONE) {
+            if (tombstone == NULL) tombstone = entry;
+        } else if (typeKeysEqual(typeKeyOf(*entry), key)) {
+            return entry;
         }
+
+        index = (index + 1) & (capacity - 1);
     }
 }
 
-ObjConcreteYargType* newYargArrayTypeFromType(Value elementType) {
-    ObjConcreteYargTypeArray* t = (ObjConcreteYargTypeArray*) newYargTypeFromType(TypeArray);
-    if (IS_YARGTYPE(elementType)) {
-        t->element_type = AS_YARGTYPE(elementType);
+static void adjustTypeTableCapacity(YargTypeTable* table, int capacity) {
+    ObjConcreteYargType** entries = ALLOCATE(ObjConcreteYargType*, capacity);
+    for (int i = 0; i < capacity; i++) {
+        entries[i] = NULL;
+    }
+
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        ObjConcreteYargType* type = table->entries[i];
+        if (type == NULL || type == TYPE_TOMBSTONE) continue;
+
+        *findTypeEntry(entries, capacity, typeKeyOf(type)) = type;
+        table->count++;
+    }
+
+    FREE_ARRAY(ObjConcreteYargType*, table->entries, table->capacity);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+static ObjConcreteYargType* internType(TypeKey key) {
+    YargTypeTable* table = &vm.compositeTypes;
+    if (table->count > 0) {
+        ObjConcreteYargType* existing = *findTypeEntry(table->entries, table->capacity, key);
+        if (existing != NULL && existing != TYPE_TOMBSTONE) {
+            return existing;
+        }
+    }
+
+    ObjConcreteYargType* type = newYargTypeFromType(key.yt);
+    switch (key.yt) {
+        case TypeArray: {
+            YargTypeLayout element = layoutOf(key.first);
+            ((ObjConcreteYargTypeArray*)type)->element_type = key.first;
+            ((ObjConcreteYargTypeArray*)type)->cardinality = key.cardinality;
+            type->layout.storage_size = element.storage_size * key.cardinality;
+            type->layout.holds_references = key.cardinality > 0 && element.holds_references;
+            type->layout.zero_initialised = key.cardinality == 0 || element.zero_initialised;
+            break;
+        }
+        case TypePointer:
+            ((ObjConcreteYargTypePointer*)type)->target_type = key.first;
+            break;
+        case TypeMap:
+            ((ObjConcreteYargTypeMap*)type)->key_type = key.first;
+            ((ObjConcreteYargTypeMap*)type)->value_type = key.second;
+            break;
+        default:
+            break;
+    }
+    tempRootPush(OBJ_VAL(type));
+
+    if (table->count + 1 > table->capacity * TYPE_TABLE_MAX_LOAD) {
+        adjustTypeTableCapacity(table, GROW_CAPACITY(table->capacity));
+    }
+    ObjConcreteYargType** entry = findTypeEntry(table->entries, table->capacity, key);
+    if (*entry == NULL) table->count++;
+    *entry = type;
+
+    tempRootPop();
+    return type;
+}
+
+void initYargTypes() {
+    vm.compositeTypes.count = 0;
+    vm.compositeTypes.capacity = 0;
+    vm.compositeTypes.entries = NULL;
+
+    for (int yt = 0; yt <= TypeYargType; yt++) {
+        switch (yt) {
+            case TypeArray:
+            case TypeStruct:
+            case TypePointer:
+            case TypeMap:
+                vm.primitiveTypes[yt] = NULL;
+                break;
+            default:
+                vm.primitiveTypes[yt] = newYargTypeFromType(yt);
+                break;
+        }
     }
-    t->core.yt = TypeArray;
-    return (ObjConcreteYargType*)t;
+}
+
+void freeYargTypes() {
+    FREE_ARRAY(ObjConcreteYargType*, vm.compositeTypes.entries, vm.compositeTypes.capacity);
+    vm.compositeTypes.count = 0;
+    vm.compositeTypes.capacity = 0;
+    vm.compositeTypes.entries = NULL;
+
+    for (int yt = 0; yt <= TypeYargType; yt++) {
+        vm.primitiveTypes[yt] = NULL;
+    }
+}
+
+void markYargTypes() {
+    for (int yt = 0; yt <= TypeYargType; yt++) {
+        markObject((Obj*)vm.primitiveTypes[yt]);
+    }
+}
+
+void yargTypeTableRemoveWhite(YargTypeTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        ObjConcreteYargType* type = table->entries[i];
+        if (type != NULL && type != TYPE_TOMBSTONE && !type->obj.isMarked) {
+            table->entries[i] = TYPE_TOMBSTONE;
+        }
+    }
+}
+
+ObjConcreteYargType* yargPrimitiveType(ConcreteYargType yt) {
+    return vm.primitiveTypes[yt];
+}
+
+ObjConcreteYargType* internYargArrayType(Value elementType, size_t cardinality) {
+    TypeKey key = {
+        .yt = TypeArray,
+        .first = IS_YARGTYPE(elementType) ? AS_YARGTYPE(elementType) : NULL,
+        .cardinality = cardinality
+    };
+    return internType(key);
+}
+
+ObjConcreteYargType* internYargPointerType(Value targetType) {
+    TypeKey key = {
+        .yt = TypePointer,
+        .first = IS_YARGTYPE(targetType) ? AS_YARGTYPE(targetType) : NULL
+    };
+    return internType(key);
+}
+
+ObjConcreteYargType* internYargMapType(Value keyType, Value valueType) {
+    TypeKey key = {
+        .yt = TypeMap,
+        .first = IS_YARGTYPE(keyType) ? AS_YARGTYPE(keyType) : NULL,
+        .second = IS_YARGTYPE(valueType) ? AS_YARGTYPE(valueType) : NULL
+    };
+    return internType(key);
 }
 
 Value arrayElementType(ObjConcreteYargTypeArray* arrayType) {
@@ -72,7 +298,7 @@ size_t arrayElementOffset(ObjConcreteYargTypeArray* arrayType, size_t index) {
 }
 
 size_t arrayElementSize(ObjConcreteYargTypeArray* arrayType) {
-    return yt_sizeof_type_storage(arrayElementType(arrayType));
+    return layoutOf(arrayType->element_type).storage_size;
 }
 
 ObjConcreteYargType* newYargStructType(size_t fieldCount) {
@@ -92,30 +318,36 @@ ObjConcreteYargType* newYargStructType(size_t fieldCount) {
     t->field_indexes = fieldIndexes;
     t->field_types = fieldTypes;
     t->field_count = fieldCount;
+    // until its fields are added, they are all any.
+    t->core.layout.holds_references = fieldCount > 0;
+    t->core.layout.zero_initialised = fieldCount == 0;
 
     tempRootPop();
     return (ObjConcreteYargType*)t;
 }
 
-ObjConcreteYargType* newYargPointerType(Value targetType) {
-    ObjConcreteYargTypePointer* p = (ObjConcreteYargTypePointer*) newYargTypeFromType(TypePointer);
-    if (IS_YARGTYPE(targetType)) {
-        p->target_type = AS_YARGTYPE(targetType);
-    }
-    return (ObjConcreteYargType*)p;
-}
-
 size_t addFieldType(ObjConcreteYargTypeStruct* st, size_t index, size_t fieldOffset, Value type, Value offset, Value name) {
     st->field_types[index] = IS_NIL(type) ? NULL : AS_YARGTYPE(type);
-    tableSet(&st->field_names, AS_STRING(name), SIZE_T_UI_VAL(index));
+    tableSet(&st->field_names, AS_STRING(name), UI32_VAL((uint32_t)index));
     if (IS_NIL(offset)) {
         st->field_indexes[index] = fieldOffset;
     } else if (is_positive_integer32(offset)) {
         fieldOffset = as_positive_integer32(offset);
         st->field_indexes[index] = fieldOffset;
     }
-    st->storage_size = fieldOffset + yt_sizeof_type_storage(type);
-    return st->storage_size;
+    st->core.layout.storage_size = fieldOffset + yt_sizeof_type_storage(type);
+
+    // the fields are added in order, so the layout is known once the last one is.
+    if (index + 1 == st->field_count) {
+        st->core.layout.holds_references = false;
+        st->core.layout.zero_initialised = true;
+        for (size_t i = 0; i < st->field_count; i++) {
+            YargTypeLayout field = layoutOf(st->field_types[i]);
+            st->core.layout.holds_references |= field.holds_references;
+            st->core.layout.zero_initialised &= field.zero_initialised;
+        }
+    }
+    return st->core.layout.storage_size;
 }
 
 bool isUint32Pointer(Value val) {
@@ -133,55 +365,55 @@ Value concrete_typeof(Value a) {
     if (IS_NIL(a)) {
         return NIL_VAL;
     } else if (IS_BOOL(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeBool));
+        return OBJ_VAL(yargPrimitiveType(TypeBool));
     } else if (IS_DOUBLE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeDouble));
+        return OBJ_VAL(yargPrimitiveType(TypeDouble));
     } else if (IS_I8(a)) {
-        return (OBJ_VAL(newYargTypeFromType(TypeInt8)));
+        return OBJ_VAL(yargPrimitiveType(TypeInt8));
     } else if (IS_UI8(a)) {
-        return (OBJ_VAL(newYargTypeFromType(TypeUint8)));
+        return OBJ_VAL(yargPrimitiveType(TypeUint8));
     } else if (IS_I16(a)) {
-        return (OBJ_VAL(newYargTypeFromType(TypeInt16)));
+        return OBJ_VAL(yargPrimitiveType(TypeInt16));
     } else if (IS_UI16(a)) {
-        return (OBJ_VAL(newYargTypeFromType(TypeUint16)));
+        return OBJ_VAL(yargPrimitiveType(TypeUint16));
     } else if (IS_I32(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeInt32));
+        return OBJ_VAL(yargPrimitiveType(TypeInt32));
     } else if (IS_UI32(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeUint32));
+        return OBJ_VAL(yargPrimitiveType(TypeUint32));
     } else if (IS_I64(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeInt64));
+        return OBJ_VAL(yargPrimitiveType(TypeInt64));
     } else if (IS_UI64(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeUint64));
+        return OBJ_VAL(yargPrimitiveType(TypeUint64));
     } else if (IS_FUNCTION(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeFunction));
+        return OBJ_VAL(yargPrimitiveType(TypeFunction));
     } else if (IS_CLOSURE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeFunction));
+        return OBJ_VAL(yargPrimitiveType(TypeFunction));
     } else if (IS_NATIVE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeFunction));
+        return OBJ_VAL(yargPrimitiveType(TypeFunction));
     } else if (IS_BOUND_METHOD(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeFunction));
+        return OBJ_VAL(yargPrimitiveType(TypeFunction));
     } else if (IS_CLASS(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeClass));
+        return OBJ_VAL(yargPrimitiveType(TypeClass));
     } else if (IS_INSTANCE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeInstance));
+        return OBJ_VAL(yargPrimitiveType(TypeInstance));
     } else if (IS_ROUTINE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeRoutine));
+        return OBJ_VAL(yargPrimitiveType(TypeRoutine));
     } else if (IS_CHANNEL(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeChannel));
+        return OBJ_VAL(yargPrimitiveType(TypeChannel));
     } else if (IS_STRING(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeString));
+        return OBJ_VAL(yargPrimitiveType(TypeString));
     } else if (IS_UNIFORMARRAY(a)) {
         return OBJ_VAL(AS_UNIFORMARRAY(a)->store.storedType);
     } else if (IS_STRUCT(a)) {
         return OBJ_VAL(AS_STRUCT(a)->store.storedType);
     } else if (IS_YARGTYPE(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeYargType));
+        return OBJ_VAL(yargPrimitiveType(TypeYargType));
     } else if (IS_POINTER(a)) {
         return OBJ_VAL(AS_POINTER(a)->type);
     } else if (IS_MAP(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeMap));
+        return OBJ_VAL(internYargMapType(NIL_VAL, NIL_VAL));
     } else if (IS_INT(a)) {
-        return OBJ_VAL(newYargTypeFromType(TypeInt));
+        return OBJ_VAL(yargPrimitiveType(TypeInt));
     }
     fatalVMError("Unexpected object type");
     return NIL_VAL;
@@ -330,52 +562,7 @@ bool is_stored_type(Value type) {
 }
 
 size_t yt_sizeof_type_storage(Value type) {
-    if (IS_NIL(type)) {
-        return sizeof(Value);
-    } else {
-        ObjConcreteYargType* t = AS_YARGTYPE(type);
-        switch (t->yt) {
-        case TypeAny:
-        case TypeBool:
-        case TypeDouble:
-            return sizeof(Value);
-        case TypeInt8:
-            return sizeof(int8_t);
-        case TypeUint8:
-            return sizeof(uint8_t);
-        case TypeInt16:
-            return sizeof(int16_t);
-        case TypeUint16:
-            return sizeof(uint16_t);
-        case TypeInt32:
-            return sizeof(int32_t);
-        case TypeUint32:
-            return sizeof(uint32_t);
-        case TypeInt64:
-            return sizeof(int64_t);
-        case TypeUint64:
-            return sizeof(uint64_t);
-        case TypeStruct: {
-            ObjConcreteYargTypeStruct* st = (ObjConcreteYargTypeStruct*)t;
-            return st->storage_size;
-        }
-        case TypeArray: {
-            ObjConcreteYargTypeArray* array = (ObjConcreteYargTypeArray*)t;
-            return arrayElementSize(array) * array->cardinality;
-        }
-        case TypeInt:
-        case TypeString:
-        case TypeClass:
-        case TypeInstance:
-        case TypeFunction:
-        case TypeRoutine:
-        case TypeChannel:
-        case TypePointer:
-        case TypeMap:
-        case TypeYargType:
-            return sizeof(Obj*);
-        }
-    }
+    return layoutOf(IS_NIL(type) ? NULL : AS_YARGTYPE(type)).storage_size;
 }
 
 Value defaultValue(Value type) {
@@ -439,7 +626,7 @@ static bool isInitializableArray(ObjConcreteYargTypeArray* lhsConcreteType, ObjC
 
 bool isInitialisableType(ObjConcreteYargType* lhsType, Value rhsValue, Value *promotedRhs) {
 
-    promotedRhs->type = VAL_NIL;
+    *promotedRhs = NIL_VAL;
 
     if (lhsType->yt == TypeAny) {
         return true;
@@ -452,69 +639,73 @@ bool isInitialisableType(ObjConcreteYargType* lhsType, Value rhsValue, Value *pr
     Value rhsType = concrete_typeof(rhsValue);
     ObjConcreteYargType* rhsConcreteType = AS_YARGTYPE(rhsType);
 
+    if (lhsType == rhsConcreteType) {
+        return true;
+    }
+
     if (lhsType->yt == TypeArray && rhsConcreteType->yt == TypeArray) {       
         return isInitializableArray((ObjConcreteYargTypeArray*)lhsType, (ObjConcreteYargTypeArray*)rhsConcreteType); 
     } else {
         if (IS_INT(rhsValue))
         {
-            ObjInt *i = (ObjInt *) rhsValue.as.obj;
-            if (i->isLiteral)
+            Int *i = AS_INT(rhsValue);
+            if (isLiteralInt(rhsValue))
             {
                 switch (lhsType->yt)
                 {
                 case TypeInt8:
-                    if (int_is_range(&i->bigInt, INT8_MIN, INT8_MAX) == INT_WITHIN)
+                    if (int_is_range(i, INT8_MIN, INT8_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = I8_VAL(int_to_i32(&i->bigInt));
+                        *promotedRhs = I8_VAL(int_to_i32(i));
                         return true;
                     }
                     break;
                 case TypeUint8:
-                    if (int_is_range(&i->bigInt, 0, UINT8_MAX) == INT_WITHIN)
+                    if (int_is_range(i, 0, UINT8_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = UI8_VAL(int_to_u32(&i->bigInt));
+                        *promotedRhs = UI8_VAL(int_to_u32(i));
                         return true;
                     }
                     break;
                 case TypeInt16:
-                    if (int_is_range(&i->bigInt, INT16_MIN, INT16_MAX) == INT_WITHIN)
+                    if (int_is_range(i, INT16_MIN, INT16_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = I16_VAL(int_to_i32(&i->bigInt));
+                        *promotedRhs = I16_VAL(int_to_i32(i));
                         return true;
                     }
                     break;
                 case TypeUint16:
-                    if (int_is_range(&i->bigInt, 0, UINT16_MAX) == INT_WITHIN)
+                    if (int_is_range(i, 0, UINT16_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = UI16_VAL(int_to_u32(&i->bigInt));
+                        *promotedRhs = UI16_VAL(int_to_u32(i));
                         return true;
                     }
                     break;
                 case TypeInt32:
-                    if (int_is_range(&i->bigInt, INT32_MIN, INT32_MAX) == INT_WITHIN)
+                    if (int_is_range(i, INT32_MIN, INT32_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = I32_VAL(int_to_i32(&i->bigInt));
+                        *promotedRhs = I32_VAL(int_to_i32(i));
                         return true;
                     }
                     break;
                 case TypeUint32:
-                    if (int_is_range(&i->bigInt, 0, UINT32_MAX) == INT_WITHIN)
+                    if (int_is_range(i, 0, UINT32_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = UI32_VAL(int_to_u32(&i->bigInt));
+                        *promotedRhs = UI32_VAL(int_to_u32(i));
                         return true;
                     }
                     break;
                 case TypeInt64:
-                    if (int_is_range(&i->bigInt, INT64_MIN, INT64_MAX) == INT_WITHIN)
+                    if (int_is_range(i, INT64_MIN, INT64_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = I64_VAL(int_to_i64(&i->bigInt));
+                        *promotedRhs = I64_VAL(int_to_i64(i));
                         return true;
                     }
                     break;
                 case TypeUint64:
-                    if (int_is_range(&i->bigInt, 0, UINT64_MAX) == INT_WITHIN)
+                    if (int_is_range(i, 0, UINT64_MAX) == INT_WITHIN)
                     {
-                        *promotedRhs = UI64_VAL(int_to_u64(&i->bigInt));
+                        *promotedRhs = UI64_VAL(int_to_u64(i));
                         return true;
                     }
                     break;
@@ -587,7 +778,7 @@ static ObjString* typeLiteralToString(ObjConcreteYargType* type) {
         case TypeStruct: {
             ObjConcreteYargTypeStruct* st = (ObjConcreteYargTypeStruct*) type;
             char buffer[1024];
-            snprintf(buffer, sizeof(buffer), "struct{|%zu:%zu| ", st->field_count, st->storage_size);
+            snprintf(buffer, sizeof(buffer), "struct{|%zu:%zu| ", st->field_count, st->core.layout.storage_size);
             size_t cursor = strlen(buffer);
             for (size_t i = 0; i < st->field_count; i++) {
                 ObjString* fieldTypeStr = typeLiteralToString(st->field_types[i]);
@@ -30,9 +30,17 @@ typedef enum {
    TypeYargType
 } ConcreteYargType;
 
+// How values of a type are held in packed storage, worked out once the type is made.
+typedef struct YargTypeLayout {
+    size_t storage_size;
+    bool holds_references; // the collector has to trace the storage
+    bool zero_initialised; // the default value is all zero bytes
+} YargTypeLayout;
+
 typedef struct ObjConcreteYargType {
     Obj obj;
     ConcreteYargType yt;
+    YargTypeLayout layout;
 } ObjConcreteYargType;
 
 typedef struct ObjConcreteYargTypeArray {
@@ -47,7 +55,6 @@ typedef struct ObjConcreteYargTypeStruct {
     size_t* field_indexes;
     ObjConcreteYargType** field_types;
     size_t field_count;
-    size_t storage_size;
 } ObjConcreteYargTypeStruct;
 
 typedef struct ObjConcreteYargTypePointer {
@@ -61,11 +68,25 @@ typedef struct ObjConcreteYargTypeMap {
     ObjConcreteYargType* value_type;
 } ObjConcreteYargTypeMap;
 
+// array, pointer and map types are hash-consed, so each distinct one exists once.
+typedef struct {
+    int count;
+    int capacity;
+    ObjConcreteYargType** entries;
+} YargTypeTable;
+
+void initYargTypes();
+void freeYargTypes();
+void markYargTypes();
+void yargTypeTableRemoveWhite(YargTypeTable* table);
+
 ObjConcreteYargType* newYargTypeFromType(ConcreteYargType yt);
 
-ObjConcreteYargType* newYargArrayTypeFromType(Value elementType);
+ObjConcreteYargType* yargPrimitiveType(ConcreteYargType yt);
+ObjConcreteYargType* internYargArrayType(Value elementType, size_t cardinality);
+ObjConcreteYargType* internYargPointerType(Value targetType);
+ObjConcreteYargType* internYargMapType(Value keyType, Value valueType);
 ObjConcreteYargType* newYargStructType(size_t fieldCount);
-ObjConcreteYargType* newYargPointerType(Value targetType);
 
 size_t arrayElementOffset(ObjConcreteYargTypeArray* arrayType, size_t index);
 size_t arrayElementSize(ObjConcreteYargTypeArray* arrayType);
@@ -5,6 +5,7 @@ CYARG_ERROR=0
 $INTERPRETER --help || CYARG_ERROR=$?
 $INTERPRETER --lib yarg/specimen test/cyarg/simple.ya || CYARG_ERROR=$?
 $INTERPRETER --lib yarg/specimen test/cyarg/hosted.ya -- test || CYARG_ERROR=$?
+$INTERPRETER --heap-size 1M --lib yarg/specimen test/cyarg/hosted.ya -- test || CYARG_ERROR=$?
 $INTERPRETER --lib yarg/specimen test/cyarg/hosted.ya || CYARG_ERROR=$?
 $INTERPRETER --lib yarg/specimen test/cyarg/compile-error.ya
 ERROR=$?
@@ -24,6 +25,13 @@ OUTPUT_FILE="$OUTPUT_DIR/simple.yb"
 
 $INTERPRETER --compile test/cyarg/simple.ya "$OUTPUT_FILE" || CYARG_ERROR=$?
 $INTERPRETER --lib yarg/specimen "$OUTPUT_FILE" || CYARG_ERROR=$?
+$INTERPRETER --aot "$OUTPUT_FILE" "$OUTPUT_DIR/simple.c" || CYARG_ERROR=$?
+if [ -f "$OUTPUT_DIR/simple.c" ]; then
+    rm "$OUTPUT_DIR/simple.c"
+else
+    echo "Expected translated package to exist at $OUTPUT_DIR/simple.c"
+    CYARG_ERROR=1
+fi
 if [ -d "$OUTPUT_DIR" ] && [ -f "$OUTPUT_FILE" ]; then
     rm "$OUTPUT_FILE"
     rmdir "$OUTPUT_DIR"
@@ -32,5 +40,18 @@ else
     CYARG_ERROR=1
 fi
 
+OUTPUT_DIR=`mktemp -d`
+OUTPUT_FILE="$OUTPUT_DIR/warm-traceback.yb"
+
+$INTERPRETER --compile test/cyarg/warm-traceback.ya "$OUTPUT_FILE" || CYARG_ERROR=$?
+$INTERPRETER --lib yarg/specimen "$OUTPUT_FILE" 2>&1 | sed -n 1,2p
+ERROR=${PIPESTATUS[0]}
+if [ $ERROR -ne 70 ]; then
+    echo "Expected runtime error, got exit code $ERROR"
+    CYARG_ERROR=1
+fi
+rm -f "$OUTPUT_FILE"
+rmdir "$OUTPUT_DIR"
+
 $INTERPRETER --disassemble test/cyarg/simple.ya || CYARG_ERROR=$?
 exit $CYARG_ERROR
\ No newline at end of file
@@ -2,13 +2,18 @@
 
 # omitted, only runs on pico: stable-interrupt
 BENCHMARKS="fib equality string_equality instantiation invocation \
-                method_call properties trees zoo zoo_batch binary_trees int-perform"
+                method_call properties trees zoo zoo_batch binary_trees int-perform gc_pauses gc_slabs gc_pacing"
 
 BENCH_ERROR=0
 
-for bench in $BENCHMARKS
+# on hosted x86-64 each benchmark is run again with the JIT off, for comparison
+for jit in on off
 do
-    ./bin/yarg run --interpreter bin/cyarg --lib yarg/specimen test/benchmark/$bench.ya || BENCH_ERROR=1
+    echo "JIT $jit"
+    for bench in $BENCHMARKS
+    do
+        CYARG_JIT=$jit ./bin/yarg run --interpreter bin/cyarg --lib yarg/specimen test/benchmark/$bench.ya || BENCH_ERROR=1
+    done
 done
 
 exit $BENCH_ERROR
\ No newline at end of file